@@ -0,0 +1,58 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/Ticker.h"
+
+/**
+ * Schedules autosaves of the state machine history
+ * Autosaves are requested every N history elements, every T seconds or by certain nodes. All requests within the coalescing window are merged
+ * into a single autosave, which is captured on the game thread once the window elapsed.
+ * The capture only takes the history elements added since the previous autosave and hands them to a save journal, see FDSMSaveJournal.
+ * The journal writes them in order with all other saves on the save file pipe, so an autosave never waits for the previous write.
+ */
+class DYNAMICSTATEMACHINE_API FDSMAutosave
+{
+public:
+	// Captures the history on the game thread and hands it to the writer, returns false if there is nothing to save
+	using FCapture = TFunction<bool()>;
+
+	~FDSMAutosave() { Stop(); }
+
+	// Starts the scheduler, capture is called on the game thread whenever an autosave is due
+	// historyInterval and intervalSeconds of 0 disable the corresponding trigger, coalesceSeconds of 0 captures every request immediately
+	void Start(int32 historyInterval, float intervalSeconds, float coalesceSeconds, FCapture capture);
+
+	// Stops all triggers and drops a requested autosave, which was not captured yet
+	// Captured autosaves are still written in the background
+	void Stop();
+
+	// Returns true if the scheduler was started
+	bool IsRunning() const { return _capture != nullptr; }
+
+	// Counts a new history element, bRequest requests an autosave independent of the history interval
+	void OnHistoryElementAdded(bool bRequest);
+
+	// Requests an autosave, requests within the coalescing window are merged
+	void Request();
+
+	// Number of requests merged into another autosave
+	int32 GetCoalescedNum() const { return _coalescedNum; }
+
+	// Number of captured autosaves
+	int32 GetCapturedNum() const { return _capturedNum; }
+
+private:
+	// Captures the history elements added since the previous autosave
+	void Capture();
+
+	FCapture _capture;
+	int32 _historyInterval = 0;
+	float _coalesceSeconds = 0.f;
+	int32 _historyNum = 0;
+	int32 _coalescedNum = 0;
+	int32 _capturedNum = 0;
+	FTSTicker::FDelegateHandle _intervalHandle;
+	FTSTicker::FDelegateHandle _coalesceHandle;
+};
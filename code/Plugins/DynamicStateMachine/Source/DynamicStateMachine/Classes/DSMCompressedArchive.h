@@ -0,0 +1,72 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Serialization/Archive.h"
+
+
+/**
+ * Writes all serialized bytes as compressed blocks into the inner archive
+ * Each block is stored as uncompressed size, stored size and the stored bytes, a block of size 0 ends the stream
+ * Blocks which do not shrink by compression are stored uncompressed
+ */
+class DYNAMICSTATEMACHINE_API FDSMCompressedWriter : public FArchive
+{
+public:
+	FDSMCompressedWriter(FArchive& innerArchive, FName compressionFormat, int32 blockSize);
+	virtual ~FDSMCompressedWriter();
+
+	virtual void Serialize(void* data, int64 num) override;
+	virtual int64 Tell() override { return _uncompressedBytes + _block.Num(); }
+	virtual int64 TotalSize() override { return Tell(); }
+	virtual FString GetArchiveName() const override { return TEXT("FDSMCompressedWriter"); }
+
+	// Writes the last block and the end marker, must be called before the inner archive is closed
+	virtual bool Close() override;
+
+	// Number of bytes passed to the writer
+	int64 GetUncompressedBytes() const { return _uncompressedBytes + _block.Num(); }
+
+	// Number of bytes written to the inner archive, including block headers
+	int64 GetStoredBytes() const { return _storedBytes; }
+
+private:
+	void FlushBlock();
+
+	FArchive& _innerArchive;
+	FName _compressionFormat;
+	int32 _blockSize = 0;
+	TArray<uint8> _block;
+	TArray<uint8> _compressed;
+	int64 _uncompressedBytes = 0;
+	int64 _storedBytes = 0;
+	bool _bClosed = false;
+};
+
+/**
+ * Reads a block stream written by FDSMCompressedWriter
+ * Only a single block is decompressed at a time, the uncompressed stream is never held in memory
+ */
+class DYNAMICSTATEMACHINE_API FDSMCompressedReader : public FArchive
+{
+public:
+	FDSMCompressedReader(FArchive& innerArchive, FName compressionFormat, int32 maxBlockSize);
+
+	virtual void Serialize(void* data, int64 num) override;
+	virtual int64 Tell() override { return _blockStart + _blockOffset; }
+	virtual FString GetArchiveName() const override { return TEXT("FDSMCompressedReader"); }
+
+private:
+	// Reads and decompresses the next block, returns false at the end of the stream or on invalid data
+	bool ReadBlock();
+
+	FArchive& _innerArchive;
+	FName _compressionFormat;
+	int32 _maxBlockSize = 0;
+	TArray<uint8> _block;
+	TArray<uint8> _compressed;
+	int32 _blockOffset = 0;
+	int64 _blockStart = 0;
+	bool _bEnd = false;
+};
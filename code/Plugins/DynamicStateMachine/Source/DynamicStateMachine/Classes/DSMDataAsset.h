@@ -19,4 +19,12 @@ public:
 	// You can simply duplicate all ptr type objects in here
 	// Please use the passed owner as new owner of the copied objects
 	virtual void OnRequestDeepCopy(UObject* owner) {};
+
+	// Wakes latent states awaiting a change of this data asset, see FDSMLatent::WaitForDataChange
+	// Call it after changing data which is not changed by DSM nodes, e.g. by a widget
+	UFUNCTION(BlueprintCallable, Category = "Dynamic State Machine")
+	void NotifyDataChanged() { OnDataChanged.Broadcast(); }
+
+	// Fired by NotifyDataChanged
+	FSimpleMulticastDelegate OnDataChanged;
 };
@@ -7,6 +7,7 @@
 #include "Components/ActorComponent.h"
 #include "Engine/DataAsset.h"
 #include "DSMConditionUtils.h"
+#include "DSMTimer.h"
 #include "DSMDefaultNode.generated.h"
 
 
@@ -48,6 +49,22 @@ struct DYNAMICSTATEMACHINE_API FDSMDebugSuccess
 	float ElapsedTime = 0.0f;
 };
 
+// Blueprint events of a DSM node, events not implemented by the Blueprint class of a node are never called
+enum class EDSMNodeEvent : uint16
+{
+	None = 0,
+	InitNode = 1 << 0,
+	CanEnterState = 1 << 1,
+	OnBeginState = 1 << 2,
+	ApplyStateBegin = 1 << 3,
+	OnUpdateState = 1 << 4,
+	ApplyStateUpdate = 1 << 5,
+	OnEndState = 1 << 6,
+	ApplyStateEnd = 1 << 7,
+	ResetState = 1 << 8,
+	All = (1 << 9) - 1
+};
+ENUM_CLASS_FLAGS(EDSMNodeEvent)
 
 /**
  * DSM Node. 
@@ -97,6 +114,11 @@ public:
 	UPROPERTY(EditDefaultsOnly, Category = "Conditions")
 	bool _BindConditions = false;
 
+	// Apply events of this node only depend on the latest state of its data references, applying them once has the same effect as applying them repeatedly
+	// If fast load is enabled, the node is applied once at its last history element using the latest data versions instead of replaying every history element
+	UPROPERTY(EditDefaultsOnly, Category = "Save Game")
+	bool _bIdempotentApply = false;
+
 	// Event fired when node is intialized
 	UFUNCTION(BlueprintImplementableEvent, Category = "Dynamic State Machine")
 	void InitNodeEvent();
@@ -157,6 +179,18 @@ public:
 	void ApplyStateEndEvent();
 	virtual void ApplyStateEnd() {};
 
+	// Event fired when a state is restored in place and the owner of this node was touched after the restored history element
+	// AActor::Reset was called on the owning actor before, it only resets actors overriding it (Event OnReset in Blueprint)
+	// Undo all changes this node applied to the world here, afterwards the history elements of the owner are applied again
+	UFUNCTION(BlueprintImplementableEvent, Category = "Dynamic State Machine")
+	void ResetStateEvent();
+	virtual void ResetState() {};
+
+	// Latent state of C++ nodes, started after ApplyStateBegin unless the state has already ended
+	// Write the state as coroutine which awaits events instead of checking them every tick, see FDSMLatentTask in DSMLatent.h
+	// While the coroutine awaits an event, the node is neither updated nor applied. Returns an invalid task by default
+	virtual struct FDSMLatentTask RunLatentState();
+
 	// With this function you access/update referenced data-assets, data asset must be defined inside _writableDataReferences or _readOnlyDataReferences
 	// If requested asset is a _writableDataReferences a reference to the dataAsset is returned
 	// If requested asset is a _readOnlyDataReferences a copy of the dataAsset is returned
@@ -198,6 +232,18 @@ public:
 
 	// Check if a name is defined in _ConditionDefinitions
 	bool ValidateConditionName(const FName& name) const;
+
+	// Returns true if the Blueprint class of this node implements the event
+	// Nodes which did not register at the DSM manager yet call all events
+	bool ImplementsEvent(EDSMNodeEvent event) const { return EnumHasAnyFlags(_implementedEvents, event); }
+
+	// Caches the Blueprint events implemented by the class of this node, called on registration
+	// Events are looked up once per class and stored inside the class default object
+	void CacheImplementedEvents();
+
+	// Called by the DSM game mode when this node becomes active, activation is 0 while the node is inactive
+	// Typed data slots resolve their data once per activation, see TDSMNode
+	void SetActivation(uint32 activation);
 protected:
 
 	// Requests DSM Management System to transition to this node
@@ -209,6 +255,31 @@ protected:
 	UFUNCTION(BlueprintCallable, Category = "Dynamic State Machine", meta = (BlueprintProtected))
 	bool RequestDSMSelfTransition();
 
+	// Suspends updates of this node while it is active, until ResumeState is called
+	// Use it to wait for events like timers, animation notifies or widget answers, a suspended node costs nothing per tick
+	UFUNCTION(BlueprintCallable, Category = "Dynamic State Machine", meta = (BlueprintProtected))
+	void SuspendState();
+
+	// Resumes updates of this node after SuspendState
+	// HasStateEnded, if true state ends instead of being updated again
+	UFUNCTION(BlueprintCallable, Category = "Dynamic State Machine", meta = (BlueprintProtected))
+	void ResumeState(bool HasStateEnded);
+
+	// Starts a timer of this node, instead of counting down a duration inside OnUpdateStateEvent
+	// EndState ends this node if it is still active, pending EndState timers are cleared when the node ends
+	// SelfTransition requests a self transition of this node
+	// Pending timers are stored in the history, loading a save game restores them
+	UFUNCTION(BlueprintCallable, Category = "Dynamic State Machine", meta = (BlueprintProtected))
+	FDSMTimerHandle SetStateTimer(float seconds, EDSMTimerAction action);
+
+	// Clears a pending timer of this node, returns false if the timer already fired
+	UFUNCTION(BlueprintCallable, Category = "Dynamic State Machine", meta = (BlueprintProtected))
+	bool ClearStateTimer(FDSMTimerHandle handle);
+
+	// Returns the remaining seconds of a pending timer, or -1 if the timer is not pending
+	UFUNCTION(BlueprintCallable, Category = "Dynamic State Machine")
+	float GetStateTimerRemaining(FDSMTimerHandle handle) const;
+
 	// Stores validated expressions, which are ready for evaluation
 	UPROPERTY()
 	TArray<FExpressionEvaluator> _expressionEvaluators = {};
@@ -224,4 +295,13 @@ private:
 	TFunction<bool(TWeakObjectPtr<UDSMDefaultNode>)> _requestSelfTranstion = nullptr;
 	TWeakObjectPtr<class ADSMGameMode> _ownerRef = nullptr;
 	bool bCanEnter = true;
+	EDSMNodeEvent _implementedEvents = EDSMNodeEvent::All;
+	bool _bImplementedEventsCached = false;
+
+	friend class FDSMNodeSlots;
+	// Data assets of typed data slots resolved during the current activation
+	UPROPERTY(Transient)
+	TArray<TObjectPtr<UDSMDataAsset>> _slotData = {};
+	int32 _slotNum = 0;
+	uint32 _activation = 0;
 };
@@ -0,0 +1,527 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DSMDefaultNode.h"
+#include "DSMDataAsset.h"
+#include "DSMLogInclude.h"
+#include "UObject/Package.h"
+#include "Algo/BinarySearch.h"
+#include "DSMHistory.generated.h"
+
+
+// Storage used for the data of cold history segments
+UENUM(BlueprintType)
+enum class EDSMColdHistoryStorage : uint8
+{
+	// Append only page file inside the Saved directory
+	PageFile UMETA(DisplayName = "Page File"),
+	// Compressed segment buffers kept in memory
+	CompressedMemory UMETA(DisplayName = "Compressed Memory")
+};
+
+// Secondary indexes of the history, which are keyed by name
+UENUM(BlueprintType)
+enum class EDSMHistoryIndex : uint8
+{
+	// Name of the node owning actor
+	Owner UMETA(DisplayName = "Owner"),
+	// Component tags of the node
+	NodeTag UMETA(DisplayName = "Node Tag"),
+	// Name of the default data asset, referenced by the node
+	DataAsset UMETA(DisplayName = "Data Asset")
+};
+
+/**
+ * Save Game representation of a node for the DSM State Machine History
+ * Stores the node, its owner, and the referenced data assets
+ * Each NodeID stores an own copy of the referenced data assets
+ * The history itself is stored compactly inside FDSMHistoryStore, NodeIDs are materialized on request
+ */
+USTRUCT(BlueprintType)
+struct DYNAMICSTATEMACHINE_API FDSMNodeID
+{
+	GENERATED_BODY()
+
+	// Node object ptr
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Node")
+	TWeakObjectPtr<UDSMDefaultNode> _node = nullptr;
+
+	// Name of the node object
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Node")
+	FName _nodeLabel = NAME_None;
+
+	// Class of the node
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Node")
+	TSubclassOf<UActorComponent> _nodeClass = nullptr;
+
+	// Node owning actor ptr
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Owner")
+	TWeakObjectPtr<AActor> _owner = nullptr;
+
+	// Node owning actor name
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Owner")
+	FName _ownerLabel = NAME_None;
+
+	// Node owning actor class
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Owner")
+	TSubclassOf<AActor> _ownerClass;
+
+	// Referenced/modified data assets of the node
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Data")
+	TMap<FName, TObjectPtr<UDSMDataAsset>> _data;
+
+	// Names of the referenced/modified data assets
+	UPROPERTY()
+	TMap<FName, FName> _dataRaw;
+
+	// We look for the previously stored data-assets and recreate the data-references
+	// Only used for save games written before the compact history store existed
+	void PostDeserialization(const TMap<FName, UObject*>& objectsInPackage)
+	{
+		_data.Empty(_dataRaw.Num());
+		for (const TTuple<FName, FName>& elem : _dataRaw)
+		{
+			if (objectsInPackage.Contains(elem.Value))
+			{
+				_data.Add(elem.Key, Cast<UDSMDataAsset>(objectsInPackage[elem.Value]));
+			}
+			else
+			{
+				UE_LOG(LogDSM, Error, TEXT("Could not find data asset with name %s"), *elem.Value.ToString());
+			}
+		}
+	}
+};
+
+/**
+ * Node metadata of the history
+ * Each node is stored once inside the node table of the history store, no matter how often it was executed
+ */
+USTRUCT(BlueprintType)
+struct DYNAMICSTATEMACHINE_API FDSMNodeRecord
+{
+	GENERATED_BODY()
+
+	// Node object ptr
+	UPROPERTY(VisibleAnywhere, Category = "Node")
+	TWeakObjectPtr<UDSMDefaultNode> _node = nullptr;
+
+	// Name of the node object
+	UPROPERTY(VisibleAnywhere, Category = "Node")
+	FName _nodeLabel = NAME_None;
+
+	// Class of the node
+	UPROPERTY(VisibleAnywhere, Category = "Node")
+	TSubclassOf<UActorComponent> _nodeClass = nullptr;
+
+	// Node owning actor ptr
+	UPROPERTY(VisibleAnywhere, Category = "Owner")
+	TWeakObjectPtr<AActor> _owner = nullptr;
+
+	// Node owning actor name
+	UPROPERTY(VisibleAnywhere, Category = "Owner")
+	FName _ownerLabel = NAME_None;
+
+	// Node owning actor class
+	UPROPERTY(VisibleAnywhere, Category = "Owner")
+	TSubclassOf<AActor> _ownerClass = nullptr;
+
+	// Component tags of the node
+	UPROPERTY(VisibleAnywhere, Category = "Node")
+	TArray<FName> _nodeTags{};
+
+	// Creates the record of a running node, node and owner can already be pending kill
+	static FDSMNodeRecord Create(TWeakObjectPtr<UDSMDefaultNode> node);
+
+	// Creates the record from a materialized node id
+	static FDSMNodeRecord Create(const FDSMNodeID& nodeID);
+};
+
+/**
+ * Referenced data asset of a history entry
+ * Data slots of all entries are stored in a single array, each entry owns a contiguous range
+ */
+USTRUCT(BlueprintType)
+struct DYNAMICSTATEMACHINE_API FDSMDataSlot
+{
+	GENERATED_BODY()
+
+	// Name of the default data asset, this copy belongs to
+	UPROPERTY(VisibleAnywhere, Category = "Data")
+	FName _key = NAME_None;
+
+	// Copy of the data asset, when the node finished executing
+	UPROPERTY(VisibleAnywhere, Category = "Data")
+	TObjectPtr<UDSMDataAsset> _asset = nullptr;
+
+	// Object name of the copy, used to find the asset again after deserialization
+	UPROPERTY()
+	FName _assetName = NAME_None;
+
+	// Data slot of the lazily loaded save file, this slot was restored from. Kept when the slot is copied or moved to another index
+	int32 _storedSlot = INDEX_NONE;
+};
+
+/**
+ * Serialized data asset of a data slot, stored inside save games instead of a package
+ */
+USTRUCT()
+struct DYNAMICSTATEMACHINE_API FDSMDataSnapshot
+{
+	GENERATED_BODY()
+
+	// Snapshot bytes, see FDSMSnapshot. Empty if the data slot has no data asset
+	UPROPERTY()
+	TArray<uint8> _bytes{};
+};
+
+/**
+ * Compact history entry
+ * Points into the node table and into the data slot array of the history store
+ */
+USTRUCT(BlueprintType)
+struct DYNAMICSTATEMACHINE_API FDSMHistoryEntry
+{
+	GENERATED_BODY()
+
+	// Index into the node table
+	UPROPERTY(VisibleAnywhere, Category = "Entry")
+	int32 _nodeIndex = INDEX_NONE;
+
+	// First data slot of this entry
+	UPROPERTY(VisibleAnywhere, Category = "Entry")
+	int32 _dataOffset = 0;
+
+	// Number of data slots of this entry
+	UPROPERTY(VisibleAnywhere, Category = "Entry")
+	int32 _dataNum = 0;
+};
+
+static_assert(sizeof(FDSMHistoryEntry) < 16, "History entries must stay compact");
+
+/**
+ * Consecutive entries of the entry pool of a history store
+ */
+USTRUCT(BlueprintType)
+struct DYNAMICSTATEMACHINE_API FDSMHistoryRun
+{
+	GENERATED_BODY()
+
+	// First pool entry of the run
+	UPROPERTY(VisibleAnywhere, Category = "Branch")
+	int32 _firstEntry = 0;
+
+	// Number of pool entries of the run
+	UPROPERTY(VisibleAnywhere, Category = "Branch")
+	int32 _num = 0;
+};
+
+/**
+ * Timeline of the history
+ * A branch shares the first entries of its parent branch and only stores the entries added after the fork
+ */
+USTRUCT(BlueprintType)
+struct DYNAMICSTATEMACHINE_API FDSMHistoryBranch
+{
+	GENERATED_BODY()
+
+	// Unique name of the branch
+	UPROPERTY(VisibleAnywhere, Category = "Branch")
+	FName _name = NAME_None;
+
+	// Index of the parent branch, INDEX_NONE for the root branch
+	UPROPERTY(VisibleAnywhere, Category = "Branch")
+	int32 _parent = INDEX_NONE;
+
+	// Number of entries shared with the parent branch
+	UPROPERTY(VisibleAnywhere, Category = "Branch")
+	int32 _forkLength = 0;
+
+	// Entries added to this branch after the fork as runs of the entry pool of the history store
+	// A new run only starts after another branch added entries to the pool
+	UPROPERTY(VisibleAnywhere, Category = "Branch")
+	TArray<FDSMHistoryRun> _runs{};
+
+	// Number of history entries of this branch
+	int32 Num() const
+	{
+		int32 num = _forkLength;
+		for (const FDSMHistoryRun& run : _runs)
+		{
+			num += run._num;
+		}
+		return num;
+	}
+
+	// Adds num consecutive pool entries, the last run is extended if the entries follow it
+	void AddEntries(int32 firstEntry, int32 num);
+};
+
+/**
+ * Blueprint description of a history branch
+ */
+USTRUCT(BlueprintType)
+struct DYNAMICSTATEMACHINE_API FDSMHistoryBranchInfo
+{
+	GENERATED_BODY()
+
+	// Name of the branch
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Branch")
+	FName _name = NAME_None;
+
+	// Name of the branch this branch was forked from, None for the root branch
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Branch")
+	FName _parent = NAME_None;
+
+	// Number of history elements shared with the parent branch
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Branch")
+	int32 _forkLength = 0;
+
+	// Number of history elements of the branch
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Branch")
+	int32 _num = 0;
+
+	// True if this is the branch new history elements are added to
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Branch")
+	bool _bActive = false;
+};
+
+/**
+ * Stores the DSM state machine history as struct of arrays
+ * Node metadata is interned inside a deduplicated node table, entries only store indices into the node table and the data slots
+ * FDSMNodeIDs are materialized on request
+ * Entries are stored inside an append only pool shared by all history branches, forking a branch does not copy any entry
+ * All history indices refer to the active branch
+ */
+USTRUCT(BlueprintType)
+struct DYNAMICSTATEMACHINE_API FDSMHistoryStore
+{
+	GENERATED_BODY()
+
+	// Root branch of each history
+	static const FName RootBranchName;
+
+	// Number of history entries of the active branch
+	int32 Num() const { return _timelineNum; }
+
+	// Checks if index is a valid history index
+	bool IsValidIndex(int32 index) const { return index >= 0 && index < _timelineNum; }
+
+	// Removes all entries, nodes, data and branches
+	void Empty();
+
+	// Adds a new entry to the history, node is interned in the node table
+	// Returns the index of the new entry
+	int32 Add(const FDSMNodeRecord& node, const TMap<FName, TObjectPtr<UDSMDataAsset>>& data);
+
+	// Adds a materialized node id to the history
+	int32 Add(const FDSMNodeID& nodeID);
+
+	// Copies a single entry of another store to the end of this history, other can be this store
+	int32 Add(const FDSMHistoryStore& other, int32 index);
+
+	// Adds a new entry, whose data assets are not loaded yet
+	// Unresolved data slots store their key as asset name until SetDataAsset is called, see FDSMSaveFileView
+	// The data slots remember their stored slot, counting up from firstStoredSlot
+	int32 AddUnresolved(const FDSMNodeRecord& node, TArrayView<const FName> keys, int32 firstStoredSlot);
+
+	// Sets the data asset of an unresolved data slot
+	void SetDataAsset(int32 slot, UDSMDataAsset* asset);
+
+	// Replaces this history with the first num entries of the active branch of the other store
+	// The copy only contains a single branch
+	void CopyFrom(const FDSMHistoryStore& other, int32 num);
+
+	// Removes all entries starting at num
+	// Only possible as long as the history was never forked
+	void Truncate(int32 num);
+
+	// Creates a new branch sharing the first num entries of the active branch
+	// Neither entries nor data are copied, the active branch does not change
+	bool Fork(FName branchName, int32 num);
+
+	// Changes the branch new entries are added to, all history indices refer to the active branch afterwards
+	bool SwitchBranch(FName branchName);
+
+	// Removes a branch, which is neither active nor forked by another branch
+	// Pool entries only referenced by the branch are removed together with their data slots, the pool is compacted afterwards
+	// onRelease receives the released pool entries before the pool is compacted, pool entries and data slots of other branches move afterwards
+	bool DropBranch(FName branchName, TFunctionRef<void(TArrayView<const int32> releasedEntries)> onRelease);
+	bool DropBranch(FName branchName);
+
+	// Changes whenever the timeline of the active branch is rebuilt, e.g. the history was replaced, truncated or another branch became active
+	// Adding entries keeps the generation
+	uint32 GetGeneration() const { return _generation; }
+
+	// Returns the name of the active branch
+	FName GetActiveBranch() const { return _branches.IsValidIndex(_activeBranch) ? _branches[_activeBranch]._name : RootBranchName; }
+
+	// Returns a description of all branches
+	TArray<FDSMHistoryBranchInfo> GetBranches() const;
+
+	// Returns the node metadata of a history entry
+	const FDSMNodeRecord& GetNode(int32 index) const { return _nodeTable[_entries[GetPoolEntry(index)]._nodeIndex]; }
+
+	// Returns the referenced data assets of a history entry
+	TArrayView<const FDSMDataSlot> GetData(int32 index) const
+	{
+		const FDSMHistoryEntry& entry = _entries[GetPoolEntry(index)];
+		return TArrayView<const FDSMDataSlot>(_dataSlots.GetData() + entry._dataOffset, entry._dataNum);
+	}
+
+	// Returns all data slots of the entry pool, ordered by pool entry
+	const TArray<FDSMDataSlot>& GetDataSlots() const { return _dataSlots; }
+
+	// Returns the pool entry owning a data slot
+	int32 GetEntryIndexOfSlot(int32 slot) const;
+
+	// Returns the ascending history indices of all entries executed by nodes of the passed class
+	const TArray<int32>& GetIndicesByClass(const UClass* nodeClass) const;
+
+	// Returns the ascending history indices of all entries matching the key of a secondary index
+	const TArray<int32>& GetIndices(EDSMHistoryIndex index, FName key) const;
+
+	// Returns up to maxResults indices starting at the first history index equal or greater than firstHistoryIndex
+	// A maxResults of 0 or less returns all remaining indices
+	static TArray<int32> GetPage(const TArray<int32>& indices, int32 firstHistoryIndex, int32 maxResults);
+
+	// Creates a FDSMNodeID of a single history entry
+	FDSMNodeID Materialize(int32 index) const;
+
+	// Creates the full FDSMNodeID array of the history
+	TArray<FDSMNodeID> Materialize() const;
+
+	// Returns the latest version of a data asset with the passed default data asset name
+	UDSMDataAsset* FindLatestData(FName key) const;
+
+	// Returns the ascending history indices of all versions of a data asset
+	const TArray<int32>& GetDataVersions(FName key) const;
+
+	// Returns the history index of the data asset version, which was valid at the passed history index
+	// Returns INDEX_NONE if the data asset was not written until then
+	int32 FindDataVersion(FName key, int32 historyIndex) const;
+
+	// Returns the data asset version, which was valid at the passed history index
+	UDSMDataAsset* FindDataAt(FName key, int32 historyIndex) const;
+
+	// Returns the names of all data assets stored in the active branch
+	void GetDataKeys(TArray<FName>& outKeys) const;
+
+	// Writes a snapshot of each data slot and releases the data references afterwards
+	// The store can be serialized afterwards without touching any data asset
+	void WriteSnapshots(TArray<FDSMDataSnapshot>& outSnapshots);
+
+	// Recreates the data assets of all data slots from snapshots written by WriteSnapshots
+	void ReadSnapshots(const TArray<FDSMDataSnapshot>& snapshots);
+
+	// Rebuilds transient lookup tables after deserialization
+	void PostSerialize(const FArchive& Ar);
+
+private:
+	friend class FDSMHistoryPager;
+
+	// Returns the node table index of a node, adds the node if it is not known yet
+	int32 InternNode(const FDSMNodeRecord& node);
+
+	// Rebuilds the node lookup from the node table
+	void RebuildNodeLookup();
+
+	// Adds an entry to the pool and to the active branch, returns the history index
+	int32 AddEntry(const FDSMHistoryEntry& entry);
+
+	// Creates the root branch, if the history has no branch yet
+	void EnsureRootBranch();
+
+	// Rebuilds the timeline of the active branch
+	void RebuildTimeline();
+
+	// Appends num consecutive pool entries to the timeline
+	void AppendTimeline(int32 firstEntry, int32 num);
+
+	// Returns the pool entry of a history index of the active branch
+	int32 GetPoolEntry(int32 index) const
+	{
+		// Unforked histories consist of a single run, only forked timelines are searched
+		const int32 run = _timeline.Num() == 1 ? 0 : Algo::UpperBoundBy(_timeline, index, &FTimelineRun::_firstIndex) - 1;
+		return _timeline[run]._firstEntry + index - _timeline[run]._firstIndex;
+	}
+
+	// Removes pool entries and their data slots, remaining entries and data slots keep their order
+	void RemoveEntries(TArrayView<const int32> entries);
+
+	// Appends the first num pool entries of a branch to the timeline
+	void AppendBranchEntries(int32 branch, int32 num);
+
+	// Adds a history entry of the active branch to the secondary indexes
+	void IndexEntry(int32 index);
+
+	// Rebuilds the secondary indexes of the active branch
+	void RebuildIndexes();
+
+	int32 FindBranch(FName branchName) const { return _branches.IndexOfByPredicate([branchName](const FDSMHistoryBranch& branch) { return branch._name == branchName; }); }
+
+	using FNodeKey = TTuple<FName, FName, UClass*>;
+	static FNodeKey MakeNodeKey(const FDSMNodeRecord& node) { return FNodeKey(node._ownerLabel, node._nodeLabel, node._nodeClass.Get()); }
+
+	// Deduplicated node metadata
+	UPROPERTY(VisibleAnywhere, Category = "DSM History")
+	TArray<FDSMNodeRecord> _nodeTable{};
+
+	// Compact history entries of all branches in the order they were added, entries of dropped branches are removed
+	UPROPERTY(VisibleAnywhere, Category = "DSM History")
+	TArray<FDSMHistoryEntry> _entries{};
+
+	// Referenced data of all entries in the order they were added
+	UPROPERTY(VisibleAnywhere, Category = "DSM History")
+	TArray<FDSMDataSlot> _dataSlots{};
+
+	// Timelines of the history, branches without parent start at the first history entry
+	UPROPERTY(VisibleAnywhere, Category = "DSM History")
+	TArray<FDSMHistoryBranch> _branches{};
+
+	// Branch new entries are added to
+	UPROPERTY(VisibleAnywhere, Category = "DSM History")
+	int32 _activeBranch = 0;
+
+	// Runs of consecutive pool entries of the active branch, ordered by the history index they start at
+	// A run starts at each fork point and wherever other branches added entries in between, rebuilt when the active branch changes
+	struct FTimelineRun
+	{
+		int32 _firstIndex = 0;
+		int32 _firstEntry = 0;
+	};
+	TArray<FTimelineRun> _timeline{};
+
+	// Number of history entries of the active branch
+	int32 _timelineNum = 0;
+
+	// Secondary indexes of the active branch, map keys to ascending history indices
+	TMap<const UClass*, TArray<int32>> _classIndex{};
+	TMap<FName, TArray<int32>> _ownerIndex{};
+	TMap<FName, TArray<int32>> _tagIndex{};
+
+	// Version chain of each data asset, history indices and data slots of all versions in ascending order
+	struct FDataVersions
+	{
+		TArray<int32> _historyIndices;
+		TArray<int32> _slots;
+	};
+	TMap<FName, FDataVersions> _dataVersions{};
+
+	// Maps owner label, node label and node class to the node table index
+	TMap<FNodeKey, int32> _nodeLookup{};
+
+	// Unique among all stores, assigned whenever the secondary indexes are rebuilt
+	uint32 _generation = 0;
+};
+
+template<>
+struct TStructOpsTypeTraits<FDSMHistoryStore> : public TStructOpsTypeTraitsBase2<FDSMHistoryStore>
+{
+	enum
+	{
+		WithPostSerialize = true,
+	};
+};
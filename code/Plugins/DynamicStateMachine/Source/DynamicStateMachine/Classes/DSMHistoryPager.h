@@ -0,0 +1,123 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DSMHistory.h"
+
+/**
+ * Keeps the memory used by the data of the history below a budget
+ * The history is split into segments of fixed entry count. Data of cold segments is either written to an append only page file
+ * inside the Saved directory or compressed in memory, afterwards the data assets are released.
+ * Segments are paged in again, when they are accessed. A small LRU of paged in segments stays resident to serve repeated access.
+ * Latest versions of the data assets are never paged out, they are used to create new data copies.
+ * Segments are formed by the entry pool of the history store, so all history branches share the same pages.
+ */
+class DYNAMICSTATEMACHINE_API FDSMHistoryPager
+{
+public:
+	~FDSMHistoryPager() { Reset(); }
+
+	// Sets the paging parameters, a memory budget of 0 disables paging
+	void Configure(int32 segmentSize, int64 memoryBudget, int32 prefetchSegments);
+
+	// Sets where cold segments are stored, compressionFormat is used for compressed memory storage
+	// Storage can only change as long as nothing is paged out
+	void ConfigureStorage(EDSMColdHistoryStorage storage, FName compressionFormat, int32 pagedInCacheSize);
+
+	// Returns true if cold segments are paged out
+	bool IsEnabled() const { return _memoryBudget > 0; }
+
+	// Accounts the data of a new history entry, pages out cold segments if the memory budget is exceeded
+	// Nothing is accounted while paging is disabled, the entire history is accounted once paging is enabled
+	void OnEntryAdded(FDSMHistoryStore& store, int32 index);
+
+	// Accounts the entire history again if paging is enabled, must be called if the history was replaced
+	void Rebuild(FDSMHistoryStore& store);
+
+	// Pins the latest data versions of the active branch, must be called if the active branch changed
+	void RefreshPins(FDSMHistoryStore& store);
+
+	// Releases the data of pool entries, which are not referenced by any branch anymore, must be called before the entries are removed
+	// Segments from the first released entry on are paged in, they are formed by other entries once the pool is compacted
+	void ReleaseEntries(FDSMHistoryStore& store, TArrayView<const int32> entries);
+
+	// Accounts the segments released by ReleaseEntries again, must be called after the entries were removed from the pool
+	void OnEntriesRemoved(FDSMHistoryStore& store);
+
+	// Pages in all segments containing the passed history range of the active branch
+	// Sequential access pages in the following segments as well, other segments are paged out again if the memory budget is exceeded
+	void EnsureResident(FDSMHistoryStore& store, int32 firstEntry, int32 entryNum);
+
+	// Releases all pages and deletes the page file
+	void Reset();
+
+	// Takes over settings, pages and page file of another pager, the other pager is reset without deleting the page file
+	// Used when the history is moved into another save game
+	void MoveFrom(FDSMHistoryPager& other);
+
+	// Returns the estimated memory of the resident history data
+	int64 GetResidentBytes() const { return _residentBytes; }
+
+	// Returns the memory used by compressed cold segments, segments are decompressed and released when they are paged in
+	int64 GetCompressedBytes() const { return _compressedBytes; }
+
+private:
+	struct FPage
+	{
+		// Location of the segment inside the page file, segments are only written once
+		int64 _fileOffset = INDEX_NONE;
+		int64 _fileSize = 0;
+		int64 _residentBytes = 0;
+		uint64 _lastAccess = 0;
+		bool _bResident = true;
+		// Segment data, if cold segments are compressed in memory
+		TArray<uint8> _compressedBytes;
+		FName _compressionFormat = NAME_None;
+		// Segment was paged in again after it was paged out
+		bool _bPagedIn = false;
+	};
+
+	void AccountEntry(FDSMHistoryStore& store, int32 index);
+	// Pages out least recently used segments until the budget is met, segments accessed at or after firstProtectedAccess stay resident
+	void EvictColdSegments(FDSMHistoryStore& store, uint64 firstProtectedAccess);
+	bool PageOut(FDSMHistoryStore& store, int32 segment);
+	bool PageIn(FDSMHistoryStore& store, int32 segment);
+	bool HasPagedOutSegments() const;
+	bool HasStoredSegment(int32 segment) const;
+	bool StoreSegment(int32 segment, const TArray<uint8>& segmentBytes);
+	bool LoadSegment(int32 segment, TArray<uint8>& outSegmentBytes);
+	void MakeResident(FDSMHistoryStore& store, int32 segment);
+	void ReleaseSlot(FDSMHistoryStore& store, int32 slot);
+	void TrimPagedInSegments(FDSMHistoryStore& store, uint64 firstProtectedAccess);
+	void Touch(int32 segment) { _pages[segment]._lastAccess = ++_accessCounter; }
+
+	// Returns the number of data slots of a segment
+	int32 GetSlotRange(const FDSMHistoryStore& store, int32 segment, int32& outFirstSlot) const;
+	int32 GetSegment(int32 entry) const { return entry / _segmentSize; }
+	bool IsSealed(const FDSMHistoryStore& store, int32 segment) const;
+	bool IsPinned(int32 slot, FName key) const;
+	const FString& GetPageFilePath();
+
+	int32 _segmentSize = 256;
+	int64 _memoryBudget = 0;
+	int32 _prefetchSegments = 2;
+	EDSMColdHistoryStorage _storage = EDSMColdHistoryStorage::PageFile;
+	FName _compressionFormat = NAME_LZ4;
+	int32 _pagedInCacheSize = 4;
+
+	TArray<FPage> _pages;
+	// Estimated size of each data slot
+	TArray<int32> _slotBytes;
+	// Latest data slot of each data asset name, these slots are never paged out
+	TMap<FName, int32> _latestSlots;
+	int64 _residentBytes = 0;
+	int64 _compressedBytes = 0;
+	uint64 _accessCounter = 0;
+	int32 _lastPagedIn = INDEX_NONE;
+	// History is accounted, only true while paging is enabled or segments are paged out
+	bool _bAccounting = false;
+
+	FString _pageFilePath;
+	int64 _pageFileSize = 0;
+};
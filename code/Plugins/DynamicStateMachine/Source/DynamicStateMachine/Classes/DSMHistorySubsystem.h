@@ -0,0 +1,43 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/GameInstanceSubsystem.h"
+#include "DSMHistorySubsystem.generated.h"
+
+class UDSMSaveGame;
+
+/**
+ * Carries the DSM history across level transitions
+ * When the DSM game mode ends play because of a level transition, its history, including paged data and the lazily loaded save file, is moved into this subsystem.
+ * The DSM game mode of the next level adopts the history in StartStateMachine. Nothing is serialized or written to disc, data asset versions are moved as they are.
+ * Loading a save game in the next level takes precedence, the carried history is discarded in this case.
+ */
+UCLASS()
+class DYNAMICSTATEMACHINE_API UDSMHistorySubsystem : public UGameInstanceSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	// Moves the history of the state machine data into the subsystem, a previously carried history is discarded
+	void CarryHistory(UDSMSaveGame* stateMachineData);
+
+	// Moves the carried history into the state machine data, returns false if no history is carried
+	bool AdoptHistory(UDSMSaveGame* stateMachineData);
+
+	// Returns true if a history is carried to the next DSM game mode
+	UFUNCTION(BlueprintCallable, Category = "DSM History")
+	bool HasCarriedHistory() const { return _carriedHistory != nullptr; }
+
+	// Discards the carried history, the next DSM game mode starts with an empty history
+	UFUNCTION(BlueprintCallable, Category = "DSM History")
+	void DiscardHistory() { _carriedHistory = nullptr; }
+
+	void Deinitialize() override;
+
+private:
+	// Holds the carried history and keeps its data asset versions alive during the level transition
+	UPROPERTY()
+	TObjectPtr<UDSMSaveGame> _carriedHistory = nullptr;
+};
@@ -0,0 +1,144 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/StrongObjectPtr.h"
+#include <coroutine>
+
+class UDSMDefaultNode;
+class UDSMDataAsset;
+class UAnimInstance;
+class UAnimMontage;
+
+/**
+ * Latent state of a C++ DSM node written as coroutine, see UDSMDefaultNode::RunLatentState
+ * The coroutine starts after ApplyStateBegin and runs until its first co_await. While it awaits an event, the node is neither updated nor applied.
+ * Awaited events only wake the coroutine, the DSM manager resumes it during its next update, so the coroutine always runs on the game thread.
+ * If the node was destroyed in the meantime, the coroutine is destroyed without being resumed and the state ends.
+ * co_return true ends the state, co_return false continues the state with regular updates.
+ * Coroutines require C++20, modules implementing latent states must set CppStandard = CppStandardVersion.Cpp20 in their Build.cs
+ */
+struct DYNAMICSTATEMACHINE_API FDSMLatentTask
+{
+	// Shared by the coroutine and its awaited event, events fired after the coroutine was destroyed are ignored
+	struct FWakeState
+	{
+		~FWakeState();
+
+		bool _bWoken = false;
+		// Called if the coroutine is destroyed before the awaited event fired, e.g. to clear a timer
+		TFunction<void()> _onAbort = nullptr;
+		// Keeps objects listening to the awaited event alive
+		TStrongObjectPtr<UObject> _listener;
+	};
+
+	struct promise_type
+	{
+		promise_type() = default;
+
+		// Latent states are member functions of DSM nodes, the node is passed as implicit first parameter
+		template<typename... TArgs>
+		promise_type(UDSMDefaultNode& node, TArgs&&...) : _node(&node) {}
+
+		FDSMLatentTask get_return_object() { return FDSMLatentTask(std::coroutine_handle<promise_type>::from_promise(*this)); }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_always final_suspend() noexcept { return {}; }
+		void return_value(bool bHasStateEnded) { _bHasStateEnded = bHasStateEnded; }
+		void unhandled_exception() { check(false); }
+
+		TWeakObjectPtr<UDSMDefaultNode> _node = nullptr;
+		TSharedPtr<FWakeState, ESPMode::ThreadSafe> _wakeState = nullptr;
+		bool _bHasStateEnded = true;
+	};
+	using FHandle = std::coroutine_handle<promise_type>;
+
+	FDSMLatentTask() = default;
+	FDSMLatentTask(FDSMLatentTask&& other) : _handle(other._handle) { other._handle = nullptr; }
+	FDSMLatentTask& operator=(FDSMLatentTask&& other);
+	FDSMLatentTask(const FDSMLatentTask&) = delete;
+	FDSMLatentTask& operator=(const FDSMLatentTask&) = delete;
+	~FDSMLatentTask() { Reset(); }
+
+	// Invalid tasks are returned by nodes without latent state
+	bool IsValid() const { return static_cast<bool>(_handle); }
+
+	// Returns true if the coroutine finished
+	bool IsDone() const { return !_handle || _handle.done(); }
+
+	// Returns the value passed to co_return, only valid after the coroutine finished
+	bool HasStateEnded() const { return IsDone() && (!_handle || _handle.promise()._bHasStateEnded); }
+
+	// Resumes the coroutine if its awaited event fired, returns true if the coroutine was resumed
+	bool ResumeIfWoken();
+
+	// Destroys the coroutine, pending awaited events are ignored
+	void Reset();
+
+private:
+	explicit FDSMLatentTask(FHandle handle) : _handle(handle) {}
+
+	FHandle _handle = nullptr;
+};
+
+/**
+ * Event awaited by a latent state, created by the functions of FDSMLatent
+ * Bind is called on suspension and must wake the passed wake state once the event fired
+ */
+struct DYNAMICSTATEMACHINE_API FDSMLatentAwaiter
+{
+	using FWakeState = FDSMLatentTask::FWakeState;
+	using FBindFunction = TFunction<void(UDSMDefaultNode* node, const TSharedRef<FWakeState, ESPMode::ThreadSafe>& wakeState)>;
+
+	explicit FDSMLatentAwaiter(FBindFunction bind) : _bind(MoveTemp(bind)) {}
+
+	bool await_ready() const { return false; }
+	void await_suspend(FDSMLatentTask::FHandle handle);
+	void await_resume() const {}
+
+	// Wakes the coroutine owning the wake state, if it still exists
+	static void Wake(const TWeakPtr<FWakeState, ESPMode::ThreadSafe>& wakeState);
+
+private:
+	FBindFunction _bind;
+};
+
+/**
+ * Events which can be awaited inside latent states
+ * e.g. co_await FDSMLatent::Delay(2.0f);
+ */
+struct DYNAMICSTATEMACHINE_API FDSMLatent
+{
+	// Resumes after the delay passed, uses the timer manager of the world of the node
+	static FDSMLatentAwaiter Delay(float seconds);
+
+	// Resumes after the delegate was broadcast
+	// The binding removes itself on broadcast or when the latent state is destroyed, the delegate must stay valid until then
+	template<typename... TParams>
+	static FDSMLatentAwaiter WaitFor(TMulticastDelegate<void(TParams...)>& delegate)
+	{
+		return FDSMLatentAwaiter([&delegate](UDSMDefaultNode*, const TSharedRef<FDSMLatentTask::FWakeState, ESPMode::ThreadSafe>& wakeState)
+			{
+				TWeakPtr<FDSMLatentTask::FWakeState, ESPMode::ThreadSafe> weakWakeState = wakeState;
+				TSharedRef<FDelegateHandle> binding = MakeShared<FDelegateHandle>();
+				*binding = delegate.AddLambda([&delegate, weakWakeState, binding](TParams...)
+					{
+						FDSMLatentAwaiter::Wake(weakWakeState);
+						delegate.Remove(*binding);
+					});
+				wakeState->_onAbort = [&delegate, binding]()
+				{
+					delegate.Remove(*binding);
+				};
+			});
+	}
+
+	// Resumes after UDSMDataAsset::NotifyDataChanged was called on the data asset
+	static FDSMLatentAwaiter WaitForDataChange(UDSMDataAsset* dataAsset);
+
+	// Resumes after the montage played by the anim instance ended or was interrupted
+	static FDSMLatentAwaiter WaitForMontageEnd(UAnimInstance* animInstance, UAnimMontage* montage);
+
+	// Resumes after a montage played by the anim instance reached a notify with the given name
+	static FDSMLatentAwaiter WaitForMontageNotify(UAnimInstance* animInstance, FName notifyName);
+};
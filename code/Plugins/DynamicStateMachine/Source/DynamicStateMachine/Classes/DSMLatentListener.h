@@ -0,0 +1,55 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/NoExportTypes.h"
+#include "Animation/AnimInstance.h"
+#include "DSMLatentListener.generated.h"
+
+/**
+ * Listens to dynamic delegates awaited by latent states, see FDSMLatent
+ * Dynamic delegates can only bind to UFunctions, the listener forwards them to the awaiting coroutine
+ */
+UCLASS()
+class UDSMLatentNotifyListener : public UObject
+{
+	GENERATED_BODY()
+public:
+	// Binds the listener to the montage notifies of the anim instance
+	void Listen(UAnimInstance* animInstance, FName notifyName, TFunction<void()> onNotify);
+
+	// Unbinds the listener, e.g. if the latent state was destroyed before the notify
+	void StopListening();
+
+	UFUNCTION()
+	void OnMontageNotifyBegin(FName notifyName, const FBranchingPointNotifyPayload& payload);
+
+private:
+	TWeakObjectPtr<UAnimInstance> _animInstance = nullptr;
+	FName _notifyName = NAME_None;
+	TFunction<void()> _onNotify = nullptr;
+};
+
+/**
+ * Listens to the end of a montage played by an anim instance, see FDSMLatent::WaitForMontageEnd
+ */
+UCLASS()
+class UDSMLatentMontageListener : public UObject
+{
+	GENERATED_BODY()
+public:
+	// Binds the listener to the montage ends of the anim instance, only the end of the passed montage is forwarded
+	void Listen(UAnimInstance* animInstance, UAnimMontage* montage, TFunction<void()> onEnded);
+
+	// Unbinds the listener, e.g. if the latent state was destroyed before the montage ended
+	void StopListening();
+
+	UFUNCTION()
+	void OnMontageEnded(UAnimMontage* montage, bool bInterrupted);
+
+private:
+	TWeakObjectPtr<UAnimInstance> _animInstance = nullptr;
+	TWeakObjectPtr<UAnimMontage> _montage = nullptr;
+	TFunction<void()> _onEnded = nullptr;
+};
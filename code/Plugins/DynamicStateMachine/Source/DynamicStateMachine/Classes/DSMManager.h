@@ -10,6 +10,9 @@
 #include "Misc/Optional.h"
 #include "DSMManager.generated.h"
 
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FOnReplayProgress, int32, replayedNum, int32, replayNum);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FOnReplayFinished, bool, bSuccess);
+
 /*
 * Class defining the currently active node.
 */
@@ -98,6 +101,54 @@ public:
 	UPROPERTY(EditAnywhere, Category = "Dynamic State Machine")
 	bool bRequestTransitionAfterBeginPlay = false;
 
+	// Fired after each replayed frame while a save game is loaded, e.g. to update a loading screen
+	UPROPERTY(BlueprintAssignable, Category = "DSM Save Game")
+	FOnReplayProgress OnReplayProgress;
+
+	// Fired after a loaded save game was replayed, before the transition after begin play is requested
+	UPROPERTY(BlueprintAssignable, Category = "DSM Save Game")
+	FOnReplayFinished OnReplayFinished;
+
+	// Returns true while a loaded save game is replayed, transitions are blocked during replay
+	UFUNCTION(BlueprintCallable, Category = "DSM Save Game")
+	bool IsReplaying() const { return _replaySaveGame != nullptr; }
+
+	// Restores the state of a history element without reloading the level
+	// Actors spawned inside node events after the history element are destroyed, owners of later nodes are reset and only their history elements are applied again
+	// Resetting an owner calls AActor::Reset and ResetState of its nodes, the owner only changes as far as these are implemented
+	// keepState keeps all history elements, otherwise the history ends at historyIndex
+	UFUNCTION(BlueprintCallable, Category = "DSM Save Game")
+	bool RestoreStateInPlace(int32 historyIndex, bool keepState = false);
+
+	// Loads a slot and restores it without reloading the level
+	// History elements shared with the running history are not applied again
+	UFUNCTION(BlueprintCallable, Category = "DSM Save Game")
+	bool RestoreSlotInPlace(const FString& slotName, bool deleteSlotAfterLoad);
+
+	// Remembers a destroyed level actor, which owns DSM nodes, so restoring in place can spawn it again
+	// Called automatically, when a node of the actor is unregistered while the actor is destroyed
+	void RecordDestroyedOwner(AActor* owner);
+
+	// Spawns destroyed level actors of the touched owners again from their archetype, under their previous name
+	// Returns the number of spawned actors
+	int32 RespawnDestroyedOwners(const TSet<FName>& touchedOwners);
+
+	// Suspends or resumes updates of the active node, see UDSMDefaultNode::SuspendState
+	// Ignored if the node is not active, bHasStateEnded ends the state on resume
+	void SetStateSuspended(TWeakObjectPtr<UDSMDefaultNode> node, bool bSuspended, bool bHasStateEnded = false);
+
+	// Returns true while the active node awaits an event, instead of being updated
+	bool IsStateSuspended() const { return _bStateSuspended || _latentTask.IsValid(); }
+
+	// Schedules a timer of a node on the timer wheel, see UDSMDefaultNode::SetStateTimer
+	FDSMTimerHandle SetNodeTimer(TWeakObjectPtr<UDSMDefaultNode> node, float seconds, EDSMTimerAction action);
+
+	// Clears a pending timer, returns false if the timer already fired
+	bool ClearNodeTimer(const FDSMTimerHandle& handle);
+
+	// Returns the remaining seconds of a pending timer, or -1 if the timer is not pending
+	float GetNodeTimerRemaining(const FDSMTimerHandle& handle) const;
+
 	// Returns latest version of a data reference, based on the history and current active node
 	// If there is no current active node, latest version is searched in history
 	TWeakObjectPtr<UDSMDataAsset> GetDataAssetCached(const TWeakObjectPtr<UDSMDataAsset> DefaultDataAssetObject);
@@ -137,8 +188,12 @@ protected:
 	// Custom transition can only get called from the owning default node
 	bool RequestCustomTransition(TWeakObjectPtr<UDSMDefaultNode> node);
 
+	// Resumes the latent state of the active node if its awaited event fired
+	// Returns true if the active node should be updated, false while it awaits an event or after its state ended
+	bool UpdateLatentState();
+
 private:
-	TWeakObjectPtr<UDSMDefaultNode> GetComponentFromNodeID(const FDSMNodeID& node, TArray<TObjectPtr<AActor>>& cachedActors);
+	TWeakObjectPtr<UDSMDefaultNode> GetComponentFromNodeID(const FDSMNodeRecord& node, TArray<TObjectPtr<AActor>>& cachedActors);
 
 	// Holds currently active node
 	UPROPERTY()
@@ -154,6 +209,30 @@ private:
 	bool _hasStateEnded = false;
 	bool _IsTransitionAllowed = true;
 
+	// Latent state of the active node, set while its coroutine has not finished
+	TSharedPtr<struct FDSMLatentTask> _latentTask = nullptr;
+	// Set by nodes suspending themselves until they resume
+	bool _bStateSuspended = false;
+
+	// Advances the timer wheel and performs the actions of fired timers
+	void UpdateTimers(float DeltaTime);
+
+	// Replaces the pending timers with the timers stored inside the history
+	void RestoreTimers();
+
+	// Pending timers of all nodes, time only advances while no save game is replayed
+	FDSMTimerWheel _timerWheel;
+
+	// Default data asset of the timers stored inside the history
+	UPROPERTY()
+	TObjectPtr<UDSMTimerData> _timerDefaults = nullptr;
+
+	// Set if timers were scheduled, cleared or fired since they were stored the last time
+	bool _bTimersChanged = false;
+
+	// Number of states begun by this game mode, identifies the activation of the active node
+	uint32 _activationNum = 0;
+
 public:
 	// Save load information
 	struct SaveLoadInfo
@@ -165,8 +244,68 @@ public:
 	static SaveLoadInfo _saveLoadInfo;
 private:
 
-	// Applies the new save game
-	void LoadSaveGame_Internal(const SaveLoadInfo saveLoadInfo);
+	// Loads the save game and starts its replay, returns false if no save game was loaded
+	bool LoadSaveGame_Internal(const SaveLoadInfo saveLoadInfo);
+
+	// Replaces the history with the first historyNum elements of the save game and starts replaying its first replayNum elements
+	// The entire history is in place during the replay, data requests of the replayed nodes return the versions of their own history element
+	// Elements before firstReplayed are only applied, if their owner is contained in replayedOwners
+	void StartReplay(TObjectPtr<UDSMSaveGame> saveGame, int32 historyNum, int32 replayNum, int32 firstReplayed = 0, TSet<FName> replayedOwners = {});
+
+	// Resets the world to the history elements the save game shares with the running history and replays the remaining ones
+	bool RestoreInPlace_Internal(TObjectPtr<UDSMSaveGame> saveGame, int32 historyNum, int32 replayNum);
+
+	// Destroys actors spawned by nodes at or after the history index, spawns destroyed level actors again and resets the remaining touched owners and their nodes
+	// Owners are reset by AActor::Reset, which keeps the state of actors not overriding it
+	// Returns the number of reset actors
+	int32 ResetTouchedActors(int32 historyIndex, const TSet<FName>& touchedOwners);
+
+	// Keeps track of actors spawned inside node events, other actors are not touched by restoring in place
+	void OnActorSpawned(AActor* actor);
+
+	// Replays history elements of the loaded save game until the replay budget of the frame is used
+	void ContinueReplay();
+
+	// Allows transitions again and requests the transition after begin play
+	// A failed replay restores the history from before the replay
+	void FinishReplay(bool bSuccess);
+
+	// Save game which is currently replayed
+	UPROPERTY()
+	TObjectPtr<UDSMSaveGame> _replaySaveGame = nullptr;
+
+	// History before the replay replaced it, restored if the replay fails
+	UPROPERTY()
+	TObjectPtr<UDSMSaveGame> _replayPreviousHistory = nullptr;
+
+	// Actors found during replay
+	UPROPERTY()
+	TArray<TObjectPtr<AActor>> _replayActorCache = {};
+
+	// Idempotent nodes and the history element they are applied at
+	TMap<const FDSMNodeRecord*, int32> _replayCollapsedNodes;
+	int32 _replayNext = 0;
+	int32 _replayNum = 0;
+	int32 _replayAppliedNum = 0;
+	int32 _replayFirst = 0;
+	TSet<FName> _replayOwners;
+
+	// Actors spawned by nodes and the history index of the spawning node, destroyed when an earlier state is restored in place
+	TArray<TPair<TWeakObjectPtr<AActor>, int32>> _spawnedActors;
+
+	// Set while events of a node are called, only actors spawned meanwhile are spawned by nodes
+	bool _bInNodeEvent = false;
+
+	// Level actor owning DSM nodes, which was destroyed while the state machine runs
+	struct FDestroyedOwner
+	{
+		TWeakObjectPtr<UClass> _class;
+		TWeakObjectPtr<AActor> _archetype;
+		TWeakObjectPtr<ULevel> _level;
+		FTransform _transform;
+	};
+	TMap<FName, FDestroyedOwner> _destroyedOwners;
+	FDelegateHandle _actorSpawnedHandle;
 public:
 	// Sets save laod information
 	static void SetSaveLoadInfo(const SaveLoadInfo& saveLoadInfo) { _saveLoadInfo = saveLoadInfo; }
@@ -0,0 +1,196 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DSMHistory.h"
+
+/**
+ * Native DSM save format
+ * A single file inside the Saved directory, containing a header, the data asset snapshots and an index table at the end of the file
+ * The index table contains the name table, the node table, the history entries and the location of each data asset snapshot
+ * Data asset snapshots contain the tagged properties of the data asset and all objects owned by it
+ * Save files are read and written by FArchive streaming, neither the package system nor USaveGame serialization is involved
+ * Each snapshot is compressed on its own and the index table is stored as compressed blocks, see FDSMCompressedWriter
+ * Snapshots can be read one by one without reading the rest of the file, see FDSMSaveFileView
+ */
+struct DYNAMICSTATEMACHINE_API FDSMSaveFile
+{
+	// Identifies DSM save files
+	static constexpr uint32 Magic = 0x44534D46;
+
+	// Increased whenever the file layout changes, files of other versions are not read
+	static constexpr int32 LatestVersion = 1;
+
+	// Node of the node table, all strings are indices into the name table
+	struct FNode
+	{
+		int32 _nodeLabel = INDEX_NONE;
+		int32 _nodePath = INDEX_NONE;
+		int32 _nodeClass = INDEX_NONE;
+		int32 _ownerLabel = INDEX_NONE;
+		int32 _ownerPath = INDEX_NONE;
+		int32 _ownerClass = INDEX_NONE;
+		TArray<int32> _nodeTags;
+	};
+
+	// History entry, data slots of all entries are stored in order
+	struct FEntry
+	{
+		int32 _nodeIndex = INDEX_NONE;
+		int32 _dataNum = 0;
+	};
+
+	// Data slot, key is an index into the name table
+	struct FSlot
+	{
+		int32 _key = INDEX_NONE;
+		TArray<uint8> _snapshot;
+	};
+
+	// Summary of the saved history stored inside the header, so save menus do not need to read the rest of the file
+	// Strings are stored as zero padded UTF-8 of a fixed size, longer strings are truncated
+	struct FSummary
+	{
+		static constexpr int32 ClassPathBytes = 256;
+		static constexpr int32 LabelBytes = 128;
+		static constexpr int32 MetadataBytes = 1024;
+		static constexpr int64 FixedSize = sizeof(int32) + sizeof(int64) + ClassPathBytes + LabelBytes + MetadataBytes;
+
+		// Number of history elements of the saved history, including earlier journal records
+		int32 _historyNum = 0;
+		// Class path and label of the last saved node, empty if the history is empty
+		FString _lastNodeClass;
+		FString _lastNodeLabel;
+		// UTC time of the capture in ticks, see FDateTime
+		int64 _timestamp = 0;
+		// User defined metadata, e.g. playtime or chapter name
+		FString _metadata;
+
+		// Reads or writes FixedSize bytes
+		void SerializeFixed(FArchive& ar);
+	};
+
+	// Location of a data slot snapshot inside the file, key is an index into the name table
+	struct FSlotLocation
+	{
+		int32 _key = INDEX_NONE;
+		// Offset of the stored snapshot from the start of the file
+		int64 _offset = 0;
+		// Stored and uncompressed size, a snapshot is stored uncompressed if both are equal
+		int32 _storedSize = 0;
+		int32 _size = 0;
+	};
+
+	int32 _version = LatestVersion;
+	// Compression format of the blocks after the header, NAME_None if the file is not compressed
+	FName _compressionFormat = NAME_None;
+	// Uncompressed size of a compressed block
+	int32 _compressionBlockSize = 256 * 1024;
+	int32 _indexToLoad = INDEX_NONE;
+	bool _bKeepState = false;
+	FSummary _summary;
+	TArray<FString> _names;
+	TArray<FNode> _nodes;
+	TArray<FEntry> _entries;
+	TArray<FSlot> _slots;
+	// Offset of the index table from the start of the file
+	int64 _tableOffset = 0;
+	// Snapshot locations of all data slots, only filled by ReadIndex
+	TArray<FSlotLocation> _slotLocations;
+
+	// Size of the file content after the header, before and after compression
+	// Filled when the file is written or read
+	int64 _uncompressedBytes = 0;
+	int64 _storedBytes = 0;
+
+	// Captures the first num entries of the active branch, data assets are written as snapshots
+	// Must be called on the game thread, the data of the captured entries must be resident
+	static FDSMSaveFile Capture(const FDSMHistoryStore& store, int32 num);
+
+	// Captures num entries of the active branch starting at firstIndex, used for journal records
+	static FDSMSaveFile Capture(const FDSMHistoryStore& store, int32 firstIndex, int32 num);
+
+	// Returns num entries starting at firstIndex as a file of its own, names and nodes only contain what these entries reference
+	// Tables of equal entries are equal, used for the content addressed segments of FDSMSlotStore
+	FDSMSaveFile Slice(int32 firstIndex, int32 num) const;
+
+	// Appends the entries of another save file, names and nodes are remapped to the tables of this file
+	// Index to load, keep state and summary are taken from the other file
+	void Append(const FDSMSaveFile& other);
+
+	// Recreates the history from the save file, data assets are created inside the transient package
+	// Snapshots are read in parallel, see FDSMSnapshot::ReadParallel. Must be called on the game thread
+	void Restore(FDSMHistoryStore& outStore) const;
+
+	// Adds the entries of the save file to the end of the history
+	// Must be called on the game thread
+	void AppendTo(FDSMHistoryStore& outStore) const;
+
+	// Reads or writes the save file, can be called from any thread
+	// Returns false if the archive does not contain a valid DSM save file
+	bool Serialize(FArchive& ar);
+
+	// Writes the save file to disc, can be called from any thread
+	bool Write(const FString& filePath);
+
+	// Reads the save file from disc, can be called from any thread
+	bool Read(const FString& filePath);
+
+	// Reads the save file from disc and recreates the history while reading
+	// Snapshots are restored in parallel in batches and released afterwards, so neither the uncompressed file nor all snapshots are held in memory
+	// Must be called on the game thread
+	bool Load(const FString& filePath, FDSMHistoryStore& outStore);
+
+	// Recreates the history while reading the save file from an archive, e.g. a file prefetched into memory
+	// Must be called on the game thread
+	bool Load(FArchive& reader, FDSMHistoryStore& outStore);
+
+	// Reads the header including the summary, but nothing behind it, can be called from any thread
+	bool ReadHeader(FArchive& ar) { return SerializeHeader(ar); }
+
+	// Reads the summary of a save file, can be called from any thread
+	// See FDSMSaveJournal::ReadSummary for journaled slots
+	static bool ReadSummary(const FString& filePath, FSummary& outSummary);
+
+	// Reads header and index table, but no snapshot, can be called from any thread
+	// Returns false if the archive does not contain a valid DSM save file
+	bool ReadIndex(FArchive& ar);
+
+	// Reads or writes the tables and the keys of all data slots, but neither header nor snapshots, can be called from any thread
+	// Used for history segments of FDSMSlotStore, loaded slots have empty snapshots
+	bool SerializeSegment(FArchive& ar);
+
+	// Decompresses the stored bytes of a snapshot read from the location of a data slot
+	bool DecodeSnapshot(const FSlotLocation& location, TArrayView<const uint8> storedBytes, TArray<uint8>& outSnapshot) const;
+
+	// Recreates the first num entries of the history from the index table read by ReadIndex
+	// No snapshot is read, data slots stay unresolved until the data is read by FDSMSaveFileView
+	// Must be called on the game thread
+	void RestoreUnresolved(FDSMHistoryStore& outStore, int32 num) const;
+
+	// Returns the path of the save file of a slot inside the Saved directory
+	static FString GetFilePath(const FString& slotName);
+
+private:
+	// Magic, version, compression settings and summary, never compressed
+	bool SerializeHeader(FArchive& ar);
+
+	// Everything before the data slots, validates all table indices on load
+	bool SerializeTables(FArchive& ar);
+
+	// Writes the snapshots followed by the index table, the table offset inside the header is written last
+	bool WriteIndexed(FArchive& ar, int64 tableOffsetPosition);
+
+	// Reads the index table of a file, the archive must be positioned behind the header
+	bool ReadIndexTable(FArchive& ar);
+
+	// Reads and decodes the snapshot of a data slot listed inside the index table
+	bool ReadSlot(FArchive& ar, int32 slotIndex, TArray<uint8>& storedBytes, FSlot& outSlot) const;
+
+	// Creates node records of the node table
+	void CreateRecords(TArray<FDSMNodeRecord>& outRecords) const;
+
+	// Number of data slots of all entries
+	int32 GetSlotNum() const;
+};
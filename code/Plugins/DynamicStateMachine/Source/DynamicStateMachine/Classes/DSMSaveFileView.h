@@ -0,0 +1,71 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DSMSaveFile.h"
+
+class IMappedFileHandle;
+class IMappedFileRegion;
+
+/**
+ * Lazily loaded native save file
+ * The save file is mapped into memory and only its index table is read on open. History entries are restored up to the requested index,
+ * data snapshots are decoded the first time their data slot is accessed. Snapshots stored uncompressed are read directly from the mapped file.
+ * Restored data slots remember their slot inside the file, so they are still resolved after the history was copied, branched or compacted.
+ * Entries added after the load are never resolved by the view.
+ * Platforms without memory mapped files read the entire file into memory instead, snapshots are still decoded on access.
+ */
+class DYNAMICSTATEMACHINE_API FDSMSaveFileView
+{
+public:
+	~FDSMSaveFileView();
+
+	// Maps the save file and reads its index table, can be called from any thread
+	// Returns nullptr if the file can not be opened or is not a valid DSM save file
+	static TSharedPtr<FDSMSaveFileView> Open(const FString& filePath);
+
+	// Returns header and index table of the save file
+	const FDSMSaveFile& GetIndex() const { return _index; }
+
+	// Returns the path of the mapped save file
+	const FString& GetFilePath() const { return _filePath; }
+
+	// Restores the first num history entries, all data slots stay unresolved
+	// Must be called on the game thread
+	void RestoreEntries(FDSMHistoryStore& outStore, int32 num) const { _index.RestoreUnresolved(outStore, num); }
+
+	// Reads the data assets of all unresolved data slots of the history range
+	// Must be called on the game thread
+	void Resolve(FDSMHistoryStore& store, int32 firstIndex, int32 num);
+
+	// Reads the latest version of each data asset of the active branch
+	void ResolveLatest(FDSMHistoryStore& store);
+
+	// Reads the data assets of all unresolved data slots
+	void ResolveAll(FDSMHistoryStore& store);
+
+	// Copies the file into memory and releases the mapping, must be called before the save file is written or deleted
+	// Unresolved data slots can still be resolved afterwards
+	void Detach();
+
+	// Number of snapshots read so far
+	int32 GetResolvedNum() const { return _resolvedNum; }
+
+private:
+	// Reads the data asset of a data slot, if the slot belongs to the file and is not resolved yet
+	void ResolveSlot(FDSMHistoryStore& store, int32 slot);
+
+	FString _filePath;
+	FDSMSaveFile _index;
+	// File mapping, the region must be released before the handle
+	TUniquePtr<IMappedFileHandle> _mappedFile;
+	TUniquePtr<IMappedFileRegion> _mappedRegion;
+	// File content, if the file is not mapped
+	TArray64<uint8> _fileBytes;
+	const uint8* _data = nullptr;
+	int64 _size = 0;
+	// Buffer of decompressed snapshots
+	TArray<uint8> _snapshot;
+	int32 _resolvedNum = 0;
+};
@@ -17,86 +17,98 @@
 #include "Misc/PackageName.h"
 #include "UObject/SavePackage.h"
 #include "HAL/PlatformFilemanager.h"
+#include "DSMHistory.h"
+#include "DSMHistoryPager.h"
+#include "DSMSaveJournal.h"
+#include "DSMAutosave.h"
+#include "DSMSaveFileView.h"
 #include "DSMSaveGame.generated.h"
 
 
 
 
-/**
- * Save Game representation of a node for the DSM State Machine History
- * Stores the node, its owner, and the referenced data assets
- * Each NodeID stores an own copy of the referenced data assets
- */
+DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnAsyncSaveFinished);
+
+// File format used to store DSM save games
+UENUM(BlueprintType)
+enum class EDSMSaveFormat : uint8
+{
+	// Single binary file inside Saved/DSM/SaveGames, see FDSMSaveFile
+	NativeFile UMETA(DisplayName = "Native File"),
+	// Unreal save game slot, has no summary and is not listed by EnumerateSlots
+	SaveGameSlot UMETA(DisplayName = "Save Game Slot"),
+	// Native file, later saves of a slot only append new history elements to a journal, see FDSMSaveJournal
+	JournaledFile UMETA(DisplayName = "Journaled Native File"),
+	// Manifest inside Saved/DSM/SaveGames, history segments and data snapshots are shared by all slots inside Saved/DSM/Store, see FDSMSlotStore
+	SharedStore UMETA(DisplayName = "Shared Store")
+};
+
+// Result of the last save, sizes and timings are logged after each save
 USTRUCT(BlueprintType)
-struct DYNAMICSTATEMACHINE_API FDSMNodeID
+struct FDSMSaveResult
 {
 	GENERATED_BODY()
-	
-	// Node object ptr
-	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Node")
-	TWeakObjectPtr<UDSMDefaultNode> _node = nullptr;
 
-	// Name of the node object
-	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Node")
-	FName _nodeLabel = NAME_None;
+	UPROPERTY(BlueprintReadOnly, Category = "DSM Save Game")
+	FString _slotName;
 
-	// Class of the node
-	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Node")
-	TSubclassOf<UActorComponent> _nodeClass = nullptr;
+	UPROPERTY(BlueprintReadOnly, Category = "DSM Save Game")
+	bool _bSuccess = false;
 
-	// Node owning actor ptr
-	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Owner")
-	TWeakObjectPtr<AActor> _owner = nullptr;
+	// Compression format of the save file, None if the save is not compressed
+	UPROPERTY(BlueprintReadOnly, Category = "DSM Save Game")
+	FName _compressionFormat = NAME_None;
 
-	// Node owning actor name
-	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Owner")
-	FName _ownerLabel = NAME_None;
+	// Size of the saved history before compression
+	UPROPERTY(BlueprintReadOnly, Category = "DSM Save Game")
+	int32 _uncompressedBytes = 0;
 
-	// Node owning actor class
-	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Owner")
-	TSubclassOf<AActor> _ownerClass;
+	// Size of the saved history on disc
+	UPROPERTY(BlueprintReadOnly, Category = "DSM Save Game")
+	int32 _storedBytes = 0;
 
-	// Referenced/modified data assets of the node
-	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Data")
-	TMap<FName, TObjectPtr<UDSMDataAsset>> _data;
+	// Uncompressed bytes divided by stored bytes
+	UPROPERTY(BlueprintReadOnly, Category = "DSM Save Game")
+	float _compressionRatio = 1.f;
 
-	// Names of the referenced/modified data assets
-	UPROPERTY()
-	TMap<FName, FName> _dataRaw;
-
-	// We move the associated data assets to the new package
-	// The package will get saved later on
-	void PrepareSerialization(TObjectPtr<UPackage> newPackage)
-	{
-		_dataRaw.Empty(_data.Num());
-		for (const TTuple<FName, TObjectPtr<UDSMDataAsset>>& elem : _data)
-		{
-			// Add values to the new package we are going to save
-			elem.Value->Rename(nullptr, newPackage);
-			// Store the raw names of the data assets, that we can find them again on load
-			_dataRaw.Add(elem.Key, elem.Value->GetFName());
-		}
-	}
-
-	// We look for the previously stored data-assets and recreate the data-references
-	void PostDeserialization(const TMap<FName, UObject*>& objectsInPackage)
-	{
-		_data.Empty(_dataRaw.Num());
-		for (const TTuple<FName, FName>& elem : _dataRaw)
-		{
-			if (objectsInPackage.Contains(elem.Value))
-			{
-				_data.Add(elem.Key, Cast<UDSMDataAsset>(objectsInPackage[elem.Value]));
-			}
-			else
-			{
-				UE_LOG(LogDSM, Error, TEXT("Could not find data asset with name %s"), *elem.Value.ToString());
-			}
-		}
-	}
+	// Time spent on the game thread to capture the history
+	UPROPERTY(BlueprintReadOnly, Category = "DSM Save Game")
+	float _captureMilliseconds = 0.f;
+
+	// Time spent to serialize, compress and write the save, runs on a background task for async saves
+	UPROPERTY(BlueprintReadOnly, Category = "DSM Save Game")
+	float _writeMilliseconds = 0.f;
 };
 
-DECLARE_DYNAMIC_MULTICAST_DELEGATE(FOnAsyncSaveFinished);
+// Summary of a saved slot, read from the header of the native save file or the manifest of a shared store slot
+USTRUCT(BlueprintType)
+struct FDSMSlotInfo
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly, Category = "DSM Save Game")
+	FString _slotName;
+
+	// Number of saved history elements
+	UPROPERTY(BlueprintReadOnly, Category = "DSM Save Game")
+	int32 _historyNum = 0;
+
+	// Class of the last saved node, the class is not loaded
+	UPROPERTY(BlueprintReadOnly, Category = "DSM Save Game")
+	TSoftClassPtr<UActorComponent> _lastNodeClass;
+
+	// Name of the last saved node
+	UPROPERTY(BlueprintReadOnly, Category = "DSM Save Game")
+	FName _lastNodeLabel = NAME_None;
+
+	// UTC time of the save
+	UPROPERTY(BlueprintReadOnly, Category = "DSM Save Game")
+	FDateTime _timestamp;
+
+	// Save metadata of the state machine data at the time of the save
+	UPROPERTY(BlueprintReadOnly, Category = "DSM Save Game")
+	FString _metadata;
+};
 
 /**
  * Holds the entire DSM state machine history and information relevant for the save game
@@ -109,15 +121,21 @@ class DYNAMICSTATEMACHINE_API UDSMSaveGame : public USaveGame
 
 	// Debug package name, for debuggin purposes only
 	const FString _debugSaveName = "DSMDebug";
-
-	// Referenced data asset in history will be stored in this package
-	UPROPERTY()
-	TObjectPtr<UPackage> _dsmPackage = nullptr;
 protected:
 	// Stores history of executed node
 	// Each node stores a copy of the referenced data, when the node finished executing
 	UPROPERTY(VisibleAnywhere, Category = "DSM History")
-	TArray<FDSMNodeID> _stateMachineHistory{};
+	FDSMHistoryStore _historyStore{};
+
+	// Serialized data assets of the history, one snapshot per data slot
+	// Only filled inside save games
+	UPROPERTY()
+	TArray<FDSMDataSnapshot> _dataSnapshots{};
+
+	// History layout of save games written before the history store existed
+	// Only filled on load, content is moved to the history store on deserialization
+	UPROPERTY()
+	TArray<FDSMNodeID> _stateMachineHistory_DEPRECATED{};
 
 public:
 
@@ -125,6 +143,11 @@ public:
 	UPROPERTY(BlueprintAssignable, Category = "DSM Save Game")
 	FOnAsyncSaveFinished OnAsyncSaveFinished;
 
+	// Written into the summary of native save files and shared store manifests, e.g. playtime or chapter name, see EnumerateSlots
+	// Stored with at most FDSMSaveFile::FSummary::MetadataBytes of UTF-8
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "DSM Save Game")
+	FString _saveMetadata;
+
 	// Should state be kept when loading a history element
 	UPROPERTY(EditAnywhere, Category = "DSM History")
 	bool _keepState = false;
@@ -133,55 +156,274 @@ public:
 	UPROPERTY(EditAnywhere, Category = "DSM History")
 	int32 _indexToLoad = -1;
 
-	// Iterates backwards over the history
-	// Returns the index of the first element which has certain type
+	// Format used by SaveState and AsyncSaveState, LoadState reads all formats
+	UPROPERTY(EditAnywhere, Category = "DSM Save Game")
+	EDSMSaveFormat _saveFormat = EDSMSaveFormat::NativeFile;
+
+	// On load, nodes with idempotent apply events are only applied once at their last history element
+	// All other nodes are replayed in order, see UDSMDefaultNode::_bIdempotentApply
+	UPROPERTY(EditAnywhere, Category = "DSM Save Game")
+	bool _bFastLoad = false;
+
+	// Time per frame in milliseconds used to replay a loaded save game, the replay continues in the next frame afterwards
+	// 0 replays the entire save game in a single frame
+	UPROPERTY(EditAnywhere, Category = "DSM Save Game", meta = (ClampMin = 0))
+	float _replayBudgetMilliseconds = 0.f;
+
+	// Native save files are mapped into memory on load, history elements are restored up to the loaded index and data assets are read on first access
+	// The save file stays mapped until the history is replaced, slots deleted after load are always read entirely
+	UPROPERTY(EditAnywhere, Category = "DSM Save Game")
+	bool _bLazyLoad = false;
+
+	// LoadState restores the slot without reloading the level, see ADSMGameMode::RestoreSlotInPlace
+	// Setting the index to load in the details panel always restores in place
+	UPROPERTY(EditAnywhere, Category = "DSM Save Game")
+	bool _bRestoreInPlace = false;
+
+	// Journaled saves are batched and written once per interval, 0 writes every save immediately
+	UPROPERTY(EditAnywhere, Category = "DSM Save Game|Journal", meta = (ClampMin = 0))
+	float _journalFlushIntervalSeconds = 5.f;
+
+	// Number of journal records after which the journal is merged into the base file on a background task, 0 disables compaction
+	UPROPERTY(EditAnywhere, Category = "DSM Save Game|Journal", meta = (ClampMin = 0))
+	int32 _journalCompactionRecords = 16;
+
+	// Autosaves the history while the state machine runs, see FDSMAutosave
+	// Autosaves are always written as journaled native save files, see _journalCompactionRecords
+	UPROPERTY(EditAnywhere, Category = "DSM Save Game|Autosave")
+	bool _bAutosave = false;
+
+	// Slot autosaves are written to
+	UPROPERTY(EditAnywhere, Category = "DSM Save Game|Autosave")
+	FString _autosaveSlotName = TEXT("DSMAutosave");
+
+	// An autosave is requested after this number of new history elements, 0 disables the trigger
+	UPROPERTY(EditAnywhere, Category = "DSM Save Game|Autosave", meta = (ClampMin = 0))
+	int32 _autosaveHistoryInterval = 0;
+
+	// An autosave is requested every interval, 0 disables the trigger
+	UPROPERTY(EditAnywhere, Category = "DSM Save Game|Autosave", meta = (ClampMin = 0))
+	float _autosaveIntervalSeconds = 0.f;
+
+	// An autosave is requested whenever a node of these classes finished, e.g. save points
+	UPROPERTY(EditAnywhere, Category = "DSM Save Game|Autosave")
+	TArray<TSubclassOf<UDSMDefaultNode>> _autosaveNodeClasses;
+
+	// Requests within this time are merged into a single autosave, 0 captures every request immediately
+	UPROPERTY(EditAnywhere, Category = "DSM Save Game|Autosave", meta = (ClampMin = 0))
+	float _autosaveCoalesceSeconds = 1.f;
+
+	// Maximum memory in MB used by the data of the history
+	// If exceeded, data of old history segments is paged to a file inside the Saved directory
+	// 0 disables paging
+	UPROPERTY(EditAnywhere, Category = "DSM History|Paging", meta = (ClampMin = 0))
+	int32 _historyMemoryBudgetMB = 0;
+
+	// Number of history elements per paged segment
+	UPROPERTY(EditAnywhere, Category = "DSM History|Paging", meta = (ClampMin = 1))
+	int32 _historySegmentSize = 256;
+
+	// Number of segments paged in ahead, when the history is accessed in order
+	UPROPERTY(EditAnywhere, Category = "DSM History|Paging", meta = (ClampMin = 0))
+	int32 _historyPrefetchSegments = 2;
+
+	// Storage of paged out history segments
+	UPROPERTY(EditAnywhere, Category = "DSM History|Paging")
+	EDSMColdHistoryStorage _coldHistoryStorage = EDSMColdHistoryStorage::PageFile;
+
+	// Compression format used for compressed memory storage, e.g. LZ4, Oodle or Zlib
+	UPROPERTY(EditAnywhere, Category = "DSM History|Paging")
+	FName _historyCompressionFormat = NAME_LZ4;
+
+	// Number of paged in segments, which stay resident after access
+	UPROPERTY(EditAnywhere, Category = "DSM History|Paging", meta = (ClampMin = 0))
+	int32 _pagedInSegmentCacheSize = 4;
+
+	// Returns the index of the most recent history element which has certain type
 	// E.g. Can be used to find the index of the last save point, or similar
 	UFUNCTION(BlueprintCallable, Category = "DSM History")
 	int32 GetRecentHistoryIndexByClass(TSubclassOf<class UDSMDefaultNode> type) const;
 
+	// Returns the index of the most recent history element matching the key of the passed index
+	// E.g. the last element referencing a certain data asset
+	UFUNCTION(BlueprintCallable, Category = "DSM History|Query")
+	int32 GetRecentHistoryIndex(EDSMHistoryIndex index, FName key) const;
+
+	// Returns up to maxResults history indices of elements with certain type, starting at firstHistoryIndex
+	// Pass the last returned index + 1 as firstHistoryIndex to get the next page, maxResults of 0 returns all indices
+	UFUNCTION(BlueprintCallable, Category = "DSM History|Query")
+	TArray<int32> QueryHistoryByClass(TSubclassOf<class UDSMDefaultNode> type, int32 firstHistoryIndex = 0, int32 maxResults = 0) const;
+
+	// Returns up to maxResults history indices of elements matching the key of the passed index, starting at firstHistoryIndex
+	// Pass the last returned index + 1 as firstHistoryIndex to get the next page, maxResults of 0 returns all indices
+	UFUNCTION(BlueprintCallable, Category = "DSM History|Query")
+	TArray<int32> QueryHistory(EDSMHistoryIndex index, FName key, int32 firstHistoryIndex = 0, int32 maxResults = 0) const;
+
+	// Returns the number of history elements
+	UFUNCTION(BlueprintCallable, Category = "DSM History|Query")
+	int32 GetStateMachineHistoryNum() const { return _historyStore.Num(); }
+
+	// Returns num history elements starting at firstIndex
+	// Prefer this function over GetStateMachineHistory, if only a part of the history is shown
+	UFUNCTION(BlueprintCallable, Category = "DSM History|Query")
+	TArray<FDSMNodeID> GetStateMachineHistoryRange(int32 firstIndex, int32 num) const;
+
 	// Returns the entire state machine history
+	// History elements are materialized from the compact history store
+	// Paged out segments are paged in one at a time and paged out again, if the memory budget is exceeded
 	UFUNCTION(BlueprintCallable, Category = "DSM History")
-	TArray<FDSMNodeID> GetStateMachineHistory() const { return _stateMachineHistory; }
+	TArray<FDSMNodeID> GetStateMachineHistory() const;
+
+	// Returns a deep copy of a data asset, as it was at the passed history index
+	// If the data asset was not written until then, a copy of the default data asset is returned
+	UFUNCTION(BlueprintCallable, Category = "DSM History|Query")
+	UDSMDataAsset* GetDataCopyAtHistoryIndex(UDSMDataAsset* defaultDataAsset, int32 historyIndex) const;
+
+	// Data requests return the data asset versions of the passed history index instead of the latest version
+	// Used while the history is replayed on load, INDEX_NONE returns the latest versions again
+	void SetReplayIndex(int32 historyIndex) { _replayIndex = historyIndex; }
+
+	// Returns the compact history store
+	const FDSMHistoryStore& GetHistoryStore() const { return _historyStore; }
+
+	// Creates a new history branch sharing all history elements until and including historyIndex
+	// No history element is copied, use SwitchHistoryBranch to continue on the new branch
+	UFUNCTION(BlueprintCallable, Category = "DSM History|Branches")
+	bool ForkHistory(FName branchName, int32 historyIndex);
+
+	// New history elements are added to the passed branch, all history indices refer to this branch afterwards
+	UFUNCTION(BlueprintCallable, Category = "DSM History|Branches")
+	bool SwitchHistoryBranch(FName branchName);
+
+	// Removes a history branch and releases its data, the active branch and branches other branches were forked from can not be dropped
+	UFUNCTION(BlueprintCallable, Category = "DSM History|Branches")
+	bool DropHistoryBranch(FName branchName);
+
+	// Returns all history branches
+	UFUNCTION(BlueprintCallable, Category = "DSM History|Branches")
+	TArray<FDSMHistoryBranchInfo> GetHistoryBranches() const { return _historyStore.GetBranches(); }
+
+	// Returns the name of the branch new history elements are added to
+	UFUNCTION(BlueprintCallable, Category = "DSM History|Branches")
+	FName GetActiveHistoryBranch() const { return _historyStore.GetActiveBranch(); }
 
 	// Async saves the DSM history to disc using the defined slot name
+	// Only the history copy is created on the game thread, serialization and file IO run on a background task
 	// You can subscribe the OnAsyncSaveFinished delegate to get a callback, when saving has finished
-	// In order to delete the save game from disc, you need to delete the save game folder and the save game package (both have same name)
-	// You can find the save game package inside the content folder or the save game folder
 	UFUNCTION(BlueprintCallable, Category = "DSM Save Game")
 	void AsyncSaveState(int32 historyIndex, const FString& slotName, bool keepState = false);
 
 	// Saves the DSM history to disc using the defined slot name
-	// In order to delete the save game from disc, you need to delete the save game folder and the save game package (both have same name)
-	// You can find the save game package inside the content folder or the save game folder
 	UFUNCTION(BlueprintCallable, Category = "DSM Save Game")
 	void SaveState(int32 historyIndex, const FString& slotName, bool keepState = false) const;
 
+	// Returns sizes and timings of the last save of this save game
+	UFUNCTION(BlueprintCallable, Category = "DSM Save Game")
+	FDSMSaveResult GetLastSaveResult() const { return _lastSaveResult; }
+
 	// Loads previously stored state, either from disc or from memory
+	// Memory slots are found before slots on disc with the same name
 	// deleteSlotAfterLoad, if true save game and package is deleted after load
 	UFUNCTION(BlueprintCallable, Category = "DSM Save Game")
 	void LoadState(const FString& slotName, bool deleteSlotAfterLoad) const;
 
+	// Restores the state of a history element without reloading the level, see ADSMGameMode::RestoreStateInPlace
+	// keepState keeps all history elements, otherwise the history ends at historyIndex
+	UFUNCTION(BlueprintCallable, Category = "DSM Save Game")
+	void RestoreState(int32 historyIndex, bool keepState = false) const;
+
+	// Captures the history into a named memory slot without writing to disc, e.g. for quick saves
+	// The slot shares the data asset versions with the history, only the compact history elements are copied
+	// flushToDisc additionally writes the slot to disc on a background task, see FlushMemorySlot
+	UFUNCTION(BlueprintCallable, Category = "DSM Save Game|Memory")
+	void SaveStateToMemory(int32 historyIndex, const FString& slotName, bool keepState = false, bool flushToDisc = false);
+
+	// Writes a memory slot as native save file on a background task, the slot stays in memory
+	UFUNCTION(BlueprintCallable, Category = "DSM Save Game|Memory")
+	void FlushMemorySlot(const FString& slotName);
+
+	// Returns true if a memory slot with the passed name exists
+	UFUNCTION(BlueprintCallable, Category = "DSM Save Game|Memory")
+	static bool HasMemorySlot(const FString& slotName);
+
+	// Releases a memory slot, the save game on disc is not affected
+	UFUNCTION(BlueprintCallable, Category = "DSM Save Game|Memory")
+	static void DeleteMemorySlot(const FString& slotName);
+
+	// Requests an autosave, requests within the coalescing window are merged into a single autosave
+	// Does nothing if autosaves are disabled or the state machine is not running
+	UFUNCTION(BlueprintCallable, Category = "DSM Save Game|Autosave")
+	void RequestAutosave() { _autosave.Request(); }
+
+	// Starts the autosave scheduler, called when the state machine starts
+	void StartAutosave();
+
+	// Stops the autosave scheduler, captured autosaves are written in the background
+	void StopAutosave();
+
+	// Returns the summary of a native, journaled or shared store slot, only the header of the file is read
+	// Returns false if the slot has no such file, slots saved as Save Game Slot have no summary
+	UFUNCTION(BlueprintCallable, Category = "DSM Save Game|Slots")
+	static bool GetSlotInfo(const FString& slotName, FDSMSlotInfo& slotInfo);
+
+	// Returns the summaries of all native, journaled and shared store slots, most recent save first
+	// Slots saved as Save Game Slot are not listed, use UGameplayStatics::DoesSaveGameExist for them
+	// Only the headers are read, so the time does not depend on the size of the saves
+	// Does not wait for background writes, their slots are listed with the last written summary
+	UFUNCTION(BlueprintCallable, Category = "DSM Save Game|Slots")
+	static TArray<FDSMSlotInfo> EnumerateSlots();
+
+	// Starts reading a slot once all pending saves are written, e.g. while the level is loaded
+	// The next LoadSlot of this slot waits for the result instead of reading the slot again, saving the slot in the meantime discards the result
+	// Native save files are only read into memory, they are decompressed while the history is recreated
+	// bLazy only maps the native save file and reads its index table, see FDSMSaveFileView
+	static void PrefetchSlot(const FString& slotName, bool bLazy = false);
+
+	// Loads a save game of any format from disc, returns nullptr if the slot does not exist
+	// Only data assets are created on the game thread, if the slot was prefetched
+	// bLazy restores native save files without journal up to the loaded index, data assets are read on first access
+	static TObjectPtr<UDSMSaveGame> LoadSlot(const FString& slotName, bool bLazy = false);
+
+	// Deletes the save game of a slot from disc and from memory
+	static void DeleteSlot(const FString& slotName);
+
+	// Creates a save game holding the history up to historyIndex, all elements if keepState is set
+	// Data asset versions are shared with this history, paged out data is loaded again before
+	TObjectPtr<UDSMSaveGame> CopyHistory(int32 historyIndex, bool keepState) const;
+
 	// Replaces the state machine history
 	// This is called on load
-	void SetStateMachineHistory(const TArray<FDSMNodeID>& history)
-	{
-		_stateMachineHistory = history;
-		UpdateData();
-	}
+	void SetStateMachineHistory(const TArray<FDSMNodeID>& history);
+
+	// Replaces the state machine history with the first num elements of the passed store
+	void SetStateMachineHistory(const FDSMHistoryStore& history, int32 num);
+
+	// Moves history, paged data and lazily loaded save file of another save game into this save game, the other history is empty afterwards
+	// Journaled saves of both save games start with a new base file
+	void MoveHistoryFrom(UDSMSaveGame& other);
 
 	// Adds an element to the state machine history
-	void PushStateMachineElement(const FDSMNodeID& node)
-	{
-		_stateMachineHistory.Push(node);
-		UpdateData();
-	}
-
-	// Creates a package and a save game files
-	// Stores DSM history to save game and referenced data assets to package
-	void PrepareSerialization(const FString& slotName);
-
-	// Loads package and save game from disc or from memory
-	// Moves referenced data assets to transient package and recreates the previous history
+	void PushStateMachineElement(const FDSMNodeID& node);
+
+	// Adds an element of another history to the state machine history
+	void PushStateMachineElement(const FDSMHistoryStore& history, int32 index);
+
+	// Makes sure the data of the history range is in memory
+	// Data of paged out history segments is loaded again from the page file, data of lazily loaded save files from the save file
+	void EnsureHistoryResident(int32 firstIndex, int32 num) const;
+
+	// Resolves unloaded data of the history from the lazily loaded save file, the history must be restored from the same file
+	// Latest versions of all data assets are read immediately
+	void SetSaveFileView(TSharedPtr<FDSMSaveFileView> saveFileView);
+
+	// Returns the lazily loaded save file of this history, nullptr if the history is entirely in memory
+	TSharedPtr<FDSMSaveFileView> GetSaveFileView() const { return _saveFileView; }
+
+	// Writes the referenced data assets as snapshots into the save game
+	void PrepareSerialization();
+
+	// Recreates the referenced data assets inside the transient package
+	// Save games of older versions load the data assets from their package
 	void PostDeserialization(TWeakObjectPtr<UObject> parent, const FString& slotName);
 
 	// Adds a node element to the history
@@ -196,11 +438,26 @@ private:
 	// Searches for the latest version of a data asset inside the history
 	TWeakObjectPtr<UDSMDataAsset> GetLatestDataAssetOfType(const TWeakObjectPtr<UDSMDataAsset> DefaultDataAssetObject) const;
 
+	// Looks up the data asset version valid at the history index inside the version chain of the data asset
+	TWeakObjectPtr<UDSMDataAsset> GetDataAssetAtHistoryIndex(FName key, int32 historyIndex) const;
+
+	// History index used for data requests during replay
+	int32 _replayIndex = INDEX_NONE;
+
 private:
 
 	// Shows the latest version of all referenced data assets in the editor for debug purposes
 	void UpdateData();
 
+	// Called after a new element was added to the history
+	void OnHistoryElementAdded(int32 index);
+
+	// Applies the paging settings to the history pager
+	void ConfigureHistoryPager() const;
+
+	// Pages cold history segments to disc, paging only changes residency, never the content of the history
+	mutable FDSMHistoryPager _historyPager;
+
 	// Converts a save game name to a package name path
 	FString NameToPackageName(const FString& name){	return FString::Printf(TEXT("/Game/%s/%s"), *name, *name);}
 
@@ -209,11 +466,63 @@ private:
 	TMap<FName, TWeakObjectPtr<UDSMDataAsset>> _data;
 
 #if WITH_EDITOR
-	bool CanEditChange(const FProperty* InProperty) const override;
+	// Setting the index to load in the details panel restores it in place
+	void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
 #endif
 
+	void BeginDestroy() override;
+
 	TObjectPtr<UDSMSaveGame> SaveState_Internal(int32 historyIndex, const FString& slotName, bool keepState = false) const;
 
+	// Captures the history for the native save format
+	bool CaptureSaveFile(int32 historyIndex, const FString& slotName, bool keepState, struct FDSMSaveFile& outSaveFile) const;
+
+	// Applies the compression settings and releases the lazily loaded save file of the slot
+	// Save games of the other formats are removed after the native save file was written
+	void PrepareSaveFile(const FString& slotName, FDSMSaveFile& saveFile) const;
+
+	// Writes a captured native save file on the save file pipe and reports the result on the game thread
+	void WriteSaveFileAsync(TSharedPtr<FDSMSaveFile> saveFile, const FString& slotName, double captureSeconds);
+
+	// Captures the history elements added since the last journaled save of the slot, bWait blocks until they are written
+	void SaveJournal(int32 historyIndex, const FString& slotName, bool keepState, bool bWait) const;
+
+	// Applies the journal settings to the save journal
+	void ConfigureSaveJournal() const;
+
+	// Writes only new history elements of journaled saves
+	mutable FDSMSaveJournal _saveJournal;
+
+	// Captures the history elements added since the previous autosave, returns false if there is nothing to save
+	bool CaptureAutosave() const;
+
+	// Schedules autosaves
+	FDSMAutosave _autosave;
+
+	// Writes only new history elements of autosaves, independent of journaled saves to other slots
+	mutable FDSMSaveJournal _autosaveJournal;
+
+	// Creates the save game of a prefetched slot, returns false if the slot was not prefetched
+	static bool LoadPrefetchedSlot(const FString& slotName, bool bLazy, TObjectPtr<UDSMSaveGame>& outSaveGame);
+
+	// Creates a save game from a lazily loaded save file, bLazy false reads all data assets immediately
+	static TObjectPtr<UDSMSaveGame> LoadSaveFileView(TSharedPtr<FDSMSaveFileView> saveFileView, bool bLazy);
+
+	// Releases the mapping of the lazily loaded save file, before the save file of the slot is written or deleted
+	void DetachSaveFileView(const FString& slotName) const;
+
+	// Save file the history was lazily loaded from, unresolved data is read from this file
+	TSharedPtr<FDSMSaveFileView> _saveFileView;
+
+	// Called on the game thread after an async save finished
+	static void OnAsyncSaveCompleted(TWeakObjectPtr<UDSMSaveGame> saveGame, const FDSMSaveResult& result);
+
+	// Stores and logs the result of a finished save
+	void SetSaveResult(const FDSMSaveResult& result) const;
+
+	// Result of the last save, SaveState is const and only updates this diagnostic
+	mutable FDSMSaveResult _lastSaveResult;
+
 
 
 public:
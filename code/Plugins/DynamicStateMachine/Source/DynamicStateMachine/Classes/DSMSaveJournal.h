@@ -0,0 +1,123 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/Ticker.h"
+#include "Tasks/Task.h"
+#include "Tasks/Pipe.h"
+#include "DSMSaveFile.h"
+#include <atomic>
+
+/**
+ * Append only save journal of the native save format
+ * The first save of a slot writes a base file, later saves only capture the history entries added since the previous save.
+ * Captured entries are batched and appended as a single record to Saved/DSM/SaveGames/<slot>.dsmj once the flush interval elapsed.
+ * On load the base file is restored and all journal records are replayed. A compactor merges base file and journal,
+ * after a number of records was appended. All file IO runs in order on a background pipe.
+ */
+class DYNAMICSTATEMACHINE_API FDSMSaveJournal
+{
+public:
+	// Called on a background task after a base file or journal record was written
+	using FOnWritten = TFunction<void(const FString& slotName, const FDSMSaveFile& written, bool bSuccess, double writeSeconds)>;
+
+	// Identifies journal records
+	static constexpr uint32 RecordMagic = 0x44534D4A;
+
+	~FDSMSaveJournal() { Reset(); }
+
+	// Sets the flush interval in seconds and the number of records after which the journal is merged into the base file
+	void Configure(float flushIntervalSeconds, int32 compactionRecords, FOnWritten onWritten);
+
+	// Captures the first num entries of the active branch for the slot, only entries added since the previous save are captured
+	// A base file is captured if the slot or the store changed or the saved entries are not a prefix of the history anymore, see FDSMHistoryStore::GetGeneration
+	// A base file is captured as well after a write of this journal failed, later records would not continue a base file
+	// Must be called on the game thread, the data of the captured entries must be resident
+	void Capture(const FDSMHistoryStore& store, int32 num, const FString& slotName, int32 indexToLoad, bool keepState, FName compressionFormat, int32 compressionBlockSize, const FString& metadata = FString());
+
+	// Returns the first history index of the store, which is not captured yet for the slot
+	int32 GetCapturedNum(const FString& slotName, const FDSMHistoryStore& store) const
+	{
+		return slotName == _slotName && &store == _store && store.GetGeneration() == _storeGeneration && !*_bWriteFailed ? _capturedNum : 0;
+	}
+
+	// Writes captured entries once the flush interval elapsed, multiple captures are written as one record
+	void ScheduleFlush();
+
+	// Writes captured entries, bWait blocks until they are on disc
+	void Flush(bool bWait);
+
+	// Writes captured entries and starts with a new base file on the next save
+	void Reset();
+
+	// Starts with a new base file on the next save of the slot, must be called if the slot is written in another format
+	void Invalidate(const FString& slotName)
+	{
+		if (slotName == _slotName)
+		{
+			Reset();
+		}
+	}
+
+	// Replays the journal of a slot on top of the history restored from the base file
+	// outSaveFile receives index to load and keep state of the latest record
+	static bool Replay(const FString& slotName, FDSMHistoryStore& outStore, FDSMSaveFile& outSaveFile);
+
+	// Appends all journal records of a slot to the save file read from its base file, can be called from any thread
+	static bool AppendRecords(const FString& slotName, FDSMSaveFile& saveFile);
+
+	// Reads the summary of a slot from the headers of its base file and of its last complete journal record, can be called from any thread
+	static bool ReadSummary(const FString& slotName, FDSMSaveFile::FSummary& outSummary);
+
+	// Replaces the base file of a slot and removes its journal, can be called from any thread
+	// The base file is written to a temporary file first and renamed afterwards, so an interrupted write keeps the previous base file
+	static bool WriteBaseFile(const FString& slotName, FDSMSaveFile& saveFile);
+
+	// Merges the journal of a slot into its base file, can be called from any thread
+	static bool Compact(const FString& slotName);
+
+	// Blocks until all pending base files, journal records, compactions and launched writes are written
+	static void WaitForPendingWrites();
+
+	// Runs a write of another save format in order with all base files and journal records, WaitForPendingWrites waits for it as well
+	static UE::Tasks::FTask LaunchWrite(TUniqueFunction<void()> write);
+
+	// Runs a read of a slot once all pending writes are written, no worker thread waits for them in the meantime
+	template<typename TReadBody>
+	static auto LaunchRead(TReadBody&& read)
+	{
+		return GetSaveFilePipe().Launch(UE_SOURCE_LOCATION, Forward<TReadBody>(read));
+	}
+
+	// Returns the path of the journal of a slot inside the Saved directory
+	static FString GetFilePath(const FString& slotName);
+
+private:
+	// Base files, journal records, compactions and launched writes and reads of all slots run in order
+	static UE::Tasks::FPipe& GetSaveFilePipe();
+
+	// Reads all complete records of a journal, a torn record at the end of the journal is ignored
+	// Records ending before baseNum belong to a previous base file and are skipped
+	static bool ReadRecords(const FString& slotName, int32 baseNum, TFunctionRef<void(FDSMSaveFile&)> onRecord);
+
+	FString _slotName;
+	// Store and generation of the captured entries
+	const FDSMHistoryStore* _store = nullptr;
+	uint32 _storeGeneration = 0;
+	int32 _capturedNum = 0;
+	int32 _recordNum = 0;
+	float _flushInterval = 0.f;
+	int32 _compactionRecords = 0;
+	FOnWritten _onWritten;
+
+	// Captured, but not yet written entries
+	TSharedPtr<FDSMSaveFile> _pending;
+	// Pending capture is a base file, otherwise a journal record
+	bool _bPendingBase = false;
+	// History index of the first pending entry
+	int32 _pendingFirstIndex = 0;
+	// Set on the save file pipe if a base file or record of this journal was not written, cleared by the next written base file
+	TSharedRef<std::atomic<bool>, ESPMode::ThreadSafe> _bWriteFailed = MakeShared<std::atomic<bool>, ESPMode::ThreadSafe>(false);
+	FTSTicker::FDelegateHandle _flushHandle;
+};
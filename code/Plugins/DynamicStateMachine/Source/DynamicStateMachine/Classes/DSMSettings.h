@@ -0,0 +1,43 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DeveloperSettings.h"
+#include "DSMSettings.generated.h"
+
+/**
+ * Project wide settings of the dynamic state machine
+ * Can be found in the project settings under Plugins, values are stored inside DefaultGame.ini
+ */
+UCLASS(Config = Game, DefaultConfig, meta = (DisplayName = "Dynamic State Machine"))
+class DYNAMICSTATEMACHINE_API UDSMSettings : public UDeveloperSettings
+{
+	GENERATED_BODY()
+
+public:
+	UDSMSettings() { CategoryName = TEXT("Plugins"); }
+
+	// Compression format of native save files, e.g. Oodle, LZ4 or Zlib
+	// None writes uncompressed save files, files of any format can always be loaded
+	UPROPERTY(Config, EditAnywhere, Category = "DSM Save Game")
+	FName _saveCompressionFormat = NAME_None;
+
+	// Uncompressed size of a compressed save file block in KB, only a single block is decompressed at a time on load
+	UPROPERTY(Config, EditAnywhere, Category = "DSM Save Game", meta = (ClampMin = 16, ClampMax = 16384))
+	int32 _saveCompressionBlockSizeKB = 256;
+
+	// Number of history elements of a segment of the shared store, see FDSMSlotStore
+	// Slots only share segments with equal history elements, smaller segments share more but need more blobs
+	UPROPERTY(Config, EditAnywhere, Category = "DSM Save Game", meta = (ClampMin = 1))
+	int32 _sharedStoreSegmentSize = 64;
+
+	// History of the DSM game mode is moved to the DSM game mode of the next level on level transitions, see UDSMHistorySubsystem
+	// If disabled, each level starts with an empty history unless a save game is loaded
+	UPROPERTY(Config, EditAnywhere, Category = "DSM History")
+	bool _bCarryHistoryAcrossLevels = false;
+
+	// Length of a tick of the DSM timer wheel in seconds, node timers fire at the first tick after their deadline
+	UPROPERTY(Config, EditAnywhere, Category = "DSM Timers", meta = (ClampMin = 0.001))
+	float _timerResolution = 0.05f;
+};
@@ -0,0 +1,72 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/SecureHash.h"
+#include "DSMSaveFile.h"
+
+/**
+ * Content addressed slot storage of the native save format
+ * The history of a save file is split into segments of a fixed number of history elements. Segments and data snapshots are
+ * stored as blobs inside Saved/DSM/Store, named by the SHA1 hash of their uncompressed content. A slot only stores a manifest
+ * Saved/DSM/SaveGames/<slot>.dsmm containing the summary and the hashes of its segments. Slots sharing the beginning of their
+ * history share the blobs, so writing a slot only writes the blobs missing inside the store.
+ * Blobs are never changed after they were written, blobs not referenced by any manifest are removed by CollectGarbage.
+ */
+class DYNAMICSTATEMACHINE_API FDSMSlotStore
+{
+public:
+	// Identifies manifests and blobs
+	static constexpr uint32 ManifestMagic = 0x44534D4D;
+	static constexpr uint32 BlobMagic = 0x44534D42;
+
+	// Increased whenever the manifest, segment or blob layout changes, manifests of other versions are not read
+	static constexpr int32 LatestVersion = 1;
+
+	// Writes the save file as manifest of the slot, only segments and snapshots missing inside the store are written
+	// Removes native file and journal of the slot, can be called from any thread
+	// Stored bytes of the save file only count written blobs and the manifest
+	static bool Write(const FString& slotName, FDSMSaveFile& saveFile, int32 segmentSize);
+
+	// Reads the manifest of the slot and all its segments and snapshots, can be called from any thread
+	static bool Read(const FString& slotName, FDSMSaveFile& outSaveFile);
+
+	// Reads the summary of the slot from its manifest, can be called from any thread
+	static bool ReadSummary(const FString& slotName, FDSMSaveFile::FSummary& outSummary);
+
+	// Removes all blobs not referenced by any manifest, returns the number of removed blobs
+	// Nothing is removed if a manifest or segment can not be read, can be called from any thread
+	static int32 CollectGarbage();
+
+	// Returns the path of the manifest of a slot inside the Saved directory
+	static FString GetManifestPath(const FString& slotName);
+
+	// Returns the path of a blob inside the store
+	static FString GetBlobPath(const FSHAHash& hash);
+
+private:
+	// Manifest of a slot, segments are listed in history order
+	struct FManifest
+	{
+		int32 _version = LatestVersion;
+		FDSMSaveFile::FSummary _summary;
+		int32 _indexToLoad = INDEX_NONE;
+		bool _bKeepState = false;
+		TArray<FSHAHash> _segments;
+	};
+
+	// Magic, version and summary are read first, so save menus can skip the segment list
+	static bool SerializeManifest(FArchive& ar, FManifest& manifest, bool bSummaryOnly = false);
+	static bool ReadManifest(const FString& filePath, FManifest& outManifest, bool bSummaryOnly = false);
+
+	// Writes the blob unless it exists already, returns the number of written bytes
+	// Blobs are written to a temporary file first and renamed afterwards, so an interrupted write never leaves a torn blob
+	static bool WriteBlob(const FSHAHash& hash, TArrayView<const uint8> bytes, FName compressionFormat, int64& outStoredBytes);
+
+	// Reads and decompresses a blob, the content is verified against its hash
+	static bool ReadBlob(const FSHAHash& hash, TArray<uint8>& outBytes);
+
+	// Serializes a segment, the hashes of the snapshots follow the tables of the segment
+	static bool SerializeSegment(FArchive& ar, FDSMSaveFile& segment, TArray<FSHAHash>& snapshots);
+};
@@ -0,0 +1,53 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DSMDataAsset.h"
+#include "Serialization/ObjectAndNameAsStringProxyArchive.h"
+
+
+/**
+ * Archive used to serialize data asset snapshots
+ * Objects owned by the snapshot are written as index into the snapshot object table, all other objects by path
+ * Without bLoadIfFindFails, objects are only searched in memory, e.g. on worker threads
+ */
+class DYNAMICSTATEMACHINE_API FDSMSnapshotArchive : public FObjectAndNameAsStringProxyArchive
+{
+public:
+	FDSMSnapshotArchive(FArchive& innerArchive, TArray<UObject*>& objectTable, bool bLoadIfFindFails = true)
+		: FObjectAndNameAsStringProxyArchive(innerArchive, bLoadIfFindFails)
+		, _objectTable(objectTable)
+	{
+	}
+
+	virtual FArchive& operator<<(UObject*& obj) override;
+	virtual FArchive& operator<<(FObjectPtr& obj) override;
+
+	// True if a referenced object was not found in memory and was not loaded
+	bool HasUnresolvedReferences() const { return _bUnresolved; }
+
+private:
+	TArray<UObject*>& _objectTable;
+	bool _bUnresolved = false;
+};
+
+/**
+ * Converts data asset copies of the history to self contained byte buffers and back
+ * A snapshot contains the data asset and all objects owned by it (e.g. instanced quest actions)
+ */
+struct DYNAMICSTATEMACHINE_API FDSMSnapshot
+{
+	// Writes the data asset and all objects owned by it into bytes
+	static void Write(const UDSMDataAsset* asset, TArray<uint8>& outBytes);
+
+	// Recreates a data asset from bytes inside the transient package
+	// Returns nullptr if the bytes are invalid or the class can not be found
+	static UDSMDataAsset* Read(TArrayView<const uint8> bytes);
+
+	// Recreates the data assets of many snapshots, outAssets receives one data asset per snapshot, nullptr for empty or invalid snapshots
+	// Objects are created on the game thread, their properties are read in chunks on worker threads
+	// Snapshots referencing objects, which are not in memory, are read again on the game thread and load these objects
+	// Must be called on the game thread
+	static void ReadParallel(TArrayView<const TArrayView<const uint8>> snapshots, TArray<UDSMDataAsset*>& outAssets);
+};
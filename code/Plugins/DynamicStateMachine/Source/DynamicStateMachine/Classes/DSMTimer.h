@@ -0,0 +1,168 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DSMDataAsset.h"
+#include "DSMTimer.generated.h"
+
+// Action performed when a timer of a DSM node fires
+UENUM(BlueprintType)
+enum class EDSMTimerAction : uint8
+{
+	// Ends the state of the node, if the node is still active. Pending end state timers are cleared when the node ends
+	EndState UMETA(DisplayName = "End State"),
+	// Requests a self transition of the node, only possible if there is no active node
+	SelfTransition UMETA(DisplayName = "Self Transition")
+};
+
+/**
+ * Identifies a timer of the DSM timer wheel
+ * Handles stay valid after a save game was loaded, cleared and fired timers invalidate their handle
+ */
+USTRUCT(BlueprintType)
+struct DYNAMICSTATEMACHINE_API FDSMTimerHandle
+{
+	GENERATED_BODY()
+
+	// Index inside the timer pool of the timer wheel
+	UPROPERTY()
+	int32 _index = INDEX_NONE;
+
+	// Unique serial of the timer, distinguishes timers reusing the same index
+	UPROPERTY()
+	int32 _serial = 0;
+
+	bool IsValid() const { return _index != INDEX_NONE; }
+	bool operator==(const FDSMTimerHandle& other) const { return _index == other._index && _serial == other._serial; }
+};
+
+/**
+ * Pending timer of a DSM node
+ * Nodes are stored by name, so timers can be restored from the history
+ */
+USTRUCT()
+struct DYNAMICSTATEMACHINE_API FDSMTimerRecord
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	FDSMTimerHandle _handle;
+
+	// Name of the node object
+	UPROPERTY()
+	FName _nodeLabel = NAME_None;
+
+	// Name of the node owning actor
+	UPROPERTY()
+	FName _ownerLabel = NAME_None;
+
+	UPROPERTY()
+	EDSMTimerAction _action = EDSMTimerAction::EndState;
+
+	// Time of the timer wheel the timer fires at
+	UPROPERTY()
+	double _deadline = 0.0;
+};
+
+/**
+ * Pending timers of the DSM game mode
+ * Stored as data of history elements, whenever a state ends while timers are pending
+ */
+UCLASS()
+class DYNAMICSTATEMACHINE_API UDSMTimerData : public UDSMDataAsset
+{
+	GENERATED_BODY()
+public:
+	// Time of the timer wheel when the timers were stored
+	UPROPERTY(VisibleAnywhere, Category = "Timers")
+	double _time = 0.0;
+
+	// Serial of the next scheduled timer
+	UPROPERTY(VisibleAnywhere, Category = "Timers")
+	int32 _nextSerial = 1;
+
+	UPROPERTY(VisibleAnywhere, Category = "Timers")
+	TArray<FDSMTimerRecord> _timers{};
+};
+
+/**
+ * Hierarchical timing wheel of the DSM game mode
+ * Time is split into ticks of a fixed resolution. Each level of the wheel has 64 slots, a slot of level n covers 64^n ticks.
+ * Timers are stored inside intrusive lists of the slot their deadline falls into, scheduling and clearing a timer is O(1).
+ * Whenever a level wraps around, the timers of the current slot of the next level are moved down.
+ * Advancing the wheel by a tick only touches the current slot, no matter how many timers are pending.
+ */
+class DYNAMICSTATEMACHINE_API FDSMTimerWheel
+{
+public:
+	static constexpr int32 LevelBits = 6;
+	static constexpr int32 LevelSlots = 1 << LevelBits;
+	static constexpr int32 LevelNum = 4;
+
+	// Resolution is the length of a tick in seconds, timers fire at the first tick after their deadline
+	explicit FDSMTimerWheel(float resolution = 0.05f);
+
+	// Schedules a timer at record._deadline, the handle of the record is ignored
+	FDSMTimerHandle Schedule(const FDSMTimerRecord& record);
+
+	// Clears a pending timer, returns false if the timer fired or was cleared already
+	bool Clear(const FDSMTimerHandle& handle);
+
+	// Returns the pending timer, or nullptr
+	const FDSMTimerRecord* Find(const FDSMTimerHandle& handle) const;
+
+	// Clears all pending timers matching the predicate, returns the number of cleared timers
+	int32 ClearIf(TFunctionRef<bool(const FDSMTimerRecord&)> predicate);
+
+	// Advances the time of the wheel, fired timers are added to outFired ordered by their deadline tick
+	void Advance(double deltaSeconds, TArray<FDSMTimerRecord>& outFired);
+
+	// Returns the current time of the wheel in seconds
+	double GetTime() const { return _time; }
+
+	// Returns the number of pending timers
+	int32 Num() const { return _num; }
+
+	// Stores time and pending timers
+	void Export(UDSMTimerData& outData) const;
+
+	// Replaces time and pending timers, handles of the stored timers stay valid
+	void Restore(const UDSMTimerData& data);
+
+	// Clears all timers and resets the time
+	void Empty();
+
+private:
+	struct FTimer
+	{
+		FDSMTimerRecord _record;
+		uint64 _tick = 0;
+		int32 _prev = INDEX_NONE;
+		int32 _next = INDEX_NONE;
+		int32 _slot = INDEX_NONE;
+	};
+
+	// Inserts a timer into the slot of its deadline tick
+	void Link(int32 index);
+	void Unlink(int32 index);
+
+	// Moves all timers of a slot to lower levels
+	void Cascade(int32 level, int32 slot);
+
+	// Fires all timers of the current tick and moves to the next tick
+	void ProcessTick(TArray<FDSMTimerRecord>& outFired);
+
+	// Returns the first tick at or after the time
+	uint64 ToTick(double time) const;
+
+	TArray<FTimer> _timers;
+	TArray<int32> _freeTimers;
+	int32 _slots[LevelNum * LevelSlots];
+	// Next tick to process
+	uint64 _currentTick = 0;
+	double _time = 0.0;
+	double _resolution = 0.05;
+	int32 _num = 0;
+	int32 _nextSerial = 1;
+};
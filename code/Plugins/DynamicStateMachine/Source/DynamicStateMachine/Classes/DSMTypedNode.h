@@ -0,0 +1,169 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Templates/Tuple.h"
+#include "DSMDataAsset.h"
+#include "DSMDefaultNode.h"
+#include <type_traits>
+
+// Name of a typed data slot, passed as string literal e.g. TWritable<UMyDataAsset, "Inventory">
+template<int32 N>
+struct TDSMSlotName
+{
+	constexpr TDSMSlotName(const ANSICHAR (&name)[N])
+	{
+		for (int32 i = 0; i < N; ++i)
+		{
+			Value[i] = name[i];
+		}
+	}
+
+	template<int32 M>
+	constexpr bool operator==(const TDSMSlotName<M>& other) const
+	{
+		if constexpr (N != M)
+		{
+			return false;
+		}
+		else
+		{
+			for (int32 i = 0; i < N; ++i)
+			{
+				if (Value[i] != other.Value[i])
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+	}
+
+	ANSICHAR Value[N];
+};
+
+// Typed data slot of a data asset inside _writableDataReferences
+template<typename TAsset, TDSMSlotName InName>
+struct TWritable
+{
+	static_assert(std::is_base_of_v<UDSMDataAsset, TAsset>, "Typed data slots must reference DSM data assets");
+	using AssetType = TAsset;
+	static constexpr bool bWritable = true;
+	static constexpr auto Name = InName;
+};
+
+// Typed data slot of a data asset inside _readOnlyDataReferences
+template<typename TAsset, TDSMSlotName InName>
+struct TReadOnly
+{
+	static_assert(std::is_base_of_v<UDSMDataAsset, TAsset>, "Typed data slots must reference DSM data assets");
+	using AssetType = TAsset;
+	static constexpr bool bWritable = false;
+	static constexpr auto Name = InName;
+};
+
+/**
+ * Untyped part of TDSMNode, binds data slots to the data references of a node
+ */
+class DYNAMICSTATEMACHINE_API FDSMNodeSlots
+{
+public:
+	// Returns true if all slots were found inside the data references of the node
+	bool IsBound() const { return _bBound; }
+
+protected:
+	struct FSlotInfo
+	{
+		const ANSICHAR* _name = nullptr;
+		UClass* _class = nullptr;
+		bool _bWritable = false;
+	};
+
+	// Validates the slots against the data references of the node, errors are logged
+	bool BindSlots(UDSMDefaultNode* node, TArrayView<const FSlotInfo> slots);
+
+	// Returns the data asset of a slot, resolved once per activation of the node
+	UDSMDataAsset* GetSlot(int32 index) const
+	{
+		if (_node && _node->_activation != 0 && _node->_slotData.IsValidIndex(_offset + index))
+		{
+			if (UDSMDataAsset* dataAsset = _node->_slotData[_offset + index])
+			{
+				return dataAsset;
+			}
+		}
+		return ResolveSlot(index);
+	}
+
+private:
+	// Requests the data asset from the DSM game mode, same as UDSMDefaultNode::GetData
+	UDSMDataAsset* ResolveSlot(int32 index) const;
+
+	UDSMDefaultNode* _node = nullptr;
+	// Default data assets of the slots, kept alive by the data references of the node
+	TArray<UDSMDataAsset*> _defaults;
+	TBitArray<> _writable;
+	// First slot of this binding inside the slot data of the node
+	int32 _offset = INDEX_NONE;
+	bool _bBound = false;
+};
+
+/**
+ * Typed access to the data references of a C++ node
+ * e.g. TDSMNode<TWritable<UNPCInfoAsset, "NPC">, TReadOnly<UPlayerInventory, "Inventory">> _data;
+ * Slot names are resolved to indices at compile time. Bind validates key, reference type and class of each slot against the data references of the node.
+ * Afterwards Get<"NPC">() returns the typed data asset without any name lookup, data is requested from the DSM game mode once per activation of the node.
+ * Read only slots return the same copy during an activation. Call Bind in BeginPlay of the node.
+ */
+template<typename... TSlots>
+class TDSMNode : public FDSMNodeSlots
+{
+public:
+	static constexpr int32 SlotNum = sizeof...(TSlots);
+
+	TDSMNode()
+	{
+		static_assert(SlotNum > 0, "Typed nodes need at least one data slot");
+		static_assert(((CountName<TSlots>() == 1) && ...), "Names of data slots must be unique");
+	}
+
+	// Returns the index of a slot, INDEX_NONE if the node does not declare the slot
+	template<TDSMSlotName Name>
+	static constexpr int32 IndexOf()
+	{
+		constexpr bool matches[] = { (TSlots::Name == Name)... };
+		for (int32 i = 0; i < SlotNum; ++i)
+		{
+			if (matches[i])
+			{
+				return i;
+			}
+		}
+		return INDEX_NONE;
+	}
+
+	bool Bind(UDSMDefaultNode* node)
+	{
+		const FSlotInfo slots[] = { FSlotInfo{ TSlots::Name.Value, TSlots::AssetType::StaticClass(), TSlots::bWritable }... };
+		return BindSlots(node, slots);
+	}
+
+	// Returns the data asset of the slot, or nullptr if binding failed
+	template<TDSMSlotName Name>
+	auto* Get() const
+	{
+		constexpr int32 Index = IndexOf<Name>();
+		static_assert(Index != INDEX_NONE, "Data slot is not declared by this node");
+		using TAsset = typename TTupleElement<Index, TTuple<TSlots...>>::Type::AssetType;
+		// Classes of the data assets are validated by Bind
+		return static_cast<TAsset*>(GetSlot(Index));
+	}
+
+private:
+	template<typename TSlot>
+	static constexpr int32 CountName()
+	{
+		return ((TSlots::Name == TSlot::Name ? 1 : 0) + ...);
+	}
+};
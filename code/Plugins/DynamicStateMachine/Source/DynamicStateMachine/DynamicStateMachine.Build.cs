@@ -7,6 +7,8 @@ public class DynamicStateMachine : ModuleRules
 	public DynamicStateMachine(ReadOnlyTargetRules Target) : base(Target)
 	{
 		PCHUsage = ModuleRules.PCHUsageMode.UseExplicitOrSharedPCHs;
+		// Latent node states are written as C++20 coroutines, see DSMLatent.h
+		CppStandard = CppStandardVersion.Cpp20;
 		
 		PublicIncludePaths.AddRange(
 			new string[] {
@@ -39,7 +41,8 @@ public class DynamicStateMachine : ModuleRules
 				"Engine",
 				"Slate",
 				"SlateCore",
-				"UMG"
+				"UMG",
+				"DeveloperSettings"
 				// ... add private dependencies that you statically link with here ...	
 			}
 			);
@@ -0,0 +1,83 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DSMAutosave.h"
+
+
+void FDSMAutosave::Start(int32 historyInterval, float intervalSeconds, float coalesceSeconds, FCapture capture)
+{
+	Stop();
+	_capture = MoveTemp(capture);
+	_historyInterval = FMath::Max(0, historyInterval);
+	_coalesceSeconds = FMath::Max(0.f, coalesceSeconds);
+	_historyNum = 0;
+	if (intervalSeconds > 0.f)
+	{
+		_intervalHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateLambda([this](float)
+			{
+				Request();
+				return true;
+			}), intervalSeconds);
+	}
+}
+
+void FDSMAutosave::Stop()
+{
+	if (_intervalHandle.IsValid())
+	{
+		FTSTicker::GetCoreTicker().RemoveTicker(_intervalHandle);
+		_intervalHandle.Reset();
+	}
+	if (_coalesceHandle.IsValid())
+	{
+		FTSTicker::GetCoreTicker().RemoveTicker(_coalesceHandle);
+		_coalesceHandle.Reset();
+	}
+	_capture = nullptr;
+}
+
+void FDSMAutosave::OnHistoryElementAdded(bool bRequest)
+{
+	if (!IsRunning())
+	{
+		return;
+	}
+	++_historyNum;
+	if (bRequest || (_historyInterval > 0 && _historyNum >= _historyInterval))
+	{
+		Request();
+	}
+}
+
+void FDSMAutosave::Request()
+{
+	if (!IsRunning())
+	{
+		return;
+	}
+	if (_coalesceHandle.IsValid())
+	{
+		++_coalescedNum;
+		return;
+	}
+	if (_coalesceSeconds <= 0.f)
+	{
+		Capture();
+		return;
+	}
+	_coalesceHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateLambda([this](float)
+		{
+			_coalesceHandle.Reset();
+			Capture();
+			return false;
+		}), _coalesceSeconds);
+}
+
+void FDSMAutosave::Capture()
+{
+	_historyNum = 0;
+	if (_capture && _capture())
+	{
+		++_capturedNum;
+	}
+}
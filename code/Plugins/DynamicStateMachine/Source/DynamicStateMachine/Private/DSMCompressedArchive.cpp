@@ -0,0 +1,147 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DSMCompressedArchive.h"
+#include "DSMLogInclude.h"
+#include "Misc/Compression.h"
+
+
+FDSMCompressedWriter::FDSMCompressedWriter(FArchive& innerArchive, FName compressionFormat, int32 blockSize)
+	: _innerArchive(innerArchive)
+	, _compressionFormat(compressionFormat)
+	, _blockSize(FMath::Max(blockSize, 1))
+{
+	SetIsSaving(true);
+	SetIsPersistent(innerArchive.IsPersistent());
+	_block.Reserve(_blockSize);
+}
+
+FDSMCompressedWriter::~FDSMCompressedWriter()
+{
+	Close();
+}
+
+void FDSMCompressedWriter::Serialize(void* data, int64 num)
+{
+	const uint8* bytes = static_cast<const uint8*>(data);
+	while (num > 0 && !_bClosed)
+	{
+		const int32 copyNum = static_cast<int32>(FMath::Min<int64>(num, _blockSize - _block.Num()));
+		_block.Append(bytes, copyNum);
+		bytes += copyNum;
+		num -= copyNum;
+		if (_block.Num() == _blockSize)
+		{
+			FlushBlock();
+		}
+	}
+}
+
+bool FDSMCompressedWriter::Close()
+{
+	if (!_bClosed)
+	{
+		FlushBlock();
+		int32 endMarker = 0;
+		_innerArchive << endMarker << endMarker;
+		_storedBytes += 2 * sizeof(int32);
+		_bClosed = true;
+	}
+	return !IsError() && !_innerArchive.IsError();
+}
+
+void FDSMCompressedWriter::FlushBlock()
+{
+	int32 uncompressedSize = _block.Num();
+	if (uncompressedSize == 0)
+	{
+		return;
+	}
+
+	int32 compressedSize = FCompression::CompressMemoryBound(_compressionFormat, uncompressedSize);
+	_compressed.SetNumUninitialized(compressedSize, false);
+	const bool bCompressed = FCompression::CompressMemory(_compressionFormat, _compressed.GetData(), compressedSize, _block.GetData(), uncompressedSize)
+		&& compressedSize < uncompressedSize;
+	// Equal sizes mark uncompressed blocks
+	int32 storedSize = bCompressed ? compressedSize : uncompressedSize;
+	_innerArchive << uncompressedSize << storedSize;
+	_innerArchive.Serialize(bCompressed ? _compressed.GetData() : _block.GetData(), storedSize);
+	_uncompressedBytes += uncompressedSize;
+	_storedBytes += 2 * sizeof(int32) + storedSize;
+	_block.Reset();
+}
+
+FDSMCompressedReader::FDSMCompressedReader(FArchive& innerArchive, FName compressionFormat, int32 maxBlockSize)
+	: _innerArchive(innerArchive)
+	, _compressionFormat(compressionFormat)
+	, _maxBlockSize(maxBlockSize)
+{
+	SetIsLoading(true);
+	SetIsPersistent(innerArchive.IsPersistent());
+}
+
+void FDSMCompressedReader::Serialize(void* data, int64 num)
+{
+	uint8* bytes = static_cast<uint8*>(data);
+	while (num > 0)
+	{
+		if (_blockOffset == _block.Num() && !ReadBlock())
+		{
+			// Reading past the end of the stream, same behaviour as other archives
+			FMemory::Memzero(bytes, num);
+			SetError();
+			return;
+		}
+		const int32 copyNum = static_cast<int32>(FMath::Min<int64>(num, _block.Num() - _blockOffset));
+		FMemory::Memcpy(bytes, _block.GetData() + _blockOffset, copyNum);
+		_blockOffset += copyNum;
+		bytes += copyNum;
+		num -= copyNum;
+	}
+}
+
+bool FDSMCompressedReader::ReadBlock()
+{
+	if (_bEnd || IsError())
+	{
+		return false;
+	}
+	int32 uncompressedSize = 0;
+	int32 storedSize = 0;
+	_innerArchive << uncompressedSize << storedSize;
+	if (uncompressedSize == 0 || _innerArchive.IsError())
+	{
+		_bEnd = true;
+		return false;
+	}
+	if (uncompressedSize < 0 || uncompressedSize > _maxBlockSize || storedSize <= 0 || storedSize > uncompressedSize)
+	{
+		UE_LOG(LogDSM, Error, TEXT("Compressed block of size %d/%d is invalid"), storedSize, uncompressedSize);
+		_bEnd = true;
+		return false;
+	}
+
+	_blockStart += _block.Num();
+	_blockOffset = 0;
+	_block.SetNumUninitialized(uncompressedSize, false);
+	bool bValid = false;
+	if (storedSize == uncompressedSize)
+	{
+		_innerArchive.Serialize(_block.GetData(), storedSize);
+		bValid = !_innerArchive.IsError();
+	}
+	else
+	{
+		_compressed.SetNumUninitialized(storedSize, false);
+		_innerArchive.Serialize(_compressed.GetData(), storedSize);
+		bValid = !_innerArchive.IsError() && FCompression::UncompressMemory(_compressionFormat, _block.GetData(), uncompressedSize, _compressed.GetData(), storedSize);
+	}
+	if (!bValid)
+	{
+		UE_LOG(LogDSM, Error, TEXT("Failed to decompress block using %s"), *_compressionFormat.ToString());
+		_block.Reset();
+		_bEnd = true;
+		return false;
+	}
+	return true;
+}
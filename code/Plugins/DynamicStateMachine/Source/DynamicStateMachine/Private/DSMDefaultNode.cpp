@@ -7,6 +7,7 @@
 #include "DSMPolicy.h"
 #include "DSMCondition.h"
 #include "DSMManager.h"
+#include "DSMLatent.h"
 
 
 UDSMDefaultNode::UDSMDefaultNode()
@@ -35,9 +36,53 @@ void UDSMDefaultNode::BeginPlay()
 	{
 		UE_LOG(LogDSM, Warning, TEXT("Conditions can not be validated for default node %s (outer : %s)"), *GetName(), *GetOuter()->GetName());
 	}
+	CacheImplementedEvents();
 	ADSMGameMode::RegisterNode(this);
 }
 
+void UDSMDefaultNode::CacheImplementedEvents()
+{
+	// Recompiled Blueprint classes get a new class default object, so the cache never outlives the class layout
+	UDSMDefaultNode* defaultNode = GetClass()->GetDefaultObject<UDSMDefaultNode>();
+	if (!defaultNode->_bImplementedEventsCached)
+	{
+		const UClass* nodeClass = GetClass();
+		const TPair<EDSMNodeEvent, FName> events[] = {
+			{ EDSMNodeEvent::InitNode, GET_FUNCTION_NAME_CHECKED(UDSMDefaultNode, InitNodeEvent) },
+			{ EDSMNodeEvent::CanEnterState, GET_FUNCTION_NAME_CHECKED(UDSMDefaultNode, CanEnterStateEvent) },
+			{ EDSMNodeEvent::OnBeginState, GET_FUNCTION_NAME_CHECKED(UDSMDefaultNode, OnBeginStateEvent) },
+			{ EDSMNodeEvent::ApplyStateBegin, GET_FUNCTION_NAME_CHECKED(UDSMDefaultNode, ApplyStateBeginEvent) },
+			{ EDSMNodeEvent::OnUpdateState, GET_FUNCTION_NAME_CHECKED(UDSMDefaultNode, OnUpdateStateEvent) },
+			{ EDSMNodeEvent::ApplyStateUpdate, GET_FUNCTION_NAME_CHECKED(UDSMDefaultNode, ApplyStateUpdateEvent) },
+			{ EDSMNodeEvent::OnEndState, GET_FUNCTION_NAME_CHECKED(UDSMDefaultNode, OnEndStateEvent) },
+			{ EDSMNodeEvent::ApplyStateEnd, GET_FUNCTION_NAME_CHECKED(UDSMDefaultNode, ApplyStateEndEvent) },
+			{ EDSMNodeEvent::ResetState, GET_FUNCTION_NAME_CHECKED(UDSMDefaultNode, ResetStateEvent) }
+		};
+		// Native classes never implement Blueprint events, see UClass::IsFunctionImplementedInScript
+		EDSMNodeEvent implementedEvents = EDSMNodeEvent::None;
+		for (const TPair<EDSMNodeEvent, FName>& event : events)
+		{
+			if (nodeClass->IsFunctionImplementedInScript(event.Value))
+			{
+				implementedEvents |= event.Key;
+			}
+		}
+		defaultNode->_implementedEvents = implementedEvents;
+		defaultNode->_bImplementedEventsCached = true;
+	}
+	_implementedEvents = defaultNode->_implementedEvents;
+}
+
+void UDSMDefaultNode::SetActivation(uint32 activation)
+{
+	_activation = activation;
+	_slotData.Reset();
+	if (activation != 0)
+	{
+		_slotData.SetNum(_slotNum);
+	}
+}
+
 void UDSMDefaultNode::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
 	Super::EndPlay(EndPlayReason);
@@ -53,6 +98,54 @@ bool UDSMDefaultNode::RequestDSMSelfTransition()
 	return false;
 }
 
+void UDSMDefaultNode::SuspendState()
+{
+	if (ADSMGameMode* manager = GetDSMManager())
+	{
+		manager->SetStateSuspended(this, true);
+	}
+}
+
+void UDSMDefaultNode::ResumeState(bool HasStateEnded)
+{
+	if (ADSMGameMode* manager = GetDSMManager())
+	{
+		manager->SetStateSuspended(this, false, HasStateEnded);
+	}
+}
+
+FDSMTimerHandle UDSMDefaultNode::SetStateTimer(float seconds, EDSMTimerAction action)
+{
+	if (ADSMGameMode* manager = GetDSMManager())
+	{
+		return manager->SetNodeTimer(this, seconds, action);
+	}
+	return FDSMTimerHandle();
+}
+
+bool UDSMDefaultNode::ClearStateTimer(FDSMTimerHandle handle)
+{
+	if (ADSMGameMode* manager = GetDSMManager())
+	{
+		return manager->ClearNodeTimer(handle);
+	}
+	return false;
+}
+
+float UDSMDefaultNode::GetStateTimerRemaining(FDSMTimerHandle handle) const
+{
+	if (ADSMGameMode* manager = GetDSMManager())
+	{
+		return manager->GetNodeTimerRemaining(handle);
+	}
+	return -1.0f;
+}
+
+FDSMLatentTask UDSMDefaultNode::RunLatentState()
+{
+	return FDSMLatentTask();
+}
+
 void UDSMDefaultNode::GetData(FName key, TSubclassOf<UDSMDataAsset> castToType, UObject*& dataAsset, bool& success) const
 {
 	TObjectPtr<UObject> found = Cast<UObject>(GetData(key));
@@ -176,13 +269,17 @@ bool UDSMDefaultNode::EvaluateEnterConditions(bool IsSelfTransition, TTuple<FStr
 		bCanEnterResult = bCanEnterResult && elem.Value;
 	}
 
+	// Blueprint event is only dispatched if the node class implements it
 	bool bCanEnterEventResult = true;
-	TMap<FName, bool> CanEnterEventResults = {};
-	CanEnterStateEvent(IsSelfTransition, CanEnterEventResults);
-	for (const TTuple<FName, bool>& elem : CanEnterEventResults)
+	if (ImplementsEvent(EDSMNodeEvent::CanEnterState))
 	{
-		debugElements.Conditions.Add(elem.Key, elem.Value);
-		bCanEnterEventResult = bCanEnterEventResult && elem.Value;
+		TMap<FName, bool> CanEnterEventResults = {};
+		CanEnterStateEvent(IsSelfTransition, CanEnterEventResults);
+		for (const TTuple<FName, bool>& elem : CanEnterEventResults)
+		{
+			debugElements.Conditions.Add(elem.Key, elem.Value);
+			bCanEnterEventResult = bCanEnterEventResult && elem.Value;
+		}
 	}
 
 	bool bCanEnterConditionGroups = true;
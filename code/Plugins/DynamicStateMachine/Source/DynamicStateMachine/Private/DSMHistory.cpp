@@ -0,0 +1,627 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DSMHistory.h"
+#include "DSMLogInclude.h"
+#include "DSMSnapshot.h"
+#include "Algo/BinarySearch.h"
+
+
+const FName FDSMHistoryStore::RootBranchName = TEXT("Main");
+
+// Last generation assigned to a history store
+static uint32 GHistoryGeneration = 0;
+
+FDSMNodeRecord FDSMNodeRecord::Create(TWeakObjectPtr<UDSMDefaultNode> node)
+{
+	FDSMNodeRecord record;
+	// If node or actor was destroyed during node, we still try to get the instance for the history
+	if (node.IsValid(true))
+	{
+		record._node = node;
+		record._nodeLabel = node.Get(true)->GetFName();
+		record._nodeClass = node.Get(true)->GetClass();
+		record._owner = node.Get(true)->GetOwner();
+		record._ownerClass = node.Get(true)->GetOwner()->GetClass();
+		record._ownerLabel = node.Get(true)->GetOwner()->GetFName();
+		record._nodeTags = node.Get(true)->ComponentTags;
+	}
+	return record;
+}
+
+FDSMNodeRecord FDSMNodeRecord::Create(const FDSMNodeID& nodeID)
+{
+	FDSMNodeRecord record;
+	record._node = nodeID._node;
+	record._nodeLabel = nodeID._nodeLabel;
+	record._nodeClass = nodeID._nodeClass;
+	record._owner = nodeID._owner;
+	record._ownerLabel = nodeID._ownerLabel;
+	record._ownerClass = nodeID._ownerClass;
+	return record;
+}
+
+void FDSMHistoryBranch::AddEntries(int32 firstEntry, int32 num)
+{
+	if (num <= 0)
+	{
+		return;
+	}
+	if (_runs.Num() > 0 && _runs.Last()._firstEntry + _runs.Last()._num == firstEntry)
+	{
+		_runs.Last()._num += num;
+		return;
+	}
+	FDSMHistoryRun& run = _runs.AddDefaulted_GetRef();
+	run._firstEntry = firstEntry;
+	run._num = num;
+}
+
+void FDSMHistoryStore::Empty()
+{
+	_nodeTable.Empty();
+	_entries.Empty();
+	_dataSlots.Empty();
+	_nodeLookup.Empty();
+	_branches.Empty();
+	_activeBranch = 0;
+	_timeline.Empty();
+	_timelineNum = 0;
+	RebuildIndexes();
+}
+
+int32 FDSMHistoryStore::Add(const FDSMNodeRecord& node, const TMap<FName, TObjectPtr<UDSMDataAsset>>& data)
+{
+	FDSMHistoryEntry entry;
+	entry._nodeIndex = InternNode(node);
+	entry._dataOffset = _dataSlots.Num();
+	for (const TTuple<FName, TObjectPtr<UDSMDataAsset>>& elem : data)
+	{
+		if (!elem.Value)
+		{
+			continue;
+		}
+		FDSMDataSlot& slot = _dataSlots.AddDefaulted_GetRef();
+		slot._key = elem.Key;
+		slot._asset = elem.Value;
+		slot._assetName = elem.Value->GetFName();
+	}
+	entry._dataNum = _dataSlots.Num() - entry._dataOffset;
+	return AddEntry(entry);
+}
+
+int32 FDSMHistoryStore::Add(const FDSMNodeID& nodeID)
+{
+	return Add(FDSMNodeRecord::Create(nodeID), nodeID._data);
+}
+
+int32 FDSMHistoryStore::Add(const FDSMHistoryStore& other, int32 index)
+{
+	check(other.IsValidIndex(index));
+	FDSMHistoryEntry entry;
+	entry._nodeIndex = InternNode(other.GetNode(index));
+	entry._dataOffset = _dataSlots.Num();
+	// Copied slots might be part of this store, they must not move while they are appended
+	_dataSlots.Reserve(_dataSlots.Num() + other.GetData(index).Num());
+	_dataSlots.Append(other.GetData(index));
+	entry._dataNum = _dataSlots.Num() - entry._dataOffset;
+	return AddEntry(entry);
+}
+
+int32 FDSMHistoryStore::AddUnresolved(const FDSMNodeRecord& node, TArrayView<const FName> keys, int32 firstStoredSlot)
+{
+	FDSMHistoryEntry entry;
+	entry._nodeIndex = InternNode(node);
+	entry._dataOffset = _dataSlots.Num();
+	for (int32 i = 0; i < keys.Num(); ++i)
+	{
+		FDSMDataSlot& slot = _dataSlots.AddDefaulted_GetRef();
+		slot._key = keys[i];
+		slot._assetName = keys[i];
+		slot._storedSlot = firstStoredSlot + i;
+	}
+	entry._dataNum = _dataSlots.Num() - entry._dataOffset;
+	return AddEntry(entry);
+}
+
+void FDSMHistoryStore::SetDataAsset(int32 slot, UDSMDataAsset* asset)
+{
+	FDSMDataSlot& dataSlot = _dataSlots[slot];
+	dataSlot._asset = asset;
+	dataSlot._assetName = asset ? asset->GetFName() : NAME_None;
+}
+
+void FDSMHistoryStore::CopyFrom(const FDSMHistoryStore& other, int32 num)
+{
+	num = FMath::Clamp(num, 0, other.Num());
+	_nodeTable = other._nodeTable;
+	_nodeLookup = other._nodeLookup;
+	_entries.Reset(num);
+	_dataSlots.Reset();
+	_branches.Reset();
+	_activeBranch = 0;
+	_timeline.Reset();
+	_timelineNum = 0;
+	// Only the active branch is copied, its entries are stored in execution order
+	for (int32 i = 0; i < num; ++i)
+	{
+		const FDSMHistoryEntry& otherEntry = other._entries[other.GetPoolEntry(i)];
+		FDSMHistoryEntry& entry = _entries.Add_GetRef(otherEntry);
+		entry._dataOffset = _dataSlots.Num();
+		_dataSlots.Append(other._dataSlots.GetData() + otherEntry._dataOffset, otherEntry._dataNum);
+	}
+	EnsureRootBranch();
+}
+
+void FDSMHistoryStore::Truncate(int32 num)
+{
+	if (num < 0 || num >= Num())
+	{
+		return;
+	}
+	if (_branches.Num() > 1 || _entries.Num() != Num())
+	{
+		UE_LOG(LogDSM, Warning, TEXT("Can not truncate a forked history, switch or fork the history branch instead"));
+		return;
+	}
+	// Unforked history is a single run of the entire pool
+	_dataSlots.SetNum(_entries[num]._dataOffset);
+	_entries.SetNum(num);
+	_branches[_activeBranch]._runs.Reset();
+	_branches[_activeBranch].AddEntries(0, num);
+	_timeline.Reset();
+	_timelineNum = 0;
+	AppendTimeline(0, num);
+	RebuildIndexes();
+}
+
+bool FDSMHistoryStore::Fork(FName branchName, int32 num)
+{
+	if (branchName.IsNone() || FindBranch(branchName) != INDEX_NONE)
+	{
+		UE_LOG(LogDSM, Warning, TEXT("History branch name %s is invalid or already in use"), *branchName.ToString());
+		return false;
+	}
+	EnsureRootBranch();
+	FDSMHistoryBranch branch;
+	branch._name = branchName;
+	branch._forkLength = FMath::Clamp(num, 0, Num());
+	// Shared entries are referenced from the branch, which actually owns them
+	branch._parent = _activeBranch;
+	while (_branches[branch._parent]._parent != INDEX_NONE && branch._forkLength <= _branches[branch._parent]._forkLength)
+	{
+		branch._parent = _branches[branch._parent]._parent;
+	}
+	_branches.Add(branch);
+	return true;
+}
+
+bool FDSMHistoryStore::SwitchBranch(FName branchName)
+{
+	const int32 branch = FindBranch(branchName);
+	if (branch == INDEX_NONE)
+	{
+		UE_LOG(LogDSM, Warning, TEXT("History branch %s does not exist"), *branchName.ToString());
+		return false;
+	}
+	_activeBranch = branch;
+	RebuildTimeline();
+	return true;
+}
+
+bool FDSMHistoryStore::DropBranch(FName branchName)
+{
+	return DropBranch(branchName, [](TArrayView<const int32>) {});
+}
+
+bool FDSMHistoryStore::DropBranch(FName branchName, TFunctionRef<void(TArrayView<const int32> releasedEntries)> onRelease)
+{
+	const int32 branch = FindBranch(branchName);
+	if (branch == INDEX_NONE)
+	{
+		UE_LOG(LogDSM, Warning, TEXT("History branch %s does not exist"), *branchName.ToString());
+		return false;
+	}
+	if (branch == _activeBranch)
+	{
+		UE_LOG(LogDSM, Warning, TEXT("Can not drop the active history branch %s"), *branchName.ToString());
+		return false;
+	}
+	if (_branches.ContainsByPredicate([branch](const FDSMHistoryBranch& other) { return other._parent == branch; }))
+	{
+		UE_LOG(LogDSM, Warning, TEXT("Can not drop history branch %s, other branches were forked from it"), *branchName.ToString());
+		return false;
+	}
+	// Entries added after the fork are only referenced by this branch
+	TArray<int32> releasedEntries;
+	for (const FDSMHistoryRun& run : _branches[branch]._runs)
+	{
+		for (int32 i = 0; i < run._num; ++i)
+		{
+			releasedEntries.Add(run._firstEntry + i);
+		}
+	}
+	_branches.RemoveAt(branch);
+	for (FDSMHistoryBranch& other : _branches)
+	{
+		if (other._parent > branch)
+		{
+			--other._parent;
+		}
+	}
+	if (_activeBranch > branch)
+	{
+		--_activeBranch;
+	}
+	onRelease(releasedEntries);
+	RemoveEntries(releasedEntries);
+	return true;
+}
+
+void FDSMHistoryStore::RemoveEntries(TArrayView<const int32> entries)
+{
+	if (entries.Num() == 0)
+	{
+		return;
+	}
+	TBitArray<> removed(false, _entries.Num());
+	for (int32 entry : entries)
+	{
+		removed[entry] = true;
+	}
+	// Remaining entries and their data slots are moved to the front, pool indices of the branches are remapped
+	TArray<int32> poolRemap;
+	poolRemap.SetNumUninitialized(_entries.Num());
+	int32 entryNum = 0;
+	int32 slotNum = 0;
+	for (int32 i = 0; i < _entries.Num(); ++i)
+	{
+		if (removed[i])
+		{
+			poolRemap[i] = INDEX_NONE;
+			continue;
+		}
+		FDSMHistoryEntry entry = _entries[i];
+		if (entry._dataOffset != slotNum)
+		{
+			for (int32 slot = 0; slot < entry._dataNum; ++slot)
+			{
+				_dataSlots[slotNum + slot] = MoveTemp(_dataSlots[entry._dataOffset + slot]);
+			}
+			entry._dataOffset = slotNum;
+		}
+		slotNum += entry._dataNum;
+		poolRemap[i] = entryNum;
+		_entries[entryNum++] = entry;
+	}
+	_entries.SetNum(entryNum);
+	_dataSlots.SetNum(slotNum);
+	// Runs never contain removed entries, runs separated by removed entries are merged
+	for (FDSMHistoryBranch& branch : _branches)
+	{
+		const TArray<FDSMHistoryRun> runs = MoveTemp(branch._runs);
+		for (const FDSMHistoryRun& run : runs)
+		{
+			branch.AddEntries(poolRemap[run._firstEntry], run._num);
+		}
+	}
+	// Data versions point to data slots, history indices of the active branch stay the same
+	RebuildTimeline();
+}
+
+TArray<FDSMHistoryBranchInfo> FDSMHistoryStore::GetBranches() const
+{
+	TArray<FDSMHistoryBranchInfo> branches;
+	if (_branches.Num() == 0)
+	{
+		FDSMHistoryBranchInfo& root = branches.AddDefaulted_GetRef();
+		root._name = RootBranchName;
+		root._bActive = true;
+		return branches;
+	}
+	branches.Reserve(_branches.Num());
+	for (int32 i = 0; i < _branches.Num(); ++i)
+	{
+		FDSMHistoryBranchInfo& info = branches.AddDefaulted_GetRef();
+		info._name = _branches[i]._name;
+		info._parent = _branches.IsValidIndex(_branches[i]._parent) ? _branches[_branches[i]._parent]._name : NAME_None;
+		info._forkLength = _branches[i]._forkLength;
+		info._num = _branches[i].Num();
+		info._bActive = i == _activeBranch;
+	}
+	return branches;
+}
+
+FDSMNodeID FDSMHistoryStore::Materialize(int32 index) const
+{
+	const FDSMNodeRecord& node = GetNode(index);
+	FDSMNodeID nodeID;
+	nodeID._node = node._node;
+	nodeID._nodeLabel = node._nodeLabel;
+	nodeID._nodeClass = node._nodeClass;
+	nodeID._owner = node._owner;
+	nodeID._ownerLabel = node._ownerLabel;
+	nodeID._ownerClass = node._ownerClass;
+	const TArrayView<const FDSMDataSlot> data = GetData(index);
+	nodeID._data.Reserve(data.Num());
+	nodeID._dataRaw.Reserve(data.Num());
+	for (const FDSMDataSlot& slot : data)
+	{
+		nodeID._data.Add(slot._key, slot._asset);
+		nodeID._dataRaw.Add(slot._key, slot._assetName);
+	}
+	return nodeID;
+}
+
+TArray<FDSMNodeID> FDSMHistoryStore::Materialize() const
+{
+	TArray<FDSMNodeID> history;
+	history.Reserve(Num());
+	for (int32 i = 0; i < Num(); ++i)
+	{
+		history.Add(Materialize(i));
+	}
+	return history;
+}
+
+int32 FDSMHistoryStore::GetEntryIndexOfSlot(int32 slot) const
+{
+	// Entries own contiguous slot ranges, the owning entry is the last entry starting before or at the slot
+	return Algo::UpperBoundBy(_entries, slot, &FDSMHistoryEntry::_dataOffset) - 1;
+}
+
+const TArray<int32>& FDSMHistoryStore::GetIndicesByClass(const UClass* nodeClass) const
+{
+	static const TArray<int32> noIndices;
+	const TArray<int32>* indices = _classIndex.Find(nodeClass);
+	return indices ? *indices : noIndices;
+}
+
+const TArray<int32>& FDSMHistoryStore::GetIndices(EDSMHistoryIndex index, FName key) const
+{
+	static const TArray<int32> noIndices;
+	const TArray<int32>* indices = nullptr;
+	switch (index)
+	{
+	case EDSMHistoryIndex::Owner:
+		indices = _ownerIndex.Find(key);
+		break;
+	case EDSMHistoryIndex::NodeTag:
+		indices = _tagIndex.Find(key);
+		break;
+	case EDSMHistoryIndex::DataAsset:
+		return GetDataVersions(key);
+	}
+	return indices ? *indices : noIndices;
+}
+
+const TArray<int32>& FDSMHistoryStore::GetDataVersions(FName key) const
+{
+	static const TArray<int32> noIndices;
+	const FDataVersions* versions = _dataVersions.Find(key);
+	return versions ? versions->_historyIndices : noIndices;
+}
+
+int32 FDSMHistoryStore::FindDataVersion(FName key, int32 historyIndex) const
+{
+	const FDataVersions* versions = _dataVersions.Find(key);
+	if (!versions)
+	{
+		return INDEX_NONE;
+	}
+	// Last version written until and including the history index
+	const int32 version = Algo::UpperBound(versions->_historyIndices, historyIndex) - 1;
+	return version >= 0 ? versions->_historyIndices[version] : INDEX_NONE;
+}
+
+UDSMDataAsset* FDSMHistoryStore::FindDataAt(FName key, int32 historyIndex) const
+{
+	const FDataVersions* versions = _dataVersions.Find(key);
+	if (!versions)
+	{
+		return nullptr;
+	}
+	const int32 version = Algo::UpperBound(versions->_historyIndices, historyIndex) - 1;
+	return version >= 0 ? _dataSlots[versions->_slots[version]]._asset : nullptr;
+}
+
+void FDSMHistoryStore::GetDataKeys(TArray<FName>& outKeys) const
+{
+	_dataVersions.GetKeys(outKeys);
+}
+
+TArray<int32> FDSMHistoryStore::GetPage(const TArray<int32>& indices, int32 firstHistoryIndex, int32 maxResults)
+{
+	const int32 first = Algo::LowerBound(indices, firstHistoryIndex);
+	const int32 remaining = indices.Num() - first;
+	const int32 num = maxResults > 0 ? FMath::Min(maxResults, remaining) : remaining;
+	return TArray<int32>(indices.GetData() + first, num);
+}
+
+UDSMDataAsset* FDSMHistoryStore::FindLatestData(FName key) const
+{
+	return FindDataAt(key, _timelineNum - 1);
+}
+
+void FDSMHistoryStore::WriteSnapshots(TArray<FDSMDataSnapshot>& outSnapshots)
+{
+	outSnapshots.SetNum(_dataSlots.Num());
+	for (int32 i = 0; i < _dataSlots.Num(); ++i)
+	{
+		FDSMDataSlot& slot = _dataSlots[i];
+		if (slot._asset)
+		{
+			FDSMSnapshot::Write(slot._asset, outSnapshots[i]._bytes);
+		}
+		// Data assets are owned by the history we copied from, they must not be serialized with this store
+		slot._asset = nullptr;
+	}
+}
+
+void FDSMHistoryStore::ReadSnapshots(const TArray<FDSMDataSnapshot>& snapshots)
+{
+	if (snapshots.Num() != _dataSlots.Num())
+	{
+		UE_LOG(LogDSM, Error, TEXT("Save game contains %d data snapshots, but the history has %d data slots"), snapshots.Num(), _dataSlots.Num());
+	}
+	const int32 slotNum = FMath::Min(snapshots.Num(), _dataSlots.Num());
+	TArray<TArrayView<const uint8>> snapshotBytes;
+	snapshotBytes.Reserve(slotNum);
+	for (int32 i = 0; i < slotNum; ++i)
+	{
+		snapshotBytes.Add(snapshots[i]._bytes);
+	}
+	TArray<UDSMDataAsset*> assets;
+	FDSMSnapshot::ReadParallel(snapshotBytes, assets);
+	for (int32 i = 0; i < slotNum; ++i)
+	{
+		FDSMDataSlot& slot = _dataSlots[i];
+		slot._asset = assets[i];
+		slot._assetName = slot._asset ? slot._asset->GetFName() : NAME_None;
+	}
+}
+
+void FDSMHistoryStore::PostSerialize(const FArchive& Ar)
+{
+	if (Ar.IsLoading())
+	{
+		RebuildNodeLookup();
+		// Histories stored before branches existed only contain the root branch
+		EnsureRootBranch();
+		_activeBranch = FMath::Clamp(_activeBranch, 0, _branches.Num() - 1);
+		RebuildTimeline();
+	}
+}
+
+int32 FDSMHistoryStore::InternNode(const FDSMNodeRecord& node)
+{
+	const FNodeKey key = MakeNodeKey(node);
+	if (const int32* found = _nodeLookup.Find(key))
+	{
+		// Node might have been respawned with the same name, keep the record pointing to the living instance
+		FDSMNodeRecord& record = _nodeTable[*found];
+		if (!record._node.IsValid() && node._node.IsValid())
+		{
+			record._node = node._node;
+			record._owner = node._owner;
+		}
+		return *found;
+	}
+	const int32 index = _nodeTable.Add(node);
+	_nodeLookup.Add(key, index);
+	return index;
+}
+
+void FDSMHistoryStore::RebuildNodeLookup()
+{
+	_nodeLookup.Empty(_nodeTable.Num());
+	for (int32 i = 0; i < _nodeTable.Num(); ++i)
+	{
+		_nodeLookup.Add(MakeNodeKey(_nodeTable[i]), i);
+	}
+}
+
+int32 FDSMHistoryStore::AddEntry(const FDSMHistoryEntry& entry)
+{
+	EnsureRootBranch();
+	const int32 poolIndex = _entries.Add(entry);
+	_branches[_activeBranch].AddEntries(poolIndex, 1);
+	const int32 index = _timelineNum;
+	AppendTimeline(poolIndex, 1);
+	IndexEntry(index);
+	return index;
+}
+
+void FDSMHistoryStore::EnsureRootBranch()
+{
+	if (_branches.Num() > 0)
+	{
+		return;
+	}
+	FDSMHistoryBranch& root = _branches.AddDefaulted_GetRef();
+	root._name = RootBranchName;
+	root.AddEntries(0, _entries.Num());
+	_activeBranch = 0;
+	_timeline.Reset();
+	_timelineNum = 0;
+	AppendTimeline(0, _entries.Num());
+	RebuildIndexes();
+}
+
+void FDSMHistoryStore::RebuildTimeline()
+{
+	_timeline.Reset();
+	_timelineNum = 0;
+	if (_branches.IsValidIndex(_activeBranch))
+	{
+		AppendBranchEntries(_activeBranch, _branches[_activeBranch].Num());
+	}
+	RebuildIndexes();
+}
+
+void FDSMHistoryStore::AppendTimeline(int32 firstEntry, int32 num)
+{
+	if (num <= 0)
+	{
+		return;
+	}
+	// Entries following the last run extend it
+	const bool bContinuesRun = _timeline.Num() > 0 && _timeline.Last()._firstEntry + _timelineNum - _timeline.Last()._firstIndex == firstEntry;
+	if (!bContinuesRun)
+	{
+		FTimelineRun& run = _timeline.AddDefaulted_GetRef();
+		run._firstIndex = _timelineNum;
+		run._firstEntry = firstEntry;
+	}
+	_timelineNum += num;
+}
+
+void FDSMHistoryStore::AppendBranchEntries(int32 branch, int32 num)
+{
+	const FDSMHistoryBranch& current = _branches[branch];
+	const int32 sharedNum = FMath::Min(num, current._forkLength);
+	if (sharedNum > 0 && _branches.IsValidIndex(current._parent))
+	{
+		AppendBranchEntries(current._parent, sharedNum);
+	}
+	int32 remaining = num - current._forkLength;
+	for (int32 i = 0; i < current._runs.Num() && remaining > 0; ++i)
+	{
+		const int32 runNum = FMath::Min(current._runs[i]._num, remaining);
+		AppendTimeline(current._runs[i]._firstEntry, runNum);
+		remaining -= runNum;
+	}
+}
+
+void FDSMHistoryStore::IndexEntry(int32 index)
+{
+	// History indices are added in ascending order, index lists stay sorted without sorting
+	const FDSMNodeRecord& node = GetNode(index);
+	_classIndex.FindOrAdd(node._nodeClass.Get()).Add(index);
+	_ownerIndex.FindOrAdd(node._ownerLabel).Add(index);
+	for (const FName& tag : node._nodeTags)
+	{
+		_tagIndex.FindOrAdd(tag).Add(index);
+	}
+	const FDSMHistoryEntry& entry = _entries[GetPoolEntry(index)];
+	for (int32 slot = entry._dataOffset; slot < entry._dataOffset + entry._dataNum; ++slot)
+	{
+		FDataVersions& versions = _dataVersions.FindOrAdd(_dataSlots[slot]._key);
+		versions._historyIndices.Add(index);
+		versions._slots.Add(slot);
+	}
+}
+
+void FDSMHistoryStore::RebuildIndexes()
+{
+	// Timeline was replaced or rewound, entries of the same index might differ
+	_generation = ++GHistoryGeneration;
+	_classIndex.Reset();
+	_ownerIndex.Reset();
+	_tagIndex.Reset();
+	_dataVersions.Reset();
+	for (int32 i = 0; i < _timelineNum; ++i)
+	{
+		IndexEntry(i);
+	}
+}
@@ -0,0 +1,555 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DSMHistoryPager.h"
+#include "DSMHistory.h"
+#include "DSMSnapshot.h"
+#include "DSMLogInclude.h"
+#include "HAL/FileManager.h"
+#include "Misc/Paths.h"
+#include "Misc/Guid.h"
+#include "Serialization/ArchiveCountMem.h"
+#include "Serialization/MemoryWriter.h"
+#include "Serialization/MemoryReader.h"
+#include "Misc/Compression.h"
+
+
+void FDSMHistoryPager::Configure(int32 segmentSize, int64 memoryBudget, int32 prefetchSegments)
+{
+	// Segment size can only change as long as nothing is paged
+	if (_pages.Num() == 0)
+	{
+		_segmentSize = FMath::Max(1, segmentSize);
+	}
+	_memoryBudget = FMath::Max<int64>(0, memoryBudget);
+	_prefetchSegments = FMath::Max(0, prefetchSegments);
+}
+
+void FDSMHistoryPager::ConfigureStorage(EDSMColdHistoryStorage storage, FName compressionFormat, int32 pagedInCacheSize)
+{
+	const bool bHasStoredSegments = _pages.ContainsByPredicate([](const FPage& page) { return page._fileOffset != INDEX_NONE || page._compressedBytes.Num() > 0; });
+	if (!bHasStoredSegments)
+	{
+		_storage = storage;
+		_compressionFormat = compressionFormat;
+	}
+	_pagedInCacheSize = FMath::Max(0, pagedInCacheSize);
+}
+
+void FDSMHistoryPager::OnEntryAdded(FDSMHistoryStore& store, int32 index)
+{
+	if (!_bAccounting)
+	{
+		// Entries added before paging was enabled are accounted at once
+		if (IsEnabled())
+		{
+			Rebuild(store);
+		}
+		return;
+	}
+	if (!IsEnabled() && !HasPagedOutSegments())
+	{
+		// Paging was disabled and all data is resident again, accounting stops until paging is enabled again
+		Reset();
+		return;
+	}
+	const int32 entry = store.GetPoolEntry(index);
+	AccountEntry(store, entry);
+	if (IsEnabled() && _residentBytes > _memoryBudget)
+	{
+		EvictColdSegments(store, _accessCounter);
+	}
+}
+
+void FDSMHistoryPager::Rebuild(FDSMHistoryStore& store)
+{
+	Reset();
+	// Estimating the data size is expensive, nothing is accounted as long as paging is disabled
+	if (!IsEnabled())
+	{
+		return;
+	}
+	_bAccounting = true;
+	for (int32 i = 0; i < store._entries.Num(); ++i)
+	{
+		AccountEntry(store, i);
+	}
+	RefreshPins(store);
+}
+
+void FDSMHistoryPager::RefreshPins(FDSMHistoryStore& store)
+{
+	if (!_bAccounting)
+	{
+		return;
+	}
+	// Latest versions of the active branch are pinned
+	TMap<FName, int32> latestSlots;
+	for (int32 i = 0; i < store.Num(); ++i)
+	{
+		const FDSMHistoryEntry& entry = store._entries[store.GetPoolEntry(i)];
+		for (int32 slot = entry._dataOffset; slot < entry._dataOffset + entry._dataNum; ++slot)
+		{
+			latestSlots.Add(store._dataSlots[slot]._key, slot);
+		}
+	}
+	// Previous pins of paged out segments are released, new pins of paged out segments are paged in again
+	for (const TTuple<FName, int32>& pin : _latestSlots)
+	{
+		const int32* latestSlot = latestSlots.Find(pin.Key);
+		if ((!latestSlot || *latestSlot != pin.Value) && !_pages[GetSegment(store.GetEntryIndexOfSlot(pin.Value))]._bResident)
+		{
+			ReleaseSlot(store, pin.Value);
+		}
+	}
+	_latestSlots = MoveTemp(latestSlots);
+	for (const TTuple<FName, int32>& pin : _latestSlots)
+	{
+		const int32 segment = GetSegment(store.GetEntryIndexOfSlot(pin.Value));
+		if (!_pages[segment]._bResident)
+		{
+			PageIn(store, segment);
+		}
+		Touch(segment);
+	}
+	if (IsEnabled() && _residentBytes > _memoryBudget)
+	{
+		EvictColdSegments(store, _accessCounter + 1);
+	}
+}
+
+void FDSMHistoryPager::ReleaseEntries(FDSMHistoryStore& store, TArrayView<const int32> entries)
+{
+	int32 firstEntry = MAX_int32;
+	for (int32 entryIndex : entries)
+	{
+		firstEntry = FMath::Min(firstEntry, entryIndex);
+		const FDSMHistoryEntry& entry = store._entries[entryIndex];
+		for (int32 slot = entry._dataOffset; slot < entry._dataOffset + entry._dataNum; ++slot)
+		{
+			if (_bAccounting)
+			{
+				ReleaseSlot(store, slot);
+			}
+			store._dataSlots[slot]._asset = nullptr;
+			// Released slots are never paged in again
+			store._dataSlots[slot]._assetName = NAME_None;
+		}
+	}
+	if (!_bAccounting || entries.Num() == 0)
+	{
+		return;
+	}
+
+	// Pages of earlier segments stay valid, later pages are dropped. Their part of the page file is not reused until the pager is reset
+	const int32 firstSegment = GetSegment(firstEntry);
+	for (int32 segment = firstSegment; segment < _pages.Num(); ++segment)
+	{
+		if (!_pages[segment]._bResident)
+		{
+			PageIn(store, segment);
+		}
+		_residentBytes -= _pages[segment]._residentBytes;
+		_compressedBytes -= _pages[segment]._compressedBytes.Num();
+	}
+	const int32 firstSlot = store._entries[firstSegment * _segmentSize]._dataOffset;
+	_pages.SetNum(firstSegment);
+	_slotBytes.SetNum(firstSlot);
+	for (TMap<FName, int32>::TIterator pin = _latestSlots.CreateIterator(); pin; ++pin)
+	{
+		if (pin.Value() >= firstSlot)
+		{
+			pin.RemoveCurrent();
+		}
+	}
+	if (_lastPagedIn >= firstSegment)
+	{
+		_lastPagedIn = INDEX_NONE;
+	}
+}
+
+void FDSMHistoryPager::OnEntriesRemoved(FDSMHistoryStore& store)
+{
+	if (!_bAccounting)
+	{
+		return;
+	}
+	for (int32 i = _pages.Num() * _segmentSize; i < store._entries.Num(); ++i)
+	{
+		AccountEntry(store, i);
+	}
+	RefreshPins(store);
+}
+
+void FDSMHistoryPager::EnsureResident(FDSMHistoryStore& store, int32 firstEntry, int32 entryNum)
+{
+	firstEntry = FMath::Max(0, firstEntry);
+	entryNum = FMath::Min(entryNum, store.Num() - firstEntry);
+	if (entryNum <= 0 || _pages.Num() == 0)
+	{
+		return;
+	}
+	const uint64 firstAccess = _accessCounter + 1;
+	const bool bSequential = GetSegment(store.GetPoolEntry(firstEntry)) == _lastPagedIn + 1;
+	int32 lastSegment = INDEX_NONE;
+	// Entries of a branch are ordered inside the pool, consecutive entries mostly share their segment
+	for (int32 i = firstEntry; i < firstEntry + entryNum; ++i)
+	{
+		const int32 segment = GetSegment(store.GetPoolEntry(i));
+		if (segment != lastSegment)
+		{
+			MakeResident(store, segment);
+			lastSegment = segment;
+		}
+	}
+	// Replay walks the history in order, load the next segments ahead of time
+	if (bSequential)
+	{
+		const int32 lastPrefetched = FMath::Min(lastSegment + _prefetchSegments, _pages.Num() - 1);
+		for (int32 segment = lastSegment + 1; segment <= lastPrefetched; ++segment)
+		{
+			MakeResident(store, segment);
+		}
+	}
+	TrimPagedInSegments(store, firstAccess);
+	// Paged in segments count against the budget as well, only the requested segments are protected
+	if (IsEnabled() && _residentBytes > _memoryBudget)
+	{
+		EvictColdSegments(store, firstAccess);
+	}
+}
+
+void FDSMHistoryPager::Reset()
+{
+	if (!_pageFilePath.IsEmpty())
+	{
+		IFileManager::Get().Delete(*_pageFilePath, false, false, true);
+	}
+	_pageFilePath.Empty();
+	_pageFileSize = 0;
+	_pages.Empty();
+	_compressedBytes = 0;
+	_slotBytes.Empty();
+	_latestSlots.Empty();
+	_residentBytes = 0;
+	_accessCounter = 0;
+	_lastPagedIn = INDEX_NONE;
+	_bAccounting = false;
+}
+
+void FDSMHistoryPager::MoveFrom(FDSMHistoryPager& other)
+{
+	Reset();
+	_segmentSize = other._segmentSize;
+	_memoryBudget = other._memoryBudget;
+	_prefetchSegments = other._prefetchSegments;
+	_storage = other._storage;
+	_compressionFormat = other._compressionFormat;
+	_pagedInCacheSize = other._pagedInCacheSize;
+	_pages = MoveTemp(other._pages);
+	_slotBytes = MoveTemp(other._slotBytes);
+	_latestSlots = MoveTemp(other._latestSlots);
+	_residentBytes = other._residentBytes;
+	_compressedBytes = other._compressedBytes;
+	_accessCounter = other._accessCounter;
+	_lastPagedIn = other._lastPagedIn;
+	_bAccounting = other._bAccounting;
+	_pageFilePath = MoveTemp(other._pageFilePath);
+	_pageFileSize = other._pageFileSize;
+	// Page file belongs to this pager now
+	other._pageFilePath.Empty();
+	other.Reset();
+}
+
+void FDSMHistoryPager::AccountEntry(FDSMHistoryStore& store, int32 index)
+{
+	const int32 segment = GetSegment(index);
+	if (!_pages.IsValidIndex(segment))
+	{
+		_pages.SetNum(segment + 1);
+	}
+	const FDSMHistoryEntry& entry = store._entries[index];
+	_slotBytes.SetNumZeroed(entry._dataOffset + entry._dataNum);
+	for (int32 slot = entry._dataOffset; slot < entry._dataOffset + entry._dataNum; ++slot)
+	{
+		const FDSMDataSlot& dataSlot = store._dataSlots[slot];
+		if (dataSlot._asset)
+		{
+			FArchiveCountMem countMem(dataSlot._asset);
+			_slotBytes[slot] = static_cast<int32>(countMem.GetMax());
+		}
+		_pages[segment]._residentBytes += _slotBytes[slot];
+		_residentBytes += _slotBytes[slot];
+
+		// Previous latest version is not pinned anymore, release it if its segment is already paged out
+		int32& latestSlot = _latestSlots.FindOrAdd(dataSlot._key, INDEX_NONE);
+		if (latestSlot != INDEX_NONE && !_pages[GetSegment(store.GetEntryIndexOfSlot(latestSlot))]._bResident)
+		{
+			ReleaseSlot(store, latestSlot);
+		}
+		latestSlot = slot;
+	}
+	Touch(segment);
+}
+
+void FDSMHistoryPager::EvictColdSegments(FDSMHistoryStore& store, uint64 firstProtectedAccess)
+{
+	while (_residentBytes > _memoryBudget)
+	{
+		// Least recently used sealed segment is paged out first
+		int32 coldest = INDEX_NONE;
+		for (int32 segment = 0; segment < _pages.Num(); ++segment)
+		{
+			const FPage& page = _pages[segment];
+			if (page._lastAccess < firstProtectedAccess && page._bResident && page._residentBytes > 0 && IsSealed(store, segment) &&
+				(coldest == INDEX_NONE || page._lastAccess < _pages[coldest]._lastAccess))
+			{
+				coldest = segment;
+			}
+		}
+		if (coldest == INDEX_NONE || !PageOut(store, coldest))
+		{
+			return;
+		}
+	}
+}
+
+bool FDSMHistoryPager::PageOut(FDSMHistoryStore& store, int32 segment)
+{
+	FPage& page = _pages[segment];
+	int32 firstSlot = 0;
+	const int32 slotNum = GetSlotRange(store, segment, firstSlot);
+
+	// Sealed segments never change, so they are only stored once
+	if (!HasStoredSegment(segment))
+	{
+		TArray<uint8> segmentBytes;
+		FMemoryWriter writer(segmentBytes, true);
+		for (int32 slot = firstSlot; slot < firstSlot + slotNum; ++slot)
+		{
+			TArray<uint8> snapshot;
+			if (const UDSMDataAsset* asset = store._dataSlots[slot]._asset)
+			{
+				FDSMSnapshot::Write(asset, snapshot);
+			}
+			writer << snapshot;
+		}
+		if (!StoreSegment(segment, segmentBytes))
+		{
+			return false;
+		}
+	}
+
+	for (int32 slot = firstSlot; slot < firstSlot + slotNum; ++slot)
+	{
+		FDSMDataSlot& dataSlot = store._dataSlots[slot];
+		if (dataSlot._asset && !IsPinned(slot, dataSlot._key))
+		{
+			dataSlot._asset = nullptr;
+			page._residentBytes -= _slotBytes[slot];
+			_residentBytes -= _slotBytes[slot];
+		}
+	}
+	page._bResident = false;
+	page._bPagedIn = false;
+	UE_LOG(LogDSM, Verbose, TEXT("Paged out DSM history segment %d"), segment);
+	return true;
+}
+
+bool FDSMHistoryPager::PageIn(FDSMHistoryStore& store, int32 segment)
+{
+	FPage& page = _pages[segment];
+	TArray<uint8> segmentBytes;
+	if (!LoadSegment(segment, segmentBytes))
+	{
+		return false;
+	}
+
+	int32 firstSlot = 0;
+	const int32 slotNum = GetSlotRange(store, segment, firstSlot);
+	FMemoryReader reader(segmentBytes, true);
+	for (int32 slot = firstSlot; slot < firstSlot + slotNum; ++slot)
+	{
+		TArray<uint8> snapshot;
+		reader << snapshot;
+		FDSMDataSlot& dataSlot = store._dataSlots[slot];
+		if (!dataSlot._asset && !dataSlot._assetName.IsNone() && snapshot.Num() > 0)
+		{
+			dataSlot._asset = FDSMSnapshot::Read(snapshot);
+			dataSlot._assetName = dataSlot._asset ? dataSlot._asset->GetFName() : NAME_None;
+			page._residentBytes += _slotBytes[slot];
+			_residentBytes += _slotBytes[slot];
+		}
+	}
+	page._bResident = true;
+	page._bPagedIn = true;
+	// Compressed copy is only kept while the segment is paged out, the segment is compressed again on the next page out
+	if (page._compressedBytes.Num() > 0)
+	{
+		_compressedBytes -= page._compressedBytes.Num();
+		page._compressedBytes.Empty();
+		page._compressionFormat = NAME_None;
+	}
+	UE_LOG(LogDSM, Verbose, TEXT("Paged in DSM history segment %d"), segment);
+	return true;
+}
+
+bool FDSMHistoryPager::HasPagedOutSegments() const
+{
+	return _pages.ContainsByPredicate([](const FPage& page) { return !page._bResident; });
+}
+
+bool FDSMHistoryPager::HasStoredSegment(int32 segment) const
+{
+	const FPage& page = _pages[segment];
+	return page._fileOffset != INDEX_NONE || page._compressedBytes.Num() > 0;
+}
+
+bool FDSMHistoryPager::StoreSegment(int32 segment, const TArray<uint8>& segmentBytes)
+{
+	FPage& page = _pages[segment];
+	page._fileSize = segmentBytes.Num();
+	if (_storage == EDSMColdHistoryStorage::CompressedMemory)
+	{
+		int32 compressedSize = FCompression::CompressMemoryBound(_compressionFormat, segmentBytes.Num());
+		page._compressedBytes.SetNumUninitialized(compressedSize);
+		if (FCompression::CompressMemory(_compressionFormat, page._compressedBytes.GetData(), compressedSize, segmentBytes.GetData(), segmentBytes.Num()) &&
+			compressedSize < segmentBytes.Num())
+		{
+			page._compressedBytes.SetNum(compressedSize);
+			page._compressionFormat = _compressionFormat;
+		}
+		else
+		{
+			// Segment is not compressible, keep it uncompressed
+			page._compressedBytes = segmentBytes;
+			page._compressionFormat = NAME_None;
+		}
+		page._compressedBytes.Shrink();
+		_compressedBytes += page._compressedBytes.Num();
+		return true;
+	}
+
+	TUniquePtr<FArchive> pageFile(IFileManager::Get().CreateFileWriter(*GetPageFilePath(), FILEWRITE_Append | FILEWRITE_AllowRead));
+	if (!pageFile)
+	{
+		UE_LOG(LogDSM, Error, TEXT("Can not open DSM history page file %s, history stays in memory"), *GetPageFilePath());
+		return false;
+	}
+	pageFile->Serialize(const_cast<uint8*>(segmentBytes.GetData()), segmentBytes.Num());
+	if (!pageFile->Close())
+	{
+		UE_LOG(LogDSM, Error, TEXT("Failed to write DSM history segment %d to page file"), segment);
+		return false;
+	}
+	page._fileOffset = _pageFileSize;
+	_pageFileSize += segmentBytes.Num();
+	return true;
+}
+
+bool FDSMHistoryPager::LoadSegment(int32 segment, TArray<uint8>& outSegmentBytes)
+{
+	const FPage& page = _pages[segment];
+	outSegmentBytes.SetNumUninitialized(page._fileSize);
+	if (page._compressedBytes.Num() > 0)
+	{
+		if (page._compressionFormat.IsNone())
+		{
+			outSegmentBytes = page._compressedBytes;
+			return true;
+		}
+		if (!FCompression::UncompressMemory(page._compressionFormat, outSegmentBytes.GetData(), outSegmentBytes.Num(), page._compressedBytes.GetData(), page._compressedBytes.Num()))
+		{
+			UE_LOG(LogDSM, Error, TEXT("Failed to decompress DSM history segment %d"), segment);
+			return false;
+		}
+		return true;
+	}
+
+	TUniquePtr<FArchive> pageFile(IFileManager::Get().CreateFileReader(*GetPageFilePath(), FILEREAD_AllowWrite));
+	if (!pageFile)
+	{
+		UE_LOG(LogDSM, Error, TEXT("Can not open DSM history page file %s"), *GetPageFilePath());
+		return false;
+	}
+	pageFile->Seek(page._fileOffset);
+	pageFile->Serialize(outSegmentBytes.GetData(), outSegmentBytes.Num());
+	if (pageFile->IsError())
+	{
+		UE_LOG(LogDSM, Error, TEXT("Failed to read DSM history segment %d from page file"), segment);
+		return false;
+	}
+	return true;
+}
+
+void FDSMHistoryPager::MakeResident(FDSMHistoryStore& store, int32 segment)
+{
+	if (!_pages[segment]._bResident && PageIn(store, segment))
+	{
+		_lastPagedIn = segment;
+	}
+	Touch(segment);
+}
+
+void FDSMHistoryPager::ReleaseSlot(FDSMHistoryStore& store, int32 slot)
+{
+	FDSMDataSlot& dataSlot = store._dataSlots[slot];
+	if (dataSlot._asset)
+	{
+		dataSlot._asset = nullptr;
+		const int32 segment = GetSegment(store.GetEntryIndexOfSlot(slot));
+		_pages[segment]._residentBytes -= _slotBytes[slot];
+		_residentBytes -= _slotBytes[slot];
+	}
+}
+
+void FDSMHistoryPager::TrimPagedInSegments(FDSMHistoryStore& store, uint64 firstProtectedAccess)
+{
+	// Only a small number of paged in segments stays resident, least recently used segments are released first
+	// Segments accessed by the current request are protected
+	TArray<int32> pagedIn;
+	for (int32 segment = 0; segment < _pages.Num(); ++segment)
+	{
+		if (_pages[segment]._bResident && _pages[segment]._bPagedIn && _pages[segment]._lastAccess < firstProtectedAccess)
+		{
+			pagedIn.Add(segment);
+		}
+	}
+	if (pagedIn.Num() <= _pagedInCacheSize)
+	{
+		return;
+	}
+	pagedIn.Sort([this](int32 a, int32 b) { return _pages[a]._lastAccess < _pages[b]._lastAccess; });
+	for (int32 i = 0; i < pagedIn.Num() - _pagedInCacheSize; ++i)
+	{
+		PageOut(store, pagedIn[i]);
+	}
+}
+
+int32 FDSMHistoryPager::GetSlotRange(const FDSMHistoryStore& store, int32 segment, int32& outFirstSlot) const
+{
+	const int32 firstEntry = segment * _segmentSize;
+	const int32 lastEntry = FMath::Min(firstEntry + _segmentSize, store._entries.Num()) - 1;
+	outFirstSlot = store._entries[firstEntry]._dataOffset;
+	return store._entries[lastEntry]._dataOffset + store._entries[lastEntry]._dataNum - outFirstSlot;
+}
+
+bool FDSMHistoryPager::IsSealed(const FDSMHistoryStore& store, int32 segment) const
+{
+	return (segment + 1) * _segmentSize <= store._entries.Num();
+}
+
+bool FDSMHistoryPager::IsPinned(int32 slot, FName key) const
+{
+	const int32* latestSlot = _latestSlots.Find(key);
+	return latestSlot && *latestSlot == slot;
+}
+
+const FString& FDSMHistoryPager::GetPageFilePath()
+{
+	if (_pageFilePath.IsEmpty())
+	{
+		_pageFilePath = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("DSM"), TEXT("HistoryPages"), FGuid::NewGuid().ToString() + TEXT(".dsmpage"));
+	}
+	return _pageFilePath;
+}
@@ -0,0 +1,34 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DSMHistorySubsystem.h"
+#include "DSMSaveGame.h"
+#include "DSMLogInclude.h"
+
+
+void UDSMHistorySubsystem::CarryHistory(UDSMSaveGame* stateMachineData)
+{
+	check(stateMachineData);
+	_carriedHistory = NewObject<UDSMSaveGame>(this);
+	_carriedHistory->MoveHistoryFrom(*stateMachineData);
+	UE_LOG(LogDSM, Log, TEXT("Carrying %d history elements to the next level"), _carriedHistory->GetStateMachineHistoryNum());
+}
+
+bool UDSMHistorySubsystem::AdoptHistory(UDSMSaveGame* stateMachineData)
+{
+	check(stateMachineData);
+	if (!_carriedHistory)
+	{
+		return false;
+	}
+	stateMachineData->MoveHistoryFrom(*_carriedHistory);
+	_carriedHistory = nullptr;
+	UE_LOG(LogDSM, Log, TEXT("Adopted %d history elements of the previous level"), stateMachineData->GetStateMachineHistoryNum());
+	return true;
+}
+
+void UDSMHistorySubsystem::Deinitialize()
+{
+	_carriedHistory = nullptr;
+	Super::Deinitialize();
+}
@@ -0,0 +1,251 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DSMLatent.h"
+#include "DSMLatentListener.h"
+#include "DSMLogInclude.h"
+#include "DSMDefaultNode.h"
+#include "DSMDataAsset.h"
+#include "Engine/World.h"
+#include "TimerManager.h"
+#include "Animation/AnimInstance.h"
+#include "Animation/AnimMontage.h"
+
+
+FDSMLatentTask::FWakeState::~FWakeState()
+{
+	if (!_bWoken && _onAbort)
+	{
+		_onAbort();
+	}
+}
+
+FDSMLatentTask& FDSMLatentTask::operator=(FDSMLatentTask&& other)
+{
+	if (this != &other)
+	{
+		Reset();
+		_handle = other._handle;
+		other._handle = nullptr;
+	}
+	return *this;
+}
+
+bool FDSMLatentTask::ResumeIfWoken()
+{
+	if (IsDone())
+	{
+		return false;
+	}
+	promise_type& promise = _handle.promise();
+	// Latent states of destroyed nodes must not run anymore, the coroutine is destroyed instead
+	if (!promise._node.IsExplicitlyNull() && !promise._node.IsValid())
+	{
+		Reset();
+		return false;
+	}
+	if (!promise._wakeState.IsValid() || !promise._wakeState->_bWoken)
+	{
+		return false;
+	}
+	promise._wakeState.Reset();
+	_handle.resume();
+	return true;
+}
+
+void FDSMLatentTask::Reset()
+{
+	if (_handle)
+	{
+		// Destroying the frame releases the wake state, pending events abort
+		_handle.destroy();
+		_handle = nullptr;
+	}
+}
+
+void FDSMLatentAwaiter::await_suspend(FDSMLatentTask::FHandle handle)
+{
+	TSharedRef<FWakeState, ESPMode::ThreadSafe> wakeState = MakeShared<FWakeState, ESPMode::ThreadSafe>();
+	handle.promise()._wakeState = wakeState;
+	if (_bind)
+	{
+		_bind(handle.promise()._node.Get(), wakeState);
+	}
+	else
+	{
+		wakeState->_bWoken = true;
+	}
+}
+
+void FDSMLatentAwaiter::Wake(const TWeakPtr<FWakeState, ESPMode::ThreadSafe>& wakeState)
+{
+	if (TSharedPtr<FWakeState, ESPMode::ThreadSafe> pinned = wakeState.Pin())
+	{
+		pinned->_bWoken = true;
+	}
+}
+
+FDSMLatentAwaiter FDSMLatent::Delay(float seconds)
+{
+	return FDSMLatentAwaiter([seconds](UDSMDefaultNode* node, const TSharedRef<FDSMLatentTask::FWakeState, ESPMode::ThreadSafe>& wakeState)
+		{
+			UWorld* world = node ? node->GetWorld() : nullptr;
+			if (!world || seconds <= 0.0f)
+			{
+				UE_CLOG(!world, LogDSM, Warning, TEXT("Latent delay requires a node inside a world, delay is skipped"));
+				wakeState->_bWoken = true;
+				return;
+			}
+			TWeakPtr<FDSMLatentTask::FWakeState, ESPMode::ThreadSafe> weakWakeState = wakeState;
+			FTimerHandle timerHandle;
+			world->GetTimerManager().SetTimer(timerHandle, FTimerDelegate::CreateLambda([weakWakeState]()
+				{
+					FDSMLatentAwaiter::Wake(weakWakeState);
+				}), seconds, false);
+			TWeakObjectPtr<UWorld> weakWorld = world;
+			wakeState->_onAbort = [weakWorld, timerHandle]() mutable
+			{
+				if (weakWorld.IsValid())
+				{
+					weakWorld->GetTimerManager().ClearTimer(timerHandle);
+				}
+			};
+		});
+}
+
+FDSMLatentAwaiter FDSMLatent::WaitForDataChange(UDSMDataAsset* dataAsset)
+{
+	if (!IsValid(dataAsset))
+	{
+		UE_LOG(LogDSM, Warning, TEXT("Latent state awaits change of an invalid data asset, state is resumed immediately"));
+		return FDSMLatentAwaiter(nullptr);
+	}
+	return WaitFor(dataAsset->OnDataChanged);
+}
+
+FDSMLatentAwaiter FDSMLatent::WaitForMontageEnd(UAnimInstance* animInstance, UAnimMontage* montage)
+{
+	if (!IsValid(animInstance) || !animInstance->Montage_IsPlaying(montage))
+	{
+		return FDSMLatentAwaiter(nullptr);
+	}
+	TWeakObjectPtr<UAnimInstance> weakAnimInstance = animInstance;
+	TWeakObjectPtr<UAnimMontage> weakMontage = montage;
+	return FDSMLatentAwaiter([weakAnimInstance, weakMontage](UDSMDefaultNode*, const TSharedRef<FDSMLatentTask::FWakeState, ESPMode::ThreadSafe>& wakeState)
+		{
+			if (!weakAnimInstance.IsValid())
+			{
+				wakeState->_bWoken = true;
+				return;
+			}
+			// End delegates of montages are single bindings, which would replace the binding of the game code
+			UDSMLatentMontageListener* listener = NewObject<UDSMLatentMontageListener>();
+			TWeakPtr<FDSMLatentTask::FWakeState, ESPMode::ThreadSafe> weakWakeState = wakeState;
+			listener->Listen(weakAnimInstance.Get(), weakMontage.Get(), [weakWakeState]()
+				{
+					FDSMLatentAwaiter::Wake(weakWakeState);
+				});
+			TWeakObjectPtr<UDSMLatentMontageListener> weakListener = listener;
+			wakeState->_onAbort = [weakListener]()
+			{
+				if (weakListener.IsValid())
+				{
+					weakListener->StopListening();
+				}
+			};
+			wakeState->_listener.Reset(listener);
+		});
+}
+
+FDSMLatentAwaiter FDSMLatent::WaitForMontageNotify(UAnimInstance* animInstance, FName notifyName)
+{
+	if (!IsValid(animInstance))
+	{
+		UE_LOG(LogDSM, Warning, TEXT("Latent state awaits notify %s of an invalid anim instance, state is resumed immediately"), *notifyName.ToString());
+		return FDSMLatentAwaiter(nullptr);
+	}
+	TWeakObjectPtr<UAnimInstance> weakAnimInstance = animInstance;
+	return FDSMLatentAwaiter([weakAnimInstance, notifyName](UDSMDefaultNode*, const TSharedRef<FDSMLatentTask::FWakeState, ESPMode::ThreadSafe>& wakeState)
+		{
+			if (!weakAnimInstance.IsValid())
+			{
+				wakeState->_bWoken = true;
+				return;
+			}
+			// Listener is owned by the wake state, it is released together with the coroutine
+			UDSMLatentNotifyListener* listener = NewObject<UDSMLatentNotifyListener>();
+			TWeakPtr<FDSMLatentTask::FWakeState, ESPMode::ThreadSafe> weakWakeState = wakeState;
+			listener->Listen(weakAnimInstance.Get(), notifyName, [weakWakeState]()
+				{
+					FDSMLatentAwaiter::Wake(weakWakeState);
+				});
+			TWeakObjectPtr<UDSMLatentNotifyListener> weakListener = listener;
+			wakeState->_onAbort = [weakListener]()
+			{
+				if (weakListener.IsValid())
+				{
+					weakListener->StopListening();
+				}
+			};
+			wakeState->_listener.Reset(listener);
+		});
+}
+
+void UDSMLatentNotifyListener::Listen(UAnimInstance* animInstance, FName notifyName, TFunction<void()> onNotify)
+{
+	_animInstance = animInstance;
+	_notifyName = notifyName;
+	_onNotify = MoveTemp(onNotify);
+	animInstance->OnPlayMontageNotifyBegin.AddDynamic(this, &UDSMLatentNotifyListener::OnMontageNotifyBegin);
+}
+
+void UDSMLatentNotifyListener::StopListening()
+{
+	if (_animInstance.IsValid())
+	{
+		_animInstance->OnPlayMontageNotifyBegin.RemoveDynamic(this, &UDSMLatentNotifyListener::OnMontageNotifyBegin);
+	}
+}
+
+void UDSMLatentNotifyListener::OnMontageNotifyBegin(FName notifyName, const FBranchingPointNotifyPayload& payload)
+{
+	if (notifyName != _notifyName)
+	{
+		return;
+	}
+	StopListening();
+	if (_onNotify)
+	{
+		_onNotify();
+	}
+}
+
+void UDSMLatentMontageListener::Listen(UAnimInstance* animInstance, UAnimMontage* montage, TFunction<void()> onEnded)
+{
+	_animInstance = animInstance;
+	_montage = montage;
+	_onEnded = MoveTemp(onEnded);
+	animInstance->OnMontageEnded.AddDynamic(this, &UDSMLatentMontageListener::OnMontageEnded);
+}
+
+void UDSMLatentMontageListener::StopListening()
+{
+	if (_animInstance.IsValid())
+	{
+		_animInstance->OnMontageEnded.RemoveDynamic(this, &UDSMLatentMontageListener::OnMontageEnded);
+	}
+}
+
+void UDSMLatentMontageListener::OnMontageEnded(UAnimMontage* montage, bool bInterrupted)
+{
+	// Without montage filter, the end of any montage resumes the state
+	if (!_montage.IsExplicitlyNull() && montage != _montage.Get())
+	{
+		return;
+	}
+	StopListening();
+	if (_onEnded)
+	{
+		_onEnded();
+	}
+}
@@ -7,6 +7,10 @@
 #include "Kismet/GameplayStatics.h"
 #include "DSMPolicy.h"
 #include "TimerManager.h"
+#include "DSMHistorySubsystem.h"
+#include "DSMSettings.h"
+#include "DSMLatent.h"
+#include "Engine/GameInstance.h"
 
 
 ADSMGameMode::SaveLoadInfo ADSMGameMode::_saveLoadInfo = { "", true };
@@ -15,11 +19,14 @@ ADSMGameMode::ADSMGameMode()
 {
 	PrimaryActorTick.bCanEverTick = true;
 	_stateMachineData = CreateDefaultSubobject<UDSMSaveGame>(TEXT("DSM Data"));
+	_timerDefaults = CreateDefaultSubobject<UDSMTimerData>(TEXT("DSMTimers"));
 }
 
 void ADSMGameMode::BeginPlay()
 {
 	Super::BeginPlay();
+	_timerWheel = FDSMTimerWheel(GetDefault<UDSMSettings>()->_timerResolution);
+	_actorSpawnedHandle = GetWorld()->AddOnActorSpawnedHandler(FOnActorSpawned::FDelegate::CreateUObject(this, &ADSMGameMode::OnActorSpawned));
 	// State machine starts automatically after all DefaultNodes registered at the manager, PostInitializeComponents is called after BeginPlay
 	GetWorld()->GetTimerManager().SetTimerForNextTick([this]()
 		{	
@@ -30,21 +37,56 @@ void ADSMGameMode::BeginPlay()
 void ADSMGameMode::Tick(float DeltaSeconds)
 {
 	Super::Tick(DeltaSeconds);
+	// Timers are paused while a save game is replayed
+	if (!IsReplaying())
+	{
+		UpdateTimers(DeltaSeconds);
+	}
 	UpdateStateMachine(DeltaSeconds);
 }
 
 void ADSMGameMode::EndPlay(const EEndPlayReason::Type EndPlayReason)
 {
 	Super::EndPlay(EndPlayReason);
+	GetWorld()->RemoveOnActorSpawnedHandler(_actorSpawnedHandle);
+	_spawnedActors.Empty();
+	_destroyedOwners.Empty();
 	StopStateMachine();
+	// History is carried to the next level, unless a save game is loaded there
+	if (EndPlayReason == EEndPlayReason::LevelTransition && GetDefault<UDSMSettings>()->_bCarryHistoryAcrossLevels && _saveLoadInfo._saveSlotName.IsEmpty())
+	{
+		if (UDSMHistorySubsystem* historySubsystem = UGameInstance::GetSubsystem<UDSMHistorySubsystem>(GetGameInstance()))
+		{
+			historySubsystem->CarryHistory(_stateMachineData);
+		}
+	}
 }
 
 void ADSMGameMode::StartStateMachine()
 {
-	LoadSaveGame_Internal(_saveLoadInfo);
+	// Replay of a loaded save game performs the transition after it finished
+	const bool bReplayStarted = LoadSaveGame_Internal(_saveLoadInfo);
+	// History carried from the previous level is adopted as it is, a loaded save game replaces it
+	if (UDSMHistorySubsystem* historySubsystem = UGameInstance::GetSubsystem<UDSMHistorySubsystem>(GetGameInstance()))
+	{
+		if (bReplayStarted)
+		{
+			historySubsystem->DiscardHistory();
+		}
+		else
+		{
+			historySubsystem->AdoptHistory(_stateMachineData);
+		}
+	}
+	// Timers of a carried history continue in this level
+	if (!bReplayStarted && _stateMachineData->GetStateMachineHistoryNum() > 0)
+	{
+		RestoreTimers();
+	}
 	// Clear Save Load Info after load process
 	_saveLoadInfo = SaveLoadInfo();
-	if (bRequestTransitionAfterBeginPlay)
+	_stateMachineData->StartAutosave();
+	if (!bReplayStarted && bRequestTransitionAfterBeginPlay)
 	{
 		TransitionState();
 	}
@@ -59,25 +101,42 @@ void ADSMGameMode::StopStateMachine()
 		EndState();
 		_currentNode = nullptr;
 	}
+	_latentTask.Reset();
+	_bStateSuspended = false;
+	_timerWheel.Empty();
 	_defaultNodes.Empty();
 	_hasStateEnded = false;
+	_stateMachineData->StopAutosave();
+	// A pending replay is not continued
+	_replaySaveGame = nullptr;
+	_replayPreviousHistory = nullptr;
 }
 
 void ADSMGameMode::BeginState(TWeakObjectPtr<UDSMDefaultNode> node)
 {
 	check(node.IsValid() && "Valid node must be passed");
 	
-	
+	TGuardValue<bool> nodeEvent(_bInNodeEvent, true);
 	_currentNode = UDSMActiveNode::Create(node.Get());
+	if (IsValid(_currentNode->_node))_currentNode->_node->SetActivation(++_activationNum);
 	if(IsValid(_currentNode->_node))_currentNode->_node->InitNode();
-	if (IsValid(_currentNode->_node))_currentNode->_node->InitNodeEvent();
+	if (IsValid(_currentNode->_node) && _currentNode->_node->ImplementsEvent(EDSMNodeEvent::InitNode))_currentNode->_node->InitNodeEvent();
 	bool blocalHasStateEnded = false;
 	bool blocalHasStateEndedEvent = false;
 	if (IsValid(_currentNode->_node))_currentNode->_node->OnBeginState(blocalHasStateEnded);
-	if (IsValid(_currentNode->_node))_currentNode->_node->OnBeginStateEvent(blocalHasStateEndedEvent);
+	if (IsValid(_currentNode->_node) && _currentNode->_node->ImplementsEvent(EDSMNodeEvent::OnBeginState))_currentNode->_node->OnBeginStateEvent(blocalHasStateEndedEvent);
 	if (IsValid(_currentNode->_node))_currentNode->_node->ApplyStateBegin();
-	if (IsValid(_currentNode->_node))_currentNode->_node->ApplyStateBeginEvent();
+	if (IsValid(_currentNode->_node) && _currentNode->_node->ImplementsEvent(EDSMNodeEvent::ApplyStateBegin))_currentNode->_node->ApplyStateBeginEvent();
 	_hasStateEnded = blocalHasStateEnded || blocalHasStateEndedEvent;
+	if (!_hasStateEnded && IsValid(_currentNode->_node))
+	{
+		FDSMLatentTask latentTask = _currentNode->_node->RunLatentState();
+		if (latentTask.IsValid())
+		{
+			_latentTask = MakeShared<FDSMLatentTask>(MoveTemp(latentTask));
+			UpdateLatentState();
+		}
+	}
 
 	UE_LOG(LogDSM, Log, TEXT("DSM State Info : Begin state %s"),
 		*(node.IsValid() ? node->GetName(): FString("node")));
@@ -233,13 +292,18 @@ void ADSMGameMode::UpdateStateMachine(float DeltaTime)
 	}
 	else if (IsValid(_currentNode))
 	{
-
+		// Suspended nodes are not updated until their awaited event fired
+		if (_bStateSuspended || (_latentTask.IsValid() && !UpdateLatentState()))
+		{
+			return;
+		}
+		TGuardValue<bool> nodeEvent(_bInNodeEvent, true);
 		bool blocalHasStateEnded = false;
 		bool blocalHasStateEndedEvent = false;
 		if (IsValid(_currentNode->_node))_currentNode->_node->OnUpdateState(DeltaTime, blocalHasStateEnded);
-		if (IsValid(_currentNode->_node))_currentNode->_node->OnUpdateStateEvent(DeltaTime, blocalHasStateEndedEvent);
+		if (IsValid(_currentNode->_node) && _currentNode->_node->ImplementsEvent(EDSMNodeEvent::OnUpdateState))_currentNode->_node->OnUpdateStateEvent(DeltaTime, blocalHasStateEndedEvent);
 		if (IsValid(_currentNode->_node))_currentNode->_node->ApplyStateUpdate();
-		if (IsValid(_currentNode->_node))_currentNode->_node->ApplyStateUpdateEvent();
+		if (IsValid(_currentNode->_node) && _currentNode->_node->ImplementsEvent(EDSMNodeEvent::ApplyStateUpdate))_currentNode->_node->ApplyStateUpdateEvent();
 		_hasStateEnded = blocalHasStateEnded || blocalHasStateEndedEvent;
 	}
 }
@@ -248,17 +312,148 @@ void ADSMGameMode::EndState()
 {
 	if (IsValid(_currentNode) && _stateMachineData)
 	{
+		TGuardValue<bool> nodeEvent(_bInNodeEvent, true);
 		if (IsValid(_currentNode->_node))_currentNode->_node->OnEndState();
-		if (IsValid(_currentNode->_node))_currentNode->_node->OnEndStateEvent();
+		if (IsValid(_currentNode->_node) && _currentNode->_node->ImplementsEvent(EDSMNodeEvent::OnEndState))_currentNode->_node->OnEndStateEvent();
 		if (IsValid(_currentNode->_node))_currentNode->_node->ApplyStateEnd();
-		if (IsValid(_currentNode->_node))_currentNode->_node->ApplyStateEndEvent();
+		if (IsValid(_currentNode->_node) && _currentNode->_node->ImplementsEvent(EDSMNodeEvent::ApplyStateEnd))_currentNode->_node->ApplyStateEndEvent();
+		// End state timers of this activation must not end a later activation of the node
+		if (IsValid(_currentNode->_node) && _currentNode->_node->GetOwner())
+		{
+			const FName nodeLabel = _currentNode->_node->GetFName();
+			const FName ownerLabel = _currentNode->_node->GetOwner()->GetFName();
+			_bTimersChanged |= _timerWheel.ClearIf([nodeLabel, ownerLabel](const FDSMTimerRecord& timer)
+				{
+					return timer._action == EDSMTimerAction::EndState && timer._nodeLabel == nodeLabel && timer._ownerLabel == ownerLabel;
+				}) > 0;
+		}
+		// Pending timers are stored with the history element, so loading the history restores them
+		if (_bTimersChanged || _timerWheel.Num() > 0)
+		{
+			TObjectPtr<UDSMTimerData> timerData = NewObject<UDSMTimerData>(GetTransientPackage());
+			_timerWheel.Export(*timerData);
+			_currentNode->_cachedReferences.Add(_timerDefaults->GetFName(), timerData);
+			_bTimersChanged = false;
+		}
 		_stateMachineData->AddMemory(_currentNode->_node,_currentNode->_cachedReferences);
+		if (IsValid(_currentNode->_node))_currentNode->_node->SetActivation(0);
 		_hasStateEnded = false;
+		_latentTask.Reset();
+		_bStateSuspended = false;
 
 		UE_LOG(LogDSM, Log, TEXT("DSM State Info : End state %s"), *_currentNode->_node->GetName());
 	}
 }
 
+FDSMTimerHandle ADSMGameMode::SetNodeTimer(TWeakObjectPtr<UDSMDefaultNode> node, float seconds, EDSMTimerAction action)
+{
+	if (!node.IsValid() || !node->GetOwner())
+	{
+		UE_LOG(LogDSM, Warning, TEXT("Timers can only be set for valid nodes owned by an actor"));
+		return FDSMTimerHandle();
+	}
+	FDSMTimerRecord timer;
+	timer._nodeLabel = node->GetFName();
+	timer._ownerLabel = node->GetOwner()->GetFName();
+	timer._action = action;
+	timer._deadline = _timerWheel.GetTime() + FMath::Max(seconds, 0.0f);
+	_bTimersChanged = true;
+	return _timerWheel.Schedule(timer);
+}
+
+bool ADSMGameMode::ClearNodeTimer(const FDSMTimerHandle& handle)
+{
+	const bool bCleared = _timerWheel.Clear(handle);
+	_bTimersChanged |= bCleared;
+	return bCleared;
+}
+
+float ADSMGameMode::GetNodeTimerRemaining(const FDSMTimerHandle& handle) const
+{
+	const FDSMTimerRecord* timer = _timerWheel.Find(handle);
+	return timer ? static_cast<float>(FMath::Max(timer->_deadline - _timerWheel.GetTime(), 0.0)) : -1.0f;
+}
+
+void ADSMGameMode::UpdateTimers(float DeltaTime)
+{
+	TArray<FDSMTimerRecord> firedTimers;
+	_timerWheel.Advance(DeltaTime, firedTimers);
+	for (const FDSMTimerRecord& timer : firedTimers)
+	{
+		_bTimersChanged = true;
+		const TObjectPtr<UDSMDefaultNode>* found = _defaultNodes.FindByPredicate([&timer](const TObjectPtr<UDSMDefaultNode>& node)
+			{
+				return IsValid(node) && node->GetFName() == timer._nodeLabel && node->GetOwner() && node->GetOwner()->GetFName() == timer._ownerLabel;
+			});
+		if (!found)
+		{
+			UE_LOG(LogDSM, Log, TEXT("Node %s (outer : %s) of fired timer is not registered, timer is skipped"),
+				*timer._nodeLabel.ToString(), *timer._ownerLabel.ToString());
+			continue;
+		}
+		if (timer._action == EDSMTimerAction::EndState)
+		{
+			// Timer of a node which is not active anymore has no effect
+			_hasStateEnded = _hasStateEnded || GetActiveNode() == *found;
+		}
+		else if (!RequestCustomTransition(*found))
+		{
+			UE_LOG(LogDSM, Log, TEXT("Self transition of node %s (outer : %s) requested by timer failed"),
+				*timer._nodeLabel.ToString(), *timer._ownerLabel.ToString());
+		}
+	}
+}
+
+void ADSMGameMode::RestoreTimers()
+{
+	// Copy of the default timer data is empty, if the history does not store any timers
+	const UDSMTimerData* timerData = Cast<UDSMTimerData>(_stateMachineData->GetDataCopy(_timerDefaults));
+	if (timerData)
+	{
+		_timerWheel.Restore(*timerData);
+	}
+	else
+	{
+		_timerWheel.Empty();
+	}
+	_bTimersChanged = false;
+}
+
+bool ADSMGameMode::UpdateLatentState()
+{
+	// Latent state of a destroyed node is dropped without resuming it, the state ends
+	if (!IsValid(_currentNode) || !IsValid(_currentNode->_node))
+	{
+		_latentTask.Reset();
+		_hasStateEnded = true;
+		return false;
+	}
+	{
+		TGuardValue<bool> nodeEvent(_bInNodeEvent, true);
+		_latentTask->ResumeIfWoken();
+	}
+	if (!_latentTask->IsDone())
+	{
+		return false;
+	}
+	// co_return true ends the state, otherwise the node is updated again
+	_hasStateEnded = _latentTask->HasStateEnded();
+	_latentTask.Reset();
+	return !_hasStateEnded;
+}
+
+void ADSMGameMode::SetStateSuspended(TWeakObjectPtr<UDSMDefaultNode> node, bool bSuspended, bool bHasStateEnded /*= false*/)
+{
+	if (!node.IsValid() || GetActiveNode() != node.Get())
+	{
+		UE_LOG(LogDSM, Warning, TEXT("Node %s can only be suspended or resumed while it is active"),
+			*(node.IsValid() ? node->GetName() : FString("None")));
+		return;
+	}
+	_bStateSuspended = bSuspended;
+	_hasStateEnded = _hasStateEnded || (!bSuspended && bHasStateEnded);
+}
+
 bool ADSMGameMode::RequestCustomTransition(TWeakObjectPtr<UDSMDefaultNode> node)
 {
 	if (!IsActive())
@@ -324,6 +519,11 @@ bool ADSMGameMode::UnregisterNode(UDSMDefaultNode* nodeToUnregister)
 		if (ADSMGameMode* manager = Cast<ADSMGameMode>(FoundActors[0]))
 		{
 			int32 removedElements = manager->_defaultNodes.Remove(nodeToUnregister);
+			AActor* owner = nodeToUnregister->GetOwner();
+			if (removedElements > 0 && IsValid(owner) && owner->IsActorBeingDestroyed())
+			{
+				manager->RecordDestroyedOwner(owner);
+			}
 			return removedElements > 0;
 		}
 	}
@@ -368,63 +568,381 @@ bool ADSMGameMode::RequestDSMTransition(const UWorld* world)
 	return false;
 }
 
-void ADSMGameMode::LoadSaveGame_Internal(const SaveLoadInfo saveLoadInfo)
+bool ADSMGameMode::LoadSaveGame_Internal(const SaveLoadInfo saveLoadInfo)
 {
 	if (saveLoadInfo._saveSlotName.IsEmpty())
 	{
-		return;
+		return false;
 	}
 
 	// Prevent any node from performing unpredictable transitions
 	_IsTransitionAllowed = false;
-	TObjectPtr<UDSMSaveGame> loadedSaveGame = Cast<UDSMSaveGame>(UGameplayStatics::LoadGameFromSlot(_saveLoadInfo._saveSlotName, 0));
-	if (loadedSaveGame)
+	// Slots deleted after load can not stay mapped
+	TObjectPtr<UDSMSaveGame> loadedSaveGame = UDSMSaveGame::LoadSlot(_saveLoadInfo._saveSlotName, _stateMachineData->_bLazyLoad && !saveLoadInfo._deleteSlotAfterLoad);
+	if (!loadedSaveGame)
 	{
-		loadedSaveGame->PostDeserialization(GetWorld(), _saveLoadInfo._saveSlotName);
-		if (saveLoadInfo._deleteSlotAfterLoad)
-		{
-			// Reset slot, so we do not always load the default save game
-			UGameplayStatics::DeleteGameInSlot(_saveLoadInfo._saveSlotName, 0);
-		}
-		// Keep entire state, nodes are applied based on the general progress
-		_stateMachineData->SetStateMachineHistory({});
-		const TArray<FDSMNodeID> loadedSaveGameHistory = loadedSaveGame->GetStateMachineHistory();
-		TArray<TObjectPtr<AActor>> actorCache = {};
-		for (int32 i = 0; i < loadedSaveGame->_indexToLoad + 1; ++i)
+		_IsTransitionAllowed = true;
+		return false;
+	}
+	if (saveLoadInfo._deleteSlotAfterLoad)
+	{
+		// Reset slot, so we do not always load the default save game
+		UDSMSaveGame::DeleteSlot(_saveLoadInfo._saveSlotName);
+	}
+	// Keep entire state, nodes are applied based on the general progress
+	const FDSMHistoryStore& loadedSaveGameHistory = loadedSaveGame->GetHistoryStore();
+	const int32 replayNum = FMath::Min(loadedSaveGame->_indexToLoad + 1, loadedSaveGameHistory.Num());
+	StartReplay(loadedSaveGame, loadedSaveGame->_keepState ? loadedSaveGameHistory.Num() : replayNum, replayNum);
+	return true;
+}
+
+void ADSMGameMode::StartReplay(TObjectPtr<UDSMSaveGame> saveGame, int32 historyNum, int32 replayNum, int32 firstReplayed /*= 0*/, TSet<FName> replayedOwners /*= {}*/)
+{
+	// Prevent any node from performing unpredictable transitions
+	_IsTransitionAllowed = false;
+	const FDSMHistoryStore& loadedSaveGameHistory = saveGame->GetHistoryStore();
+	if (saveGame != _stateMachineData)
+	{
+		// Running history is kept until the replay succeeded, a failed replay does not leave the loaded history behind
+		_replayPreviousHistory = NewObject<UDSMSaveGame>(this);
+		_replayPreviousHistory->MoveHistoryFrom(*_stateMachineData);
+		_stateMachineData->SetStateMachineHistory(loadedSaveGameHistory, historyNum);
+		// Copied history keeps the data slot order of the lazily loaded save file
+		_stateMachineData->SetSaveFileView(saveGame->GetSaveFileView());
+	}
+
+	// Idempotent nodes are collapsed to their last history element, nodes are interned inside the history store
+	_replayCollapsedNodes.Reset();
+	if (_stateMachineData->_bFastLoad)
+	{
+		for (int32 i = 0; i < replayNum; ++i)
 		{
-			const FDSMNodeID& node = loadedSaveGameHistory[i];
-			_stateMachineData->PushStateMachineElement(node);
-			TWeakObjectPtr<UDSMDefaultNode> foundNode = GetComponentFromNodeID(node, actorCache);
-			if (foundNode.IsValid())
+			const FDSMNodeRecord& node = loadedSaveGameHistory.GetNode(i);
+			if (node._nodeClass && node._nodeClass->IsChildOf<UDSMDefaultNode>() && node._nodeClass->GetDefaultObject<UDSMDefaultNode>()->_bIdempotentApply)
 			{
-				// Allow node to create variables, btw. cache some information
-				_currentNode = UDSMActiveNode::Create(foundNode.Get());
-				_currentPolicy = nullptr;
-				// Apply all states, nodes can be destroyed at all time 
-				if (foundNode.IsValid())foundNode->ApplyStateBegin();
-				if (foundNode.IsValid())foundNode->ApplyStateBeginEvent();
-				if (foundNode.IsValid())foundNode->ApplyStateUpdate();
-				if (foundNode.IsValid())foundNode->ApplyStateUpdateEvent();
-				if (foundNode.IsValid())foundNode->ApplyStateEnd();
-				if (foundNode.IsValid())foundNode->ApplyStateEndEvent();
-				_currentPolicy = nullptr;
-				_currentNode = nullptr;
+				_replayCollapsedNodes.Add(&node, i);
 			}
-			else
+		}
+	}
+	_replaySaveGame = saveGame;
+	_replayNext = 0;
+	_replayNum = replayNum;
+	_replayAppliedNum = 0;
+	_replayFirst = firstReplayed;
+	_replayOwners = MoveTemp(replayedOwners);
+	_replayActorCache.Reset();
+	ContinueReplay();
+}
+
+// History elements are equal, if the same node was executed with the same data asset versions
+static bool IsSameHistoryElement(const FDSMHistoryStore& history, const FDSMHistoryStore& other, int32 index)
+{
+	const FDSMNodeRecord& node = history.GetNode(index);
+	const FDSMNodeRecord& otherNode = other.GetNode(index);
+	if (node._ownerLabel != otherNode._ownerLabel || node._nodeLabel != otherNode._nodeLabel || node._nodeClass != otherNode._nodeClass)
+	{
+		return false;
+	}
+	TArrayView<const FDSMDataSlot> data = history.GetData(index);
+	TArrayView<const FDSMDataSlot> otherData = other.GetData(index);
+	if (data.Num() != otherData.Num())
+	{
+		return false;
+	}
+	for (int32 i = 0; i < data.Num(); ++i)
+	{
+		// Copies of the same version share the asset name, paged in or loaded versions are treated as different
+		if (data[i]._key != otherData[i]._key || data[i]._assetName != otherData[i]._assetName)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool ADSMGameMode::RestoreStateInPlace(int32 historyIndex, bool keepState /*= false*/)
+{
+	if (!_stateMachineData->GetHistoryStore().IsValidIndex(historyIndex))
+	{
+		UE_LOG(LogDSM, Warning, TEXT("Invalid Index passed to save/load state."));
+		return false;
+	}
+	// Kept history is replayed from the running history, otherwise the restored part is copied before the history is replaced
+	if (keepState)
+	{
+		return RestoreInPlace_Internal(_stateMachineData, _stateMachineData->GetStateMachineHistoryNum(), historyIndex + 1);
+	}
+	return RestoreInPlace_Internal(_stateMachineData->CopyHistory(historyIndex, false), historyIndex + 1, historyIndex + 1);
+}
+
+bool ADSMGameMode::RestoreSlotInPlace(const FString& slotName, bool deleteSlotAfterLoad)
+{
+	// Slots deleted after load can not stay mapped
+	TObjectPtr<UDSMSaveGame> loadedSaveGame = UDSMSaveGame::LoadSlot(slotName, _stateMachineData->_bLazyLoad && !deleteSlotAfterLoad);
+	if (!loadedSaveGame)
+	{
+		UE_LOG(LogDSM, Warning, TEXT("Can not restore slot %s, slot does not exist"), *slotName);
+		return false;
+	}
+	if (deleteSlotAfterLoad)
+	{
+		UDSMSaveGame::DeleteSlot(slotName);
+	}
+	const FDSMHistoryStore& loadedSaveGameHistory = loadedSaveGame->GetHistoryStore();
+	const int32 replayNum = FMath::Min(loadedSaveGame->_indexToLoad + 1, loadedSaveGameHistory.Num());
+	return RestoreInPlace_Internal(loadedSaveGame, loadedSaveGame->_keepState ? loadedSaveGameHistory.Num() : replayNum, replayNum);
+}
+
+bool ADSMGameMode::RestoreInPlace_Internal(TObjectPtr<UDSMSaveGame> saveGame, int32 historyNum, int32 replayNum)
+{
+	if (!HasActorBegunPlay() || IsReplaying())
+	{
+		UE_LOG(LogDSM, Warning, TEXT("State can only be restored in place while the state machine is running and no save game is replayed"));
+		return false;
+	}
+
+	// History elements shared with the running history are already applied to the world
+	const FDSMHistoryStore& runningHistory = _stateMachineData->GetHistoryStore();
+	const FDSMHistoryStore& restoredHistory = saveGame->GetHistoryStore();
+	int32 sharedNum = 0;
+	const int32 maxSharedNum = FMath::Min(replayNum, runningHistory.Num());
+	while (sharedNum < maxSharedNum && (saveGame == _stateMachineData || IsSameHistoryElement(runningHistory, restoredHistory, sharedNum)))
+	{
+		++sharedNum;
+	}
+
+	// Owners of all other history elements and of the active node have to be reset
+	TSet<FName> touchedOwners;
+	for (int32 i = sharedNum; i < runningHistory.Num(); ++i)
+	{
+		touchedOwners.Add(runningHistory.GetNode(i)._ownerLabel);
+	}
+	if (IsValid(_currentNode) && IsValid(_currentNode->_node) && _currentNode->_node->GetOwner())
+	{
+		touchedOwners.Add(_currentNode->_node->GetOwner()->GetFName());
+	}
+	// Active node is discarded, it is not part of the restored history
+	if (IsValid(_currentNode) && IsValid(_currentNode->_node))
+	{
+		_currentNode->_node->SetActivation(0);
+	}
+	_currentNode = nullptr;
+	_currentPolicy = nullptr;
+	_hasStateEnded = false;
+	_latentTask.Reset();
+	_bStateSuspended = false;
+
+	const int32 resetNum = ResetTouchedActors(sharedNum, touchedOwners);
+	UE_LOG(LogDSM, Log, TEXT("Restoring %d history elements in place, %d elements are shared with the running history, %d actors were reset"), replayNum, sharedNum, resetNum);
+	StartReplay(saveGame, historyNum, replayNum, sharedNum, MoveTemp(touchedOwners));
+	return true;
+}
+
+int32 ADSMGameMode::ResetTouchedActors(int32 historyIndex, const TSet<FName>& touchedOwners)
+{
+	// Actors spawned by later nodes do not exist at the restored state
+	for (const TPair<TWeakObjectPtr<AActor>, int32>& spawnedActor : _spawnedActors)
+	{
+		if (spawnedActor.Value >= historyIndex && spawnedActor.Key.IsValid())
+		{
+			spawnedActor.Key->Destroy();
+		}
+	}
+	_spawnedActors.RemoveAll([](const TPair<TWeakObjectPtr<AActor>, int32>& spawnedActor) { return !spawnedActor.Key.IsValid(); });
+
+	// Destroyed level actors are spawned again, their nodes register at begin play and start with their default state
+	const int32 respawnedNum = RespawnDestroyedOwners(touchedOwners);
+
+	// Remaining owners are reset, AActor::Reset only changes actors overriding it, nodes undo their own changes in ResetState
+	TSet<AActor*> resetActors;
+	for (UDSMDefaultNode* node : TArray<UDSMDefaultNode*>(_defaultNodes))
+	{
+		AActor* owner = IsValid(node) ? node->GetOwner() : nullptr;
+		if (!IsValid(owner) || !touchedOwners.Contains(owner->GetFName()))
+		{
+			continue;
+		}
+		bool bAlreadyReset = false;
+		resetActors.Add(owner, &bAlreadyReset);
+		if (!bAlreadyReset)
+		{
+			owner->Reset();
+		}
+		if (IsValid(node))node->ResetState();
+		if (IsValid(node) && node->ImplementsEvent(EDSMNodeEvent::ResetState))node->ResetStateEvent();
+	}
+	return resetActors.Num() + respawnedNum;
+}
+
+void ADSMGameMode::RecordDestroyedOwner(AActor* owner)
+{
+	check(owner);
+	// Actors spawned at runtime are not part of the level, actors spawned by nodes are destroyed on restore anyway
+	if (!owner->HasAnyFlags(RF_WasLoaded) || !owner->GetLevel())
+	{
+		return;
+	}
+	FDestroyedOwner& destroyedOwner = _destroyedOwners.FindOrAdd(owner->GetFName());
+	destroyedOwner._class = owner->GetClass();
+	destroyedOwner._archetype = Cast<AActor>(owner->GetArchetype());
+	destroyedOwner._level = owner->GetLevel();
+	destroyedOwner._transform = owner->GetActorTransform();
+}
+
+int32 ADSMGameMode::RespawnDestroyedOwners(const TSet<FName>& touchedOwners)
+{
+	int32 respawnedNum = 0;
+	for (auto it = _destroyedOwners.CreateIterator(); it; ++it)
+	{
+		const FName ownerName = it.Key();
+		if (!touchedOwners.Contains(ownerName))
+		{
+			continue;
+		}
+		const FDestroyedOwner destroyedOwner = it.Value();
+		it.RemoveCurrent();
+		ULevel* level = destroyedOwner._level.Get();
+		if (!level || !destroyedOwner._class.IsValid())
+		{
+			UE_LOG(LogDSM, Warning, TEXT("Destroyed actor %s can not be spawned again, its level is not loaded anymore"), *ownerName.ToString());
+			continue;
+		}
+		// Nodes are found by the name of their owner, the destroyed actor is moved out of the way until it is garbage collected
+		if (UObject* previous = StaticFindObjectFast(nullptr, level, ownerName))
+		{
+			if (IsValid(previous))
 			{
-				UE_LOG(LogDSM, Error, TEXT("Could not load save game node %s outer %s, node could not be found"), *node._nodeLabel.ToString(), *node._ownerLabel.ToString());
-				return;
+				continue;
 			}
+			previous->Rename(nullptr, GetTransientPackage(), REN_DontCreateRedirectors | REN_NonTransactional | REN_ForceNoResetLoaders);
+		}
+		FActorSpawnParameters spawnParameters;
+		spawnParameters.Name = ownerName;
+		spawnParameters.NameMode = FActorSpawnParameters::ESpawnActorNameMode::Required_ReturnNull;
+		spawnParameters.OverrideLevel = level;
+		spawnParameters.Template = destroyedOwner._archetype.Get();
+		spawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+		if (!GetWorld()->SpawnActor(destroyedOwner._class.Get(), &destroyedOwner._transform, spawnParameters))
+		{
+			UE_LOG(LogDSM, Warning, TEXT("Destroyed actor %s can not be spawned again"), *ownerName.ToString());
+			continue;
+		}
+		++respawnedNum;
+	}
+	return respawnedNum;
+}
+
+void ADSMGameMode::OnActorSpawned(AActor* actor)
+{
+	// Only actors spawned by nodes belong to the history, actors of other game systems are spawned while a node is active as well
+	if (!_bInNodeEvent)
+	{
+		return;
+	}
+	// Actors spawned during replay belong to the replayed history element
+	const int32 historyIndex = _replaySaveGame ? _replayNext - 1 : _stateMachineData->GetStateMachineHistoryNum();
+	_spawnedActors.Emplace(actor, historyIndex);
+	// Destroyed actors are removed from time to time
+	if (_spawnedActors.Num() % 1024 == 0)
+	{
+		_spawnedActors.RemoveAll([](const TPair<TWeakObjectPtr<AActor>, int32>& spawnedActor) { return !spawnedActor.Key.IsValid(); });
+	}
+}
+
+void ADSMGameMode::ContinueReplay()
+{
+	if (!_replaySaveGame)
+	{
+		return;
+	}
+
+	const double budgetSeconds = _stateMachineData->_replayBudgetMilliseconds / 1000.0;
+	const double startSeconds = FPlatformTime::Seconds();
+	const FDSMHistoryStore& loadedSaveGameHistory = _replaySaveGame->GetHistoryStore();
+	while (_replayNext < _replayNum)
+	{
+		const int32 i = _replayNext++;
+		const FDSMNodeRecord& node = loadedSaveGameHistory.GetNode(i);
+		const int32* lastIndex = _replayCollapsedNodes.Find(&node);
+		if (lastIndex && *lastIndex != i)
+		{
+			continue;
+		}
+		// On in place restore, shared history elements are only applied again for reset owners
+		if (i < _replayFirst && !_replayOwners.Contains(node._ownerLabel))
+		{
+			continue;
+		}
+		++_replayAppliedNum;
+		// Nodes see the data versions of their own history element, version chains resolve them without walking the history
+		// Collapsed nodes are applied once with the latest data versions
+		_stateMachineData->SetReplayIndex(lastIndex ? _replayNum - 1 : i);
+		TWeakObjectPtr<UDSMDefaultNode> foundNode = GetComponentFromNodeID(node, _replayActorCache);
+		if (!foundNode.IsValid())
+		{
+			UE_LOG(LogDSM, Error, TEXT("Could not load save game node %s outer %s, node could not be found"), *node._nodeLabel.ToString(), *node._ownerLabel.ToString());
+			FinishReplay(false);
+			return;
 		}
-		if (loadedSaveGame->_keepState)
+		// Allow node to create variables, btw. cache some information
+		_currentNode = UDSMActiveNode::Create(foundNode.Get());
+		_currentPolicy = nullptr;
+		// Apply all states, nodes can be destroyed at all time 
+		TGuardValue<bool> nodeEvent(_bInNodeEvent, true);
+		if (foundNode.IsValid())foundNode->ApplyStateBegin();
+		if (foundNode.IsValid() && foundNode->ImplementsEvent(EDSMNodeEvent::ApplyStateBegin))foundNode->ApplyStateBeginEvent();
+		if (foundNode.IsValid())foundNode->ApplyStateUpdate();
+		if (foundNode.IsValid() && foundNode->ImplementsEvent(EDSMNodeEvent::ApplyStateUpdate))foundNode->ApplyStateUpdateEvent();
+		if (foundNode.IsValid())foundNode->ApplyStateEnd();
+		if (foundNode.IsValid() && foundNode->ImplementsEvent(EDSMNodeEvent::ApplyStateEnd))foundNode->ApplyStateEndEvent();
+		_currentPolicy = nullptr;
+		_currentNode = nullptr;
+		if (budgetSeconds > 0.0 && FPlatformTime::Seconds() - startSeconds >= budgetSeconds)
 		{
-			_stateMachineData->SetStateMachineHistory(loadedSaveGame->GetStateMachineHistory());
+			break;
 		}
 	}
+	// Data requests outside of replay see the latest versions
+	_stateMachineData->SetReplayIndex(INDEX_NONE);
+	OnReplayProgress.Broadcast(_replayNext, _replayNum);
+	if (_replayNext < _replayNum)
+	{
+		GetWorld()->GetTimerManager().SetTimerForNextTick(this, &ADSMGameMode::ContinueReplay);
+		return;
+	}
+	FinishReplay(true);
+}
+
+void ADSMGameMode::FinishReplay(bool bSuccess)
+{
+	_stateMachineData->SetReplayIndex(INDEX_NONE);
+	if (bSuccess)
+	{
+		UE_LOG(LogDSM, Log, TEXT("Applied %d of %d history elements on load"), _replayAppliedNum, _replayNum);
+	}
+	else if (_replayPreviousHistory)
+	{
+		// Nodes applied so far keep their state, but the history is the one before the replay again
+		_stateMachineData->MoveHistoryFrom(*_replayPreviousHistory);
+	}
+	// A failed replay is logged by the caller, the state machine continues with the restored history
+	_IsTransitionAllowed = true;
+	_replayPreviousHistory = nullptr;
+	_replaySaveGame = nullptr;
+	_replayCollapsedNodes.Reset();
+	_replayOwners.Reset();
+	_replayFirst = 0;
+	_replayActorCache.Reset();
 	_currentPolicy = nullptr;
 	_currentNode = nullptr;
-	_IsTransitionAllowed = true;
+	RestoreTimers();
+	OnReplayFinished.Broadcast(bSuccess);
+	if (bRequestTransitionAfterBeginPlay)
+	{
+		TransitionState();
+	}
 }
+
 TWeakObjectPtr<UDSMDataAsset> ADSMGameMode::GetDataAssetCached(const TWeakObjectPtr<UDSMDataAsset> DefaultDataAssetObject)
 {
 	if (_stateMachineData)
@@ -447,7 +965,7 @@ TWeakObjectPtr<UDSMDataAsset> ADSMGameMode::GetDataAssetCached(const TWeakObject
 }
 
 
-TWeakObjectPtr<UDSMDefaultNode> ADSMGameMode::GetComponentFromNodeID(const FDSMNodeID& node, TArray<TObjectPtr<AActor>>& cachedActors)
+TWeakObjectPtr<UDSMDefaultNode> ADSMGameMode::GetComponentFromNodeID(const FDSMNodeRecord& node, TArray<TObjectPtr<AActor>>& cachedActors)
 {
 	// If node valid, we simply return the node
 	if (node._node.IsValid())
@@ -0,0 +1,744 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DSMSaveFile.h"
+#include "DSMSnapshot.h"
+#include "DSMCompressedArchive.h"
+#include "DSMLogInclude.h"
+#include "HAL/FileManager.h"
+#include "Misc/Paths.h"
+#include "Misc/Compression.h"
+
+
+static FArchive& operator<<(FArchive& ar, FDSMSaveFile::FNode& node)
+{
+	ar << node._nodeLabel << node._nodePath << node._nodeClass << node._ownerLabel << node._ownerPath << node._ownerClass << node._nodeTags;
+	return ar;
+}
+
+static FArchive& operator<<(FArchive& ar, FDSMSaveFile::FEntry& entry)
+{
+	ar << entry._nodeIndex << entry._dataNum;
+	return ar;
+}
+
+static FArchive& operator<<(FArchive& ar, FDSMSaveFile::FSlotLocation& location)
+{
+	ar << location._key << location._offset << location._storedSize << location._size;
+	return ar;
+}
+
+FDSMSaveFile FDSMSaveFile::Capture(const FDSMHistoryStore& store, int32 num)
+{
+	return Capture(store, 0, num);
+}
+
+FDSMSaveFile FDSMSaveFile::Capture(const FDSMHistoryStore& store, int32 firstIndex, int32 num)
+{
+	FDSMSaveFile file;
+	TMap<FString, int32> nameLookup;
+	auto addName = [&file, &nameLookup](const FString& name)
+	{
+		if (const int32* found = nameLookup.Find(name))
+		{
+			return *found;
+		}
+		return nameLookup.Add(name, file._names.Add(name));
+	};
+
+	// Nodes are interned inside the store, the node table of the file keeps this deduplication
+	TMap<const FDSMNodeRecord*, int32> nodeLookup;
+	firstIndex = FMath::Clamp(firstIndex, 0, store.Num());
+	num = FMath::Clamp(num, 0, store.Num() - firstIndex);
+	file._entries.Reserve(num);
+	for (int32 i = firstIndex; i < firstIndex + num; ++i)
+	{
+		const FDSMNodeRecord& record = store.GetNode(i);
+		int32* nodeIndex = nodeLookup.Find(&record);
+		if (!nodeIndex)
+		{
+			FNode node;
+			node._nodeLabel = addName(record._nodeLabel.ToString());
+			node._nodePath = addName(record._node.IsValid(true) ? record._node.Get(true)->GetPathName() : FString());
+			node._nodeClass = addName(record._nodeClass ? record._nodeClass->GetPathName() : FString());
+			node._ownerLabel = addName(record._ownerLabel.ToString());
+			node._ownerPath = addName(record._owner.IsValid(true) ? record._owner.Get(true)->GetPathName() : FString());
+			node._ownerClass = addName(record._ownerClass ? record._ownerClass->GetPathName() : FString());
+			for (const FName& tag : record._nodeTags)
+			{
+				node._nodeTags.Add(addName(tag.ToString()));
+			}
+			nodeIndex = &nodeLookup.Add(&record, file._nodes.Add(node));
+		}
+
+		FEntry& entry = file._entries.AddDefaulted_GetRef();
+		entry._nodeIndex = *nodeIndex;
+		for (const FDSMDataSlot& dataSlot : store.GetData(i))
+		{
+			if (!dataSlot._asset)
+			{
+				UE_LOG(LogDSM, Warning, TEXT("Data asset %s of history element %d is not in memory and will not be saved"), *dataSlot._key.ToString(), i);
+				continue;
+			}
+			FSlot& slot = file._slots.AddDefaulted_GetRef();
+			slot._key = addName(dataSlot._key.ToString());
+			FDSMSnapshot::Write(dataSlot._asset, slot._snapshot);
+			++entry._dataNum;
+		}
+	}
+
+	// Journal records summarize the entire history up to their last entry
+	file._summary._historyNum = firstIndex + num;
+	if (num > 0)
+	{
+		const FDSMNodeRecord& lastNode = store.GetNode(firstIndex + num - 1);
+		file._summary._lastNodeClass = lastNode._nodeClass ? lastNode._nodeClass->GetPathName() : FString();
+		file._summary._lastNodeLabel = lastNode._nodeLabel.ToString();
+	}
+	file._summary._timestamp = FDateTime::UtcNow().GetTicks();
+	return file;
+}
+
+void FDSMSaveFile::CreateRecords(TArray<FDSMNodeRecord>& outRecords) const
+{
+	outRecords.Reset(_nodes.Num());
+	for (const FNode& node : _nodes)
+	{
+		FDSMNodeRecord& record = outRecords.AddDefaulted_GetRef();
+		record._nodeLabel = FName(*_names[node._nodeLabel]);
+		record._ownerLabel = FName(*_names[node._ownerLabel]);
+		record._nodeClass = _names[node._nodeClass].IsEmpty() ? nullptr : LoadObject<UClass>(nullptr, *_names[node._nodeClass]);
+		record._ownerClass = _names[node._ownerClass].IsEmpty() ? nullptr : LoadObject<UClass>(nullptr, *_names[node._ownerClass]);
+		// Placed nodes are found by path, dynamically created nodes are searched by their owner on load
+		record._node = _names[node._nodePath].IsEmpty() ? nullptr : FindObject<UDSMDefaultNode>(nullptr, *_names[node._nodePath]);
+		record._owner = _names[node._ownerPath].IsEmpty() ? nullptr : FindObject<AActor>(nullptr, *_names[node._ownerPath]);
+		for (int32 tag : node._nodeTags)
+		{
+			record._nodeTags.Add(FName(*_names[tag]));
+		}
+	}
+}
+
+int32 FDSMSaveFile::GetSlotNum() const
+{
+	int32 slotNum = 0;
+	for (const FEntry& entry : _entries)
+	{
+		slotNum += entry._dataNum;
+	}
+	return slotNum;
+}
+
+FDSMSaveFile FDSMSaveFile::Slice(int32 firstIndex, int32 num) const
+{
+	FDSMSaveFile slice;
+	firstIndex = FMath::Clamp(firstIndex, 0, _entries.Num());
+	num = FMath::Clamp(num, 0, _entries.Num() - firstIndex);
+	TArray<int32> nameRemap;
+	nameRemap.Init(INDEX_NONE, _names.Num());
+	auto addName = [this, &slice, &nameRemap](int32 name)
+	{
+		if (nameRemap[name] == INDEX_NONE)
+		{
+			nameRemap[name] = slice._names.Add(_names[name]);
+		}
+		return nameRemap[name];
+	};
+	TArray<int32> nodeRemap;
+	nodeRemap.Init(INDEX_NONE, _nodes.Num());
+
+	int32 slotIndex = 0;
+	for (int32 i = 0; i < firstIndex; ++i)
+	{
+		slotIndex += _entries[i]._dataNum;
+	}
+	slice._entries.Reserve(num);
+	for (int32 i = firstIndex; i < firstIndex + num; ++i)
+	{
+		FEntry entry = _entries[i];
+		if (nodeRemap[entry._nodeIndex] == INDEX_NONE)
+		{
+			FNode node = _nodes[entry._nodeIndex];
+			node._nodeLabel = addName(node._nodeLabel);
+			node._nodePath = addName(node._nodePath);
+			node._nodeClass = addName(node._nodeClass);
+			node._ownerLabel = addName(node._ownerLabel);
+			node._ownerPath = addName(node._ownerPath);
+			node._ownerClass = addName(node._ownerClass);
+			for (int32& tag : node._nodeTags)
+			{
+				tag = addName(tag);
+			}
+			nodeRemap[entry._nodeIndex] = slice._nodes.Add(MoveTemp(node));
+		}
+		entry._nodeIndex = nodeRemap[entry._nodeIndex];
+		slice._entries.Add(entry);
+		for (int32 j = 0; j < entry._dataNum; ++j, ++slotIndex)
+		{
+			FSlot& slot = slice._slots.Add_GetRef(_slots[slotIndex]);
+			slot._key = addName(slot._key);
+		}
+	}
+	slice._compressionFormat = _compressionFormat;
+	slice._compressionBlockSize = _compressionBlockSize;
+	return slice;
+}
+
+void FDSMSaveFile::Append(const FDSMSaveFile& other)
+{
+	TMap<FString, int32> nameLookup;
+	nameLookup.Reserve(_names.Num());
+	for (int32 i = 0; i < _names.Num(); ++i)
+	{
+		nameLookup.Add(_names[i], i);
+	}
+	TArray<int32> nameRemap;
+	nameRemap.Reserve(other._names.Num());
+	for (const FString& name : other._names)
+	{
+		const int32* found = nameLookup.Find(name);
+		nameRemap.Add(found ? *found : nameLookup.Add(name, _names.Add(name)));
+	}
+
+	const int32 nodeOffset = _nodes.Num();
+	for (FNode node : other._nodes)
+	{
+		node._nodeLabel = nameRemap[node._nodeLabel];
+		node._nodePath = nameRemap[node._nodePath];
+		node._nodeClass = nameRemap[node._nodeClass];
+		node._ownerLabel = nameRemap[node._ownerLabel];
+		node._ownerPath = nameRemap[node._ownerPath];
+		node._ownerClass = nameRemap[node._ownerClass];
+		for (int32& tag : node._nodeTags)
+		{
+			tag = nameRemap[tag];
+		}
+		_nodes.Add(MoveTemp(node));
+	}
+	for (FEntry entry : other._entries)
+	{
+		entry._nodeIndex += nodeOffset;
+		_entries.Add(entry);
+	}
+	for (const FSlot& otherSlot : other._slots)
+	{
+		FSlot& slot = _slots.Add_GetRef(otherSlot);
+		slot._key = nameRemap[slot._key];
+	}
+	_indexToLoad = other._indexToLoad;
+	_bKeepState = other._bKeepState;
+	_summary = other._summary;
+}
+
+void FDSMSaveFile::Restore(FDSMHistoryStore& outStore) const
+{
+	outStore.Empty();
+	AppendTo(outStore);
+}
+
+void FDSMSaveFile::AppendTo(FDSMHistoryStore& outStore) const
+{
+	TArray<FDSMNodeRecord> records;
+	CreateRecords(records);
+
+	// Snapshots of all entries are read in parallel, entries are added afterwards
+	TArray<TArrayView<const uint8>> snapshots;
+	snapshots.Reserve(_slots.Num());
+	for (const FSlot& slot : _slots)
+	{
+		snapshots.Add(slot._snapshot);
+	}
+	TArray<UDSMDataAsset*> assets;
+	FDSMSnapshot::ReadParallel(snapshots, assets);
+
+	int32 slotIndex = 0;
+	TMap<FName, TObjectPtr<UDSMDataAsset>> data;
+	for (const FEntry& entry : _entries)
+	{
+		data.Reset();
+		for (int32 i = 0; i < entry._dataNum; ++i, ++slotIndex)
+		{
+			data.Add(FName(*_names[_slots[slotIndex]._key]), assets[slotIndex]);
+		}
+		outStore.Add(records[entry._nodeIndex], data);
+	}
+}
+
+// Number of data slots read by a streaming load before their snapshots are recreated, see FDSMSaveFile::Load
+static constexpr int32 LoadBatchSlots = 256;
+
+// Index table is streamed through a block archive, if the file is compressed
+static TUniquePtr<FArchive> CreatePayloadArchive(FArchive& ar, const FDSMSaveFile& file)
+{
+	if (file._compressionFormat.IsNone())
+	{
+		return nullptr;
+	}
+	if (ar.IsLoading())
+	{
+		return MakeUnique<FDSMCompressedReader>(ar, file._compressionFormat, file._compressionBlockSize);
+	}
+	return MakeUnique<FDSMCompressedWriter>(ar, file._compressionFormat, file._compressionBlockSize);
+}
+
+// Strings are cut at a character boundary, the remaining bytes are zero
+static void SerializeFixedString(FArchive& ar, FString& string, int32 size)
+{
+	TArray<ANSICHAR, TInlineAllocator<FDSMSaveFile::FSummary::MetadataBytes>> bytes;
+	bytes.SetNumZeroed(size);
+	if (ar.IsSaving())
+	{
+		FTCHARToUTF8 utf8(*string);
+		const ANSICHAR* chars = reinterpret_cast<const ANSICHAR*>(utf8.Get());
+		int32 length = utf8.Length();
+		if (length > size)
+		{
+			UE_LOG(LogDSM, Warning, TEXT("Summary string %s of DSM save file is longer than %d bytes and will be truncated"), *string.Left(32), size);
+			length = size;
+			// Continuation bytes of a multi byte character are dropped together with the character
+			while (length > 0 && (chars[length] & 0xC0) == 0x80)
+			{
+				--length;
+			}
+		}
+		FMemory::Memcpy(bytes.GetData(), chars, length);
+	}
+	ar.Serialize(bytes.GetData(), size);
+	if (ar.IsLoading())
+	{
+		int32 length = 0;
+		while (length < size && bytes[length] != 0)
+		{
+			++length;
+		}
+		string = FString(FUTF8ToTCHAR(bytes.GetData(), length));
+	}
+}
+
+void FDSMSaveFile::FSummary::SerializeFixed(FArchive& ar)
+{
+	ar << _historyNum << _timestamp;
+	SerializeFixedString(ar, _lastNodeClass, ClassPathBytes);
+	SerializeFixedString(ar, _lastNodeLabel, LabelBytes);
+	SerializeFixedString(ar, _metadata, MetadataBytes);
+}
+
+bool FDSMSaveFile::SerializeHeader(FArchive& ar)
+{
+	uint32 magic = Magic;
+	ar << magic;
+	if (magic != Magic)
+	{
+		UE_LOG(LogDSM, Error, TEXT("File is not a DSM save file"));
+		return false;
+	}
+	if (ar.IsSaving())
+	{
+		_version = LatestVersion;
+	}
+	ar << _version;
+	if (_version != LatestVersion)
+	{
+		UE_LOG(LogDSM, Error, TEXT("DSM save file version %d is not supported, expected version %d"), _version, LatestVersion);
+		return false;
+	}
+
+	FString compressionFormat = _compressionFormat.IsNone() ? FString() : _compressionFormat.ToString();
+	ar << compressionFormat << _compressionBlockSize << _tableOffset;
+	_summary.SerializeFixed(ar);
+	_compressionFormat = compressionFormat.IsEmpty() ? NAME_None : FName(*compressionFormat);
+	if (ar.IsError() || _compressionBlockSize <= 0 || _compressionBlockSize > 64 * 1024 * 1024)
+	{
+		UE_LOG(LogDSM, Error, TEXT("DSM save file header is corrupted"));
+		return false;
+	}
+	if (!_compressionFormat.IsNone() && !FCompression::IsFormatValid(_compressionFormat))
+	{
+		UE_LOG(LogDSM, Error, TEXT("Compression format %s of DSM save file is not available"), *compressionFormat);
+		return false;
+	}
+	return true;
+}
+
+bool FDSMSaveFile::SerializeTables(FArchive& ar)
+{
+	ar << _indexToLoad << _bKeepState;
+	ar << _names << _nodes << _entries;
+	if (ar.IsError())
+	{
+		UE_LOG(LogDSM, Error, TEXT("DSM save file is corrupted"));
+		return false;
+	}
+
+	// Validate all table indices, so restoring the file never reads out of bounds
+	auto isValidName = [this](int32 name) { return _names.IsValidIndex(name); };
+	const bool bValidEntries = !_entries.ContainsByPredicate([this](const FEntry& entry)
+		{
+			return !_nodes.IsValidIndex(entry._nodeIndex) || entry._dataNum < 0;
+		});
+	const bool bValidNodes = !_nodes.ContainsByPredicate([&isValidName](const FNode& node)
+		{
+			return !isValidName(node._nodeLabel) || !isValidName(node._nodePath) || !isValidName(node._nodeClass) ||
+				!isValidName(node._ownerLabel) || !isValidName(node._ownerPath) || !isValidName(node._ownerClass) ||
+				node._nodeTags.ContainsByPredicate([&isValidName](int32 tag) { return !isValidName(tag); });
+		});
+	if (!bValidEntries || !bValidNodes)
+	{
+		UE_LOG(LogDSM, Error, TEXT("DSM save file contains invalid table indices"));
+		return false;
+	}
+	return true;
+}
+
+bool FDSMSaveFile::SerializeSegment(FArchive& ar)
+{
+	if (!SerializeTables(ar))
+	{
+		return false;
+	}
+	TArray<int32> keys;
+	if (ar.IsSaving())
+	{
+		keys.Reserve(_slots.Num());
+		for (const FSlot& slot : _slots)
+		{
+			keys.Add(slot._key);
+		}
+	}
+	ar << keys;
+	if (ar.IsError() || keys.Num() != GetSlotNum() || keys.ContainsByPredicate([this](int32 key) { return !_names.IsValidIndex(key); }))
+	{
+		UE_LOG(LogDSM, Error, TEXT("DSM save file segment contains invalid data slots"));
+		return false;
+	}
+	if (ar.IsLoading())
+	{
+		_slots.SetNum(keys.Num());
+		for (int32 i = 0; i < keys.Num(); ++i)
+		{
+			_slots[i]._key = keys[i];
+		}
+	}
+	return true;
+}
+
+bool FDSMSaveFile::Serialize(FArchive& ar)
+{
+	if (!SerializeHeader(ar))
+	{
+		return false;
+	}
+	if (ar.IsSaving())
+	{
+		// Table offset is written in front of the summary, which has a fixed size
+		return WriteIndexed(ar, ar.Tell() - FSummary::FixedSize - sizeof(int64));
+	}
+	if (!ReadIndexTable(ar))
+	{
+		return false;
+	}
+	_slots.SetNum(_slotLocations.Num());
+	TArray<uint8> storedBytes;
+	for (int32 i = 0; i < _slots.Num(); ++i)
+	{
+		if (!ReadSlot(ar, i, storedBytes, _slots[i]))
+		{
+			UE_LOG(LogDSM, Error, TEXT("DSM save file is corrupted"));
+			return false;
+		}
+	}
+	_slotLocations.Empty();
+	return true;
+}
+
+bool FDSMSaveFile::WriteIndexed(FArchive& ar, int64 tableOffsetPosition)
+{
+	if (_slots.Num() != GetSlotNum() || _slots.ContainsByPredicate([this](const FSlot& slot) { return !_names.IsValidIndex(slot._key); }))
+	{
+		UE_LOG(LogDSM, Error, TEXT("DSM save file contains invalid data slots"));
+		return false;
+	}
+
+	const int64 snapshotStart = ar.Tell();
+	int64 snapshotBytes = 0;
+	TArray<FSlotLocation> locations;
+	locations.Reserve(_slots.Num());
+	TArray<uint8> compressed;
+	for (FSlot& slot : _slots)
+	{
+		FSlotLocation& location = locations.AddDefaulted_GetRef();
+		location._key = slot._key;
+		location._offset = ar.Tell();
+		location._size = slot._snapshot.Num();
+		location._storedSize = location._size;
+		uint8* storedBytes = slot._snapshot.GetData();
+		if (!_compressionFormat.IsNone() && location._size > 0)
+		{
+			int32 compressedSize = FCompression::CompressMemoryBound(_compressionFormat, location._size);
+			compressed.SetNumUninitialized(compressedSize, false);
+			// Snapshots which do not shrink by compression are stored uncompressed
+			if (FCompression::CompressMemory(_compressionFormat, compressed.GetData(), compressedSize, slot._snapshot.GetData(), location._size) &&
+				compressedSize < location._size)
+			{
+				location._storedSize = compressedSize;
+				storedBytes = compressed.GetData();
+			}
+		}
+		ar.Serialize(storedBytes, location._storedSize);
+		snapshotBytes += location._size;
+	}
+
+	_tableOffset = ar.Tell();
+	TUniquePtr<FArchive> compressedAr = CreatePayloadArchive(ar, *this);
+	FArchive& tableAr = compressedAr ? *compressedAr : ar;
+	if (!SerializeTables(tableAr))
+	{
+		return false;
+	}
+	tableAr << locations;
+	if (compressedAr)
+	{
+		compressedAr->Close();
+	}
+	const int64 fileEnd = ar.Tell();
+	_storedBytes = fileEnd - snapshotStart;
+	_uncompressedBytes = snapshotBytes + (compressedAr ? compressedAr->Tell() : fileEnd - _tableOffset);
+
+	// Table offset is only known after all snapshots were written
+	ar.Seek(tableOffsetPosition);
+	ar << _tableOffset;
+	ar.Seek(fileEnd);
+	if (tableAr.IsError() || ar.IsError())
+	{
+		UE_LOG(LogDSM, Error, TEXT("Failed to write DSM save file"));
+		return false;
+	}
+	return true;
+}
+
+bool FDSMSaveFile::ReadIndexTable(FArchive& ar)
+{
+	const int64 snapshotStart = ar.Tell();
+	const int64 totalSize = ar.TotalSize();
+	if (_tableOffset < snapshotStart || _tableOffset > totalSize)
+	{
+		UE_LOG(LogDSM, Error, TEXT("DSM save file is corrupted"));
+		return false;
+	}
+	ar.Seek(_tableOffset);
+	TUniquePtr<FArchive> compressedAr = CreatePayloadArchive(ar, *this);
+	FArchive& tableAr = compressedAr ? *compressedAr : ar;
+	if (!SerializeTables(tableAr))
+	{
+		return false;
+	}
+	tableAr << _slotLocations;
+	if (tableAr.IsError() || ar.IsError())
+	{
+		UE_LOG(LogDSM, Error, TEXT("DSM save file is corrupted"));
+		return false;
+	}
+
+	// Snapshots are located between header and index table, so reading a snapshot never reads out of bounds
+	const bool bValidLocations = _slotLocations.Num() == GetSlotNum() && !_slotLocations.ContainsByPredicate([this, snapshotStart](const FSlotLocation& location)
+		{
+			return !_names.IsValidIndex(location._key) || location._storedSize < 0 || location._storedSize > location._size ||
+				(location._storedSize < location._size && _compressionFormat.IsNone()) ||
+				location._offset < snapshotStart || location._offset + location._storedSize > _tableOffset;
+		});
+	if (!bValidLocations)
+	{
+		UE_LOG(LogDSM, Error, TEXT("DSM save file contains invalid data slots"));
+		return false;
+	}
+	int64 snapshotBytes = 0;
+	for (const FSlotLocation& location : _slotLocations)
+	{
+		snapshotBytes += location._size;
+	}
+	_storedBytes = totalSize - snapshotStart;
+	_uncompressedBytes = snapshotBytes + (compressedAr ? compressedAr->Tell() : ar.Tell() - _tableOffset);
+	return true;
+}
+
+bool FDSMSaveFile::ReadIndex(FArchive& ar)
+{
+	return SerializeHeader(ar) && ReadIndexTable(ar);
+}
+
+bool FDSMSaveFile::ReadSummary(const FString& filePath, FSummary& outSummary)
+{
+	TUniquePtr<FArchive> reader(IFileManager::Get().CreateFileReader(*filePath, FILEREAD_Silent));
+	if (!reader)
+	{
+		return false;
+	}
+	FDSMSaveFile file;
+	if (!file.SerializeHeader(*reader))
+	{
+		return false;
+	}
+	outSummary = MoveTemp(file._summary);
+	return true;
+}
+
+bool FDSMSaveFile::ReadSlot(FArchive& ar, int32 slotIndex, TArray<uint8>& storedBytes, FSlot& outSlot) const
+{
+	const FSlotLocation& location = _slotLocations[slotIndex];
+	storedBytes.SetNumUninitialized(location._storedSize, false);
+	ar.Seek(location._offset);
+	ar.Serialize(storedBytes.GetData(), location._storedSize);
+	outSlot._key = location._key;
+	return !ar.IsError() && DecodeSnapshot(location, storedBytes, outSlot._snapshot);
+}
+
+bool FDSMSaveFile::DecodeSnapshot(const FSlotLocation& location, TArrayView<const uint8> storedBytes, TArray<uint8>& outSnapshot) const
+{
+	if (storedBytes.Num() != location._storedSize)
+	{
+		return false;
+	}
+	if (location._storedSize == location._size)
+	{
+		outSnapshot.Reset(location._size);
+		outSnapshot.Append(storedBytes.GetData(), storedBytes.Num());
+		return true;
+	}
+	outSnapshot.SetNumUninitialized(location._size, false);
+	if (!FCompression::UncompressMemory(_compressionFormat, outSnapshot.GetData(), location._size, storedBytes.GetData(), location._storedSize))
+	{
+		UE_LOG(LogDSM, Error, TEXT("Failed to decompress data snapshot of DSM save file"));
+		return false;
+	}
+	return true;
+}
+
+void FDSMSaveFile::RestoreUnresolved(FDSMHistoryStore& outStore, int32 num) const
+{
+	outStore.Empty();
+	TArray<FDSMNodeRecord> records;
+	CreateRecords(records);
+	TArray<FName> names;
+	names.Reserve(_names.Num());
+	for (const FString& name : _names)
+	{
+		names.Add(FName(*name));
+	}
+
+	num = FMath::Clamp(num, 0, _entries.Num());
+	int32 slotIndex = 0;
+	TArray<FName> keys;
+	for (int32 i = 0; i < num; ++i)
+	{
+		const FEntry& entry = _entries[i];
+		const int32 firstSlot = slotIndex;
+		keys.Reset();
+		for (int32 j = 0; j < entry._dataNum; ++j, ++slotIndex)
+		{
+			keys.Add(names[_slotLocations[slotIndex]._key]);
+		}
+		outStore.AddUnresolved(records[entry._nodeIndex], keys, firstSlot);
+	}
+}
+
+bool FDSMSaveFile::Write(const FString& filePath)
+{
+	TUniquePtr<FArchive> writer(IFileManager::Get().CreateFileWriter(*filePath));
+	if (!writer)
+	{
+		UE_LOG(LogDSM, Error, TEXT("Can not create DSM save file %s"), *filePath);
+		return false;
+	}
+	const bool bValid = Serialize(*writer);
+	if (!writer->Close() || !bValid)
+	{
+		UE_LOG(LogDSM, Error, TEXT("Failed to write DSM save file %s"), *filePath);
+		return false;
+	}
+	return true;
+}
+
+bool FDSMSaveFile::Read(const FString& filePath)
+{
+	TUniquePtr<FArchive> reader(IFileManager::Get().CreateFileReader(*filePath));
+	if (!reader)
+	{
+		UE_LOG(LogDSM, Error, TEXT("Can not open DSM save file %s"), *filePath);
+		return false;
+	}
+	return Serialize(*reader);
+}
+
+bool FDSMSaveFile::Load(const FString& filePath, FDSMHistoryStore& outStore)
+{
+	TUniquePtr<FArchive> reader(IFileManager::Get().CreateFileReader(*filePath));
+	if (!reader)
+	{
+		UE_LOG(LogDSM, Error, TEXT("Can not open DSM save file %s"), *filePath);
+		return false;
+	}
+	return Load(*reader, outStore);
+}
+
+bool FDSMSaveFile::Load(FArchive& reader, FDSMHistoryStore& outStore)
+{
+	if (!SerializeHeader(reader) || !ReadIndexTable(reader))
+	{
+		return false;
+	}
+
+	outStore.Empty();
+	TArray<FDSMNodeRecord> records;
+	CreateRecords(records);
+	// Slots are read in batches, the snapshots of a batch are recreated in parallel before the next batch is read
+	TArray<FSlot> batchSlots;
+	TArray<TArrayView<const uint8>> batchSnapshots;
+	TArray<UDSMDataAsset*> batchAssets;
+	TArray<uint8> storedBytes;
+	int32 slotIndex = 0;
+	int32 batchFirstEntry = 0;
+	TMap<FName, TObjectPtr<UDSMDataAsset>> data;
+	for (int32 entryIndex = 0; entryIndex < _entries.Num(); ++entryIndex)
+	{
+		for (int32 i = 0; i < _entries[entryIndex]._dataNum; ++i, ++slotIndex)
+		{
+			FSlot& slot = batchSlots.AddDefaulted_GetRef();
+			if (!ReadSlot(reader, slotIndex, storedBytes, slot))
+			{
+				UE_LOG(LogDSM, Error, TEXT("DSM save file %s is corrupted"), *reader.GetArchiveName());
+				outStore.Empty();
+				return false;
+			}
+		}
+		if (batchSlots.Num() < LoadBatchSlots && entryIndex + 1 < _entries.Num())
+		{
+			continue;
+		}
+
+		batchSnapshots.Reset();
+		for (const FSlot& slot : batchSlots)
+		{
+			batchSnapshots.Add(slot._snapshot);
+		}
+		FDSMSnapshot::ReadParallel(batchSnapshots, batchAssets);
+		int32 batchSlot = 0;
+		for (int32 i = batchFirstEntry; i <= entryIndex; ++i)
+		{
+			data.Reset();
+			for (int32 j = 0; j < _entries[i]._dataNum; ++j, ++batchSlot)
+			{
+				data.Add(FName(*_names[batchSlots[batchSlot]._key]), batchAssets[batchSlot]);
+			}
+			outStore.Add(records[_entries[i]._nodeIndex], data);
+		}
+		batchSlots.Reset();
+		batchFirstEntry = entryIndex + 1;
+	}
+	_slotLocations.Empty();
+	return true;
+}
+
+FString FDSMSaveFile::GetFilePath(const FString& slotName)
+{
+	return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("DSM"), TEXT("SaveGames"), slotName + TEXT(".dsm"));
+}
@@ -0,0 +1,135 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DSMSaveFileView.h"
+#include "DSMSnapshot.h"
+#include "DSMLogInclude.h"
+#include "Async/MappedFileHandle.h"
+#include "HAL/PlatformFileManager.h"
+#include "Misc/FileHelper.h"
+#include "Serialization/LargeMemoryReader.h"
+
+
+FDSMSaveFileView::~FDSMSaveFileView()
+{
+	_mappedRegion.Reset();
+	_mappedFile.Reset();
+}
+
+TSharedPtr<FDSMSaveFileView> FDSMSaveFileView::Open(const FString& filePath)
+{
+	TSharedPtr<FDSMSaveFileView> view = MakeShared<FDSMSaveFileView>();
+	view->_filePath = filePath;
+	view->_mappedFile.Reset(FPlatformFileManager::Get().GetPlatformFile().OpenMapped(*filePath));
+	if (view->_mappedFile)
+	{
+		view->_mappedRegion.Reset(view->_mappedFile->MapRegion(0, view->_mappedFile->GetFileSize()));
+	}
+	if (view->_mappedRegion)
+	{
+		view->_data = view->_mappedRegion->GetMappedPtr();
+		view->_size = view->_mappedRegion->GetMappedSize();
+	}
+	else
+	{
+		view->_mappedFile.Reset();
+		if (!FFileHelper::LoadFileToArray(view->_fileBytes, *filePath, FILEREAD_Silent))
+		{
+			UE_LOG(LogDSM, Error, TEXT("Can not open DSM save file %s"), *filePath);
+			return nullptr;
+		}
+		view->_data = view->_fileBytes.GetData();
+		view->_size = view->_fileBytes.Num();
+	}
+
+	FLargeMemoryReader reader(view->_data, view->_size);
+	if (!view->_index.ReadIndex(reader))
+	{
+		return nullptr;
+	}
+	UE_LOG(LogDSM, Log, TEXT("Opened DSM save file %s lazily, %d history elements, %d data snapshots"), *filePath, view->_index._entries.Num(), view->_index._slotLocations.Num());
+	return view;
+}
+
+void FDSMSaveFileView::Resolve(FDSMHistoryStore& store, int32 firstIndex, int32 num)
+{
+	firstIndex = FMath::Max(0, firstIndex);
+	num = FMath::Min(num, store.Num() - firstIndex);
+	for (int32 i = firstIndex; i < firstIndex + num; ++i)
+	{
+		TArrayView<const FDSMDataSlot> data = store.GetData(i);
+		const int32 firstSlot = static_cast<int32>(data.GetData() - store.GetDataSlots().GetData());
+		for (int32 slot = firstSlot; slot < firstSlot + data.Num(); ++slot)
+		{
+			ResolveSlot(store, slot);
+		}
+	}
+}
+
+void FDSMSaveFileView::ResolveLatest(FDSMHistoryStore& store)
+{
+	TArray<FName> keys;
+	store.GetDataKeys(keys);
+	for (const FName& key : keys)
+	{
+		const int32 version = store.FindDataVersion(key, store.Num() - 1);
+		if (version != INDEX_NONE)
+		{
+			Resolve(store, version, 1);
+		}
+	}
+}
+
+void FDSMSaveFileView::ResolveAll(FDSMHistoryStore& store)
+{
+	for (int32 slot = 0; slot < store.GetDataSlots().Num(); ++slot)
+	{
+		ResolveSlot(store, slot);
+	}
+}
+
+void FDSMSaveFileView::Detach()
+{
+	if (!_mappedRegion)
+	{
+		return;
+	}
+	_fileBytes = TArray64<uint8>(_data, _size);
+	_data = _fileBytes.GetData();
+	_mappedRegion.Reset();
+	_mappedFile.Reset();
+}
+
+void FDSMSaveFileView::ResolveSlot(FDSMHistoryStore& store, int32 slot)
+{
+	// Slots without asset name were released or could not be read
+	const FDSMDataSlot& dataSlot = store.GetDataSlots()[slot];
+	if (!_index._slotLocations.IsValidIndex(dataSlot._storedSlot) || dataSlot._asset || dataSlot._assetName.IsNone())
+	{
+		return;
+	}
+
+	const FDSMSaveFile::FSlotLocation& location = _index._slotLocations[dataSlot._storedSlot];
+	if (_index._names[location._key] != dataSlot._key.ToString())
+	{
+		UE_LOG(LogDSM, Error, TEXT("Data slot %s does not belong to data snapshot %d of DSM save file %s"), *dataSlot._key.ToString(), dataSlot._storedSlot, *_filePath);
+		return;
+	}
+	TArrayView<const uint8> storedBytes(_data + location._offset, location._storedSize);
+	UDSMDataAsset* asset = nullptr;
+	if (location._storedSize == location._size)
+	{
+		// Uncompressed snapshots are read directly from the file
+		asset = FDSMSnapshot::Read(storedBytes);
+	}
+	else if (_index.DecodeSnapshot(location, storedBytes, _snapshot))
+	{
+		asset = FDSMSnapshot::Read(_snapshot);
+	}
+	if (!asset)
+	{
+		UE_LOG(LogDSM, Error, TEXT("Can not read data asset %s of DSM save file %s"), *dataSlot._key.ToString(), *_filePath);
+	}
+	store.SetDataAsset(slot, asset);
+	++_resolvedNum;
+}
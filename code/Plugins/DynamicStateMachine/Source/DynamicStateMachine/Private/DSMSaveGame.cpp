@@ -6,80 +6,268 @@
 #include "DSMLogInclude.h"
 #include "Kismet/GameplayStatics.h"
 #include "DSMManager.h"
+#include "DSMSaveFile.h"
+#include "DSMSlotStore.h"
+#include "DSMSettings.h"
+#include "Engine/World.h"
+#include "Misc/Compression.h"
+#include "HAL/FileManager.h"
+#include "Misc/Paths.h"
+#include "Misc/FileHelper.h"
+#include "Serialization/MemoryReader.h"
+#include "PlatformFeatures.h"
+#include "SaveGameSystem.h"
+#include "Tasks/Task.h"
+#include "Async/Async.h"
+#include "Async/ParallelFor.h"
 
 
 
 int32 UDSMSaveGame::GetRecentHistoryIndexByClass(TSubclassOf<class UDSMDefaultNode> type) const
 {
-	const int32 index = _stateMachineHistory.FindLastByPredicate([type](const FDSMNodeID& node)
-		{
-			return node._nodeClass == type;
-		});
-	return index;
+	const TArray<int32>& indices = _historyStore.GetIndicesByClass(type.Get());
+	return indices.Num() > 0 ? indices.Last() : INDEX_NONE;
 }
 
-void UDSMSaveGame::LoadState(const FString& slotName, bool deleteSlotAfterLoad) const
+int32 UDSMSaveGame::GetRecentHistoryIndex(EDSMHistoryIndex index, FName key) const
 {
-	TWeakObjectPtr<ADSMGameMode> gameMode = Cast<ADSMGameMode>(GetOuter());
-	if (gameMode.IsValid())
+	const TArray<int32>& indices = _historyStore.GetIndices(index, key);
+	return indices.Num() > 0 ? indices.Last() : INDEX_NONE;
+}
+
+TArray<int32> UDSMSaveGame::QueryHistoryByClass(TSubclassOf<class UDSMDefaultNode> type, int32 firstHistoryIndex, int32 maxResults) const
+{
+	return FDSMHistoryStore::GetPage(_historyStore.GetIndicesByClass(type.Get()), firstHistoryIndex, maxResults);
+}
+
+TArray<int32> UDSMSaveGame::QueryHistory(EDSMHistoryIndex index, FName key, int32 firstHistoryIndex, int32 maxResults) const
+{
+	return FDSMHistoryStore::GetPage(_historyStore.GetIndices(index, key), firstHistoryIndex, maxResults);
+}
+
+TArray<FDSMNodeID> UDSMSaveGame::GetStateMachineHistoryRange(int32 firstIndex, int32 num) const
+{
+	firstIndex = FMath::Max(0, firstIndex);
+	num = FMath::Min(num, _historyStore.Num() - firstIndex);
+	TArray<FDSMNodeID> history;
+	if (num <= 0)
 	{
-		ADSMGameMode::SetSaveLoadInfo({ slotName, deleteSlotAfterLoad });
-		UGameplayStatics::OpenLevel(GetWorld(), *GetWorld()->GetName(), false);
+		return history;
 	}
-	else
+	history.Reserve(num);
+	// Range is paged in one segment at a time, so segments materialized before can be paged out again
+	const int32 segmentSize = FMath::Max(1, _historySegmentSize);
+	for (int32 segmentStart = firstIndex; segmentStart < firstIndex + num; segmentStart += segmentSize)
 	{
-		UE_LOG(LogDSM, Warning, TEXT("SaveGame owner must be DSMGameMode"));
+		const int32 segmentEnd = FMath::Min(segmentStart + segmentSize, firstIndex + num);
+		EnsureHistoryResident(segmentStart, segmentEnd - segmentStart);
+		for (int32 i = segmentStart; i < segmentEnd; ++i)
+		{
+			history.Add(_historyStore.Materialize(i));
+		}
+	}
+	return history;
+}
+
+TArray<FDSMNodeID> UDSMSaveGame::GetStateMachineHistory() const
+{
+	return GetStateMachineHistoryRange(0, _historyStore.Num());
+}
+
+void UDSMSaveGame::SetStateMachineHistory(const TArray<FDSMNodeID>& history)
+{
+	_saveJournal.Reset();
+	_saveFileView.Reset();
+	_historyStore.Empty();
+	for (const FDSMNodeID& node : history)
+	{
+		_historyStore.Add(node);
 	}
+	ConfigureHistoryPager();
+	_historyPager.Rebuild(_historyStore);
+	UpdateData();
 }
 
+void UDSMSaveGame::SetStateMachineHistory(const FDSMHistoryStore& history, int32 num)
+{
+	_saveJournal.Reset();
+	_saveFileView.Reset();
+	_historyStore.CopyFrom(history, num);
+	ConfigureHistoryPager();
+	_historyPager.Rebuild(_historyStore);
+	UpdateData();
+}
 
+void UDSMSaveGame::MoveHistoryFrom(UDSMSaveGame& other)
+{
+	_saveJournal.Reset();
+	other._saveJournal.Reset();
+	_historyStore = MoveTemp(other._historyStore);
+	other._historyStore.Empty();
+	_historyPager.MoveFrom(other._historyPager);
+	_saveFileView = MoveTemp(other._saveFileView);
+	other._saveFileView.Reset();
+	// Paging settings of this save game apply from now on
+	ConfigureHistoryPager();
+	UpdateData();
+	other.UpdateData();
+}
 
-void UDSMSaveGame::PrepareSerialization(const FString& slotName)
+void UDSMSaveGame::PushStateMachineElement(const FDSMNodeID& node)
 {
-	const FString packageName = NameToPackageName(slotName);
-	// Creates or finds package
-	_dsmPackage = CreatePackage(*packageName);
+	OnHistoryElementAdded(_historyStore.Add(node));
+}
 
-	if (!_dsmPackage)
+void UDSMSaveGame::PushStateMachineElement(const FDSMHistoryStore& history, int32 index)
+{
+	OnHistoryElementAdded(_historyStore.Add(history, index));
+}
+
+bool UDSMSaveGame::ForkHistory(FName branchName, int32 historyIndex)
+{
+	if (!_historyStore.IsValidIndex(historyIndex))
 	{
-		UE_LOG(LogDSM, Error, TEXT("Node %s did not read/modify referenced data asset %s and no other node created a data asset instance of this type."));
-		return;
+		UE_LOG(LogDSM, Warning, TEXT("Invalid Index passed to fork the history."));
+		return false;
+	}
+	return _historyStore.Fork(branchName, historyIndex + 1);
+}
+
+bool UDSMSaveGame::SwitchHistoryBranch(FName branchName)
+{
+	if (!_historyStore.SwitchBranch(branchName))
+	{
+		return false;
+	}
+	_historyPager.RefreshPins(_historyStore);
+	// Journaled entries belong to the previous branch
+	_saveJournal.Reset();
+	UpdateData();
+	return true;
+}
+
+bool UDSMSaveGame::DropHistoryBranch(FName branchName)
+{
+	// Pager releases the data of the dropped entries before the entry pool is compacted
+	const bool bDropped = _historyStore.DropBranch(branchName, [this](TArrayView<const int32> releasedEntries)
+		{
+			_historyPager.ReleaseEntries(_historyStore, releasedEntries);
+		});
+	if (!bDropped)
+	{
+		return false;
 	}
+	_historyPager.OnEntriesRemoved(_historyStore);
+	return true;
+}
 
-	for (FDSMNodeID& node : _stateMachineHistory)
+void UDSMSaveGame::EnsureHistoryResident(int32 firstIndex, int32 num) const
+{
+	// Paging only changes residency of the history data, the history itself stays unchanged
+	_historyPager.EnsureResident(const_cast<FDSMHistoryStore&>(_historyStore), firstIndex, num);
+	// Data, which was never loaded, is read from the lazily loaded save file
+	if (_saveFileView)
 	{
-		node.PrepareSerialization(_dsmPackage);
+		_saveFileView->Resolve(const_cast<FDSMHistoryStore&>(_historyStore), firstIndex, num);
 	}
+}
 
-	// Delete old package file
-	FString packageFilePath = FPackageName::LongPackageNameToFilename(packageName, FPackageName::GetAssetPackageExtension());
-	if (FPlatformFileManager::Get().GetPlatformFile().DeleteFile(*packageFilePath))
+void UDSMSaveGame::SetSaveFileView(TSharedPtr<FDSMSaveFileView> saveFileView)
+{
+	_saveFileView = saveFileView;
+	if (_saveFileView)
 	{
-		UE_LOG(LogDSM, Log, TEXT("Successfully deleted old DSM package"));
+		_saveFileView->ResolveLatest(_historyStore);
+	}
+	UpdateData();
+}
+
+void UDSMSaveGame::DetachSaveFileView(const FString& slotName) const
+{
+	if (_saveFileView && _saveFileView->GetFilePath() == FDSMSaveFile::GetFilePath(slotName))
+	{
+		_saveFileView->Detach();
+	}
+}
+
+void UDSMSaveGame::OnHistoryElementAdded(int32 index)
+{
+	ConfigureHistoryPager();
+	_historyPager.OnEntryAdded(_historyStore, index);
+	UpdateData();
+}
+
+void UDSMSaveGame::ConfigureHistoryPager() const
+{
+	_historyPager.Configure(_historySegmentSize, static_cast<int64>(_historyMemoryBudgetMB) * 1024 * 1024, _historyPrefetchSegments);
+	_historyPager.ConfigureStorage(_coldHistoryStorage, _historyCompressionFormat, _pagedInSegmentCacheSize);
+}
+
+void UDSMSaveGame::BeginDestroy()
+{
+	Super::BeginDestroy();
+	_historyPager.Reset();
+	_saveJournal.Reset();
+	StopAutosave();
+	_saveFileView.Reset();
+}
 
+void UDSMSaveGame::LoadState(const FString& slotName, bool deleteSlotAfterLoad) const
+{
+	TWeakObjectPtr<ADSMGameMode> gameMode = Cast<ADSMGameMode>(GetOuter());
+	if (gameMode.IsValid())
+	{
+		// Journaled saves of this session must be written before the slot is read
+		_saveJournal.Flush(false);
+		if (_bRestoreInPlace)
+		{
+			gameMode->RestoreSlotInPlace(slotName, deleteSlotAfterLoad);
+			return;
+		}
+		// Slot is read in parallel to the level load, memory slots are not read at all
+		if (!HasMemorySlot(slotName))
+		{
+			PrefetchSlot(slotName, _bLazyLoad && !deleteSlotAfterLoad);
+		}
+		ADSMGameMode::SetSaveLoadInfo({ slotName, deleteSlotAfterLoad });
+		UGameplayStatics::OpenLevel(GetWorld(), *GetWorld()->GetName(), false);
 	}
 	else
 	{
-		UE_LOG(LogDSM, Log, TEXT("Failed to delete DSM package"));
+		UE_LOG(LogDSM, Warning, TEXT("SaveGame owner must be DSMGameMode"));
 	}
-	// Dont know why, but if this is called and not even used before saving the package
-	// there is no crash
-	UMetaData* MetaData = _dsmPackage->GetMetaData();
+}
 
-	FSavePackageArgs args;
-	args.TopLevelFlags = EObjectFlags::RF_Public | EObjectFlags::RF_Standalone;
-	if (UPackage::SavePackage(_dsmPackage, nullptr, *packageFilePath, args))
+void UDSMSaveGame::RestoreState(int32 historyIndex, bool keepState /*= false*/) const
+{
+	if (ADSMGameMode* gameMode = Cast<ADSMGameMode>(GetOuter()))
 	{
-		UE_LOG(LogDSM, Log, TEXT("DSM package saved successfully"));
+		gameMode->RestoreStateInPlace(historyIndex, keepState);
 	}
 	else
 	{
-		UE_LOG(LogDSM, Error, TEXT("DSM package save failed"));
+		UE_LOG(LogDSM, Warning, TEXT("SaveGame owner must be DSMGameMode"));
 	}
 }
 
+
+
+void UDSMSaveGame::PrepareSerialization()
+{
+	// Data assets are stored as snapshots inside the save game, no package is required
+	_historyStore.WriteSnapshots(_dataSnapshots);
+}
+
 void UDSMSaveGame::PostDeserialization(TWeakObjectPtr<UObject> parent, const FString& slotName)
 {
+	if (_dataSnapshots.Num() > 0)
+	{
+		_historyStore.ReadSnapshots(_dataSnapshots);
+		_dataSnapshots.Empty();
+		return;
+	}
+
+	// Save games written before data snapshots existed, store the data assets inside a package
 	const FString packageName = NameToPackageName(slotName);
 	// Expect existing package on load
 	UPackage* dsmPackage = LoadPackage(nullptr, *packageName, LOAD_NoRedirects);
@@ -104,22 +292,28 @@ void UDSMSaveGame::PostDeserialization(TWeakObjectPtr<UObject> parent, const FSt
 		elem->MarkAsGarbage();
 	}
 	UE_LOG(LogDSM, Log, TEXT("Found elements in package on deserialization %d"), foundObjects.Num());
-	for (FDSMNodeID& node : _stateMachineHistory)
+
+	// Save games written before the history store existed, store the history as node ids
+	if (_stateMachineHistory_DEPRECATED.Num() > 0)
 	{
-		node.PostDeserialization(foundObjectMap);
+		// Data maps are relinked in parallel, only adding them to the history stays in order
+		ParallelFor(_stateMachineHistory_DEPRECATED.Num(), [this, &foundObjectMap](int32 i)
+			{
+				_stateMachineHistory_DEPRECATED[i].PostDeserialization(foundObjectMap);
+			});
+		for (const FDSMNodeID& node : _stateMachineHistory_DEPRECATED)
+		{
+			_historyStore.Add(node);
+		}
+		_stateMachineHistory_DEPRECATED.Empty();
 	}
 }
 
 void UDSMSaveGame::AddMemory(TWeakObjectPtr<UDSMDefaultNode> node, const TMap<FName, TObjectPtr<UDSMDataAsset>>& DataReferences)
 {
-	TMap<FName, TObjectPtr<UDSMDataAsset>> copiedInstances = DataReferences;
 	for (TTuple<FName, UDSMDataAsset*> tuple : DataReferences)
 	{
-		if (tuple.Value)
-		{
-			copiedInstances[tuple.Key] = tuple.Value;
-		}
-		else
+		if (!tuple.Value)
 		{
 			UE_LOG(LogDSM, Log, TEXT("Node %s did not read/modify referenced data asset %s and no other node created a data asset instance of this type."),
 				*node->GetOwner()->GetName(), *(tuple.Value ? tuple.Value->GetName() : FString("None")));
@@ -127,20 +321,13 @@ void UDSMSaveGame::AddMemory(TWeakObjectPtr<UDSMDefaultNode> node, const TMap<FN
 		}
 	}
 
-	FDSMNodeID newNode;
-	// If node or actor was destroyed during node, we still try to get the instance for the history
-	if (node.IsValid(true))
-	{
-		newNode._node = node;
-		newNode._nodeLabel = node.Get(true)->GetFName();
-		newNode._nodeClass = node.Get(true)->GetClass();
-		newNode._owner = node.Get(true)->GetOwner();
-		newNode._ownerClass = node.Get(true)->GetOwner()->GetClass();
-		newNode._ownerLabel = node.Get(true)->GetOwner()->GetFName();
-	}
-	newNode._data = copiedInstances;
-	_stateMachineHistory.Emplace(newNode);
-	UpdateData();
+	// Data assets without instance are not stored in the history
+	OnHistoryElementAdded(_historyStore.Add(FDSMNodeRecord::Create(node), DataReferences));
+	const bool bAutosaveNode = node.IsValid() && _autosaveNodeClasses.ContainsByPredicate([&node](const TSubclassOf<UDSMDefaultNode>& nodeClass)
+		{
+			return nodeClass && node->IsA(nodeClass);
+		});
+	_autosave.OnHistoryElementAdded(bAutosaveNode);
 }
 
 TObjectPtr<UDSMDataAsset> UDSMSaveGame::GetDataCopy(const TWeakObjectPtr<UDSMDataAsset> DefaultDataAssetObject) const
@@ -166,15 +353,7 @@ TWeakObjectPtr<UDSMDataAsset> UDSMSaveGame::GetLatestDataAssetOfType(const TWeak
 {
 	if (DefaultDataAssetObject.IsValid())
 	{
-		TArray<FDSMNodeID> historyCopy = _stateMachineHistory;
-		Algo::Reverse(historyCopy);
-		for (const FDSMNodeID& node : historyCopy)
-		{
-			if (node._data.Contains(DefaultDataAssetObject->GetFName()))
-			{
-				return node._data[DefaultDataAssetObject->GetFName()];
-			}
-		}
+		return GetDataAssetAtHistoryIndex(DefaultDataAssetObject->GetFName(), _replayIndex != INDEX_NONE ? _replayIndex : _historyStore.Num() - 1);
 	}
 	else
 	{
@@ -183,71 +362,781 @@ TWeakObjectPtr<UDSMDataAsset> UDSMSaveGame::GetLatestDataAssetOfType(const TWeak
 	return nullptr;
 }
 
+TWeakObjectPtr<UDSMDataAsset> UDSMSaveGame::GetDataAssetAtHistoryIndex(FName key, int32 historyIndex) const
+{
+	const int32 version = _historyStore.FindDataVersion(key, historyIndex);
+	if (version == INDEX_NONE)
+	{
+		return nullptr;
+	}
+	// Older versions might be paged out
+	EnsureHistoryResident(version, 1);
+	return _historyStore.FindDataAt(key, version);
+}
+
+UDSMDataAsset* UDSMSaveGame::GetDataCopyAtHistoryIndex(UDSMDataAsset* defaultDataAsset, int32 historyIndex) const
+{
+	if (!defaultDataAsset || !_historyStore.IsValidIndex(historyIndex))
+	{
+		UE_LOG(LogDSM, Warning, TEXT("Invalid data asset or history index passed to GetDataCopyAtHistoryIndex"));
+		return nullptr;
+	}
+	TWeakObjectPtr<UDSMDataAsset> version = GetDataAssetAtHistoryIndex(defaultDataAsset->GetFName(), historyIndex);
+	TObjectPtr<UDSMDataAsset> copy = DuplicateObject<UDSMDataAsset>(version.IsValid() ? version.Get() : defaultDataAsset, GetTransientPackage());
+	if (copy)
+	{
+		copy->OnRequestDeepCopy(copy);
+	}
+	return copy;
+}
+
 void UDSMSaveGame::UpdateData()
 {
 	_data.Empty();
-	TArray<FDSMNodeID> historyCopy = _stateMachineHistory;
-	Algo::Reverse(historyCopy);
-	for (const FDSMNodeID& node : historyCopy)
+	TArray<FName> keys;
+	_historyStore.GetDataKeys(keys);
+	for (const FName& key : keys)
+	{
+		_data.Add(key, _historyStore.FindLatestData(key));
+	}
+}
+
+// Compression settings of native save files
+static void GetSaveCompression(FName& outCompressionFormat, int32& outBlockSize)
+{
+	const UDSMSettings* settings = GetDefault<UDSMSettings>();
+	outCompressionFormat = settings->_saveCompressionFormat;
+	outBlockSize = settings->_saveCompressionBlockSizeKB * 1024;
+	if (!outCompressionFormat.IsNone() && !FCompression::IsFormatValid(outCompressionFormat))
+	{
+		UE_LOG(LogDSM, Warning, TEXT("Save compression format %s is not available, the save file is not compressed"), *outCompressionFormat.ToString());
+		outCompressionFormat = NAME_None;
+	}
+}
+
+// Removes the save game slot of a slot name, can be called from any thread
+static void DeleteSaveGameSlot(const FString& slotName)
+{
+	ISaveGameSystem* saveSystem = IPlatformFeaturesModule::Get().GetSaveGameSystem();
+	if (saveSystem && saveSystem->DoesSaveGameExist(*slotName, 0))
+	{
+		saveSystem->DeleteGame(false, *slotName, 0);
+	}
+}
+
+// Removes native save file, journal and manifest of a slot, can be called from any thread
+static void DeleteNativeSaveFiles(const FString& slotName)
+{
+	IFileManager::Get().Delete(*FDSMSaveFile::GetFilePath(slotName), false, false, true);
+	IFileManager::Get().Delete(*FDSMSaveJournal::GetFilePath(slotName), false, false, true);
+	IFileManager::Get().Delete(*FDSMSlotStore::GetManifestPath(slotName), false, false, true);
+}
+
+// Writes a captured native save file as single file or into the shared store, can be called from any thread
+// Both replace the previous save of the slot only after they were written completely, stale save games of the other formats are removed afterwards
+static bool WriteSaveFile(const FString& slotName, FDSMSaveFile& saveFile, bool bSharedStore)
+{
+	const bool bSuccess = bSharedStore
+		? FDSMSlotStore::Write(slotName, saveFile, GetDefault<UDSMSettings>()->_sharedStoreSegmentSize)
+		: FDSMSaveJournal::WriteBaseFile(slotName, saveFile);
+	if (bSuccess)
+	{
+		DeleteSaveGameSlot(slotName);
+	}
+	return bSuccess;
+}
+
+// Sizes and timings of a written native save file
+static FDSMSaveResult MakeSaveResult(const FString& slotName, const FDSMSaveFile& saveFile, bool bSuccess, double captureSeconds, double writeSeconds)
+{
+	FDSMSaveResult result;
+	result._slotName = slotName;
+	result._bSuccess = bSuccess;
+	result._compressionFormat = saveFile._compressionFormat;
+	result._uncompressedBytes = static_cast<int32>(FMath::Min<int64>(saveFile._uncompressedBytes, MAX_int32));
+	result._storedBytes = static_cast<int32>(FMath::Min<int64>(saveFile._storedBytes, MAX_int32));
+	result._compressionRatio = saveFile._storedBytes > 0 ? static_cast<float>(static_cast<double>(saveFile._uncompressedBytes) / saveFile._storedBytes) : 1.f;
+	result._captureMilliseconds = static_cast<float>(captureSeconds * 1000.0);
+	result._writeMilliseconds = static_cast<float>(writeSeconds * 1000.0);
+	return result;
+}
+
+// Sizes and timings of a save game slot, slots are never compressed by DSM
+static FDSMSaveResult MakeSaveResult(const FString& slotName, int32 bytes, bool bSuccess, double captureSeconds, double writeSeconds)
+{
+	FDSMSaveResult result;
+	result._slotName = slotName;
+	result._bSuccess = bSuccess;
+	result._uncompressedBytes = bytes;
+	result._storedBytes = bytes;
+	result._captureMilliseconds = static_cast<float>(captureSeconds * 1000.0);
+	result._writeMilliseconds = static_cast<float>(writeSeconds * 1000.0);
+	return result;
+}
+
+// Slot read on the save file pipe, see UDSMSaveGame::PrefetchSlot
+struct FDSMSlotPrefetch
+{
+	bool _bValid = false;
+	bool _bNativeFile = false;
+	bool _bSharedStore = false;
+	// Stored bytes of the native base file, the history is recreated while they are decompressed, see FDSMSaveFile::Load
+	TArray<uint8> _fileBytes;
+	// Slot of the shared store
+	FDSMSaveFile _saveFile;
+	// Serialized save game of save game slots
+	TArray<uint8> _slotData;
+	// Mapped native file without journal, if the slot is loaded lazily
+	TSharedPtr<FDSMSaveFileView> _saveFileView;
+};
+
+// Pending prefetch and the slot it reads
+struct FDSMPendingSlotPrefetch
+{
+	FString _slotName;
+	UE::Tasks::TTask<TSharedPtr<FDSMSlotPrefetch>> _task;
+};
+
+static TOptional<FDSMPendingSlotPrefetch> GSlotPrefetch;
+
+// Prefetched content of a slot is stale once the slot is written again
+static void DiscardSlotPrefetch(const FString& slotName)
+{
+	if (GSlotPrefetch.IsSet() && GSlotPrefetch->_slotName == slotName)
+	{
+		GSlotPrefetch.Reset();
+	}
+}
+
+void UDSMSaveGame::AsyncSaveState(int32 historyIndex, const FString& slotName, bool keepState /*= false*/)
+{
+	if (_saveFormat == EDSMSaveFormat::JournaledFile)
+	{
+		SaveJournal(historyIndex, slotName, keepState, false);
+		return;
+	}
+	TWeakObjectPtr<UDSMSaveGame> weakThis = this;
+	const double captureStart = FPlatformTime::Seconds();
+	if (_saveFormat == EDSMSaveFormat::NativeFile || _saveFormat == EDSMSaveFormat::SharedStore)
 	{
-		for (const TTuple<FName, TObjectPtr<UDSMDataAsset>>& elem : node._data)
+		// Game thread only captures the history and writes the data snapshots into memory
+		TSharedPtr<FDSMSaveFile> saveFile = MakeShared<FDSMSaveFile>();
+		if (CaptureSaveFile(historyIndex, slotName, keepState, *saveFile))
 		{
-			if (!_data.Contains(elem.Key))
-			{
-				_data.Add(elem);
-			}
+			WriteSaveFileAsync(saveFile, slotName, FPlatformTime::Seconds() - captureStart);
 		}
+		return;
 	}
+
+	// Game thread copies the history and serializes the save game, UObjects are never accessed by the background task
+	TObjectPtr<UDSMSaveGame> saveGame = SaveState_Internal(historyIndex, slotName, keepState);
+	if (!saveGame)
+	{
+		return;
+	}
+	TArray<uint8> saveData;
+	const bool bSerialized = UGameplayStatics::SaveGameToMemory(saveGame, saveData);
+	const double captureSeconds = FPlatformTime::Seconds() - captureStart;
+	// Slot is written in order with the native save files, loads wait for it
+	FDSMSaveJournal::LaunchWrite([saveData = MoveTemp(saveData), bSerialized, slotName, weakThis, captureSeconds]()
+		{
+			const double writeStart = FPlatformTime::Seconds();
+			ISaveGameSystem* saveSystem = IPlatformFeaturesModule::Get().GetSaveGameSystem();
+			const bool bSuccess = bSerialized && saveSystem && saveSystem->SaveGame(false, *slotName, 0, saveData);
+			if (bSuccess)
+			{
+				DeleteNativeSaveFiles(slotName);
+			}
+			const FDSMSaveResult result = MakeSaveResult(slotName, saveData.Num(), bSuccess, captureSeconds, FPlatformTime::Seconds() - writeStart);
+			AsyncTask(ENamedThreads::GameThread, [weakThis, result]()
+				{
+					OnAsyncSaveCompleted(weakThis, result);
+				});
+		});
 }
 
-void UDSMSaveGame::AsyncSaveState(int32 historyIndex, const FString& slotName, bool keepState /*= false*/)
+void UDSMSaveGame::WriteSaveFileAsync(TSharedPtr<FDSMSaveFile> saveFile, const FString& slotName, double captureSeconds)
 {
-	
-	FAsyncSaveGameToSlotDelegate SavedDelegate;
-	// USomeUObjectClass::SaveGameDelegateFunction is a void function that takes the following parameters: const FString& SlotName, const int32 UserIndex, bool bSuccess
-	SavedDelegate.BindLambda([this](const FString& s, const int32 i , bool b)
+	TWeakObjectPtr<UDSMSaveGame> weakThis = this;
+	const bool bSharedStore = _saveFormat == EDSMSaveFormat::SharedStore;
+	// Writes of all slots are serialized, overlapping saves of a slot are written in the order they were captured
+	FDSMSaveJournal::LaunchWrite([saveFile, slotName, weakThis, captureSeconds, bSharedStore]()
 		{
-			OnAsyncSaveFinished.Broadcast();
+			const double writeStart = FPlatformTime::Seconds();
+			const bool bSuccess = WriteSaveFile(slotName, *saveFile, bSharedStore);
+			const FDSMSaveResult result = MakeSaveResult(slotName, *saveFile, bSuccess, captureSeconds, FPlatformTime::Seconds() - writeStart);
+			AsyncTask(ENamedThreads::GameThread, [weakThis, result]()
+				{
+					OnAsyncSaveCompleted(weakThis, result);
+				});
 		});
+}
 
-	// Start async save process.
-	TObjectPtr<UDSMSaveGame> saveGame = SaveState_Internal(historyIndex, slotName, keepState);
-	UGameplayStatics::AsyncSaveGameToSlot(saveGame, slotName, 0, SavedDelegate);
+void UDSMSaveGame::OnAsyncSaveCompleted(TWeakObjectPtr<UDSMSaveGame> saveGame, const FDSMSaveResult& result)
+{
+	if (!result._bSuccess)
+	{
+		UE_LOG(LogDSM, Error, TEXT("Async save of DSM slot %s failed"), *result._slotName);
+	}
+	if (saveGame.IsValid())
+	{
+		saveGame->SetSaveResult(result);
+		saveGame->OnAsyncSaveFinished.Broadcast();
+	}
+}
+
+void UDSMSaveGame::SetSaveResult(const FDSMSaveResult& result) const
+{
+	_lastSaveResult = result;
+	if (result._bSuccess)
+	{
+		UE_LOG(LogDSM, Log, TEXT("Saved DSM slot %s, %d bytes stored, %d bytes uncompressed (ratio %.2f, %s), capture %.2f ms, write %.2f ms"),
+			*result._slotName, result._storedBytes, result._uncompressedBytes, result._compressionRatio, *result._compressionFormat.ToString(),
+			result._captureMilliseconds, result._writeMilliseconds);
+	}
 }
 
 void UDSMSaveGame::SaveState(int32 historyIndex, const FString& slotName, bool keepState /*= false*/) const
 {
+	if (_saveFormat == EDSMSaveFormat::JournaledFile)
+	{
+		SaveJournal(historyIndex, slotName, keepState, true);
+		return;
+	}
+	const double captureStart = FPlatformTime::Seconds();
+	if (_saveFormat == EDSMSaveFormat::NativeFile || _saveFormat == EDSMSaveFormat::SharedStore)
+	{
+		FDSMSaveFile saveFile;
+		if (CaptureSaveFile(historyIndex, slotName, keepState, saveFile))
+		{
+			// Pending async saves of the slot must not replace this save afterwards
+			FDSMSaveJournal::WaitForPendingWrites();
+			const double writeStart = FPlatformTime::Seconds();
+			const bool bSuccess = WriteSaveFile(slotName, saveFile, _saveFormat == EDSMSaveFormat::SharedStore);
+			SetSaveResult(MakeSaveResult(slotName, saveFile, bSuccess, writeStart - captureStart, FPlatformTime::Seconds() - writeStart));
+		}
+		return;
+	}
 	TObjectPtr<UDSMSaveGame> saveGame = SaveState_Internal(historyIndex, slotName, keepState);
-	UGameplayStatics::SaveGameToSlot(saveGame, slotName, 0);
+	if (saveGame)
+	{
+		FDSMSaveJournal::WaitForPendingWrites();
+		const double writeStart = FPlatformTime::Seconds();
+		TArray<uint8> saveData;
+		const bool bSuccess = UGameplayStatics::SaveGameToMemory(saveGame, saveData) && UGameplayStatics::SaveDataToSlot(saveData, slotName, 0);
+		if (bSuccess)
+		{
+			DeleteNativeSaveFiles(slotName);
+		}
+		SetSaveResult(MakeSaveResult(slotName, saveData.Num(), bSuccess, writeStart - captureStart, FPlatformTime::Seconds() - writeStart));
+	}
 }
 
+bool UDSMSaveGame::CaptureSaveFile(int32 historyIndex, const FString& slotName, bool keepState, FDSMSaveFile& outSaveFile) const
+{
+	if (!_historyStore.IsValidIndex(historyIndex))
+	{
+		UE_LOG(LogDSM, Warning, TEXT("Invalid Index passed to save/load state."));
+		return false;
+	}
+	if (!Cast<ADSMGameMode>(GetOuter()))
+	{
+		UE_LOG(LogDSM, Warning, TEXT("SaveGame owner must be DSMGameMode"));
+		return false;
+	}
 
-TObjectPtr<UDSMSaveGame> UDSMSaveGame::SaveState_Internal(int32 historyIndex, const FString& slotName, bool keepState /*= false*/) const
+	const int32 relevantNodes = keepState ? _historyStore.Num() : historyIndex + 1;
+	EnsureHistoryResident(0, relevantNodes);
+	outSaveFile = FDSMSaveFile::Capture(_historyStore, relevantNodes);
+	outSaveFile._indexToLoad = historyIndex;
+	outSaveFile._bKeepState = keepState;
+	PrepareSaveFile(slotName, outSaveFile);
+	return true;
+}
+
+void UDSMSaveGame::PrepareSaveFile(const FString& slotName, FDSMSaveFile& saveFile) const
 {
-	if (historyIndex < 0 || historyIndex >= _stateMachineHistory.Num())
+	GetSaveCompression(saveFile._compressionFormat, saveFile._compressionBlockSize);
+	saveFile._summary._metadata = _saveMetadata;
+	// Save file is replaced by the write, it must not stay mapped
+	DetachSaveFileView(slotName);
+	DiscardSlotPrefetch(slotName);
+	// Journal of the slot is removed by the write
+	_saveJournal.Invalidate(slotName);
+	_autosaveJournal.Invalidate(slotName);
+}
+
+// Named memory slots, rooted so they survive level loads
+static TMap<FString, TObjectPtr<UDSMSaveGame>> GMemorySlots;
+static FDelegateHandle GMemorySlotCleanup;
+
+static void ReleaseMemorySlots()
+{
+	for (TPair<FString, TObjectPtr<UDSMSaveGame>>& memorySlot : GMemorySlots)
+	{
+		if (memorySlot.Value)
+		{
+			memorySlot.Value->RemoveFromRoot();
+		}
+	}
+	GMemorySlots.Empty();
+}
+
+// Memory slots belong to the play session, they are released when the session ends, e.g. at the end of PIE
+// Level loads only clean up a world without ending the session
+static void RegisterMemorySlotCleanup()
+{
+	if (GMemorySlotCleanup.IsValid())
+	{
+		return;
+	}
+	GMemorySlotCleanup = FWorldDelegates::OnWorldCleanup.AddLambda([](UWorld* world, bool bSessionEnded, bool bCleanupResources)
+		{
+			if (bSessionEnded && world && world->IsGameWorld())
+			{
+				ReleaseMemorySlots();
+			}
+		});
+}
+
+void UDSMSaveGame::SaveStateToMemory(int32 historyIndex, const FString& slotName, bool keepState /*= false*/, bool flushToDisc /*= false*/)
+{
+	if (!_historyStore.IsValidIndex(historyIndex))
 	{
 		UE_LOG(LogDSM, Warning, TEXT("Invalid Index passed to save/load state."));
-		return nullptr;
+		return;
+	}
+
+	RegisterMemorySlotCleanup();
+	TObjectPtr<UDSMSaveGame>& memorySlot = GMemorySlots.FindOrAdd(slotName);
+	if (memorySlot)
+	{
+		memorySlot->RemoveFromRoot();
+	}
+	memorySlot = CopyHistory(historyIndex, keepState);
+	memorySlot->AddToRoot();
+	if (flushToDisc)
+	{
+		FlushMemorySlot(slotName);
+	}
+}
+
+TObjectPtr<UDSMSaveGame> UDSMSaveGame::CopyHistory(int32 historyIndex, bool keepState) const
+{
+	const int32 relevantNodes = keepState ? _historyStore.Num() : historyIndex + 1;
+	// Copies hold their data assets, paged out data is loaded again before it is shared
+	EnsureHistoryResident(0, relevantNodes);
+	// Data asset versions of the history never change, so the copy references them instead of copying
+	TObjectPtr<UDSMSaveGame> saveGame = NewObject<UDSMSaveGame>();
+	saveGame->_historyStore.CopyFrom(_historyStore, relevantNodes);
+	saveGame->_indexToLoad = historyIndex;
+	saveGame->_keepState = keepState;
+	saveGame->_saveMetadata = _saveMetadata;
+	return saveGame;
+}
+
+void UDSMSaveGame::FlushMemorySlot(const FString& slotName)
+{
+	const TObjectPtr<UDSMSaveGame>* memorySlot = GMemorySlots.Find(slotName);
+	if (!memorySlot)
+	{
+		UE_LOG(LogDSM, Warning, TEXT("Memory slot %s does not exist"), *slotName);
+		return;
+	}
+	const double captureStart = FPlatformTime::Seconds();
+	const UDSMSaveGame* memorySaveGame = *memorySlot;
+	TSharedPtr<FDSMSaveFile> saveFile = MakeShared<FDSMSaveFile>(FDSMSaveFile::Capture(memorySaveGame->_historyStore, memorySaveGame->_historyStore.Num()));
+	saveFile->_indexToLoad = memorySaveGame->_indexToLoad;
+	saveFile->_bKeepState = memorySaveGame->_keepState;
+	PrepareSaveFile(slotName, *saveFile);
+	WriteSaveFileAsync(saveFile, slotName, FPlatformTime::Seconds() - captureStart);
+}
+
+bool UDSMSaveGame::GetSlotInfo(const FString& slotName, FDSMSlotInfo& slotInfo)
+{
+	FDSMSaveFile::FSummary summary;
+	if (!FDSMSaveJournal::ReadSummary(slotName, summary) && !FDSMSlotStore::ReadSummary(slotName, summary))
+	{
+		return false;
+	}
+	slotInfo._slotName = slotName;
+	slotInfo._historyNum = summary._historyNum;
+	slotInfo._lastNodeClass = TSoftClassPtr<UActorComponent>(FSoftObjectPath(summary._lastNodeClass));
+	slotInfo._lastNodeLabel = summary._lastNodeLabel.IsEmpty() ? NAME_None : FName(*summary._lastNodeLabel);
+	slotInfo._timestamp = FDateTime(summary._timestamp);
+	slotInfo._metadata = MoveTemp(summary._metadata);
+	return true;
+}
+
+TArray<FDSMSlotInfo> UDSMSaveGame::EnumerateSlots()
+{
+	// Files are replaced as a whole and incomplete journal records are ignored, slots with pending writes are listed with their last written summary
+	// Save menus therefore never wait for background writes
+	TArray<FString> fileNames;
+	TArray<FString> manifestNames;
+	const FString saveDir = FPaths::GetPath(FDSMSaveFile::GetFilePath(TEXT("Slot")));
+	IFileManager::Get().FindFiles(fileNames, *saveDir, TEXT("dsm"));
+	IFileManager::Get().FindFiles(manifestNames, *saveDir, TEXT("dsmm"));
+	fileNames.Append(manifestNames);
+	TSet<FString> slotNames;
+	TArray<FDSMSlotInfo> slots;
+	slots.Reserve(fileNames.Num());
+	for (const FString& fileName : fileNames)
+	{
+		bool bAlreadyListed = false;
+		slotNames.Add(FPaths::GetBaseFilename(fileName), &bAlreadyListed);
+		FDSMSlotInfo slotInfo;
+		if (!bAlreadyListed && GetSlotInfo(FPaths::GetBaseFilename(fileName), slotInfo))
+		{
+			slots.Add(MoveTemp(slotInfo));
+		}
 	}
+	slots.Sort([](const FDSMSlotInfo& a, const FDSMSlotInfo& b) { return a._timestamp > b._timestamp; });
+	return slots;
+}
+
+bool UDSMSaveGame::HasMemorySlot(const FString& slotName)
+{
+	return GMemorySlots.Contains(slotName);
+}
 
-	TArray<FDSMNodeID> relevantNodes = {};
-	if (keepState)
+void UDSMSaveGame::DeleteMemorySlot(const FString& slotName)
+{
+	TObjectPtr<UDSMSaveGame> memorySlot = nullptr;
+	if (GMemorySlots.RemoveAndCopyValue(slotName, memorySlot) && memorySlot)
 	{
-		relevantNodes = _stateMachineHistory;
+		memorySlot->RemoveFromRoot();
+	}
+}
+
+void UDSMSaveGame::SaveJournal(int32 historyIndex, const FString& slotName, bool keepState, bool bWait) const
+{
+	if (!_historyStore.IsValidIndex(historyIndex))
+	{
+		UE_LOG(LogDSM, Warning, TEXT("Invalid Index passed to save/load state."));
+		return;
+	}
+	if (!Cast<ADSMGameMode>(GetOuter()))
+	{
+		UE_LOG(LogDSM, Warning, TEXT("SaveGame owner must be DSMGameMode"));
+		return;
+	}
+
+	const int32 relevantNodes = keepState ? _historyStore.Num() : historyIndex + 1;
+	// Only entries added since the last save are captured, older entries might stay paged out
+	// Saving less entries than before starts a new base file
+	const int32 journaledNum = _saveJournal.GetCapturedNum(slotName, _historyStore);
+	const int32 capturedNum = journaledNum <= relevantNodes ? journaledNum : 0;
+	EnsureHistoryResident(capturedNum, relevantNodes - capturedNum);
+	// Base file might be replaced by the journal
+	DetachSaveFileView(slotName);
+	DiscardSlotPrefetch(slotName);
+	if (capturedNum == 0 && UGameplayStatics::DoesSaveGameExist(slotName, 0))
+	{
+		UGameplayStatics::DeleteGameInSlot(slotName, 0);
+	}
+	FName compressionFormat;
+	int32 compressionBlockSize = 0;
+	GetSaveCompression(compressionFormat, compressionBlockSize);
+	// Autosaves to the same slot start with a new base file afterwards
+	_autosaveJournal.Invalidate(slotName);
+	ConfigureSaveJournal();
+	_saveJournal.Capture(_historyStore, relevantNodes, slotName, historyIndex, keepState, compressionFormat, compressionBlockSize, _saveMetadata);
+	if (bWait)
+	{
+		_saveJournal.Flush(true);
 	}
 	else
 	{
-		relevantNodes.Append(_stateMachineHistory.GetData(), historyIndex + 1);
+		_saveJournal.ScheduleFlush();
+	}
+}
+
+void UDSMSaveGame::StartAutosave()
+{
+	if (!_bAutosave || _autosaveSlotName.IsEmpty())
+	{
+		StopAutosave();
+		return;
+	}
+	TWeakObjectPtr<UDSMSaveGame> weakThis = this;
+	// Every capture is written immediately, the journal is merged into the base file like journaled saves
+	_autosaveJournal.Configure(0.f, _journalCompactionRecords,
+		[weakThis](const FString& slotName, const FDSMSaveFile& written, bool bSuccess, double writeSeconds)
+		{
+			const FDSMSaveResult result = MakeSaveResult(slotName, written, bSuccess, 0.0, writeSeconds);
+			AsyncTask(ENamedThreads::GameThread, [weakThis, result]()
+				{
+					OnAsyncSaveCompleted(weakThis, result);
+				});
+		});
+	_autosave.Start(_autosaveHistoryInterval, _autosaveIntervalSeconds, _autosaveCoalesceSeconds,
+		[weakThis]()
+		{
+			return weakThis.IsValid() && weakThis->CaptureAutosave();
+		});
+}
+
+void UDSMSaveGame::StopAutosave()
+{
+	_autosave.Stop();
+	_autosaveJournal.Reset();
+}
+
+bool UDSMSaveGame::CaptureAutosave() const
+{
+	// Only history elements added since the previous autosave are captured, older elements might stay paged out
+	const int32 capturedNum = _autosaveJournal.GetCapturedNum(_autosaveSlotName, _historyStore);
+	if (_historyStore.Num() == 0 || capturedNum == _historyStore.Num())
+	{
+		return false;
+	}
+	EnsureHistoryResident(capturedNum, _historyStore.Num() - capturedNum);
+	// Base file might be replaced by the autosave or its compaction
+	DetachSaveFileView(_autosaveSlotName);
+	DiscardSlotPrefetch(_autosaveSlotName);
+	_saveJournal.Invalidate(_autosaveSlotName);
+	FName compressionFormat;
+	int32 compressionBlockSize = 0;
+	GetSaveCompression(compressionFormat, compressionBlockSize);
+	_autosaveJournal.Capture(_historyStore, _historyStore.Num(), _autosaveSlotName, _historyStore.Num() - 1, false, compressionFormat, compressionBlockSize, _saveMetadata);
+	_autosaveJournal.Flush(false);
+	return true;
+}
+
+void UDSMSaveGame::ConfigureSaveJournal() const
+{
+	TWeakObjectPtr<UDSMSaveGame> weakThis = const_cast<UDSMSaveGame*>(this);
+	_saveJournal.Configure(_journalFlushIntervalSeconds, _journalCompactionRecords,
+		[weakThis](const FString& slotName, const FDSMSaveFile& written, bool bSuccess, double writeSeconds)
+		{
+			const FDSMSaveResult result = MakeSaveResult(slotName, written, bSuccess, 0.0, writeSeconds);
+			AsyncTask(ENamedThreads::GameThread, [weakThis, result]()
+				{
+					OnAsyncSaveCompleted(weakThis, result);
+				});
+		});
+}
+
+void UDSMSaveGame::PrefetchSlot(const FString& slotName, bool bLazy)
+{
+	// Slot is read once all pending writes are written, later writes of the slot discard the prefetch
+	GSlotPrefetch = FDSMPendingSlotPrefetch{ slotName, FDSMSaveJournal::LaunchRead([slotName, bLazy]()
+		{
+			TSharedPtr<FDSMSlotPrefetch> prefetch = MakeShared<FDSMSlotPrefetch>();
+			const FString filePath = FDSMSaveFile::GetFilePath(slotName);
+			if (IFileManager::Get().FileExists(*filePath))
+			{
+				prefetch->_bNativeFile = true;
+				if (bLazy && !IFileManager::Get().FileExists(*FDSMSaveJournal::GetFilePath(slotName)))
+				{
+					prefetch->_saveFileView = FDSMSaveFileView::Open(filePath);
+					prefetch->_bValid = prefetch->_saveFileView.IsValid();
+					if (prefetch->_bValid)
+					{
+						return prefetch;
+					}
+				}
+				// Only the stored bytes are read, they are decompressed block by block while the history is recreated
+				prefetch->_bValid = FFileHelper::LoadFileToArray(prefetch->_fileBytes, *filePath);
+				return prefetch;
+			}
+			if (IFileManager::Get().FileExists(*FDSMSlotStore::GetManifestPath(slotName)))
+			{
+				prefetch->_bSharedStore = true;
+				prefetch->_bValid = FDSMSlotStore::Read(slotName, prefetch->_saveFile);
+				return prefetch;
+			}
+			ISaveGameSystem* saveSystem = IPlatformFeaturesModule::Get().GetSaveGameSystem();
+			prefetch->_bValid = saveSystem && saveSystem->DoesSaveGameExist(*slotName, 0) && saveSystem->LoadGame(false, *slotName, 0, prefetch->_slotData);
+			return prefetch;
+		}) };
+}
+
+bool UDSMSaveGame::LoadPrefetchedSlot(const FString& slotName, bool bLazy, TObjectPtr<UDSMSaveGame>& outSaveGame)
+{
+	if (!GSlotPrefetch.IsSet())
+	{
+		return false;
+	}
+	FDSMPendingSlotPrefetch pendingPrefetch = MoveTemp(GSlotPrefetch.GetValue());
+	GSlotPrefetch.Reset();
+	if (pendingPrefetch._slotName != slotName)
+	{
+		return false;
+	}
+	// Waits only for the remaining part of the read, which did not finish during the level load
+	TSharedPtr<FDSMSlotPrefetch> prefetch = pendingPrefetch._task.GetResult();
+	if (!prefetch->_bValid)
+	{
+		outSaveGame = nullptr;
+		return true;
+	}
+	if (prefetch->_saveFileView)
+	{
+		outSaveGame = LoadSaveFileView(prefetch->_saveFileView, bLazy);
+		return true;
+	}
+	if (prefetch->_bNativeFile)
+	{
+		// History is restored while the prefetched file is decompressed, journal records are appended afterwards
+		FDSMSaveFile saveFile;
+		FMemoryReader reader(prefetch->_fileBytes, true);
+		outSaveGame = NewObject<UDSMSaveGame>();
+		if (!saveFile.Load(reader, outSaveGame->_historyStore) || !FDSMSaveJournal::Replay(slotName, outSaveGame->_historyStore, saveFile))
+		{
+			outSaveGame = nullptr;
+			return true;
+		}
+		outSaveGame->_indexToLoad = saveFile._indexToLoad;
+		outSaveGame->_keepState = saveFile._bKeepState;
+		return true;
+	}
+	if (prefetch->_bSharedStore)
+	{
+		outSaveGame = NewObject<UDSMSaveGame>();
+		prefetch->_saveFile.Restore(outSaveGame->_historyStore);
+		outSaveGame->_indexToLoad = prefetch->_saveFile._indexToLoad;
+		outSaveGame->_keepState = prefetch->_saveFile._bKeepState;
+		return true;
+	}
+	outSaveGame = Cast<UDSMSaveGame>(UGameplayStatics::LoadGameFromMemory(prefetch->_slotData));
+	if (outSaveGame)
+	{
+		outSaveGame->PostDeserialization(nullptr, slotName);
+	}
+	return true;
+}
+
+TObjectPtr<UDSMSaveGame> UDSMSaveGame::LoadSaveFileView(TSharedPtr<FDSMSaveFileView> saveFileView, bool bLazy)
+{
+	const FDSMSaveFile& index = saveFileView->GetIndex();
+	TObjectPtr<UDSMSaveGame> saveGame = NewObject<UDSMSaveGame>();
+	saveGame->_indexToLoad = index._indexToLoad;
+	saveGame->_keepState = index._bKeepState;
+	if (!bLazy)
+	{
+		saveFileView->RestoreEntries(saveGame->_historyStore, index._entries.Num());
+		saveFileView->ResolveAll(saveGame->_historyStore);
+		return saveGame;
+	}
+	// History elements after the loaded index are only restored, if the entire state is kept
+	saveFileView->RestoreEntries(saveGame->_historyStore, index._bKeepState ? index._entries.Num() : index._indexToLoad + 1);
+	saveGame->_saveFileView = saveFileView;
+	return saveGame;
+}
+
+TObjectPtr<UDSMSaveGame> UDSMSaveGame::LoadSlot(const FString& slotName, bool bLazy)
+{
+	// Memory slots are restored without any file IO, the history is copied from the slot
+	// The slot itself stays unchanged, so it can be loaded again
+	if (const TObjectPtr<UDSMSaveGame>* memorySlot = GMemorySlots.Find(slotName))
+	{
+		return (*memorySlot)->CopyHistory((*memorySlot)->_indexToLoad, (*memorySlot)->_keepState);
+	}
+	TObjectPtr<UDSMSaveGame> prefetchedSaveGame = nullptr;
+	if (LoadPrefetchedSlot(slotName, bLazy, prefetchedSaveGame))
+	{
+		return prefetchedSaveGame;
+	}
+
+	// Journaled saves might still be written in the background
+	FDSMSaveJournal::WaitForPendingWrites();
+	const FString filePath = FDSMSaveFile::GetFilePath(slotName);
+	if (IFileManager::Get().FileExists(*filePath))
+	{
+		// Journaled slots are always read entirely, journal records are appended to the history
+		if (bLazy && !IFileManager::Get().FileExists(*FDSMSaveJournal::GetFilePath(slotName)))
+		{
+			if (TSharedPtr<FDSMSaveFileView> saveFileView = FDSMSaveFileView::Open(filePath))
+			{
+				return LoadSaveFileView(saveFileView, true);
+			}
+		}
+		// History is restored while the file is streamed, compressed blocks are decompressed one at a time
+		FDSMSaveFile saveFile;
+		TObjectPtr<UDSMSaveGame> saveGame = NewObject<UDSMSaveGame>();
+		if (!saveFile.Load(filePath, saveGame->_historyStore) || !FDSMSaveJournal::Replay(slotName, saveGame->_historyStore, saveFile))
+		{
+			return nullptr;
+		}
+		saveGame->_indexToLoad = saveFile._indexToLoad;
+		saveGame->_keepState = saveFile._bKeepState;
+		return saveGame;
+	}
+
+	// Slots of the shared store are always read entirely, segments and snapshots are read from their blobs
+	if (IFileManager::Get().FileExists(*FDSMSlotStore::GetManifestPath(slotName)))
+	{
+		FDSMSaveFile saveFile;
+		if (!FDSMSlotStore::Read(slotName, saveFile))
+		{
+			return nullptr;
+		}
+		TObjectPtr<UDSMSaveGame> saveGame = NewObject<UDSMSaveGame>();
+		saveFile.Restore(saveGame->_historyStore);
+		saveGame->_indexToLoad = saveFile._indexToLoad;
+		saveGame->_keepState = saveFile._bKeepState;
+		return saveGame;
+	}
+
+	// Save games stored inside a save game slot
+	TObjectPtr<UDSMSaveGame> saveGame = Cast<UDSMSaveGame>(UGameplayStatics::LoadGameFromSlot(slotName, 0));
+	if (saveGame)
+	{
+		saveGame->PostDeserialization(nullptr, slotName);
+	}
+	return saveGame;
+}
+
+void UDSMSaveGame::DeleteSlot(const FString& slotName)
+{
+	DeleteMemorySlot(slotName);
+	DiscardSlotPrefetch(slotName);
+	FDSMSaveJournal::WaitForPendingWrites();
+	IFileManager::Get().Delete(*FDSMSaveFile::GetFilePath(slotName), false, false, true);
+	IFileManager::Get().Delete(*FDSMSaveJournal::GetFilePath(slotName), false, false, true);
+	if (UGameplayStatics::DoesSaveGameExist(slotName, 0))
+	{
+		UGameplayStatics::DeleteGameInSlot(slotName, 0);
+	}
+	// Blobs of the shared store might still be used by other slots
+	const FString manifestPath = FDSMSlotStore::GetManifestPath(slotName);
+	if (IFileManager::Get().FileExists(*manifestPath))
+	{
+		IFileManager::Get().Delete(*manifestPath, false, false, true);
+		UE::Tasks::Launch(UE_SOURCE_LOCATION, []()
+			{
+				FDSMSlotStore::CollectGarbage();
+			});
 	}
+}
+
+
+TObjectPtr<UDSMSaveGame> UDSMSaveGame::SaveState_Internal(int32 historyIndex, const FString& slotName, bool keepState /*= false*/) const
+{
+	if (!_historyStore.IsValidIndex(historyIndex))
+	{
+		UE_LOG(LogDSM, Warning, TEXT("Invalid Index passed to save/load state."));
+		return nullptr;
+	}
+
+	const int32 relevantNodes = keepState ? _historyStore.Num() : historyIndex + 1;
+	EnsureHistoryResident(0, relevantNodes);
 	TWeakObjectPtr<ADSMGameMode> gameMode = Cast<ADSMGameMode>(GetOuter());
 	if (gameMode.IsValid())
 	{
 
 		TObjectPtr<UDSMSaveGame> saveGame = NewObject<UDSMSaveGame>();
-		saveGame->_stateMachineHistory = relevantNodes;
+		saveGame->_historyStore.CopyFrom(_historyStore, relevantNodes);
 		saveGame->_indexToLoad = historyIndex;
 		saveGame->_keepState = keepState;
-		saveGame->PrepareSerialization(slotName);
+		saveGame->PrepareSerialization();
+		// Native save file would be found first on load, it is removed once the save game slot was written
+		DetachSaveFileView(slotName);
+		DiscardSlotPrefetch(slotName);
+		_saveJournal.Invalidate(slotName);
+		_autosaveJournal.Invalidate(slotName);
 		return saveGame;
 		
 	}
@@ -259,21 +1148,17 @@ TObjectPtr<UDSMSaveGame> UDSMSaveGame::SaveState_Internal(int32 historyIndex, co
 }
 
 #if WITH_EDITOR
-bool UDSMSaveGame::CanEditChange(const FProperty* InProperty) const
+void UDSMSaveGame::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
 {
-	const bool ParentVal = Super::CanEditChange(InProperty);
-
-	// Can we edit flower color?
-	if (InProperty->GetFName() == GET_MEMBER_NAME_CHECKED(UDSMSaveGame, _indexToLoad))
+	Super::PostEditChangeProperty(PropertyChangedEvent);
+	// Scrubbing the history restores the index in place, the level is not reloaded
+	if (PropertyChangedEvent.GetPropertyName() == GET_MEMBER_NAME_CHECKED(UDSMSaveGame, _indexToLoad) && PropertyChangedEvent.ChangeType != EPropertyChangeType::Interactive)
 	{
-		if (_indexToLoad >= 0 && _indexToLoad < _stateMachineHistory.Num())
+		if (_indexToLoad >= 0 && _indexToLoad < _historyStore.Num())
 		{
-			SaveState(_indexToLoad, "DSMDefault", _keepState);
-			LoadState("DSMDefault", true);
+			RestoreState(_indexToLoad, _keepState);
 		}
 	}
-
-	return ParentVal;
 }
 #endif
 
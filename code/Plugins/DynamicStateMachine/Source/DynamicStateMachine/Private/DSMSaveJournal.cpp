@@ -0,0 +1,326 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DSMSaveJournal.h"
+#include "DSMSlotStore.h"
+#include "DSMLogInclude.h"
+#include "HAL/FileManager.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryWriter.h"
+#include "Serialization/MemoryReader.h"
+
+
+UE::Tasks::FPipe& FDSMSaveJournal::GetSaveFilePipe()
+{
+	static UE::Tasks::FPipe pipe(TEXT("DSMSaveFilePipe"));
+	return pipe;
+}
+
+bool FDSMSaveJournal::WriteBaseFile(const FString& slotName, FDSMSaveFile& saveFile)
+{
+	const FString filePath = FDSMSaveFile::GetFilePath(slotName);
+	const FString tempFilePath = filePath + TEXT(".tmp");
+	if (!saveFile.Write(tempFilePath) || !IFileManager::Get().Move(*filePath, *tempFilePath, true, true))
+	{
+		IFileManager::Get().Delete(*tempFilePath, false, false, true);
+		return false;
+	}
+	IFileManager::Get().Delete(*FDSMSaveJournal::GetFilePath(slotName), false, false, true);
+	IFileManager::Get().Delete(*FDSMSlotStore::GetManifestPath(slotName), false, false, true);
+	return true;
+}
+
+// Appends a record to the journal of a slot
+static bool AppendRecord(const FString& slotName, int32 firstIndex, FDSMSaveFile& record)
+{
+	TArray<uint8> recordBytes;
+	FMemoryWriter recordWriter(recordBytes);
+	if (!record.Serialize(recordWriter))
+	{
+		return false;
+	}
+	const FString filePath = FDSMSaveJournal::GetFilePath(slotName);
+	TUniquePtr<FArchive> writer(IFileManager::Get().CreateFileWriter(*filePath, FILEWRITE_Append));
+	if (!writer)
+	{
+		UE_LOG(LogDSM, Error, TEXT("Can not open DSM save journal %s"), *filePath);
+		return false;
+	}
+	// Record size is written first, so an incomplete record at the end of the journal is detected on load
+	uint32 magic = FDSMSaveJournal::RecordMagic;
+	int64 recordSize = recordBytes.Num();
+	*writer << magic << firstIndex << recordSize;
+	writer->Serialize(recordBytes.GetData(), recordSize);
+	if (!writer->Close())
+	{
+		UE_LOG(LogDSM, Error, TEXT("Failed to append to DSM save journal %s"), *filePath);
+		return false;
+	}
+	return true;
+}
+
+void FDSMSaveJournal::Configure(float flushIntervalSeconds, int32 compactionRecords, FOnWritten onWritten)
+{
+	_flushInterval = flushIntervalSeconds;
+	_compactionRecords = compactionRecords;
+	_onWritten = MoveTemp(onWritten);
+}
+
+void FDSMSaveJournal::Capture(const FDSMHistoryStore& store, int32 num, const FString& slotName, int32 indexToLoad, bool keepState, FName compressionFormat, int32 compressionBlockSize, const FString& metadata /*= FString()*/)
+{
+	num = FMath::Clamp(num, 0, store.Num());
+	// Entries captured after a failed write have no base file on disc, they are captured again instead of writing them as record
+	const bool bWriteFailed = _bWriteFailed->exchange(false);
+	if (bWriteFailed)
+	{
+		_pending.Reset();
+	}
+	// Store of the same length might contain other entries, if it was replaced or switched its branch
+	if (bWriteFailed || slotName != _slotName || num < _capturedNum || &store != _store || store.GetGeneration() != _storeGeneration)
+	{
+		// Captures of the previous slot are still valid saves
+		Flush(false);
+		_slotName = slotName;
+		_store = &store;
+		_storeGeneration = store.GetGeneration();
+		_capturedNum = 0;
+		_recordNum = 0;
+	}
+
+	if (_capturedNum == 0)
+	{
+		_pending = MakeShared<FDSMSaveFile>(FDSMSaveFile::Capture(store, num));
+		_bPendingBase = true;
+	}
+	else if (_pending)
+	{
+		_pending->Append(FDSMSaveFile::Capture(store, _capturedNum, num - _capturedNum));
+	}
+	else
+	{
+		_pending = MakeShared<FDSMSaveFile>(FDSMSaveFile::Capture(store, _capturedNum, num - _capturedNum));
+		_bPendingBase = false;
+		_pendingFirstIndex = _capturedNum;
+	}
+	_pending->_indexToLoad = indexToLoad;
+	_pending->_bKeepState = keepState;
+	_pending->_compressionFormat = compressionFormat;
+	_pending->_compressionBlockSize = compressionBlockSize;
+	_pending->_summary._metadata = metadata;
+	_capturedNum = num;
+}
+
+void FDSMSaveJournal::ScheduleFlush()
+{
+	if (!_pending)
+	{
+		return;
+	}
+	if (_flushInterval <= 0.f)
+	{
+		Flush(false);
+		return;
+	}
+	if (!_flushHandle.IsValid())
+	{
+		_flushHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateLambda([this](float)
+			{
+				_flushHandle.Reset();
+				Flush(false);
+				return false;
+			}), _flushInterval);
+	}
+}
+
+void FDSMSaveJournal::Flush(bool bWait)
+{
+	if (_flushHandle.IsValid())
+	{
+		FTSTicker::GetCoreTicker().RemoveTicker(_flushHandle);
+		_flushHandle.Reset();
+	}
+	if (!_pending)
+	{
+		return;
+	}
+
+	TSharedPtr<FDSMSaveFile> pending = MoveTemp(_pending);
+	const bool bBase = _bPendingBase;
+	const bool bCompact = !bBase && _compactionRecords > 0 && ++_recordNum >= _compactionRecords;
+	if (bBase || bCompact)
+	{
+		_recordNum = 0;
+	}
+	UE::Tasks::FTask writeTask = GetSaveFilePipe().Launch(UE_SOURCE_LOCATION,
+		[pending, bBase, bCompact, slotName = _slotName, firstIndex = _pendingFirstIndex, onWritten = _onWritten, bWriteFailed = _bWriteFailed]()
+		{
+			const double writeStart = FPlatformTime::Seconds();
+			// Records are not appended after a failed write, they would not continue the base file
+			const bool bSuccess = bBase ? WriteBaseFile(slotName, *pending) : !*bWriteFailed && AppendRecord(slotName, firstIndex, *pending);
+			*bWriteFailed = !bSuccess;
+			if (onWritten)
+			{
+				onWritten(slotName, *pending, bSuccess, FPlatformTime::Seconds() - writeStart);
+			}
+			if (bSuccess && bCompact)
+			{
+				Compact(slotName);
+			}
+		});
+	if (bWait)
+	{
+		writeTask.Wait();
+	}
+}
+
+void FDSMSaveJournal::Reset()
+{
+	Flush(false);
+	_slotName.Empty();
+	_store = nullptr;
+	_storeGeneration = 0;
+	_capturedNum = 0;
+	_recordNum = 0;
+}
+
+bool FDSMSaveJournal::ReadRecords(const FString& slotName, int32 baseNum, TFunctionRef<void(FDSMSaveFile&)> onRecord)
+{
+	const FString filePath = GetFilePath(slotName);
+	if (!IFileManager::Get().FileExists(*filePath))
+	{
+		return true;
+	}
+	TUniquePtr<FArchive> reader(IFileManager::Get().CreateFileReader(*filePath));
+	if (!reader)
+	{
+		UE_LOG(LogDSM, Error, TEXT("Can not open DSM save journal %s"), *filePath);
+		return false;
+	}
+
+	constexpr int64 headerSize = sizeof(uint32) + sizeof(int32) + sizeof(int64);
+	int32 expectedIndex = baseNum;
+	TArray<uint8> recordBytes;
+	while (reader->Tell() < reader->TotalSize())
+	{
+		uint32 magic = 0;
+		int32 firstIndex = INDEX_NONE;
+		int64 recordSize = 0;
+		if (reader->TotalSize() - reader->Tell() >= headerSize)
+		{
+			*reader << magic << firstIndex << recordSize;
+		}
+		if (magic != RecordMagic || recordSize < 0 || recordSize > reader->TotalSize() - reader->Tell())
+		{
+			// Happens if the game stopped while a record was appended
+			UE_LOG(LogDSM, Warning, TEXT("DSM save journal %s ends with an incomplete record, it is ignored"), *filePath);
+			break;
+		}
+
+		recordBytes.SetNumUninitialized(static_cast<int32>(recordSize));
+		reader->Serialize(recordBytes.GetData(), recordSize);
+		FDSMSaveFile record;
+		FMemoryReader recordReader(recordBytes);
+		if (reader->IsError() || !record.Serialize(recordReader))
+		{
+			return false;
+		}
+		// Records of the previous base file are left behind, if the game stopped after the base file was replaced but before the journal was removed
+		if (firstIndex + record._entries.Num() <= baseNum)
+		{
+			UE_LOG(LogDSM, Warning, TEXT("DSM save journal %s contains a record of a previous base file, it is skipped"), *filePath);
+			continue;
+		}
+		if (firstIndex != expectedIndex)
+		{
+			UE_LOG(LogDSM, Warning, TEXT("DSM save journal %s does not continue its base file, remaining records are ignored"), *filePath);
+			break;
+		}
+		expectedIndex += record._entries.Num();
+		onRecord(record);
+	}
+	return true;
+}
+
+bool FDSMSaveJournal::Replay(const FString& slotName, FDSMHistoryStore& outStore, FDSMSaveFile& outSaveFile)
+{
+	return ReadRecords(slotName, outStore.Num(), [&outStore, &outSaveFile](FDSMSaveFile& record)
+		{
+			record.AppendTo(outStore);
+			outSaveFile._indexToLoad = record._indexToLoad;
+			outSaveFile._bKeepState = record._bKeepState;
+		});
+}
+
+bool FDSMSaveJournal::AppendRecords(const FString& slotName, FDSMSaveFile& saveFile)
+{
+	return ReadRecords(slotName, saveFile._entries.Num(), [&saveFile](FDSMSaveFile& record) { saveFile.Append(record); });
+}
+
+bool FDSMSaveJournal::ReadSummary(const FString& slotName, FDSMSaveFile::FSummary& outSummary)
+{
+	if (!FDSMSaveFile::ReadSummary(FDSMSaveFile::GetFilePath(slotName), outSummary))
+	{
+		return false;
+	}
+	TUniquePtr<FArchive> reader(IFileManager::Get().CreateFileReader(*GetFilePath(slotName), FILEREAD_Silent));
+	if (!reader)
+	{
+		return true;
+	}
+
+	// Only the header of each record is read, records are skipped by their size
+	// Records, which do not continue the base file, are skipped on load as well
+	constexpr int64 headerSize = sizeof(uint32) + sizeof(int32) + sizeof(int64);
+	int32 expectedIndex = outSummary._historyNum;
+	while (reader->TotalSize() - reader->Tell() >= headerSize)
+	{
+		uint32 magic = 0;
+		int32 firstIndex = INDEX_NONE;
+		int64 recordSize = 0;
+		*reader << magic << firstIndex << recordSize;
+		const int64 recordStart = reader->Tell();
+		FDSMSaveFile record;
+		if (magic != RecordMagic || recordSize < 0 || recordSize > reader->TotalSize() - recordStart || !record.ReadHeader(*reader))
+		{
+			// Incomplete records are ignored on load as well
+			break;
+		}
+		if (firstIndex == expectedIndex)
+		{
+			outSummary = MoveTemp(record._summary);
+			expectedIndex = outSummary._historyNum;
+		}
+		reader->Seek(recordStart + recordSize);
+	}
+	return true;
+}
+
+bool FDSMSaveJournal::Compact(const FString& slotName)
+{
+	FDSMSaveFile saveFile;
+	if (!saveFile.Read(FDSMSaveFile::GetFilePath(slotName)))
+	{
+		return false;
+	}
+	if (!AppendRecords(slotName, saveFile))
+	{
+		return false;
+	}
+	UE_LOG(LogDSM, Log, TEXT("Compacted DSM save journal of slot %s, %d history elements"), *slotName, saveFile._entries.Num());
+	return WriteBaseFile(slotName, saveFile);
+}
+
+void FDSMSaveJournal::WaitForPendingWrites()
+{
+	GetSaveFilePipe().WaitUntilEmpty();
+}
+
+UE::Tasks::FTask FDSMSaveJournal::LaunchWrite(TUniqueFunction<void()> write)
+{
+	return GetSaveFilePipe().Launch(UE_SOURCE_LOCATION, MoveTemp(write));
+}
+
+FString FDSMSaveJournal::GetFilePath(const FString& slotName)
+{
+	return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("DSM"), TEXT("SaveGames"), slotName + TEXT(".dsmj"));
+}
@@ -0,0 +1,360 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DSMSlotStore.h"
+#include "DSMSaveJournal.h"
+#include "DSMLogInclude.h"
+#include "HAL/FileManager.h"
+#include "Misc/Compression.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+
+// Blobs are never removed while a slot is written or read
+static FCriticalSection GStoreLock;
+
+// Upper bound of the uncompressed size of a blob, protects against corrupted blobs
+static constexpr int32 MaxBlobSize = 1024 * 1024 * 1024;
+
+static FString GetStoreDir()
+{
+	return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("DSM"), TEXT("Store"));
+}
+
+static FSHAHash HashBytes(TArrayView<const uint8> bytes)
+{
+	FSHAHash hash;
+	FSHA1::HashBuffer(bytes.GetData(), bytes.Num(), hash.Hash);
+	return hash;
+}
+
+bool FDSMSlotStore::Write(const FString& slotName, FDSMSaveFile& saveFile, int32 segmentSize)
+{
+	segmentSize = FMath::Max(1, segmentSize);
+	FScopeLock lock(&GStoreLock);
+
+	FManifest manifest;
+	manifest._summary = saveFile._summary;
+	manifest._indexToLoad = saveFile._indexToLoad;
+	manifest._bKeepState = saveFile._bKeepState;
+	int64 storedBytes = 0;
+	int64 uncompressedBytes = 0;
+	TArray<uint8> segmentBytes;
+	for (int32 firstIndex = 0; firstIndex < saveFile._entries.Num(); firstIndex += segmentSize)
+	{
+		FDSMSaveFile segment = saveFile.Slice(firstIndex, segmentSize);
+		TArray<FSHAHash> snapshots;
+		snapshots.Reserve(segment._slots.Num());
+		for (const FDSMSaveFile::FSlot& slot : segment._slots)
+		{
+			snapshots.Add(HashBytes(slot._snapshot));
+			uncompressedBytes += slot._snapshot.Num();
+			if (!WriteBlob(snapshots.Last(), slot._snapshot, saveFile._compressionFormat, storedBytes))
+			{
+				return false;
+			}
+		}
+
+		// Equal entries are sliced into equal tables, so segments shared by several slots have the same hash
+		segmentBytes.Reset();
+		FMemoryWriter segmentWriter(segmentBytes);
+		if (!SerializeSegment(segmentWriter, segment, snapshots))
+		{
+			return false;
+		}
+		manifest._segments.Add(HashBytes(segmentBytes));
+		uncompressedBytes += segmentBytes.Num();
+		if (!WriteBlob(manifest._segments.Last(), segmentBytes, saveFile._compressionFormat, storedBytes))
+		{
+			return false;
+		}
+	}
+
+	TArray<uint8> manifestBytes;
+	FMemoryWriter manifestWriter(manifestBytes);
+	const FString manifestPath = GetManifestPath(slotName);
+	const FString tempManifestPath = manifestPath + TEXT(".tmp");
+	if (!SerializeManifest(manifestWriter, manifest) || !FFileHelper::SaveArrayToFile(manifestBytes, *tempManifestPath) ||
+		!IFileManager::Get().Move(*manifestPath, *tempManifestPath, true, true))
+	{
+		IFileManager::Get().Delete(*tempManifestPath, false, false, true);
+		UE_LOG(LogDSM, Error, TEXT("Failed to write DSM slot manifest %s"), *manifestPath);
+		return false;
+	}
+	saveFile._storedBytes = storedBytes + manifestBytes.Num();
+	saveFile._uncompressedBytes = uncompressedBytes + manifestBytes.Num();
+
+	// Native file and journal would be found first on load
+	IFileManager::Get().Delete(*FDSMSaveFile::GetFilePath(slotName), false, false, true);
+	IFileManager::Get().Delete(*FDSMSaveJournal::GetFilePath(slotName), false, false, true);
+	return true;
+}
+
+bool FDSMSlotStore::Read(const FString& slotName, FDSMSaveFile& outSaveFile)
+{
+	FScopeLock lock(&GStoreLock);
+	FManifest manifest;
+	if (!ReadManifest(GetManifestPath(slotName), manifest))
+	{
+		UE_LOG(LogDSM, Error, TEXT("Can not read DSM slot manifest of %s"), *slotName);
+		return false;
+	}
+
+	outSaveFile = FDSMSaveFile();
+	TArray<uint8> segmentBytes;
+	for (const FSHAHash& segmentHash : manifest._segments)
+	{
+		FDSMSaveFile segment;
+		TArray<FSHAHash> snapshots;
+		if (!ReadBlob(segmentHash, segmentBytes))
+		{
+			return false;
+		}
+		FMemoryReader segmentReader(segmentBytes);
+		if (!SerializeSegment(segmentReader, segment, snapshots))
+		{
+			return false;
+		}
+		for (int32 i = 0; i < snapshots.Num(); ++i)
+		{
+			if (!ReadBlob(snapshots[i], segment._slots[i]._snapshot))
+			{
+				return false;
+			}
+		}
+		outSaveFile.Append(segment);
+	}
+	outSaveFile._indexToLoad = manifest._indexToLoad;
+	outSaveFile._bKeepState = manifest._bKeepState;
+	outSaveFile._summary = MoveTemp(manifest._summary);
+	return true;
+}
+
+bool FDSMSlotStore::ReadSummary(const FString& slotName, FDSMSaveFile::FSummary& outSummary)
+{
+	FManifest manifest;
+	if (!ReadManifest(GetManifestPath(slotName), manifest, true))
+	{
+		return false;
+	}
+	outSummary = MoveTemp(manifest._summary);
+	return true;
+}
+
+int32 FDSMSlotStore::CollectGarbage()
+{
+	FScopeLock lock(&GStoreLock);
+	TArray<FString> manifestNames;
+	const FString manifestDir = FPaths::GetPath(GetManifestPath(TEXT("Slot")));
+	IFileManager::Get().FindFiles(manifestNames, *manifestDir, TEXT("dsmm"));
+
+	// Snapshots are only known after reading the segments, nothing is removed if any reference can not be read
+	TSet<FSHAHash> referenced;
+	TArray<uint8> segmentBytes;
+	for (const FString& manifestName : manifestNames)
+	{
+		FManifest manifest;
+		if (!ReadManifest(FPaths::Combine(manifestDir, manifestName), manifest))
+		{
+			UE_LOG(LogDSM, Warning, TEXT("Can not read DSM slot manifest %s, the store is not cleaned up"), *manifestName);
+			return 0;
+		}
+		for (const FSHAHash& segmentHash : manifest._segments)
+		{
+			bool bAlreadyReferenced = false;
+			referenced.Add(segmentHash, &bAlreadyReferenced);
+			if (bAlreadyReferenced)
+			{
+				continue;
+			}
+			if (!ReadBlob(segmentHash, segmentBytes))
+			{
+				UE_LOG(LogDSM, Warning, TEXT("Can not read segment of DSM slot manifest %s, the store is not cleaned up"), *manifestName);
+				return 0;
+			}
+			FDSMSaveFile segment;
+			TArray<FSHAHash> snapshots;
+			FMemoryReader segmentReader(segmentBytes);
+			if (!SerializeSegment(segmentReader, segment, snapshots))
+			{
+				UE_LOG(LogDSM, Warning, TEXT("Can not read segment of DSM slot manifest %s, the store is not cleaned up"), *manifestName);
+				return 0;
+			}
+			referenced.Append(snapshots);
+		}
+	}
+
+	TArray<FString> blobPaths;
+	IFileManager::Get().FindFilesRecursive(blobPaths, *GetStoreDir(), TEXT("*.dsmb"), true, false);
+	int32 removedNum = 0;
+	for (const FString& blobPath : blobPaths)
+	{
+		FSHAHash hash;
+		hash.FromString(FPaths::GetBaseFilename(blobPath));
+		if (!referenced.Contains(hash) && IFileManager::Get().Delete(*blobPath, false, false, true))
+		{
+			++removedNum;
+		}
+	}
+	UE_LOG(LogDSM, Log, TEXT("Removed %d unreferenced blobs of the DSM store, %d blobs are referenced by %d slots"), removedNum, referenced.Num(), manifestNames.Num());
+	return removedNum;
+}
+
+FString FDSMSlotStore::GetManifestPath(const FString& slotName)
+{
+	return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("DSM"), TEXT("SaveGames"), slotName + TEXT(".dsmm"));
+}
+
+FString FDSMSlotStore::GetBlobPath(const FSHAHash& hash)
+{
+	// Blobs are spread across subdirectories by the first byte of their hash
+	const FString name = hash.ToString();
+	return FPaths::Combine(GetStoreDir(), name.Left(2), name + TEXT(".dsmb"));
+}
+
+bool FDSMSlotStore::SerializeManifest(FArchive& ar, FManifest& manifest, bool bSummaryOnly /*= false*/)
+{
+	uint32 magic = ManifestMagic;
+	ar << magic;
+	if (magic != ManifestMagic)
+	{
+		UE_LOG(LogDSM, Error, TEXT("File is not a DSM slot manifest"));
+		return false;
+	}
+	if (ar.IsSaving())
+	{
+		manifest._version = LatestVersion;
+	}
+	ar << manifest._version;
+	if (manifest._version != LatestVersion)
+	{
+		UE_LOG(LogDSM, Error, TEXT("DSM slot manifest version %d is not supported, expected version %d"), manifest._version, LatestVersion);
+		return false;
+	}
+	manifest._summary.SerializeFixed(ar);
+	if (ar.IsError())
+	{
+		UE_LOG(LogDSM, Error, TEXT("DSM slot manifest is corrupted"));
+		return false;
+	}
+	if (bSummaryOnly)
+	{
+		return true;
+	}
+	ar << manifest._indexToLoad << manifest._bKeepState << manifest._segments;
+	if (ar.IsError())
+	{
+		UE_LOG(LogDSM, Error, TEXT("DSM slot manifest is corrupted"));
+		return false;
+	}
+	return true;
+}
+
+bool FDSMSlotStore::ReadManifest(const FString& filePath, FManifest& outManifest, bool bSummaryOnly /*= false*/)
+{
+	TUniquePtr<FArchive> reader(IFileManager::Get().CreateFileReader(*filePath, FILEREAD_Silent));
+	return reader && SerializeManifest(*reader, outManifest, bSummaryOnly);
+}
+
+bool FDSMSlotStore::WriteBlob(const FSHAHash& hash, TArrayView<const uint8> bytes, FName compressionFormat, int64& outStoredBytes)
+{
+	// Blobs are named by their content, an existing blob never has to be written again
+	const FString blobPath = GetBlobPath(hash);
+	if (IFileManager::Get().FileExists(*blobPath))
+	{
+		return true;
+	}
+
+	int32 size = bytes.Num();
+	TArrayView<const uint8> storedBytes = bytes;
+	FString format;
+	TArray<uint8> compressed;
+	if (!compressionFormat.IsNone() && size > 0)
+	{
+		int32 compressedSize = FCompression::CompressMemoryBound(compressionFormat, size);
+		compressed.SetNumUninitialized(compressedSize, false);
+		// Blobs which do not shrink by compression are stored uncompressed
+		if (FCompression::CompressMemory(compressionFormat, compressed.GetData(), compressedSize, bytes.GetData(), size) && compressedSize < size)
+		{
+			storedBytes = TArrayView<const uint8>(compressed.GetData(), compressedSize);
+			format = compressionFormat.ToString();
+		}
+	}
+
+	TArray<uint8> blob;
+	FMemoryWriter writer(blob);
+	uint32 magic = BlobMagic;
+	writer << magic << format << size;
+	writer.Serialize(const_cast<uint8*>(storedBytes.GetData()), storedBytes.Num());
+
+	// Another slot might write the same blob at the same time, each writer uses its own temporary file
+	const FString tempBlobPath = blobPath + TEXT(".") + FGuid::NewGuid().ToString() + TEXT(".tmp");
+	if (!FFileHelper::SaveArrayToFile(blob, *tempBlobPath) || !IFileManager::Get().Move(*blobPath, *tempBlobPath, true, true))
+	{
+		IFileManager::Get().Delete(*tempBlobPath, false, false, true);
+		UE_LOG(LogDSM, Error, TEXT("Failed to write DSM store blob %s"), *blobPath);
+		return false;
+	}
+	outStoredBytes += blob.Num();
+	return true;
+}
+
+bool FDSMSlotStore::ReadBlob(const FSHAHash& hash, TArray<uint8>& outBytes)
+{
+	const FString blobPath = GetBlobPath(hash);
+	TArray<uint8> blob;
+	if (!FFileHelper::LoadFileToArray(blob, *blobPath, FILEREAD_Silent))
+	{
+		UE_LOG(LogDSM, Error, TEXT("DSM store blob %s is missing"), *blobPath);
+		return false;
+	}
+
+	FMemoryReader reader(blob);
+	uint32 magic = 0;
+	FString format;
+	int32 size = 0;
+	reader << magic << format << size;
+	const int64 storedSize = blob.Num() - reader.Tell();
+	const FName compressionFormat = format.IsEmpty() ? NAME_None : FName(*format);
+	bool bValid = !reader.IsError() && magic == BlobMagic && size >= 0 && size <= MaxBlobSize;
+	if (bValid && compressionFormat.IsNone())
+	{
+		bValid = storedSize == size;
+		outBytes.Reset(size);
+		if (bValid)
+		{
+			outBytes.Append(blob.GetData() + reader.Tell(), size);
+		}
+	}
+	else if (bValid)
+	{
+		outBytes.SetNumUninitialized(size, false);
+		bValid = FCompression::IsFormatValid(compressionFormat) &&
+			FCompression::UncompressMemory(compressionFormat, outBytes.GetData(), size, blob.GetData() + reader.Tell(), static_cast<int32>(storedSize));
+	}
+	// Content addressing detects corrupted blobs
+	if (!bValid || HashBytes(outBytes) != hash)
+	{
+		UE_LOG(LogDSM, Error, TEXT("DSM store blob %s is corrupted"), *blobPath);
+		return false;
+	}
+	return true;
+}
+
+bool FDSMSlotStore::SerializeSegment(FArchive& ar, FDSMSaveFile& segment, TArray<FSHAHash>& snapshots)
+{
+	if (!segment.SerializeSegment(ar))
+	{
+		return false;
+	}
+	ar << snapshots;
+	if (ar.IsError() || snapshots.Num() != segment._slots.Num())
+	{
+		UE_LOG(LogDSM, Error, TEXT("DSM store segment is corrupted"));
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,235 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DSMSnapshot.h"
+#include "DSMLogInclude.h"
+#include "Serialization/MemoryWriter.h"
+#include "Serialization/MemoryReader.h"
+#include "UObject/UObjectHash.h"
+#include "UObject/GarbageCollection.h"
+#include "Async/ParallelFor.h"
+#include "Algo/SortBy.h"
+
+
+FArchive& FDSMSnapshotArchive::operator<<(UObject*& obj)
+{
+	int32 index = INDEX_NONE;
+	if (IsLoading())
+	{
+		InnerArchive << index;
+		if (_objectTable.IsValidIndex(index))
+		{
+			obj = _objectTable[index];
+			return *this;
+		}
+	}
+	else
+	{
+		index = _objectTable.IndexOfByKey(obj);
+		InnerArchive << index;
+		if (index != INDEX_NONE)
+		{
+			return *this;
+		}
+	}
+	if (IsLoading())
+	{
+		// Objects not owned by the snapshot are stored by path, null references as None
+		FString path;
+		InnerArchive << path;
+		obj = FindObject<UObject>(nullptr, *path, false);
+		if (!obj && !path.IsEmpty() && path != TEXT("None"))
+		{
+			if (bLoadIfFindFails)
+			{
+				obj = LoadObject<UObject>(nullptr, *path);
+			}
+			else
+			{
+				_bUnresolved = true;
+			}
+		}
+		return *this;
+	}
+	// Objects not owned by the snapshot are stored by path
+	return FObjectAndNameAsStringProxyArchive::operator<<(obj);
+}
+
+FArchive& FDSMSnapshotArchive::operator<<(FObjectPtr& obj)
+{
+	UObject* rawObj = IsLoading() ? nullptr : obj.Get();
+	*this << rawObj;
+	if (IsLoading())
+	{
+		obj = FObjectPtr(rawObj);
+	}
+	return *this;
+}
+
+void FDSMSnapshot::Write(const UDSMDataAsset* asset, TArray<uint8>& outBytes)
+{
+	check(asset);
+	UDSMDataAsset* mutableAsset = const_cast<UDSMDataAsset*>(asset);
+	TArray<UObject*> objectTable = { mutableAsset };
+	TArray<UObject*> innerObjects;
+	GetObjectsWithOuter(mutableAsset, innerObjects, true);
+	// Outer objects must be created before their inner objects on load
+	Algo::SortBy(innerObjects, [asset](const UObject* obj)
+		{
+			int32 depth = 0;
+			for (const UObject* outer = obj->GetOuter(); outer && outer != asset; outer = outer->GetOuter())
+			{
+				++depth;
+			}
+			return depth;
+		});
+	objectTable.Append(innerObjects);
+
+	FMemoryWriter writer(outBytes, true);
+	int32 objectNum = objectTable.Num();
+	writer << objectNum;
+	for (UObject* obj : objectTable)
+	{
+		FString classPath = obj->GetClass()->GetPathName();
+		// Root is renamed on load, so equal data assets have equal snapshots regardless of their unique names
+		FString name = obj == mutableAsset ? FString() : obj->GetName();
+		int32 outerIndex = objectTable.IndexOfByKey(obj->GetOuter());
+		writer << classPath << name << outerIndex;
+	}
+
+	FDSMSnapshotArchive archive(writer, objectTable);
+	for (UObject* obj : objectTable)
+	{
+		obj->Serialize(archive);
+	}
+}
+
+// Creates all objects listed in the object table of a snapshot, their properties are not read yet
+// Must be called on the game thread
+static bool CreateObjects(FArchive& reader, TArray<UObject*>& outObjectTable)
+{
+	int32 objectNum = 0;
+	reader << objectNum;
+	if (objectNum <= 0 || reader.IsError())
+	{
+		UE_LOG(LogDSM, Error, TEXT("Data asset snapshot is empty or corrupted"));
+		return false;
+	}
+
+	outObjectTable.Reset(objectNum);
+	for (int32 i = 0; i < objectNum; ++i)
+	{
+		FString classPath;
+		FString name;
+		int32 outerIndex = INDEX_NONE;
+		reader << classPath << name << outerIndex;
+
+		UClass* objectClass = LoadObject<UClass>(nullptr, *classPath);
+		const bool bValidOuter = i == 0 || (outerIndex >= 0 && outerIndex < i);
+		if (!objectClass || !bValidOuter || (i == 0 && !objectClass->IsChildOf(UDSMDataAsset::StaticClass())))
+		{
+			UE_LOG(LogDSM, Error, TEXT("Can not recreate object %d of class %s from data asset snapshot"), i, *classPath);
+			return false;
+		}
+		// Root object gets a unique name inside the transient package, owned objects keep their names
+		UObject* outer = i == 0 ? GetTransientPackage() : outObjectTable[outerIndex];
+		const FName objectName = i == 0 ? MakeUniqueObjectName(outer, objectClass) : FName(*name);
+		outObjectTable.Add(NewObject<UObject>(outer, objectClass, objectName));
+	}
+	return true;
+}
+
+// Reads the properties of all objects created by CreateObjects, the reader must be positioned behind the object table
+static bool ReadProperties(FArchive& reader, TArray<UObject*>& objectTable, bool bLoadIfFindFails, bool& outUnresolved)
+{
+	FDSMSnapshotArchive archive(reader, objectTable, bLoadIfFindFails);
+	for (UObject* obj : objectTable)
+	{
+		obj->Serialize(archive);
+	}
+	outUnresolved = archive.HasUnresolvedReferences();
+	return !reader.IsError();
+}
+
+UDSMDataAsset* FDSMSnapshot::Read(TArrayView<const uint8> bytes)
+{
+	FMemoryReaderView reader(bytes, true);
+	TArray<UObject*> objectTable;
+	bool bUnresolved = false;
+	if (!CreateObjects(reader, objectTable))
+	{
+		return nullptr;
+	}
+	if (!ReadProperties(reader, objectTable, true, bUnresolved))
+	{
+		UE_LOG(LogDSM, Error, TEXT("Failed to read properties of data asset snapshot %s"), *objectTable[0]->GetName());
+		return nullptr;
+	}
+	return Cast<UDSMDataAsset>(objectTable[0]);
+}
+
+// Number of snapshots read by a single worker task, see FDSMSnapshot::ReadParallel
+static constexpr int32 ParallelReadChunkSize = 16;
+
+void FDSMSnapshot::ReadParallel(TArrayView<const TArrayView<const uint8>> snapshots, TArray<UDSMDataAsset*>& outAssets)
+{
+	check(IsInGameThread());
+	struct FPendingRead
+	{
+		TArray<UObject*> _objectTable;
+		int64 _propertyOffset = 0;
+		bool _bValid = false;
+		bool _bUnresolved = false;
+	};
+	TArray<FPendingRead> reads;
+	reads.SetNum(snapshots.Num());
+
+	// Object creation needs unique names inside the transient package, it stays on the game thread
+	for (int32 i = 0; i < snapshots.Num(); ++i)
+	{
+		if (snapshots[i].Num() == 0)
+		{
+			continue;
+		}
+		FMemoryReaderView reader(snapshots[i], true);
+		reads[i]._bValid = CreateObjects(reader, reads[i]._objectTable);
+		reads[i]._propertyOffset = reader.Tell();
+	}
+
+	// Properties of independent snapshots are read on worker threads, referenced objects are only searched in memory
+	// The game thread waits for all chunks, so the created objects can not be garbage collected in between
+	const int32 chunkNum = FMath::DivideAndRoundUp(snapshots.Num(), ParallelReadChunkSize);
+	ParallelFor(chunkNum, [&snapshots, &reads](int32 chunk)
+		{
+			FGCScopeGuard gcGuard;
+			const int32 last = FMath::Min((chunk + 1) * ParallelReadChunkSize, snapshots.Num());
+			for (int32 i = chunk * ParallelReadChunkSize; i < last; ++i)
+			{
+				FPendingRead& read = reads[i];
+				if (read._bValid)
+				{
+					FMemoryReaderView reader(snapshots[i], true);
+					reader.Seek(read._propertyOffset);
+					read._bValid = ReadProperties(reader, read._objectTable, false, read._bUnresolved);
+				}
+			}
+		});
+
+	// Only publishing the data assets and loading missing references happens on the game thread
+	outAssets.Reset(snapshots.Num());
+	for (int32 i = 0; i < snapshots.Num(); ++i)
+	{
+		FPendingRead& read = reads[i];
+		if (read._bValid && read._bUnresolved)
+		{
+			FMemoryReaderView reader(snapshots[i], true);
+			reader.Seek(read._propertyOffset);
+			read._bValid = ReadProperties(reader, read._objectTable, true, read._bUnresolved);
+		}
+		if (!read._bValid && read._objectTable.Num() > 0)
+		{
+			UE_LOG(LogDSM, Error, TEXT("Failed to read properties of data asset snapshot %s"), *read._objectTable[0]->GetName());
+		}
+		outAssets.Add(read._bValid ? Cast<UDSMDataAsset>(read._objectTable[0]) : nullptr);
+	}
+}
@@ -0,0 +1,232 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DSMTimer.h"
+#include "DSMLogInclude.h"
+
+
+static constexpr uint64 LevelMask = FDSMTimerWheel::LevelSlots - 1;
+
+FDSMTimerWheel::FDSMTimerWheel(float resolution /*= 0.05f*/)
+	: _resolution(FMath::Max(resolution, UE_KINDA_SMALL_NUMBER))
+{
+	Empty();
+}
+
+FDSMTimerHandle FDSMTimerWheel::Schedule(const FDSMTimerRecord& record)
+{
+	const int32 index = _freeTimers.Num() > 0 ? _freeTimers.Pop(false) : _timers.AddDefaulted();
+	FTimer& timer = _timers[index];
+	timer._record = record;
+	timer._record._handle._index = index;
+	timer._record._handle._serial = _nextSerial++;
+	timer._tick = ToTick(record._deadline);
+	Link(index);
+	++_num;
+	return timer._record._handle;
+}
+
+bool FDSMTimerWheel::Clear(const FDSMTimerHandle& handle)
+{
+	if (!Find(handle))
+	{
+		return false;
+	}
+	Unlink(handle._index);
+	_freeTimers.Add(handle._index);
+	--_num;
+	return true;
+}
+
+const FDSMTimerRecord* FDSMTimerWheel::Find(const FDSMTimerHandle& handle) const
+{
+	if (!_timers.IsValidIndex(handle._index))
+	{
+		return nullptr;
+	}
+	const FTimer& timer = _timers[handle._index];
+	return timer._slot != INDEX_NONE && timer._record._handle == handle ? &timer._record : nullptr;
+}
+
+int32 FDSMTimerWheel::ClearIf(TFunctionRef<bool(const FDSMTimerRecord&)> predicate)
+{
+	int32 clearedNum = 0;
+	for (int32 index = 0; index < _timers.Num(); ++index)
+	{
+		if (_timers[index]._slot != INDEX_NONE && predicate(_timers[index]._record))
+		{
+			Unlink(index);
+			_freeTimers.Add(index);
+			--_num;
+			++clearedNum;
+		}
+	}
+	return clearedNum;
+}
+
+void FDSMTimerWheel::Advance(double deltaSeconds, TArray<FDSMTimerRecord>& outFired)
+{
+	_time += FMath::Max(deltaSeconds, 0.0);
+	const uint64 lastTick = static_cast<uint64>(FMath::FloorToDouble(_time / _resolution));
+	if (_num == 0)
+	{
+		// Slots are empty, there is nothing to move or fire
+		_currentTick = FMath::Max(_currentTick, lastTick + 1);
+		return;
+	}
+	while (_currentTick <= lastTick)
+	{
+		ProcessTick(outFired);
+	}
+}
+
+void FDSMTimerWheel::Export(UDSMTimerData& outData) const
+{
+	outData._time = _time;
+	outData._nextSerial = _nextSerial;
+	outData._timers.Reset(_num);
+	for (const FTimer& timer : _timers)
+	{
+		if (timer._slot != INDEX_NONE)
+		{
+			outData._timers.Add(timer._record);
+		}
+	}
+}
+
+void FDSMTimerWheel::Restore(const UDSMTimerData& data)
+{
+	Empty();
+	_time = data._time;
+	_currentTick = static_cast<uint64>(FMath::FloorToDouble(_time / _resolution)) + 1;
+	_nextSerial = data._nextSerial;
+	for (const FDSMTimerRecord& record : data._timers)
+	{
+		const int32 index = record._handle._index;
+		if (index < 0 || (_timers.IsValidIndex(index) && _timers[index]._slot != INDEX_NONE))
+		{
+			UE_LOG(LogDSM, Warning, TEXT("Stored timer of node %s (outer : %s) has an invalid handle, timer is skipped"),
+				*record._nodeLabel.ToString(), *record._ownerLabel.ToString());
+			continue;
+		}
+		if (index >= _timers.Num())
+		{
+			_timers.SetNum(index + 1);
+		}
+		FTimer& timer = _timers[index];
+		timer._record = record;
+		timer._tick = ToTick(record._deadline);
+		Link(index);
+		++_num;
+		_nextSerial = FMath::Max(_nextSerial, record._handle._serial + 1);
+	}
+	for (int32 i = _timers.Num() - 1; i >= 0; --i)
+	{
+		if (_timers[i]._slot == INDEX_NONE)
+		{
+			_freeTimers.Add(i);
+		}
+	}
+}
+
+void FDSMTimerWheel::Empty()
+{
+	_timers.Reset();
+	_freeTimers.Reset();
+	for (int32& slot : _slots)
+	{
+		slot = INDEX_NONE;
+	}
+	_currentTick = 0;
+	_time = 0.0;
+	_num = 0;
+	_nextSerial = 1;
+}
+
+void FDSMTimerWheel::Link(int32 index)
+{
+	FTimer& timer = _timers[index];
+	// Overdue timers fire at the next processed tick
+	const uint64 tick = FMath::Max(timer._tick, _currentTick);
+	uint64 delta = tick - _currentTick;
+	int32 level = 0;
+	while (level < LevelNum - 1 && delta >= (uint64(1) << (LevelBits * (level + 1))))
+	{
+		++level;
+	}
+	// Timers beyond the range of the wheel wait in the last slot of the highest level and are moved down again later
+	const uint64 range = uint64(1) << (LevelBits * LevelNum);
+	const uint64 slotTick = delta < range ? tick : _currentTick + range - 1;
+	timer._slot = level * LevelSlots + static_cast<int32>((slotTick >> (LevelBits * level)) & LevelMask);
+	timer._prev = INDEX_NONE;
+	timer._next = _slots[timer._slot];
+	if (timer._next != INDEX_NONE)
+	{
+		_timers[timer._next]._prev = index;
+	}
+	_slots[timer._slot] = index;
+}
+
+void FDSMTimerWheel::Unlink(int32 index)
+{
+	FTimer& timer = _timers[index];
+	if (timer._prev != INDEX_NONE)
+	{
+		_timers[timer._prev]._next = timer._next;
+	}
+	else
+	{
+		_slots[timer._slot] = timer._next;
+	}
+	if (timer._next != INDEX_NONE)
+	{
+		_timers[timer._next]._prev = timer._prev;
+	}
+	timer._prev = INDEX_NONE;
+	timer._next = INDEX_NONE;
+	timer._slot = INDEX_NONE;
+}
+
+void FDSMTimerWheel::Cascade(int32 level, int32 slot)
+{
+	int32 index = _slots[level * LevelSlots + slot];
+	_slots[level * LevelSlots + slot] = INDEX_NONE;
+	while (index != INDEX_NONE)
+	{
+		const int32 next = _timers[index]._next;
+		Link(index);
+		index = next;
+	}
+}
+
+void FDSMTimerWheel::ProcessTick(TArray<FDSMTimerRecord>& outFired)
+{
+	// Higher levels are moved down, whenever all lower levels wrapped around
+	for (int32 level = 1; level < LevelNum; ++level)
+	{
+		if (((_currentTick >> (LevelBits * (level - 1))) & LevelMask) != 0)
+		{
+			break;
+		}
+		Cascade(level, static_cast<int32>((_currentTick >> (LevelBits * level)) & LevelMask));
+	}
+	const int32 slot = static_cast<int32>(_currentTick & LevelMask);
+	int32 index = _slots[slot];
+	_slots[slot] = INDEX_NONE;
+	while (index != INDEX_NONE)
+	{
+		FTimer& timer = _timers[index];
+		const int32 next = timer._next;
+		timer._slot = INDEX_NONE;
+		outFired.Add(timer._record);
+		_freeTimers.Add(index);
+		--_num;
+		index = next;
+	}
+	++_currentTick;
+}
+
+uint64 FDSMTimerWheel::ToTick(double time) const
+{
+	return static_cast<uint64>(FMath::Max(FMath::CeilToDouble(time / _resolution), 0.0));
+}
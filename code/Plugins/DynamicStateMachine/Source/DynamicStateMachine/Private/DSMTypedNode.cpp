@@ -0,0 +1,73 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "DSMTypedNode.h"
+#include "DSMLogInclude.h"
+#include "DSMManager.h"
+
+
+bool FDSMNodeSlots::BindSlots(UDSMDefaultNode* node, TArrayView<const FSlotInfo> slots)
+{
+	check(node);
+	// Slot data of a node is only allocated once per binding
+	if (_node != node)
+	{
+		_node = node;
+		_offset = node->_slotNum;
+		node->_slotNum += slots.Num();
+	}
+	_defaults.Reset(slots.Num());
+	_writable.Init(false, slots.Num());
+	_bBound = true;
+	for (int32 i = 0; i < slots.Num(); ++i)
+	{
+		const FSlotInfo& slot = slots[i];
+		const FName key = FName(slot._name);
+		const TMap<FName, TObjectPtr<UDSMDataAsset>>& references = slot._bWritable ? node->_writableDataReferences : node->_readOnlyDataReferences;
+		const TMap<FName, TObjectPtr<UDSMDataAsset>>& otherReferences = slot._bWritable ? node->_readOnlyDataReferences : node->_writableDataReferences;
+		const TObjectPtr<UDSMDataAsset>* found = references.Find(key);
+		UDSMDataAsset* dataAsset = found ? found->Get() : nullptr;
+		if (!found || otherReferences.Contains(key))
+		{
+			UE_LOG(LogDSM, Error, TEXT("Typed data slot %s must be defined only inside the %s data references of DSM node %s (outer %s)"),
+				*key.ToString(), slot._bWritable ? TEXT("writable") : TEXT("read only"), *node->GetName(), *node->GetOuter()->GetName());
+			dataAsset = nullptr;
+		}
+		else if (!dataAsset || !dataAsset->IsA(slot._class))
+		{
+			UE_LOG(LogDSM, Error, TEXT("Data reference %s of DSM node %s (outer %s) is not of type %s"),
+				*key.ToString(), *node->GetName(), *node->GetOuter()->GetName(), *GetNameSafe(slot._class));
+			dataAsset = nullptr;
+		}
+		_bBound &= dataAsset != nullptr;
+		_defaults.Add(dataAsset);
+		_writable[i] = slot._bWritable;
+	}
+	return _bBound;
+}
+
+UDSMDataAsset* FDSMNodeSlots::ResolveSlot(int32 index) const
+{
+	if (!_node || !_defaults.IsValidIndex(index) || !_defaults[index])
+	{
+		return nullptr;
+	}
+	ADSMGameMode* gameMode = _node->GetDSMManager();
+	if (!gameMode)
+	{
+		return nullptr;
+	}
+	UDSMDataAsset* dataAsset = _writable[index]
+		? gameMode->GetDataAssetCached(_defaults[index]).Get()
+		: gameMode->_stateMachineData->GetDataCopy(_defaults[index]).Get();
+	// Inactive nodes always request the data again
+	if (_node->_activation != 0)
+	{
+		if (_node->_slotData.Num() < _node->_slotNum)
+		{
+			_node->_slotData.SetNum(_node->_slotNum);
+		}
+		_node->_slotData[_offset + index] = dataAsset;
+	}
+	return dataAsset;
+}
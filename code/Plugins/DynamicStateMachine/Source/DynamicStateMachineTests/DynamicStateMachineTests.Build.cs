@@ -7,6 +7,8 @@ public class DynamicStateMachineTests : ModuleRules
 	public DynamicStateMachineTests(ReadOnlyTargetRules Target) : base(Target)
 	{
 		PCHUsage = ModuleRules.PCHUsageMode.UseExplicitOrSharedPCHs;
+		// Latent node states are written as C++20 coroutines, see DSMLatent.h
+		CppStandard = CppStandardVersion.Cpp20;
 		
 		PublicIncludePaths.AddRange(
 			new string[] {
@@ -155,4 +155,26 @@ IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDSMInvalidConditionTest, "DynamicStateMachine.
 	TestFalse("wrong syntax", node->ValidateConditionGroups());
 
 	return true;
-}
\ No newline at end of file
+}
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDSMImplementedEventsTest, "DynamicStateMachine.ImplementedEvents",
+	EAutomationTestFlags::EditorContext |
+	EAutomationTestFlags::ProductFilter)
+	bool FDSMImplementedEventsTest::RunTest(const FString& Parameters) {
+
+	TObjectPtr<UTestDataAsset> daTest = NewObject<UTestDataAsset>();
+	TObjectPtr<UDSMDefaultNode> node = CreateDefaultNode({ {"daTest", daTest } }, { { "true", CreateBoolCondition("daTest", "bTrue") } });
+	node->_ConditionGroups = { { "condition", FText::FromString(TEXT("true")) } };
+	TestTrue("Unregistered nodes call all events", node->ImplementsEvent(EDSMNodeEvent::CanEnterState));
+
+	// Native node classes do not implement any Blueprint event
+	node->CacheImplementedEvents();
+	TestFalse("Can enter event is skipped", node->ImplementsEvent(EDSMNodeEvent::CanEnterState));
+	TestFalse("Begin event is skipped", node->ImplementsEvent(EDSMNodeEvent::OnBeginState));
+	TestFalse("Class default object caches the events", GetDefault<UDSMDefaultNode>()->ImplementsEvent(EDSMNodeEvent::All));
+
+	TTuple<FString, FDSMDebugConditions> debugInfo;
+	TestTrue("Compiled condition", node->ValidateConditionGroups());
+	TestTrue("Enter conditions without can enter event", node->EvaluateEnterConditions(false, debugInfo));
+	TestEqual("Only condition groups are evaluated", debugInfo.Value.Conditions.Num(), 1);
+	return true;
+}
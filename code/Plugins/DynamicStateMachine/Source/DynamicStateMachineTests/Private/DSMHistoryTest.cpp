@@ -0,0 +1,221 @@
+#include "Misc/AutomationTest.h"
+#include "Tests/AutomationCommon.h"
+#include "DSMHistory.h"
+#include "DSMHistoryPager.h"
+#include "DSMTestHelpers.h"
+
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDSMHistoryStoreTest, "DynamicStateMachine.HistoryStore",
+	EAutomationTestFlags::EditorContext |
+	EAutomationTestFlags::ProductFilter)
+	bool FDSMHistoryStoreTest::RunTest(const FString& Parameters) {
+
+	TObjectPtr<UTestDataAsset> first = NewObject<UTestDataAsset>();
+	TObjectPtr<UTestDataAsset> second = NewObject<UTestDataAsset>();
+	TObjectPtr<UTestDataAsset> third = NewObject<UTestDataAsset>();
+
+	FDSMHistoryStore store;
+	store.Add(CreateNodeID("Owner", "NodeA", { { "daTest", first } }));
+	store.Add(CreateNodeID("Owner", "NodeB", {}));
+	store.Add(CreateNodeID("Owner", "NodeA", { { "daTest", second }, { "daOther", third } }));
+	store.Add(CreateNodeID("Owner", "NodeA", { { "daInvalid", nullptr } }));
+
+	TestEqual("History contains all entries", store.Num(), 4);
+	TestTrue("Same node shares the node table entry", &store.GetNode(0) == &store.GetNode(2));
+	TestEqual("Entry without data has no data slots", store.GetData(1).Num(), 0);
+	TestEqual("Entry with two data assets has two data slots", store.GetData(2).Num(), 2);
+	TestEqual("Invalid data assets are not stored", store.GetData(3).Num(), 0);
+	TestTrue("Latest version is returned", store.FindLatestData("daTest") == second);
+
+	const FDSMNodeID materialized = store.Materialize(2);
+	TestTrue("Materialized node label", materialized._nodeLabel == FName("NodeA"));
+	TestTrue("Materialized data", materialized._data.Contains("daOther") && materialized._data["daOther"] == third);
+
+	FDSMHistoryStore copy;
+	copy.CopyFrom(store, 2);
+	TestEqual("Copy contains requested entries", copy.Num(), 2);
+	TestTrue("Copy only contains data until the copied index", copy.FindLatestData("daTest") == first);
+
+	// Data slots of the copied entry are appended to the same store
+	store.Add(store, 2);
+	TestEqual("Entry is copied inside the store", store.Num(), 5);
+	TestTrue("Copied entry keeps its data", store.GetData(4).Num() == 2 && store.FindLatestData("daOther") == third);
+
+	store.Truncate(1);
+	TestEqual("Truncated history", store.Num(), 1);
+	TestEqual("Truncated data slots", store.GetDataSlots().Num(), 1);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDSMHistoryBranchTest, "DynamicStateMachine.HistoryBranches",
+	EAutomationTestFlags::EditorContext |
+	EAutomationTestFlags::ProductFilter)
+	bool FDSMHistoryBranchTest::RunTest(const FString& Parameters) {
+
+	TObjectPtr<UTestDataAsset> first = NewObject<UTestDataAsset>();
+	TObjectPtr<UTestDataAsset> second = NewObject<UTestDataAsset>();
+	TObjectPtr<UTestDataAsset> third = NewObject<UTestDataAsset>();
+	TObjectPtr<UTestDataAsset> fourth = NewObject<UTestDataAsset>();
+
+	FDSMHistoryStore store;
+	store.Add(CreateNodeID("Owner", "NodeA", { { "daTest", first } }));
+	store.Add(CreateNodeID("Owner", "NodeB", { { "daTest", second } }));
+	store.Add(CreateNodeID("Owner", "NodeC", {}));
+
+	TestTrue("Fork after first entry", store.Fork("WhatIf", 1));
+	TestFalse("Branch names are unique", store.Fork("WhatIf", 1));
+	TestTrue("Fork does not change the active branch", store.GetActiveBranch() == FDSMHistoryStore::RootBranchName);
+	TestEqual("Fork does not copy entries", store.GetDataSlots().Num(), 2);
+
+	TestTrue("Switch to fork", store.SwitchBranch("WhatIf"));
+	TestEqual("Fork only contains shared entries", store.Num(), 1);
+	TestTrue("Latest data of the fork", store.FindLatestData("daTest") == first);
+	store.Add(CreateNodeID("Owner", "NodeD", { { "daTest", third } }));
+	TestEqual("Entry added to fork", store.Num(), 2);
+	TestTrue("Shared entry", store.GetNode(0)._nodeLabel == FName("NodeA"));
+	TestTrue("Own entry", store.GetNode(1)._nodeLabel == FName("NodeD"));
+	TestTrue("Latest data of the fork after add", store.FindLatestData("daTest") == third);
+
+	TestFalse("Active branch can not be dropped", store.DropBranch("WhatIf"));
+	TestTrue("Switch back to root", store.SwitchBranch(FDSMHistoryStore::RootBranchName));
+	TestEqual("Root keeps its entries", store.Num(), 3);
+	TestTrue("Latest data of root", store.FindLatestData("daTest") == second);
+	// Entry of root behind the entry of the fork, it moves when the fork is dropped
+	store.Add(CreateNodeID("Owner", "NodeE", { { "daTest", fourth } }));
+
+	TestEqual("Two branches exist", store.GetBranches().Num(), 2);
+	TArray<int32> releasedEntries;
+	TestTrue("Drop fork", store.DropBranch("WhatIf", [&releasedEntries](TArrayView<const int32> entries) { releasedEntries = TArray<int32>(entries); }));
+	TestEqual("Own entries of the fork are released", releasedEntries.Num(), 1);
+	TestEqual("One branch is left", store.GetBranches().Num(), 1);
+	TestEqual("Released data slots are removed", store.GetDataSlots().Num(), 3);
+	TestEqual("Root keeps its entries after the drop", store.Num(), 4);
+	TestTrue("Moved entry", store.GetNode(3)._nodeLabel == FName("NodeE"));
+	TestTrue("Data versions follow the moved data slots", store.FindDataAt("daTest", 2) == second && store.FindLatestData("daTest") == fourth);
+
+	FDSMHistoryStore copy;
+	copy.CopyFrom(store, store.Num());
+	TestEqual("Copy only contains the active branch", copy.GetDataSlots().Num(), 3);
+
+	// Entries of root are consecutive again after the drop
+	store.Truncate(2);
+	TestEqual("History without forks is truncated", store.Num(), 2);
+	TestTrue("Latest data after truncation", store.FindLatestData("daTest") == second);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDSMHistoryIndexTest, "DynamicStateMachine.HistoryIndexes",
+	EAutomationTestFlags::EditorContext |
+	EAutomationTestFlags::ProductFilter)
+	bool FDSMHistoryIndexTest::RunTest(const FString& Parameters) {
+
+	TObjectPtr<UTestDataAsset> first = NewObject<UTestDataAsset>();
+	TObjectPtr<UTestDataAsset> second = NewObject<UTestDataAsset>();
+
+	FDSMNodeRecord savePoint = FDSMNodeRecord::Create(CreateNodeID("Owner", "SavePoint", {}));
+	savePoint._nodeTags.Add("SavePoint");
+
+	FDSMHistoryStore store;
+	store.Add(savePoint, {});
+	store.Add(CreateNodeID("Owner", "NodeA", { { "daTest", first } }));
+	store.Add(CreateNodeID("Other", "NodeB", {}));
+	store.Add(savePoint, {});
+	store.Add(CreateNodeID("Owner", "NodeA", { { "daTest", second } }));
+
+	TestEqual("Class index contains all nodes", store.GetIndicesByClass(UDSMDefaultNode::StaticClass()).Num(), 5);
+	TestEqual("Owner index", store.GetIndices(EDSMHistoryIndex::Owner, "Other").Num(), 1);
+	TestEqual("Most recent tagged entry", store.GetIndices(EDSMHistoryIndex::NodeTag, "SavePoint").Last(), 3);
+	TestTrue("Data index", store.GetIndices(EDSMHistoryIndex::DataAsset, "daTest") == TArray<int32>({ 1, 4 }));
+	TestEqual("Unknown keys have no indices", store.GetIndices(EDSMHistoryIndex::DataAsset, "daUnknown").Num(), 0);
+
+	const TArray<int32>& ownerIndices = store.GetIndices(EDSMHistoryIndex::Owner, "Owner");
+	TestTrue("First page", FDSMHistoryStore::GetPage(ownerIndices, 0, 2) == TArray<int32>({ 0, 1 }));
+	TestTrue("Next page", FDSMHistoryStore::GetPage(ownerIndices, 2, 2) == TArray<int32>({ 3, 4 }));
+	TestEqual("Page after the end", FDSMHistoryStore::GetPage(ownerIndices, 5, 2).Num(), 0);
+
+	store.Fork("WhatIf", 2);
+	store.SwitchBranch("WhatIf");
+	TestEqual("Indexes follow the active branch", store.GetIndices(EDSMHistoryIndex::DataAsset, "daTest").Num(), 1);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDSMHistoryDataVersionTest, "DynamicStateMachine.HistoryDataVersions",
+	EAutomationTestFlags::EditorContext |
+	EAutomationTestFlags::ProductFilter)
+	bool FDSMHistoryDataVersionTest::RunTest(const FString& Parameters) {
+
+	TObjectPtr<UTestDataAsset> first = NewObject<UTestDataAsset>();
+	TObjectPtr<UTestDataAsset> second = NewObject<UTestDataAsset>();
+
+	FDSMHistoryStore store;
+	store.Add(CreateNodeID("Owner", "NodeA", {}));
+	store.Add(CreateNodeID("Owner", "NodeB", { { "daTest", first } }));
+	store.Add(CreateNodeID("Owner", "NodeC", {}));
+	store.Add(CreateNodeID("Owner", "NodeD", { { "daTest", second } }));
+
+	TestTrue("All versions are enumerated", store.GetDataVersions("daTest") == TArray<int32>({ 1, 3 }));
+	TestEqual("No version before the first write", store.FindDataVersion("daTest", 0), static_cast<int32>(INDEX_NONE));
+	TestTrue("No data before the first write", store.FindDataAt("daTest", 0) == nullptr);
+	TestTrue("Version at its own index", store.FindDataAt("daTest", 1) == first);
+	TestTrue("Version between writes", store.FindDataAt("daTest", 2) == first);
+	TestTrue("Latest version", store.FindDataAt("daTest", 3) == second);
+	TestTrue("Latest version equals FindLatestData", store.FindLatestData("daTest") == second);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDSMHistoryPagerTest, "DynamicStateMachine.HistoryPager",
+	EAutomationTestFlags::EditorContext |
+	EAutomationTestFlags::ProductFilter)
+	bool FDSMHistoryPagerTest::RunTest(const FString& Parameters) {
+
+	// Three sealed segments of two entries, every entry writes a new version of the data asset
+	FDSMHistoryStore store;
+	for (int32 i = 0; i < 6; ++i)
+	{
+		TObjectPtr<UTestDataAsset> version = NewObject<UTestDataAsset>();
+		version->bFalse = i % 2 == 1;
+		store.Add(CreateNodeID("Owner", "NodeA", { { "daTest", version } }));
+	}
+
+	FDSMHistoryPager disabled;
+	disabled.Configure(2, 0, 0);
+	disabled.OnEntryAdded(store, 5);
+	TestEqual("Nothing is accounted while paging is disabled", disabled.GetResidentBytes(), static_cast<int64>(0));
+
+	// Budget of one byte pages out every segment, which is not accessed
+	FDSMHistoryPager pager;
+	pager.Configure(2, 1, 0);
+	pager.ConfigureStorage(EDSMColdHistoryStorage::CompressedMemory, NAME_Zlib, 4);
+	pager.Rebuild(store);
+	TestTrue("Cold segment is paged out", store.GetData(0)[0]._asset == nullptr);
+	TestTrue("Latest version stays resident", store.GetData(5)[0]._asset != nullptr);
+	TestTrue("Cold segments are compressed", pager.GetCompressedBytes() > 0);
+
+	pager.EnsureResident(store, 1, 1);
+	const UTestDataAsset* pagedIn = Cast<UTestDataAsset>(store.GetData(1)[0]._asset);
+	TestTrue("Accessed segment is paged in", pagedIn && pagedIn->bFalse);
+	pager.EnsureResident(store, 2, 1);
+	TestTrue("Accessed segment is paged in after another", store.GetData(2)[0]._asset != nullptr);
+	TestTrue("Previous segment is paged out again to meet the budget", store.GetData(1)[0]._asset == nullptr);
+
+	// Resident segments do not keep their compressed copy
+	pager.Configure(2, MAX_int64, 0);
+	pager.EnsureResident(store, 0, store.Num());
+	TestTrue("Entire history is paged in", store.GetData(0)[0]._asset != nullptr && store.GetData(3)[0]._asset != nullptr);
+	TestEqual("Compressed copies are released", pager.GetCompressedBytes(), static_cast<int64>(0));
+
+	// Dropped branches are removed from the pool, later segments are accounted again
+	store.Fork("WhatIf", 3);
+	store.SwitchBranch("WhatIf");
+	pager.OnEntryAdded(store, store.Add(CreateNodeID("Owner", "NodeB", { { "daTest", NewObject<UTestDataAsset>() } })));
+	store.SwitchBranch(FDSMHistoryStore::RootBranchName);
+	pager.RefreshPins(store);
+	pager.OnEntryAdded(store, store.Add(CreateNodeID("Owner", "NodeA", { { "daTest", NewObject<UTestDataAsset>() } })));
+	store.DropBranch("WhatIf", [&pager, &store](TArrayView<const int32> releasedEntries) { pager.ReleaseEntries(store, releasedEntries); });
+	pager.OnEntriesRemoved(store);
+	FDSMHistoryPager rebuilt;
+	rebuilt.Configure(2, MAX_int64, 0);
+	rebuilt.Rebuild(store);
+	TestEqual("Accounting after the drop matches a rebuilt pager", pager.GetResidentBytes(), rebuilt.GetResidentBytes());
+	return true;
+}
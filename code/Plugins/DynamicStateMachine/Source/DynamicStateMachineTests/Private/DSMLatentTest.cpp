@@ -0,0 +1,73 @@
+#include "Misc/AutomationTest.h"
+#include "Tests/AutomationCommon.h"
+#include "DSMLatent.h"
+#include "DSMDefaultNode.h"
+#include "TestDataAsset.h"
+
+
+static FDSMLatentTask AwaitEvents(UDSMDataAsset* dataAsset, TMulticastDelegate<void(int32)>& delegate, int32& steps)
+{
+	++steps;
+	co_await FDSMLatent::WaitForDataChange(dataAsset);
+	++steps;
+	co_await FDSMLatent::WaitFor(delegate);
+	++steps;
+	co_return false;
+}
+
+// Node is passed as first parameter, same as for latent states of nodes
+static FDSMLatentTask AwaitNodeEvent(UDSMDefaultNode& node, TMulticastDelegate<void(int32)>& delegate, int32& steps)
+{
+	co_await FDSMLatent::WaitFor(delegate);
+	++steps;
+	co_return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDSMLatentTaskTest, "DynamicStateMachine.LatentTask",
+	EAutomationTestFlags::EditorContext |
+	EAutomationTestFlags::ProductFilter)
+	bool FDSMLatentTaskTest::RunTest(const FString& Parameters) {
+
+	TObjectPtr<UTestDataAsset> daTest = NewObject<UTestDataAsset>();
+	TMulticastDelegate<void(int32)> delegate;
+	int32 steps = 0;
+	FDSMLatentTask task = AwaitEvents(daTest, delegate, steps);
+	TestTrue("Task is valid", task.IsValid());
+	TestEqual("Runs until first await", steps, 1);
+	TestFalse("Not resumed without event", task.ResumeIfWoken());
+
+	// Events only wake the task, it is resumed by its owner
+	daTest->NotifyDataChanged();
+	TestEqual("Event does not resume", steps, 1);
+	TestTrue("Resumed after data change", task.ResumeIfWoken());
+	TestEqual("Runs until second await", steps, 2);
+	TestFalse("Data change binding removed", daTest->OnDataChanged.IsBound());
+
+	delegate.Broadcast(1);
+	TestTrue("Resumed after broadcast", task.ResumeIfWoken());
+	TestEqual("Runs until return", steps, 3);
+	TestTrue("Task is done", task.IsDone());
+	TestFalse("Returned value is kept", task.HasStateEnded());
+
+	// Events fired after a task was destroyed are ignored
+	FDSMLatentTask abortedTask = AwaitEvents(daTest, delegate, steps);
+	abortedTask.Reset();
+	daTest->NotifyDataChanged();
+	TestEqual("Destroyed task is not resumed", steps, 4);
+	TestFalse("Binding removed on destruction", daTest->OnDataChanged.IsBound());
+	FDSMLatentTask abortedDelegateTask = AwaitNodeEvent(*NewObject<UDSMDefaultNode>(), delegate, steps);
+	TestTrue("Delegate is bound", delegate.IsBound());
+	abortedDelegateTask.Reset();
+	TestFalse("Delegate binding removed on destruction", delegate.IsBound());
+	TestFalse("Invalid task has no latent state", FDSMLatentTask().IsValid());
+
+	// Latent states of destroyed nodes are not resumed
+	UDSMDefaultNode* node = NewObject<UDSMDefaultNode>();
+	FDSMLatentTask nodeTask = AwaitNodeEvent(*node, delegate, steps);
+	node->MarkAsGarbage();
+	delegate.Broadcast(1);
+	TestFalse("Destroyed node is not resumed", nodeTask.ResumeIfWoken());
+	TestEqual("Latent state did not continue", steps, 4);
+	TestTrue("Latent state is destroyed", nodeTask.IsDone());
+	return true;
+}
@@ -0,0 +1,255 @@
+#include "Misc/AutomationTest.h"
+#include "Tests/AutomationCommon.h"
+#include "DSMManager.h"
+#include "TestNode.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "TimerManager.h"
+
+
+// Game world with a DSM game mode, the world is destroyed with the fixture
+struct FDSMTestWorld
+{
+	UWorld* _world = UWorld::CreateWorld(EWorldType::Game, false);
+	ADSMGameMode* _gameMode = nullptr;
+
+	FDSMTestWorld()
+	{
+		GEngine->CreateNewWorldContext(EWorldType::Game).SetCurrentWorld(_world);
+		_gameMode = _world->SpawnActor<ADSMGameMode>();
+	}
+
+	~FDSMTestWorld()
+	{
+		GEngine->DestroyWorldContext(_world);
+		_world->DestroyWorld(false);
+	}
+
+	// Spawns an actor owning a test node, the node is registered at the game mode
+	template<typename TNode = UTestNode>
+	TNode* SpawnNode(FName ownerName, FName nodeName)
+	{
+		FActorSpawnParameters spawnParameters;
+		spawnParameters.Name = ownerName;
+		AActor* owner = _world->SpawnActor<AActor>(AActor::StaticClass(), FTransform::Identity, spawnParameters);
+		TNode* node = NewObject<TNode>(owner, nodeName);
+		node->RegisterComponent();
+		node->CacheImplementedEvents();
+		ADSMGameMode::RegisterNode(node);
+		return node;
+	}
+
+	// Saves the running history into a memory slot and begins play, the slot is loaded and replayed on the first tick
+	void BeginPlayAndLoad(int32 historyIndex, bool keepState = false)
+	{
+		const FString slotName = TEXT("DSMTestWorld");
+		_gameMode->_stateMachineData->SaveStateToMemory(historyIndex, slotName, keepState);
+		ADSMGameMode::SetSaveLoadInfo({ slotName, true });
+		_gameMode->DispatchBeginPlay();
+		Tick();
+	}
+
+	// Fires the timers of the next frame and updates the state machine
+	void Tick()
+	{
+		// Timer manager only ticks once per frame
+		++GFrameCounter;
+		_world->GetTimerManager().Tick(0.f);
+		_gameMode->TickActor(0.f, LEVELTICK_All, _gameMode->PrimaryActorTick);
+	}
+};
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDSMRespawnOwnerTest, "DynamicStateMachine.RespawnOwner",
+	EAutomationTestFlags::EditorContext |
+	EAutomationTestFlags::ProductFilter)
+	bool FDSMRespawnOwnerTest::RunTest(const FString& Parameters) {
+
+	FDSMTestWorld world;
+	ADSMGameMode* gameMode = world._gameMode;
+	FActorSpawnParameters spawnParameters;
+	spawnParameters.Name = "DSMRespawnOwnerTest";
+	AActor* owner = world._world->SpawnActor<AActor>(AActor::StaticClass(), FTransform::Identity, spawnParameters);
+	TestTrue("Game mode and owner are spawned", gameMode && owner);
+	if (gameMode && owner)
+	{
+		// Actors spawned at runtime are not spawned again
+		gameMode->RecordDestroyedOwner(owner);
+		TestEqual("Runtime actors are not recorded", gameMode->RespawnDestroyedOwners({ owner->GetFName() }), 0);
+
+		// Level actors are loaded with their level
+		owner->SetFlags(RF_WasLoaded);
+		gameMode->RecordDestroyedOwner(owner);
+		owner->Destroy();
+		TestEqual("Untouched owners are not spawned", gameMode->RespawnDestroyedOwners({ "OtherOwner" }), 0);
+		TestEqual("Touched owner is spawned again", gameMode->RespawnDestroyedOwners({ "DSMRespawnOwnerTest" }), 1);
+		AActor* respawned = FindObject<AActor>(world._world->PersistentLevel, TEXT("DSMRespawnOwnerTest"));
+		TestTrue("Spawned owner keeps its name", IsValid(respawned) && respawned != owner);
+		TestEqual("Owner is spawned once", gameMode->RespawnDestroyedOwners({ "DSMRespawnOwnerTest" }), 0);
+	}
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDSMRestoreSpawnedActorsTest, "DynamicStateMachine.RestoreSpawnedActors",
+	EAutomationTestFlags::EditorContext |
+	EAutomationTestFlags::ProductFilter)
+	bool FDSMRestoreSpawnedActorsTest::RunTest(const FString& Parameters) {
+
+	FDSMTestWorld world;
+	ADSMGameMode* gameMode = world._gameMode;
+	gameMode->DispatchBeginPlay();
+	world.Tick();
+	UTestNode* nodeA = world.SpawnNode("OwnerA", "NodeA");
+	UTestNode* nodeB = world.SpawnNode("OwnerB", "NodeB");
+
+	// NodeA ends right away and is stored in the history, NodeB stays active and spawns an actor
+	nodeA->_bCanEnter = true;
+	TestTrue("Transition to NodeA", nodeA->RequestTransition());
+	nodeA->_bCanEnter = false;
+	nodeB->_bCanEnter = true;
+	nodeB->_bEndState = false;
+	nodeB->_bSpawnActor = true;
+	world.Tick();
+	TestEqual("NodeA is stored in the history", gameMode->_stateMachineData->GetStateMachineHistoryNum(), 1);
+	TestTrue("NodeB is active", gameMode->GetActiveNode() == nodeB);
+	AActor* nodeActor = nodeB->_spawnedActor;
+	TestTrue("NodeB spawned an actor", IsValid(nodeActor));
+
+	// Actors of other game systems are spawned while a node is active, outside of its events
+	AActor* otherActor = world._world->SpawnActor<AActor>();
+	TestTrue("State restored in place", gameMode->RestoreStateInPlace(0));
+	TestFalse("Actor spawned by the discarded node is destroyed", IsValid(nodeActor));
+	TestTrue("Actor spawned outside of node events survives", IsValid(otherActor));
+	TestFalse("Active node is discarded", gameMode->IsActive());
+	TestEqual("Untouched owner is not applied again", nodeA->_appliedNum, 1);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDSMReplayCollapseTest, "DynamicStateMachine.ReplayCollapse",
+	EAutomationTestFlags::EditorContext |
+	EAutomationTestFlags::ProductFilter)
+	bool FDSMReplayCollapseTest::RunTest(const FString& Parameters) {
+
+	FDSMTestWorld world;
+	ADSMGameMode* gameMode = world._gameMode;
+	UTestIdempotentNode* marker = world.SpawnNode<UTestIdempotentNode>("OwnerA", "Marker");
+	UTestNode* step = world.SpawnNode("OwnerB", "Step");
+	UDSMSaveGame* stateMachineData = gameMode->_stateMachineData;
+	for (int32 i = 0; i < 2; ++i)
+	{
+		stateMachineData->AddMemory(marker, {});
+		stateMachineData->AddMemory(step, {});
+	}
+	stateMachineData->AddMemory(marker, {});
+
+	// Idempotent node is only applied at its last history element, the loaded history stays complete
+	stateMachineData->_bFastLoad = true;
+	world.BeginPlayAndLoad(4);
+	TestFalse("Replay finished", gameMode->IsReplaying());
+	TestEqual("Idempotent node is applied once", marker->_appliedNum, 1);
+	TestEqual("Other node is applied at each history element", step->_appliedNum, 2);
+	TestEqual("Loaded history length", stateMachineData->GetStateMachineHistoryNum(), 5);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDSMReplayBudgetTest, "DynamicStateMachine.ReplayBudget",
+	EAutomationTestFlags::EditorContext |
+	EAutomationTestFlags::ProductFilter)
+	bool FDSMReplayBudgetTest::RunTest(const FString& Parameters) {
+
+	FDSMTestWorld world;
+	ADSMGameMode* gameMode = world._gameMode;
+	UTestNode* replayed = world.SpawnNode("OwnerA", "Replayed");
+	UTestNode* waiting = world.SpawnNode("OwnerB", "Waiting");
+	UDSMSaveGame* stateMachineData = gameMode->_stateMachineData;
+	for (int32 i = 0; i < 3; ++i)
+	{
+		stateMachineData->AddMemory(replayed, {});
+	}
+
+	// Each history element uses up the budget, so one element is replayed per tick
+	replayed->_applySeconds = 0.002f;
+	stateMachineData->_replayBudgetMilliseconds = 1.f;
+	world.BeginPlayAndLoad(2);
+	TestTrue("Replay continues on the next tick", gameMode->IsReplaying());
+	TestEqual("First tick replays one element", replayed->_appliedNum, 1);
+
+	// Transitions requested during the replay do not begin a state
+	waiting->_bCanEnter = true;
+	waiting->RequestTransition();
+	TestEqual("Transition is blocked during replay", waiting->_beginNum, 0);
+	TestFalse("No node is active during replay", gameMode->IsActive());
+
+	world.Tick();
+	TestTrue("Replay is still running", gameMode->IsReplaying());
+	TestEqual("Second tick replays one element", replayed->_appliedNum, 2);
+	world.Tick();
+	TestFalse("Replay finished", gameMode->IsReplaying());
+	TestEqual("All elements are replayed", replayed->_appliedNum, 3);
+	TestEqual("Blocked transition is not performed later", waiting->_beginNum, 0);
+
+	TestTrue("Transition after the replay", waiting->RequestTransition());
+	TestEqual("State begins after the replay", waiting->_beginNum, 1);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDSMReplayFinishedTest, "DynamicStateMachine.ReplayFinished",
+	EAutomationTestFlags::EditorContext |
+	EAutomationTestFlags::ProductFilter)
+	bool FDSMReplayFinishedTest::RunTest(const FString& Parameters) {
+
+	FDSMTestWorld world;
+	ADSMGameMode* gameMode = world._gameMode;
+	UTestNode* node = world.SpawnNode("OwnerA", "NodeA");
+	gameMode->_stateMachineData->AddMemory(node, {});
+	UTestReplayListener* listener = NewObject<UTestReplayListener>();
+	listener->_node = node;
+	gameMode->OnReplayFinished.AddDynamic(listener, &UTestReplayListener::OnReplayFinished);
+
+	// Transition after begin play waits for the replay and is requested after the replay was reported
+	gameMode->bRequestTransitionAfterBeginPlay = true;
+	node->_bCanEnter = true;
+	world.BeginPlayAndLoad(0);
+	TestEqual("Replay finished once", listener->_finishedNum, 1);
+	TestTrue("Replay succeeded", listener->_bSuccess);
+	TestEqual("No state began before the replay finished", listener->_beginNumOnFinish, 0);
+	TestEqual("Node is applied by the replay and the new state", node->_appliedNum, 2);
+	TestEqual("Transition after begin play follows the replay", node->_beginNum, 1);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDSMReplayFailedTest, "DynamicStateMachine.ReplayFailed",
+	EAutomationTestFlags::EditorContext |
+	EAutomationTestFlags::ProductFilter)
+	bool FDSMReplayFailedTest::RunTest(const FString& Parameters) {
+
+	FDSMTestWorld world;
+	ADSMGameMode* gameMode = world._gameMode;
+	UTestNode* nodeA = world.SpawnNode("OwnerA", "NodeA");
+	UTestNode* nodeB = world.SpawnNode("OwnerB", "NodeB");
+	UDSMSaveGame* stateMachineData = gameMode->_stateMachineData;
+	stateMachineData->AddMemory(nodeA, {});
+	stateMachineData->AddMemory(nodeB, {});
+	UTestReplayListener* listener = NewObject<UTestReplayListener>();
+	gameMode->OnReplayFinished.AddDynamic(listener, &UTestReplayListener::OnReplayFinished);
+
+	// Loaded history contains both nodes, the running history a third element, NodeB can not be found on load
+	stateMachineData->SaveStateToMemory(1, TEXT("DSMReplayFailedTest"));
+	stateMachineData->AddMemory(nodeA, {});
+	nodeB->GetOwner()->Destroy();
+	AddExpectedError(TEXT("Can not find actor with name OwnerB"), EAutomationExpectedErrorFlags::Contains, 1);
+	AddExpectedError(TEXT("Could not load save game node NodeB"), EAutomationExpectedErrorFlags::Contains, 1);
+	ADSMGameMode::SetSaveLoadInfo({ TEXT("DSMReplayFailedTest"), true });
+	gameMode->DispatchBeginPlay();
+	world.Tick();
+	TestEqual("Replay finished once", listener->_finishedNum, 1);
+	TestFalse("Replay failed", listener->_bSuccess);
+	TestFalse("Replay stopped", gameMode->IsReplaying());
+	TestEqual("Nodes before the missing node are applied", nodeA->_appliedNum, 1);
+	TestEqual("History from before the replay is restored", stateMachineData->GetStateMachineHistoryNum(), 3);
+
+	// Transitions are allowed again after a failed replay
+	nodeA->_bCanEnter = true;
+	TestTrue("Transition after the failed replay", nodeA->RequestTransition());
+	TestEqual("State begins after the failed replay", nodeA->_beginNum, 1);
+	return true;
+}
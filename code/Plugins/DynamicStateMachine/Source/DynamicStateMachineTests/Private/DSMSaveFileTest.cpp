@@ -0,0 +1,661 @@
+#include "Misc/AutomationTest.h"
+#include "Tests/AutomationCommon.h"
+#include "DSMSaveFile.h"
+#include "DSMSaveJournal.h"
+#include "DSMSlotStore.h"
+#include "DSMAutosave.h"
+#include "DSMSaveFileView.h"
+#include "DSMSnapshot.h"
+#include "DSMSaveGame.h"
+#include "DSMManager.h"
+#include "DSMTestHelpers.h"
+#include "Serialization/MemoryWriter.h"
+#include "Serialization/MemoryReader.h"
+#include "HAL/FileManager.h"
+#include "Kismet/GameplayStatics.h"
+
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDSMSaveFileTest, "DynamicStateMachine.SaveFile",
+	EAutomationTestFlags::EditorContext |
+	EAutomationTestFlags::ProductFilter)
+	bool FDSMSaveFileTest::RunTest(const FString& Parameters) {
+
+	const FDSMTestNodes nodes;
+
+	FDSMHistoryStore store;
+	store.Add(nodes._nodeA);
+	store.Add(nodes._nodeB);
+	store.Add(nodes._nodeA);
+
+	FDSMSaveFile saveFile = FDSMSaveFile::Capture(store, 2);
+	saveFile._indexToLoad = 1;
+	TestEqual("Nodes are deduplicated", saveFile._nodes.Num(), 2);
+	TestEqual("Only captured entries are stored", saveFile._entries.Num(), 2);
+
+	TArray<uint8> bytes;
+	FMemoryWriter writer(bytes);
+	TestTrue("Save file is written", saveFile.Serialize(writer));
+
+	FDSMSaveFile loadedFile;
+	FMemoryReader reader(bytes);
+	TestTrue("Save file is read", loadedFile.Serialize(reader));
+	TestEqual("Index to load", loadedFile._indexToLoad, 1);
+
+	FDSMHistoryStore loaded;
+	loadedFile.Restore(loaded);
+	TestEqual("Loaded history length", loaded.Num(), 2);
+	TestTrue("Loaded node label", loaded.GetNode(1)._nodeLabel == FName("NodeB"));
+	TestTrue("Loaded node class", loaded.GetNode(1)._nodeClass == UDSMDefaultNode::StaticClass());
+	const UTestDataAsset* loadedData = Cast<UTestDataAsset>(loaded.FindLatestData("daTest"));
+	TestTrue("Loaded data asset is a copy", loadedData && loadedData != nodes._second);
+	TestTrue("Loaded data asset properties", loadedData && !loadedData->bTrue && loadedData->bFalse);
+
+	// Small blocks make sure snapshots are split across several compressed blocks
+	FDSMSaveFile compressedFile = FDSMSaveFile::Capture(store, 3);
+	compressedFile._compressionFormat = NAME_Zlib;
+	compressedFile._compressionBlockSize = 64;
+	TArray<uint8> compressedBytes;
+	FMemoryWriter compressedWriter(compressedBytes);
+	TestTrue("Compressed save file is written", compressedFile.Serialize(compressedWriter));
+	TestTrue("Uncompressed size is reported", compressedFile._uncompressedBytes > 0 && compressedFile._storedBytes > 0);
+
+	FDSMSaveFile loadedCompressedFile;
+	FMemoryReader compressedReader(compressedBytes);
+	TestTrue("Compressed save file is read", loadedCompressedFile.Serialize(compressedReader));
+	TestTrue("Compression format is read", loadedCompressedFile._compressionFormat == NAME_Zlib);
+	TestEqual("Compressed slots are read", loadedCompressedFile._slots.Num(), compressedFile._slots.Num());
+
+	// Streaming load restores the history while reading the file
+	const FString filePath = FDSMSaveFile::GetFilePath(TEXT("DSMSaveFileTest"));
+	TestTrue("Compressed save file is written to disc", compressedFile.Write(filePath));
+	FDSMSaveFile streamedFile;
+	FDSMHistoryStore streamed;
+	TestTrue("Compressed save file is loaded", streamedFile.Load(filePath, streamed));
+	TestEqual("Streamed history length", streamed.Num(), 3);
+
+	// Summary is read from the header only
+	FDSMSaveFile::FSummary summary;
+	TestTrue("Summary is read", FDSMSaveFile::ReadSummary(filePath, summary));
+	TestEqual("Summary history length", summary._historyNum, 3);
+	TestEqual("Summary last node label", summary._lastNodeLabel, FString("NodeA"));
+	TestTrue("Summary timestamp", summary._timestamp > 0);
+
+	// Summaries have a fixed size, long strings are truncated
+	summary._metadata = FString::ChrN(FDSMSaveFile::FSummary::MetadataBytes + 16, TEXT('m'));
+	TArray<uint8> summaryBytes;
+	FMemoryWriter summaryWriter(summaryBytes);
+	AddExpectedError(TEXT("will be truncated"), EAutomationExpectedErrorFlags::Contains, 1);
+	summary.SerializeFixed(summaryWriter);
+	TestEqual("Summary size", static_cast<int64>(summaryBytes.Num()), FDSMSaveFile::FSummary::FixedSize);
+	FDSMSaveFile::FSummary fixedSummary;
+	FMemoryReader summaryReader(summaryBytes);
+	fixedSummary.SerializeFixed(summaryReader);
+	TestEqual("Fixed summary last node label", fixedSummary._lastNodeLabel, FString("NodeA"));
+	TestEqual("Metadata is truncated", fixedSummary._metadata.Len(), FDSMSaveFile::FSummary::MetadataBytes);
+	const UTestDataAsset* streamedData = Cast<UTestDataAsset>(streamed.FindDataAt("daTest", 1));
+	TestTrue("Streamed data asset properties", streamedData && !streamedData->bTrue && streamedData->bFalse);
+
+	// Lazy load only restores the requested entries and reads snapshots on access, the mapping is released before the file is deleted
+	{
+		TSharedPtr<FDSMSaveFileView> view = FDSMSaveFileView::Open(filePath);
+		TestTrue("Save file is mapped", view.IsValid());
+		if (view)
+		{
+			FDSMHistoryStore lazy;
+			view->RestoreEntries(lazy, 2);
+			TestEqual("Only requested entries are restored", lazy.Num(), 2);
+			TestTrue("Data is not read on restore", !lazy.GetData(1)[0]._asset);
+			view->Resolve(lazy, 1, 1);
+			const UTestDataAsset* lazyData = Cast<UTestDataAsset>(lazy.GetData(1)[0]._asset);
+			TestTrue("Data is read on access", lazyData && !lazyData->bTrue && lazyData->bFalse);
+			TestEqual("Only accessed snapshots are read", view->GetResolvedNum(), 1);
+		}
+	}
+	IFileManager::Get().Delete(*filePath);
+
+	TArray<uint8> invalidBytes = { 1, 2, 3, 4 };
+	FMemoryReader invalidReader(invalidBytes);
+	FDSMSaveFile invalidFile;
+	AddExpectedError(TEXT("not a DSM save file"));
+	TestFalse("Invalid files are rejected", invalidFile.Serialize(invalidReader));
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDSMSaveFileViewSlotsTest, "DynamicStateMachine.SaveFileViewSlots",
+	EAutomationTestFlags::EditorContext |
+	EAutomationTestFlags::ProductFilter)
+	bool FDSMSaveFileViewSlotsTest::RunTest(const FString& Parameters) {
+
+	const FDSMTestNodes nodes;
+
+	FDSMHistoryStore store;
+	store.Add(nodes._nodeA);
+	store.Add(nodes._nodeB);
+	store.Add(nodes._nodeA);
+	const FString filePath = FDSMSaveFile::GetFilePath(TEXT("DSMSaveFileViewSlotsTest"));
+	FDSMSaveFile saveFile = FDSMSaveFile::Capture(store, 3);
+	TestTrue("Save file is written", saveFile.Write(filePath));
+	{
+		TSharedPtr<FDSMSaveFileView> view = FDSMSaveFileView::Open(filePath);
+		TestTrue("Save file is mapped", view.IsValid());
+		if (view)
+		{
+			FDSMHistoryStore lazy;
+			view->RestoreEntries(lazy, 3);
+			// Replay of a single unresolved entry, its data slot moves to the front of the copied history
+			FDSMHistoryStore branch;
+			branch.Add(lazy, 1);
+			TObjectPtr<UDSMSaveGame> replay = NewObject<UDSMSaveGame>();
+			replay->SetStateMachineHistory(branch, 1);
+			replay->SetSaveFileView(view);
+			replay->EnsureHistoryResident(0, 1);
+			const UTestDataAsset* replayData = Cast<UTestDataAsset>(replay->GetHistoryStore().GetData(0)[0]._asset);
+			TestTrue("Copied data slot is read from its stored slot", replayData && !replayData->bTrue && replayData->bFalse);
+			TestEqual("Only the copied snapshot is read", view->GetResolvedNum(), 1);
+		}
+	}
+	IFileManager::Get().Delete(*filePath);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDSMParallelSnapshotTest, "DynamicStateMachine.ParallelSnapshot",
+	EAutomationTestFlags::EditorContext |
+	EAutomationTestFlags::ProductFilter)
+	bool FDSMParallelSnapshotTest::RunTest(const FString& Parameters) {
+
+	const FDSMTestNodes nodes;
+
+	// Enough snapshots for several chunks, empty snapshots stay empty
+	TArray<TArray<uint8>> bytes;
+	bytes.SetNum(41);
+	for (int32 i = 0; i < 40; ++i)
+	{
+		FDSMSnapshot::Write(i % 2 == 0 ? nodes._first : nodes._second, bytes[i]);
+	}
+	TArray<TArrayView<const uint8>> snapshots;
+	for (const TArray<uint8>& snapshot : bytes)
+	{
+		snapshots.Add(snapshot);
+	}
+
+	TArray<UDSMDataAsset*> assets;
+	FDSMSnapshot::ReadParallel(snapshots, assets);
+	TestEqual("One data asset per snapshot", assets.Num(), 41);
+	TestTrue("Empty snapshot", assets.Last() == nullptr);
+	bool bAllRead = true;
+	for (int32 i = 0; i < 40; ++i)
+	{
+		const UTestDataAsset* asset = Cast<UTestDataAsset>(assets[i]);
+		const bool bSecond = i % 2 == 1;
+		bAllRead &= asset && asset != nodes._first && asset != nodes._second && asset->bTrue != bSecond && asset->bFalse == bSecond;
+	}
+	TestTrue("Properties are read on worker threads", bAllRead);
+	TestTrue("Each snapshot creates its own data asset", assets[0] != assets[2]);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDSMSaveJournalTest, "DynamicStateMachine.SaveJournal",
+	EAutomationTestFlags::EditorContext |
+	EAutomationTestFlags::ProductFilter)
+	bool FDSMSaveJournalTest::RunTest(const FString& Parameters) {
+
+	const FDSMTestNodes nodes;
+
+	const FString slotName = TEXT("DSMSaveJournalTest");
+	FDSMHistoryStore store;
+	store.Add(nodes._nodeA);
+	store.Add(nodes._nodeB);
+
+	FDSMSaveJournal journal;
+	journal.Configure(0.f, 0, nullptr);
+	journal.Capture(store, 2, slotName, 1, false, NAME_None, 256 * 1024);
+	journal.Flush(true);
+	TestEqual("Base file captured all entries", journal.GetCapturedNum(slotName, store), 2);
+
+	store.Add(nodes._nodeA);
+	store.Add(nodes._nodeB);
+	journal.Capture(store, 3, slotName, 2, false, NAME_None, 256 * 1024);
+	journal.Capture(store, 4, slotName, 3, false, NAME_None, 256 * 1024);
+	journal.Flush(true);
+	TestTrue("Journal is written", IFileManager::Get().FileExists(*FDSMSaveJournal::GetFilePath(slotName)));
+
+	FDSMSaveFile baseFile;
+	FDSMHistoryStore loaded;
+	TestTrue("Base file is loaded", baseFile.Load(FDSMSaveFile::GetFilePath(slotName), loaded));
+	TestEqual("Base file only contains the first save", loaded.Num(), 2);
+	TestTrue("Journal is replayed", FDSMSaveJournal::Replay(slotName, loaded, baseFile));
+	TestEqual("Replayed history length", loaded.Num(), 4);
+	TestEqual("Index to load of the latest record", baseFile._indexToLoad, 3);
+	TestTrue("Replayed node label", loaded.GetNode(3)._nodeLabel == FName("NodeB"));
+	FDSMSaveFile::FSummary summary;
+	TestTrue("Journaled summary is read", FDSMSaveJournal::ReadSummary(slotName, summary));
+	TestEqual("Summary of the last journal record", summary._historyNum, 4);
+
+	// Game stopped after a merged base file replaced the previous one, but before the journal was removed
+	FDSMSaveFile mergedFile = FDSMSaveFile::Capture(store, 4);
+	TestTrue("Merged base file is written", mergedFile.Write(FDSMSaveFile::GetFilePath(slotName)));
+	FDSMSaveFile mergedBaseFile;
+	FDSMHistoryStore mergedLoaded;
+	TestTrue("Merged base file is loaded", mergedBaseFile.Load(FDSMSaveFile::GetFilePath(slotName), mergedLoaded));
+	TestTrue("Stale journal does not fail the load", FDSMSaveJournal::Replay(slotName, mergedLoaded, mergedBaseFile));
+	TestEqual("Stale journal records are skipped", mergedLoaded.Num(), 4);
+	TestTrue("Summary is read with a stale journal", FDSMSaveJournal::ReadSummary(slotName, summary));
+	TestEqual("Summary of the merged base file", summary._historyNum, 4);
+
+	TestTrue("Journal is compacted", FDSMSaveJournal::Compact(slotName));
+	TestFalse("Journal is removed after compaction", IFileManager::Get().FileExists(*FDSMSaveJournal::GetFilePath(slotName)));
+	FDSMSaveFile compactedFile;
+	TestTrue("Compacted file is read", compactedFile.Read(FDSMSaveFile::GetFilePath(slotName)));
+	TestEqual("Compacted history length", compactedFile._entries.Num(), 4);
+
+	IFileManager::Get().Delete(*FDSMSaveFile::GetFilePath(slotName));
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDSMSaveJournalResetTest, "DynamicStateMachine.SaveJournalReset",
+	EAutomationTestFlags::EditorContext |
+	EAutomationTestFlags::ProductFilter)
+	bool FDSMSaveJournalResetTest::RunTest(const FString& Parameters) {
+
+	const FDSMTestNodes nodes;
+
+	const FString slotName = TEXT("DSMSaveJournalResetTest");
+	FDSMHistoryStore store;
+	store.Add(nodes._nodeA);
+	store.Add(nodes._nodeB);
+	FDSMSaveJournal journal;
+	journal.Configure(0.f, 0, nullptr);
+	journal.Capture(store, 2, slotName, 1, false, NAME_None, 256 * 1024);
+	journal.Flush(true);
+
+	// Rewound history grows beyond the saved length again, saved entries are no prefix of it anymore
+	store.Truncate(1);
+	store.Add(nodes._nodeA);
+	store.Add(nodes._nodeA);
+	TestEqual("Rewound history is not captured", journal.GetCapturedNum(slotName, store), 0);
+	journal.Capture(store, 3, slotName, 2, false, NAME_None, 256 * 1024);
+	journal.Flush(true);
+	TestFalse("Rewound history is written as base file", IFileManager::Get().FileExists(*FDSMSaveJournal::GetFilePath(slotName)));
+	FDSMSaveFile baseFile;
+	TestTrue("Base file is read", baseFile.Read(FDSMSaveFile::GetFilePath(slotName)));
+	TestEqual("Base file history length", baseFile._entries.Num(), 3);
+
+	// Another store is never appended to the base file of the previous store
+	FDSMHistoryStore otherStore;
+	for (int32 i = 0; i < 4; ++i)
+	{
+		otherStore.Add(nodes._nodeB);
+	}
+	journal.Capture(otherStore, 4, slotName, 3, false, NAME_None, 256 * 1024);
+	journal.Flush(true);
+	TestFalse("Other store is written as base file", IFileManager::Get().FileExists(*FDSMSaveJournal::GetFilePath(slotName)));
+	FDSMSaveFile otherBaseFile;
+	FDSMHistoryStore loaded;
+	TestTrue("Base file of the other store is loaded", otherBaseFile.Load(FDSMSaveFile::GetFilePath(slotName), loaded));
+	TestTrue("Base file contains the other store", loaded.Num() == 4 && loaded.GetNode(0)._nodeLabel == FName("NodeB"));
+	journal.Reset();
+
+	// Native saves replace the base file of the journal
+	TObjectPtr<UDSMSaveGame> saveGame = NewObject<UDSMSaveGame>(GetMutableDefault<ADSMGameMode>());
+	saveGame->SetStateMachineHistory({ nodes._nodeA, nodes._nodeB });
+	saveGame->_saveFormat = EDSMSaveFormat::JournaledFile;
+	saveGame->SaveState(1, slotName);
+	saveGame->_saveFormat = EDSMSaveFormat::NativeFile;
+	saveGame->SaveState(0, slotName);
+	saveGame->PushStateMachineElement(nodes._nodeA);
+	saveGame->_saveFormat = EDSMSaveFormat::JournaledFile;
+	saveGame->SaveState(2, slotName);
+	FDSMSaveJournal::WaitForPendingWrites();
+	TestFalse("Journal does not continue the native save", IFileManager::Get().FileExists(*FDSMSaveJournal::GetFilePath(slotName)));
+	TObjectPtr<UDSMSaveGame> loadedSaveGame = UDSMSaveGame::LoadSlot(slotName);
+	TestTrue("Journaled save after a native save is loaded", loadedSaveGame && loadedSaveGame->GetStateMachineHistoryNum() == 3);
+	UDSMSaveGame::DeleteSlot(slotName);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDSMSaveJournalFailedBaseTest, "DynamicStateMachine.SaveJournalFailedBase",
+	EAutomationTestFlags::EditorContext |
+	EAutomationTestFlags::ProductFilter)
+	bool FDSMSaveJournalFailedBaseTest::RunTest(const FString& Parameters) {
+
+	const FDSMTestNodes nodes;
+
+	const FString slotName = TEXT("DSMSaveJournalFailedBaseTest");
+	FDSMHistoryStore store;
+	store.Add(nodes._nodeA);
+	store.Add(nodes._nodeB);
+	FDSMSaveJournal journal;
+	journal.Configure(0.f, 0, nullptr);
+
+	// Base file can not be written, while a directory blocks its temporary file
+	const FString blockingPath = FDSMSaveFile::GetFilePath(slotName) + TEXT(".tmp");
+	IFileManager::Get().MakeDirectory(*blockingPath, true);
+	AddExpectedError(TEXT("Can not create DSM save file"), EAutomationExpectedErrorFlags::Contains, 1);
+	journal.Capture(store, 2, slotName, 1, false, NAME_None, 256 * 1024);
+	journal.Flush(true);
+	IFileManager::Get().DeleteDirectory(*blockingPath, false, true);
+	TestFalse("Base file is not written", IFileManager::Get().FileExists(*FDSMSaveFile::GetFilePath(slotName)));
+	TestEqual("Entries of the failed base file are not captured", journal.GetCapturedNum(slotName, store), 0);
+
+	// Next save writes a new base file instead of a journal record without base file
+	store.Add(nodes._nodeA);
+	journal.Capture(store, 3, slotName, 2, false, NAME_None, 256 * 1024);
+	journal.Flush(true);
+	TestFalse("No journal record is written", IFileManager::Get().FileExists(*FDSMSaveJournal::GetFilePath(slotName)));
+	FDSMSaveFile baseFile;
+	TestTrue("Base file is read", baseFile.Read(FDSMSaveFile::GetFilePath(slotName)));
+	TestEqual("Base file contains all entries", baseFile._entries.Num(), 3);
+	TestEqual("Entries of the base file are captured", journal.GetCapturedNum(slotName, store), 3);
+
+	IFileManager::Get().Delete(*FDSMSaveFile::GetFilePath(slotName));
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDSMSlotStoreTest, "DynamicStateMachine.SlotStore",
+	EAutomationTestFlags::EditorContext |
+	EAutomationTestFlags::ProductFilter)
+	bool FDSMSlotStoreTest::RunTest(const FString& Parameters) {
+
+	const FDSMTestNodes nodes;
+
+	FDSMHistoryStore store;
+	store.Add(nodes._nodeA);
+	store.Add(nodes._nodeB);
+	store.Add(nodes._nodeA);
+	store.Add(nodes._nodeB);
+
+	const FString earlySlot = TEXT("DSMSlotStoreTestEarly");
+	const FString lateSlot = TEXT("DSMSlotStoreTestLate");
+	FDSMSaveFile earlyFile = FDSMSaveFile::Capture(store, 2);
+	earlyFile._indexToLoad = 1;
+	TestTrue("Early slot is written", FDSMSlotStore::Write(earlySlot, earlyFile, 2));
+	TestTrue("Manifest is written", IFileManager::Get().FileExists(*FDSMSlotStore::GetManifestPath(earlySlot)));
+
+	// Late slot shares its first segment and all snapshots with the early slot
+	FDSMSaveFile lateFile = FDSMSaveFile::Capture(store, 4);
+	lateFile._indexToLoad = 3;
+	TestTrue("Late slot is written", FDSMSlotStore::Write(lateSlot, lateFile, 2));
+	TestTrue("Only the new segment is written", lateFile._storedBytes < earlyFile._storedBytes);
+	FDSMSaveFile rewrittenFile = FDSMSaveFile::Capture(store, 2);
+	rewrittenFile._indexToLoad = 1;
+	TestTrue("Early slot is written again", FDSMSlotStore::Write(earlySlot, rewrittenFile, 2));
+	TestTrue("Existing blobs are not written again", rewrittenFile._storedBytes < earlyFile._storedBytes);
+
+	FDSMSaveFile loadedFile;
+	TestTrue("Late slot is read", FDSMSlotStore::Read(lateSlot, loadedFile));
+	TestEqual("Index to load", loadedFile._indexToLoad, 3);
+	FDSMHistoryStore loaded;
+	loadedFile.Restore(loaded);
+	TestEqual("Loaded history length", loaded.Num(), 4);
+	TestTrue("Loaded node label", loaded.GetNode(3)._nodeLabel == FName("NodeB"));
+	const UTestDataAsset* loadedData = Cast<UTestDataAsset>(loaded.FindDataAt("daTest", 3));
+	TestTrue("Loaded data asset properties", loadedData && !loadedData->bTrue);
+	FDSMSaveFile::FSummary summary;
+	TestTrue("Summary is read from the manifest", FDSMSlotStore::ReadSummary(lateSlot, summary));
+	TestEqual("Summary history length", summary._historyNum, 4);
+
+	// Blobs of the early slot are still referenced by the late slot
+	IFileManager::Get().Delete(*FDSMSlotStore::GetManifestPath(earlySlot));
+	TestEqual("Shared blobs are kept", FDSMSlotStore::CollectGarbage(), 0);
+	IFileManager::Get().Delete(*FDSMSlotStore::GetManifestPath(lateSlot));
+	TestTrue("Unreferenced blobs are removed", FDSMSlotStore::CollectGarbage() > 0);
+	return true;
+}
+
+static int32 CountStoreBlobs()
+{
+	TArray<FString> blobPaths;
+	IFileManager::Get().FindFilesRecursive(blobPaths, *FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("DSM"), TEXT("Store")),
+		TEXT("*.dsmb"), true, false);
+	return blobPaths.Num();
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDSMSlotStoreReloadTest, "DynamicStateMachine.SlotStoreReload",
+	EAutomationTestFlags::EditorContext |
+	EAutomationTestFlags::ProductFilter)
+	bool FDSMSlotStoreReloadTest::RunTest(const FString& Parameters) {
+
+	const FDSMTestNodes nodes;
+
+	FDSMHistoryStore store;
+	store.Add(nodes._nodeA);
+	store.Add(nodes._nodeB);
+
+	const FString slot = TEXT("DSMSlotStoreReloadTest");
+	const FString reloadedSlot = TEXT("DSMSlotStoreReloadTestReloaded");
+	FDSMSaveFile saveFile = FDSMSaveFile::Capture(store, 2);
+	TestTrue("Slot is written", FDSMSlotStore::Write(slot, saveFile, 2));
+
+	// Recreated data assets get new unique names, which must not change their snapshots
+	FDSMSaveFile loadedFile;
+	TestTrue("Slot is read", FDSMSlotStore::Read(slot, loadedFile));
+	FDSMHistoryStore loaded;
+	loadedFile.Restore(loaded);
+	TestTrue("Recreated data asset is renamed", loaded.FindDataAt("daTest", 0) &&
+		loaded.FindDataAt("daTest", 0)->GetFName() != store.FindDataAt("daTest", 0)->GetFName());
+
+	const int32 blobNum = CountStoreBlobs();
+	FDSMSaveFile reloadedFile = FDSMSaveFile::Capture(loaded, 2);
+	TestTrue("Reloaded history is written", FDSMSlotStore::Write(reloadedSlot, reloadedFile, 2));
+	TestEqual("No new blobs are written", CountStoreBlobs(), blobNum);
+
+	IFileManager::Get().Delete(*FDSMSlotStore::GetManifestPath(slot));
+	IFileManager::Get().Delete(*FDSMSlotStore::GetManifestPath(reloadedSlot));
+	FDSMSlotStore::CollectGarbage();
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDSMMemorySlotTest, "DynamicStateMachine.MemorySlot",
+	EAutomationTestFlags::EditorContext |
+	EAutomationTestFlags::ProductFilter)
+	bool FDSMMemorySlotTest::RunTest(const FString& Parameters) {
+
+	const FDSMTestNodes nodes;
+
+	const FString slotName = TEXT("DSMMemorySlotTest");
+	TObjectPtr<UDSMSaveGame> saveGame = NewObject<UDSMSaveGame>();
+	saveGame->SetStateMachineHistory({ nodes._nodeA, nodes._nodeB, nodes._nodeA });
+	saveGame->SaveStateToMemory(1, slotName);
+	TestTrue("Memory slot exists", UDSMSaveGame::HasMemorySlot(slotName));
+
+	TObjectPtr<UDSMSaveGame> loaded = UDSMSaveGame::LoadSlot(slotName);
+	TestTrue("Memory slot is loaded", loaded != nullptr);
+	if (loaded)
+	{
+		TestEqual("Memory slot history length", loaded->GetHistoryStore().Num(), 2);
+		TestEqual("Memory slot index to load", loaded->_indexToLoad, 1);
+		TestTrue("Data asset versions are shared", loaded->GetHistoryStore().GetData(1)[0]._asset == nodes._second);
+		// Changes of the loaded history do not reach the slot
+		loaded->SetStateMachineHistory({ nodes._nodeA });
+		TObjectPtr<UDSMSaveGame> loadedAgain = UDSMSaveGame::LoadSlot(slotName);
+		TestTrue("Memory slot is loaded as a copy", loadedAgain && loadedAgain != loaded && loadedAgain->GetHistoryStore().Num() == 2);
+	}
+
+	UDSMSaveGame::DeleteMemorySlot(slotName);
+	TestFalse("Memory slot is deleted", UDSMSaveGame::HasMemorySlot(slotName));
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDSMAsyncSaveSlotTest, "DynamicStateMachine.AsyncSaveSlot",
+	EAutomationTestFlags::EditorContext |
+	EAutomationTestFlags::ProductFilter)
+	bool FDSMAsyncSaveSlotTest::RunTest(const FString& Parameters) {
+
+	const FDSMTestNodes nodes;
+
+	const FString slotName = TEXT("DSMAsyncSaveSlotTest");
+	// Save game slots are only written by the history of a DSM game mode
+	TObjectPtr<UDSMSaveGame> saveGame = NewObject<UDSMSaveGame>(GetMutableDefault<ADSMGameMode>());
+	saveGame->_saveFormat = EDSMSaveFormat::SaveGameSlot;
+	saveGame->SetStateMachineHistory({ nodes._nodeA, nodes._nodeB, nodes._nodeA });
+	saveGame->AsyncSaveState(1, slotName);
+	// Save game is serialized before the write is launched, the history can change right away
+	saveGame->SetStateMachineHistory({ nodes._nodeA });
+	FDSMSaveJournal::WaitForPendingWrites();
+	TestTrue("Save game slot is written", UGameplayStatics::DoesSaveGameExist(slotName, 0));
+
+	TObjectPtr<UDSMSaveGame> loaded = UDSMSaveGame::LoadSlot(slotName);
+	TestTrue("Save game slot is loaded", loaded != nullptr);
+	if (loaded)
+	{
+		TestEqual("Saved history length", loaded->GetHistoryStore().Num(), 2);
+		TestEqual("Saved index to load", loaded->_indexToLoad, 1);
+		const UTestDataAsset* loadedData = Cast<UTestDataAsset>(loaded->GetHistoryStore().FindDataAt("daTest", 1));
+		TestTrue("Saved data asset properties", loadedData && loadedData->bFalse);
+	}
+	UDSMSaveGame::DeleteSlot(slotName);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDSMAsyncSaveOrderTest, "DynamicStateMachine.AsyncSaveOrder",
+	EAutomationTestFlags::EditorContext |
+	EAutomationTestFlags::ProductFilter)
+	bool FDSMAsyncSaveOrderTest::RunTest(const FString& Parameters) {
+
+	const FDSMTestNodes nodes;
+
+	const FString slotName = TEXT("DSMAsyncSaveOrderTest");
+	TObjectPtr<UDSMSaveGame> saveGame = NewObject<UDSMSaveGame>(GetMutableDefault<ADSMGameMode>());
+	saveGame->SetStateMachineHistory({ nodes._nodeA, nodes._nodeB, nodes._nodeA });
+	saveGame->_saveFormat = EDSMSaveFormat::SaveGameSlot;
+	saveGame->AsyncSaveState(2, slotName);
+
+	// Overlapping saves of the slot replace each other in the order they were requested
+	saveGame->_saveFormat = EDSMSaveFormat::NativeFile;
+	saveGame->AsyncSaveState(0, slotName);
+	saveGame->AsyncSaveState(1, slotName);
+	FDSMSaveJournal::WaitForPendingWrites();
+	FDSMSaveFile::FSummary summary;
+	TestTrue("Native save file is written", FDSMSaveFile::ReadSummary(FDSMSaveFile::GetFilePath(slotName), summary));
+	TestEqual("Latest save is written last", summary._historyNum, 2);
+	TestFalse("Temporary file is removed", IFileManager::Get().FileExists(*(FDSMSaveFile::GetFilePath(slotName) + TEXT(".tmp"))));
+	TestFalse("Save game slot is removed after the native save file was written", UGameplayStatics::DoesSaveGameExist(slotName, 0));
+
+	saveGame->_saveFormat = EDSMSaveFormat::SaveGameSlot;
+	saveGame->AsyncSaveState(2, slotName);
+	FDSMSaveJournal::WaitForPendingWrites();
+	TestTrue("Save game slot is written", UGameplayStatics::DoesSaveGameExist(slotName, 0));
+	TestFalse("Native save file is removed after the save game slot was written", IFileManager::Get().FileExists(*FDSMSaveFile::GetFilePath(slotName)));
+	UDSMSaveGame::DeleteSlot(slotName);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDSMSlotPrefetchTest, "DynamicStateMachine.SlotPrefetch",
+	EAutomationTestFlags::EditorContext |
+	EAutomationTestFlags::ProductFilter)
+	bool FDSMSlotPrefetchTest::RunTest(const FString& Parameters) {
+
+	const FDSMTestNodes nodes;
+
+	const FString slotName = TEXT("DSMSlotPrefetchTest");
+	TObjectPtr<UDSMSaveGame> saveGame = NewObject<UDSMSaveGame>(GetMutableDefault<ADSMGameMode>());
+	saveGame->_saveFormat = EDSMSaveFormat::JournaledFile;
+	saveGame->SetStateMachineHistory({ nodes._nodeA, nodes._nodeB });
+	saveGame->SaveState(1, slotName);
+	saveGame->PushStateMachineElement(nodes._nodeA);
+	saveGame->SaveState(2, slotName);
+
+	// Prefetched base file is restored from memory, journal records are appended afterwards
+	UDSMSaveGame::PrefetchSlot(slotName);
+	TObjectPtr<UDSMSaveGame> loaded = UDSMSaveGame::LoadSlot(slotName);
+	TestTrue("Prefetched slot is loaded", loaded && loaded->GetStateMachineHistoryNum() == 3 && loaded->_indexToLoad == 2);
+	const UTestDataAsset* loadedData = loaded ? Cast<UTestDataAsset>(loaded->GetHistoryStore().FindDataAt("daTest", 1)) : nullptr;
+	TestTrue("Prefetched data asset properties", loadedData && loadedData->bFalse);
+
+	// Saves between prefetch and load discard the prefetched slot
+	UDSMSaveGame::PrefetchSlot(slotName);
+	saveGame->PushStateMachineElement(nodes._nodeB);
+	saveGame->SaveState(3, slotName);
+	loaded = UDSMSaveGame::LoadSlot(slotName);
+	TestTrue("Slot saved after the prefetch is loaded", loaded && loaded->GetStateMachineHistoryNum() == 4 && loaded->_indexToLoad == 3);
+
+	saveGame->_saveFormat = EDSMSaveFormat::NativeFile;
+	UDSMSaveGame::PrefetchSlot(slotName);
+	saveGame->AsyncSaveState(0, slotName);
+	loaded = UDSMSaveGame::LoadSlot(slotName);
+	TestTrue("Slot saved in another format after the prefetch is loaded", loaded && loaded->GetStateMachineHistoryNum() == 1);
+	UDSMSaveGame::DeleteSlot(slotName);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDSMCarryHistoryTest, "DynamicStateMachine.CarryHistory",
+	EAutomationTestFlags::EditorContext |
+	EAutomationTestFlags::ProductFilter)
+	bool FDSMCarryHistoryTest::RunTest(const FString& Parameters) {
+
+	const FDSMTestNodes nodes;
+
+	TObjectPtr<UDSMSaveGame> previousLevel = NewObject<UDSMSaveGame>();
+	previousLevel->SetStateMachineHistory({ nodes._nodeA, nodes._nodeB });
+	TObjectPtr<UDSMSaveGame> nextLevel = NewObject<UDSMSaveGame>();
+	nextLevel->MoveHistoryFrom(*previousLevel);
+
+	TestEqual("History is moved", nextLevel->GetStateMachineHistoryNum(), 2);
+	TestEqual("Previous history is empty", previousLevel->GetStateMachineHistoryNum(), 0);
+	TestTrue("Data asset versions are moved as they are", nextLevel->GetHistoryStore().FindLatestData("daTest") == nodes._second);
+	TestTrue("Latest data is updated", nextLevel->_data.Contains("daTest") && previousLevel->_data.Num() == 0);
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDSMAutosaveTest, "DynamicStateMachine.Autosave",
+	EAutomationTestFlags::EditorContext |
+	EAutomationTestFlags::ProductFilter)
+	bool FDSMAutosaveTest::RunTest(const FString& Parameters) {
+
+	const FDSMTestNodes nodes;
+
+	const FString slotName = TEXT("DSMAutosaveTest");
+	FDSMHistoryStore store;
+	// Written on the save file pipe, only read after all writes finished
+	TArray<int32> writtenEntries;
+	FDSMSaveJournal journal;
+	journal.Configure(0.f, 0, [&writtenEntries](const FString&, const FDSMSaveFile& written, bool bSuccess, double)
+		{
+			writtenEntries.Add(bSuccess ? written._entries.Num() : INDEX_NONE);
+		});
+	FDSMAutosave autosave;
+	autosave.Start(2, 0.f, 0.f,
+		[&store, &journal, &slotName]()
+		{
+			if (journal.GetCapturedNum(slotName, store) == store.Num())
+			{
+				return false;
+			}
+			journal.Capture(store, store.Num(), slotName, store.Num() - 1, false, NAME_None, 256 * 1024);
+			journal.Flush(false);
+			return true;
+		});
+
+	store.Add(nodes._nodeA);
+	autosave.OnHistoryElementAdded(false);
+	TestEqual("History interval is not reached", autosave.GetCapturedNum(), 0);
+	store.Add(nodes._nodeA);
+	autosave.OnHistoryElementAdded(false);
+	TestEqual("History interval requests an autosave", autosave.GetCapturedNum(), 1);
+	store.Add(nodes._nodeB);
+	autosave.OnHistoryElementAdded(true);
+	TestEqual("Autosave nodes request an autosave", autosave.GetCapturedNum(), 2);
+	autosave.Request();
+	TestEqual("Unchanged history is not captured", autosave.GetCapturedNum(), 2);
+	FDSMSaveJournal::WaitForPendingWrites();
+	TestEqual("Base file and one record are written", writtenEntries.Num(), 2);
+	if (writtenEntries.Num() == 2)
+	{
+		TestEqual("Base file contains the history of the first autosave", writtenEntries[0], 2);
+		TestEqual("Later autosaves only contain new history elements", writtenEntries[1], 1);
+	}
+
+	FDSMSaveFile::FSummary summary;
+	TestTrue("Autosave summary is read", FDSMSaveJournal::ReadSummary(slotName, summary));
+	TestEqual("Latest autosave is summarized", summary._historyNum, 3);
+	TObjectPtr<UDSMSaveGame> loaded = UDSMSaveGame::LoadSlot(slotName);
+	TestTrue("Autosave is loaded", loaded && loaded->GetStateMachineHistoryNum() == 3);
+
+	autosave.Stop();
+	store.Add(nodes._nodeA);
+	autosave.Request();
+	TestEqual("Stopped scheduler does not capture", autosave.GetCapturedNum(), 2);
+	journal.Reset();
+	UDSMSaveGame::DeleteSlot(slotName);
+	return true;
+}
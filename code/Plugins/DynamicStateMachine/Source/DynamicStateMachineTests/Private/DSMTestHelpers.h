@@ -0,0 +1,35 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DSMHistory.h"
+#include "TestDataAsset.h"
+
+// History element of a default node
+inline FDSMNodeID CreateNodeID(FName ownerLabel, FName nodeLabel, TMap<FName, TObjectPtr<UDSMDataAsset>> data)
+{
+	FDSMNodeID nodeID;
+	nodeID._ownerLabel = ownerLabel;
+	nodeID._nodeLabel = nodeLabel;
+	nodeID._nodeClass = UDSMDefaultNode::StaticClass();
+	nodeID._data = data;
+	return nodeID;
+}
+
+// Two nodes of the same owner, NodeB stores a changed version of the data asset stored by NodeA
+struct FDSMTestNodes
+{
+	TObjectPtr<UTestDataAsset> _first = NewObject<UTestDataAsset>();
+	TObjectPtr<UTestDataAsset> _second = NewObject<UTestDataAsset>();
+	FDSMNodeID _nodeA;
+	FDSMNodeID _nodeB;
+
+	FDSMTestNodes()
+	{
+		_second->bTrue = false;
+		_second->bFalse = true;
+		_nodeA = CreateNodeID("Owner", "NodeA", { { "daTest", _first } });
+		_nodeB = CreateNodeID("Owner", "NodeB", { { "daTest", _second } });
+	}
+};
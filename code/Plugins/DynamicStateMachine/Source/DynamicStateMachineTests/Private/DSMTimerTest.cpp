@@ -0,0 +1,71 @@
+#include "Misc/AutomationTest.h"
+#include "Tests/AutomationCommon.h"
+#include "DSMTimer.h"
+
+
+static FDSMTimerRecord CreateTimer(FName nodeLabel, double deadline)
+{
+	FDSMTimerRecord timer;
+	timer._nodeLabel = nodeLabel;
+	timer._ownerLabel = "Owner";
+	timer._deadline = deadline;
+	return timer;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDSMTimerWheelTest, "DynamicStateMachine.TimerWheel",
+	EAutomationTestFlags::EditorContext |
+	EAutomationTestFlags::ProductFilter)
+	bool FDSMTimerWheelTest::RunTest(const FString& Parameters) {
+
+	FDSMTimerWheel wheel(0.25f);
+	const FDSMTimerHandle soon = wheel.Schedule(CreateTimer("Soon", 0.5));
+	const FDSMTimerHandle cleared = wheel.Schedule(CreateTimer("Cleared", 1.0));
+	// Deadlines beyond the first levels are moved down while the wheel advances
+	const FDSMTimerHandle late = wheel.Schedule(CreateTimer("Late", 600.0));
+	TestEqual("Pending timers", wheel.Num(), 3);
+	TestTrue("Timer cleared", wheel.Clear(cleared));
+	TestFalse("Timer cleared once", wheel.Clear(cleared));
+
+	TArray<FDSMTimerRecord> fired;
+	wheel.Advance(0.25, fired);
+	TestEqual("Nothing fired before deadline", fired.Num(), 0);
+	wheel.Advance(0.25, fired);
+	TestEqual("Timer fired at deadline", fired.Num(), 1);
+	TestEqual("Fired timer", fired[0]._nodeLabel, FName("Soon"));
+	TestTrue("Handle invalid after firing", wheel.Find(soon) == nullptr);
+
+	// Stored timers keep their handles
+	TObjectPtr<UDSMTimerData> timerData = NewObject<UDSMTimerData>();
+	wheel.Export(*timerData);
+	TestEqual("Exported timers", timerData->_timers.Num(), 1);
+	FDSMTimerWheel restored(0.25f);
+	restored.Restore(*timerData);
+	TestEqual("Time restored", restored.GetTime(), wheel.GetTime());
+	TestTrue("Handle valid after restore", restored.Find(late) != nullptr);
+
+	fired.Reset();
+	for (int32 i = 0; i < 2397; ++i)
+	{
+		restored.Advance(0.25, fired);
+	}
+	TestEqual("Late timer pending before deadline", fired.Num(), 0);
+	restored.Advance(0.25, fired);
+	TestEqual("Late timer fired at deadline", fired.Num(), 1);
+	TestEqual("No timer pending", restored.Num(), 0);
+
+	// Timers of a node are cleared when its state ends
+	FDSMTimerRecord selfTransition = CreateTimer("Ended", 701.0);
+	selfTransition._action = EDSMTimerAction::SelfTransition;
+	const FDSMTimerHandle endState = restored.Schedule(CreateTimer("Ended", 701.0));
+	const FDSMTimerHandle kept = restored.Schedule(selfTransition);
+	const FDSMTimerHandle other = restored.Schedule(CreateTimer("Other", 701.0));
+	TestEqual("Matching timers cleared", restored.ClearIf([](const FDSMTimerRecord& timer)
+		{
+			return timer._nodeLabel == "Ended" && timer._action == EDSMTimerAction::EndState;
+		}), 1);
+	TestTrue("End state timer cleared", restored.Find(endState) == nullptr);
+	TestTrue("Other timers pending", restored.Find(kept) != nullptr && restored.Find(other) != nullptr);
+	TestEqual("Pending timers after clear", restored.Num(), 2);
+	TestFalse("Serials are not reused", restored.Schedule(CreateTimer("Next", 700.0)) == late);
+	return true;
+}
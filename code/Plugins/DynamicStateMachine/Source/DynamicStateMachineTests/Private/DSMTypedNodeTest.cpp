@@ -0,0 +1,36 @@
+#include "Misc/AutomationTest.h"
+#include "Tests/AutomationCommon.h"
+#include "DSMTypedNode.h"
+#include "TestDataAsset.h"
+
+
+using FTestTypedNode = TDSMNode<TWritable<UTestDataAsset, "daTest">, TReadOnly<UTestDataAsset, "daRead">>;
+
+static_assert(FTestTypedNode::IndexOf<"daTest">() == 0, "Slots are indexed in declaration order");
+static_assert(FTestTypedNode::IndexOf<"daRead">() == 1, "Slots are indexed in declaration order");
+static_assert(FTestTypedNode::IndexOf<"missing">() == INDEX_NONE, "Undeclared slots have no index");
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDSMTypedNodeTest, "DynamicStateMachine.TypedNode",
+	EAutomationTestFlags::EditorContext |
+	EAutomationTestFlags::ProductFilter)
+	bool FDSMTypedNodeTest::RunTest(const FString& Parameters) {
+
+	TObjectPtr<UDSMDefaultNode> node = NewObject<UDSMDefaultNode>();
+	node->_writableDataReferences = { { "daTest", NewObject<UTestDataAsset>() }, { "daBase", NewObject<UDSMDataAsset>() } };
+	node->_readOnlyDataReferences = { { "daRead", NewObject<UTestDataAsset>() } };
+
+	FTestTypedNode typedNode;
+	TestTrue("Slots match data references", typedNode.Bind(node));
+	TestTrue("Typed node is bound", typedNode.IsBound());
+
+	AddExpectedError(TEXT("Typed data slot"), EAutomationExpectedErrorFlags::Contains, 2);
+	AddExpectedError(TEXT("is not of type"), EAutomationExpectedErrorFlags::Contains, 1);
+	TDSMNode<TReadOnly<UTestDataAsset, "daTest">> wrongReferences;
+	TestFalse("Writable reference bound as read only", wrongReferences.Bind(node));
+	TDSMNode<TWritable<UTestDataAsset, "missing">> missingReference;
+	TestFalse("Missing reference", missingReference.Bind(node));
+	TDSMNode<TWritable<UTestDataAsset, "daBase">> wrongType;
+	TestFalse("Reference of another type", wrongType.Bind(node));
+	TestTrue("Unbound slots return nullptr", wrongType.Get<"daBase">() == nullptr);
+	return true;
+}
@@ -0,0 +1,20 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TestNode.h"
+#include "Engine/World.h"
+#include "HAL/PlatformProcess.h"
+
+
+void UTestNode::ApplyStateBegin()
+{
+	++_appliedNum;
+	if (_applySeconds > 0.f)
+	{
+		FPlatformProcess::Sleep(_applySeconds);
+	}
+	if (_bSpawnActor)
+	{
+		_spawnedActor = GetWorld()->SpawnActor<AActor>();
+	}
+}
@@ -0,0 +1,82 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DSMDefaultNode.h"
+#include "TestNode.generated.h"
+
+/**
+ * Node of the game mode tests, counts its events
+ */
+UCLASS()
+class DYNAMICSTATEMACHINETESTS_API UTestNode : public UDSMDefaultNode
+{
+	GENERATED_BODY()
+	
+public:
+	// Node can only be entered while set
+	bool _bCanEnter = false;
+
+	// State ends right after it began, otherwise the node stays active
+	bool _bEndState = true;
+
+	// Spawns an actor when the state begin is applied
+	bool _bSpawnActor = false;
+
+	// Blocks the game thread while the state begin is applied, e.g. to use up the replay budget
+	float _applySeconds = 0.f;
+
+	int32 _beginNum = 0;
+	int32 _appliedNum = 0;
+
+	// Last actor spawned by this node
+	UPROPERTY()
+	TObjectPtr<AActor> _spawnedActor = nullptr;
+
+	// Requests a self transition of this node
+	bool RequestTransition() { return RequestDSMSelfTransition(); }
+
+	void InitNode() override { ++_beginNum; }
+	void CanEnterState(bool bIsSelfTransitioned, TMap<FName, bool>& CanEnter) const override { CanEnter.Add("CanEnter", _bCanEnter); }
+	void OnBeginState(bool& HasStateEnded) const override { HasStateEnded = _bEndState; }
+	void ApplyStateBegin() override;
+};
+
+/**
+ * Test node, which is applied only once on fast load
+ */
+UCLASS()
+class DYNAMICSTATEMACHINETESTS_API UTestIdempotentNode : public UTestNode
+{
+	GENERATED_BODY()
+
+public:
+	UTestIdempotentNode() { _bIdempotentApply = true; }
+};
+
+/**
+ * Records the finished replays of a game mode
+ */
+UCLASS()
+class DYNAMICSTATEMACHINETESTS_API UTestReplayListener : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	// Node, whose begun states are recorded when the replay finished
+	UPROPERTY()
+	TObjectPtr<UTestNode> _node = nullptr;
+
+	int32 _finishedNum = 0;
+	bool _bSuccess = false;
+	int32 _beginNumOnFinish = INDEX_NONE;
+
+	UFUNCTION()
+	void OnReplayFinished(bool bSuccess)
+	{
+		++_finishedNum;
+		_bSuccess = bSuccess;
+		_beginNumOnFinish = _node ? _node->_beginNum : INDEX_NONE;
+	}
+};